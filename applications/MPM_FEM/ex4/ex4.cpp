@@ -54,6 +54,8 @@ bool SetBoundaryCondition(const std::vector < double >& x, const char name[], do
 int main(int argc, char** args)
 {
 
+  transferThreads = (argc >= 2) ? atoi(args[1]) : 1;
+
   // init Petsc-MPI communicator
   FemusInit mpinit(argc, args, MPI_COMM_WORLD);
 
@@ -254,6 +256,12 @@ int main(int argc, char** args)
   PrintLine(DEFAULT_OUTPUTDIR, line0, false, 0);
   linea->GetParticlesToGridMaterial();
 
+  // markers and transfer of the particle grid operators, used by AssembleMPMSys and GridToParticlesProjection
+  MarkerSet markerSet(dim, true);
+  ParticleGridTransfer transfer(mlMsh.GetLevel(numberOfUniformLevels - 1), solType, transferThreads);
+  ml_prob.parameters.set < MarkerSet* > ("MarkerSet") = &markerSet;
+  ml_prob.parameters.set < ParticleGridTransfer* > ("ParticleGridTransfer") = &transfer;
+
   //END init particles
 
   // ******* Print solution *******
@@ -289,12 +297,15 @@ int main(int argc, char** args)
     
     system.CopySolutionToOldSolution();
 
+    linea->GetOwnedMarkers(markerSet);
+    transfer.Setup(markerSet);
+
     system.MGsolve();
 
     // ******* Print solution *******
     mlSol.GetWriter()->Write(DEFAULT_OUTPUTDIR, "biquadratic", print_vars, time_step);
 
-    GridToParticlesProjection(ml_prob, *linea);
+    GridToParticlesProjection(ml_prob, *linea, markerSet, transfer);
 
 
 
@@ -1,10 +1,14 @@
 
+#include "ParticleGridTransfer.hpp"
+#include "MarkerSet.hpp"
+
 using namespace femus;
 
 double beta = 0.25;
 double Gamma = 0.5;
 double gravity[3] = {0., -9.81, 0.};
 Line* linea;
+unsigned transferThreads = 1; // threads of the particle grid transfers, the first argument of the examples
 
 void AssembleMPMSys(MultiLevelProblem& ml_prob) {
 
@@ -122,11 +126,12 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
 
   if(assembleMatrix) myKK->zero();
 
-  //line instances
-  std::vector<unsigned> markerOffset = linea->GetMarkerOffset();
-  unsigned markerOffset1 = markerOffset[iproc];
-  unsigned markerOffset2 = markerOffset[iproc + 1];
-  std::vector<Marker*> particles = linea->GetParticles();
+  // particle grid transfer owned by main, set up on the markers of linea before the solve
+  MarkerSet &markerSet = *ml_prob.parameters.get < MarkerSet* > ("MarkerSet");
+  ParticleGridTransfer &transfer = *ml_prob.parameters.get < ParticleGridTransfer* > ("ParticleGridTransfer");
+
+  // the markers in the owned elements are the first positions of markerSet, bucketed by element
+  unsigned nMarkers = transfer.GetNumberOfMarkers();
   //std::map<unsigned, std::vector < std::vector < std::vector < std::vector < double > > > > > aX;
 
   //BEGIN loop on elements (to initialize the "soft" stiffness matrix)
@@ -358,14 +363,29 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
   //END building "soft" stiffness matrix
 
 
+  //BEGIN particles to grid transfer of the explicit part of the particle residual
+  // mass * phi_i * (gravity + 1 / (beta dt) * VpOld + (1 - 2 beta) / (2 beta) * ApOld), with the sign of Rhs
+  std::vector < std::vector < double > > explicitForce(dim, std::vector < double > (nMarkers));
+  std::vector < const double* > particleForce(dim);
+  for(unsigned k = 0; k < dim; k++) {
+    const double *SolVpOld = markerSet.GetMPMQuantity(dim + k);
+    const double *SolApOld = markerSet.GetMPMQuantity(2 * dim + k);
+    for(unsigned p = 0; p < nMarkers; p++) {
+      explicitForce[k][p] = -(gravity[k] + 1. / (beta * dt) * SolVpOld[p] + (1. - 2.* beta) / (2. * beta) * SolApOld[p]);
+    }
+    particleForce[k] = (nMarkers > 0) ? &explicitForce[k][0] : NULL;
+  }
+  transfer.ParticlesToGrid(particleForce, markerSet.GetMPMQuantity(3 * dim), *myLinEqSolver, indexSolD, indexPdeD, myRES);
+  //END
+
   //initialization of iel
   unsigned ielOld = UINT_MAX;
 
   //BEGIN loop on particles (used as Gauss points)
-  for(unsigned iMarker = markerOffset1; iMarker < markerOffset2; iMarker++) {
+  for(unsigned iMarker = 0; iMarker < nMarkers; iMarker++) {
 
     //element of particle iMarker
-    unsigned iel = particles[iMarker]->GetMarkerElement();
+    unsigned iel = markerSet.GetMarkerElement(iMarker);
     if(iel != UINT_MAX) {
       short unsigned ielt;
       unsigned nDofsD;
@@ -433,7 +453,10 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
       //particles[iMarker]->FindLocalCoordinates(solType, aX[iel], elementUpdate, mysolution, 0);
 
       // the local coordinates of the particles are the Gauss points in this context
-      std::vector <double> xi = particles[iMarker]->GetMarkerLocalCoordinates();
+      std::vector <double> xi(dim);
+      for(unsigned k = 0; k < dim; k++) {
+        xi[k] = markerSet.GetLocalCoordinates(k)[iMarker];
+      }
 
 //       if(iMarker < 3){
 // 	std::cout << iel <<" "<< iMarker << " " << xi[0] << " " << xi[1] <<std::endl;
@@ -474,18 +497,15 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
       }
       //END evaluates SolDp at the particle iMarker
 
-      std::vector <double> SolVpOld(dim);
-      particles[iMarker]->GetMarkerVelocity(SolVpOld);
-
-
-      std::vector <double> SolApOld(dim);
-      particles[iMarker]->GetMarkerAcceleration(SolApOld);
-
-      double mass = particles[iMarker]->GetMarkerMass();
+      double mass = markerSet.GetMPMQuantity(3 * dim)[iMarker];
 
       //BEGIN computation of the Cauchy Stress
-      std::vector < std::vector < double > > FpOld;
-      FpOld = particles[iMarker]->GetDeformationGradient(); //extraction of the deformation gradient
+      std::vector < std::vector < double > > FpOld(dim, std::vector < double > (dim));
+      for(unsigned i = 0; i < dim; i++) {
+        for(unsigned j = 0; j < dim; j++) {
+          FpOld[i][j] = markerSet.GetDeformationGradient(i, j)[iMarker]; //extraction of the deformation gradient
+        }
+      }
 
       adept::adouble FpNew[3][3] = {{1., 0., 0.}, {0., 1., 0.}, {0., 0., 1.}};
       adept::adouble F[3][3] = {{0., 0., 0.}, {0., 0., 0.}, {0., 0., 0.}};
@@ -540,7 +560,7 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
       }
       //END computation of the Cauchy Stress
 
-      //BEGIN redidual Solid Momentum in moving domain
+      //BEGIN redidual Solid Momentum in moving domain, the explicit part is added by the particles to grid transfer
       for(unsigned i = 0; i < nDofsD; i++) {
         adept::adouble CauchyDIR[3] = {0., 0., 0.};
 
@@ -551,16 +571,16 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
         }
 
         for(int idim = 0; idim < dim; idim++) {
-          aRhs[indexPdeD[idim]][i] += (phi[i] * gravity[idim] - J_hat * CauchyDIR[idim] / density_MPM /*+ phi[i] * 1. / (boundaryLayer * 3. * density_MPM) * traction[idim]*/ //                                  
+          aRhs[indexPdeD[idim]][i] += (- J_hat * CauchyDIR[idim] / density_MPM /*+ phi[i] * 1. / (boundaryLayer * 3. * density_MPM) * traction[idim]*/ //                                  
 //                                        -  phi[i] * (1. / (beta * dt * dt) * (SolDp[idim]-SolDpOld[idim]) - 1. / (beta * dt) * SolVpOld[idim] - (1. - 2.* beta) / (2. * beta) * SolApOld[idim])
-					-  phi[i] * (1. / (beta * dt * dt) * SolDp[idim] - 1. / (beta * dt) * SolVpOld[idim] - (1. - 2.* beta) / (2. * beta) * SolApOld[idim])
+					-  phi[i] * 1. / (beta * dt * dt) * SolDp[idim]
 	  ) * mass;
         }
       }
       //END redidual Solid Momentum in moving domain
 
 
-      if(iMarker == markerOffset2 - 1 || iel != particles[iMarker + 1]->GetMarkerElement()) {
+      if(iMarker == nMarkers - 1 || iel != markerSet.GetMarkerElement(iMarker + 1)) {
 
         //copy adouble aRhs into double Rhs
         for(unsigned i = 0; i < dim; i++) {
@@ -616,7 +636,7 @@ void AssembleMPMSys(MultiLevelProblem& ml_prob) {
 }
 
 
-void GridToParticlesProjection(MultiLevelProblem & ml_prob, Line & linea) {
+void GridToParticlesProjection(MultiLevelProblem & ml_prob, Line & linea, MarkerSet & markerSet, ParticleGridTransfer & transfer) {
 
   // ml_prob is the global object from/to where get/set all the data
   // level is the level of the PDE system to be assembled
@@ -644,23 +664,6 @@ void GridToParticlesProjection(MultiLevelProblem & ml_prob, Line & linea) {
   // data
   unsigned iproc  = mymsh->processor_id();
 
-  // local objects
-  vector< vector < double > > SolDd(dim);
-  vector< vector < double > > SolDdOld(dim);
-  vector< vector < double > > GradSolDp(dim);
-
-  for(int i = 0; i < dim; i++) {
-    GradSolDp[i].resize(dim);
-  }
-
-  vector < double > phi_hat;
-  vector < double > gradphi_hat;
-  vector < double > nablaphi_hat;
-
-  vector <vector < double> > vx_hat(dim); //vx is coordX in assembly of ex30
-
-  double weight;
-
   //variable-name handling
   const char varname[9][3] = {"DX", "DY", "DZ", "VX", "VY", "VW", "AX", "AY", "AW"};
   vector <unsigned> indexSolD(dim);
@@ -676,140 +679,74 @@ void GridToParticlesProjection(MultiLevelProblem & ml_prob, Line & linea) {
     }
   }
 
-  //line instances
-  std::vector<unsigned> markerOffset = linea.GetMarkerOffset();
-  unsigned markerOffset1 = markerOffset[iproc];
-  unsigned markerOffset2 = markerOffset[iproc + 1];
-  std::vector<Marker*> particles = linea.GetParticles();
-  //std::map<unsigned, std::vector < std::vector < std::vector < std::vector < double > > > > > aX;
-
-  //initialization of iel
-  unsigned ielOld = UINT_MAX;
-  //declaration of element instances
-
-  //BEGIN loop on particles
-  for(unsigned iMarker = markerOffset1; iMarker < markerOffset2; iMarker++) {
-
-    //element of particle iMarker
-    unsigned iel = particles[iMarker]->GetMarkerElement();
-
-
-    if(iel != UINT_MAX) {
-
-      short unsigned ielt;
-      unsigned nve;
-
-      //update element related quantities only if we are in a different element
-      if(iel != ielOld) {
-
-        ielt = mymsh->GetElementType(iel);
-        nve = mymsh->GetElementDofNumber(iel, solType);
-
-        for(int i = 0; i < dim; i++) {
-          SolDd[i].resize(nve);
-	  SolDdOld[i].resize(nve);
-          vx_hat[i].resize(nve);
-        }
-
-        //BEGIN copy of the value of Sol at the dofs idof of the element iel
-        for(unsigned inode = 0; inode < nve; inode++) {
-          unsigned idof = mymsh->GetSolutionDof(inode, iel, solType); //local 2 global solution
-          unsigned idofX = mymsh->GetSolutionDof(inode, iel, 2); //local 2 global solution
-
-          for(int i = 0; i < dim; i++) {
-	    SolDdOld[i][inode] = (*mysolution->_SolOld[indexSolD[i]])(idof);
-            SolDd[i][inode] = (*mysolution->_Sol[indexSolD[i]])(idof) - SolDdOld[i][inode];
-	    
-            //moving domain
-            vx_hat[i][inode] = (*mymsh->_topology->_Sol[i])(idofX) + SolDdOld[i][inode];
-          }
-        }
-        //END
-      }
-      std::vector <double> xi = particles[iMarker]->GetMarkerLocalCoordinates();
-      
-      //bool elementUpdate = (aX.find(iel) != aX.end()) ? false : true;  //TODO to be removed after we include FindLocalCoordinates in the advection
-      //particles[iMarker]->FindLocalCoordinates(solType, aX[iel], elementUpdate, mysolution, 0);
-      // xi = particles[iMarker]->GetMarkerLocalCoordinates();
-
-      mymsh->_finiteElement[ielt][solType]->Jacobian(vx_hat, xi, weight, phi_hat, gradphi_hat, nablaphi_hat); //function to evaluate at the particles
-
-      std::vector <double> particleDisp(dim, 0.);
-      //std::vector <double> particleDispNew(dim, 0.);
-      //update displacement and acceleration
-      for(int i = 0; i < dim; i++) {
-        for(unsigned inode = 0; inode < nve; inode++) {
-	  //std::cout << SolDd[i][inode] << " ";
-          particleDisp[i] += phi_hat[inode] * SolDd[i][inode];
-	  //particleDispNew[i] += phi_hat[inode] * SolDd[i][inode];
-	  //std::cout<<std::endl;
-        }
-        //std::cout << particleDisp[i] <<std::endl;
-      }
-      
-
-      particles[iMarker]->SetMarkerDisplacement(particleDisp);
-      particles[iMarker]->UpdateParticleCoordinates();
-
+  //BEGIN grid to particles transfer, on the markers in the owned elements
+  // markerSet and transfer are owned by main and set up on the markers of linea before the solve, as for AssembleMPMSys
+  unsigned nMarkers = transfer.GetNumberOfMarkers();
 
-      std::vector <double> particleVelOld(dim);
-      particles[iMarker]->GetMarkerVelocity(particleVelOld);
+  std::vector < NumericVector* > solD(dim);
+  std::vector < NumericVector* > solDOld(dim);
+  for(unsigned i = 0; i < dim; i++) {
+    solD[i] = mysolution->_Sol[indexSolD[i]];
+    solDOld[i] = mysolution->_SolOld[indexSolD[i]];
+  }
 
-      std::vector <double> particleAccOld(dim);
-      particles[iMarker]->GetMarkerAcceleration(particleAccOld);
+  // the particle displacement is the increment D - DOld, the gradients are in the moving frame X + DOld
+  std::vector < std::vector < double > > dispOld(dim, std::vector < double > (nMarkers));
+  std::vector < std::vector < double > > gradD(dim * dim, std::vector < double > (nMarkers));
+  std::vector < std::vector < double > > gradDOld(dim * dim, std::vector < double > (nMarkers));
+  std::vector < double* > particleDisp(dim), particleDispOld(dim), particleGradD(dim * dim), particleGradDOld(dim * dim);
+  for(unsigned i = 0; i < dim; i++) {
+    particleDisp[i] = markerSet.GetMPMQuantity(i);
+    particleDispOld[i] = (nMarkers > 0) ? &dispOld[i][0] : NULL;
+  }
+  for(unsigned i = 0; i < dim * dim; i++) {
+    particleGradD[i] = (nMarkers > 0) ? &gradD[i][0] : NULL;
+    particleGradDOld[i] = (nMarkers > 0) ? &gradDOld[i][0] : NULL;
+  }
 
-      std::vector <double> particleAcc(dim);
-      std::vector <double> particleVel(dim);
-      for(unsigned i = 0; i < dim; i++) {
-        particleAcc[i] = 1. / (beta * dt * dt) * particleDisp[i] - 1. / (beta * dt) * particleVelOld[i] - (1. - 2.* beta) / (2. * beta) * particleAccOld[i];
-        //particleVel[i] = 2. / dt * particleDisp[i] - particleVelOld[i];
-        particleVel[i] = particleVelOld[i] + dt * ((1. - Gamma) * particleAccOld[i] + Gamma * particleAcc[i]);
-      }
+  transfer.GridToParticles(solD, particleDisp);
+  transfer.GridToParticles(solDOld, particleDispOld);
+  transfer.GridToParticlesGradient(solD, solDOld, particleGradD);
+  transfer.GridToParticlesGradient(solDOld, solDOld, particleGradDOld);
 
-      particles[iMarker]->SetMarkerVelocity(particleVel);
-      particles[iMarker]->SetMarkerAcceleration(particleAcc);
+  for(unsigned p = 0; p < nMarkers; p++) {
 
-      //   update the deformation gradient
-      for(int i = 0; i < dim; i++) {
-        for(int j = 0; j < dim; j++) {
-          GradSolDp[i][j] = 0.;
-          for(unsigned inode = 0; inode < nve; inode++) {
-            GradSolDp[i][j] +=  gradphi_hat[inode * dim + j] * SolDd[i][inode];
-          }
-        }
-      }
+    //update displacement, coordinates, velocity and acceleration
+    for(unsigned i = 0; i < dim; i++) {
+      double &disp = markerSet.GetMPMQuantity(i)[p];
+      double &vel = markerSet.GetMPMQuantity(dim + i)[p];
+      double &acc = markerSet.GetMPMQuantity(2 * dim + i)[p];
 
-      std::vector < std::vector < double > > FpOld;
-      FpOld = particles[iMarker]->GetDeformationGradient(); //extraction of the deformation gradient
+      disp -= dispOld[i][p];
+      markerSet.GetCoordinates(i)[p] += disp;
 
-      double FpNew[3][3] = {{1., 0., 0.}, {0., 1., 0.}, {0., 0., 1.}};
-      std::vector < std::vector < double > > Fp(dim);
+      double accNew = 1. / (beta * dt * dt) * disp - 1. / (beta * dt) * vel - (1. - 2.* beta) / (2. * beta) * acc;
+      vel += dt * ((1. - Gamma) * acc + Gamma * accNew);
+      acc = accNew;
+    }
 
-      for(unsigned i = 0; i < dim; i++) {
-        for(unsigned j = 0; j < dim; j++) {
-          FpNew[i][j] += GradSolDp[i][j];
-        }
+    //update the deformation gradient, Fp = (I + grad(D - DOld)) FpOld
+    double FpNew[3][3] = {{1., 0., 0.}, {0., 1., 0.}, {0., 0., 1.}};
+    double FpOld[3][3];
+    for(unsigned i = 0; i < dim; i++) {
+      for(unsigned j = 0; j < dim; j++) {
+        FpNew[i][j] += gradD[i * dim + j][p] - gradDOld[i * dim + j][p];
+        FpOld[i][j] = markerSet.GetDeformationGradient(i, j)[p];
       }
-
-      for(unsigned i = 0; i < dim; i++) {
-        Fp[i].resize(dim);
-        for(unsigned j = 0; j < dim; j++) {
-          Fp[i][j] = 0.;
-          for(unsigned k = 0; k < dim; k++) {
-            Fp[i][j] += FpNew[i][k] * FpOld[k][j];
-          }
+    }
+    for(unsigned i = 0; i < dim; i++) {
+      for(unsigned j = 0; j < dim; j++) {
+        double Fp = 0.;
+        for(unsigned k = 0; k < dim; k++) {
+          Fp += FpNew[i][k] * FpOld[k][j];
         }
+        markerSet.GetDeformationGradient(i, j)[p] = Fp;
       }
-
-      particles[iMarker]->SetDeformationGradient(Fp);
-
-      ielOld = iel;
-    }
-    else {
-      break;
     }
   }
-  //END loop on particles
+
+  linea.SetOwnedMarkers(markerSet);
+  //END grid to particles transfer
 
 
   //BEGIN loop on elements to update grid velocity and acceleration
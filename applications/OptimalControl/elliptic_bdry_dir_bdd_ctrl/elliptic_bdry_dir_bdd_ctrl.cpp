@@ -1108,7 +1108,7 @@ std::cout <<  " qp_" << d << " " << coord_at_qp_bdry[d];
   std::vector<int>    positions(global_ctrl_size);
 
   for (unsigned i = 0; i < positions.size(); i++) {
-    positions[i] = pdeSys->KKoffset[ctrl_index][iproc] + i;
+    positions[i] = pdeSys->GetKKDof(ctrl_index, iproc, i);
     one_times_mu[i] = ineq_flag * 1. * (*sol->_Sol[solIndex_mu])(i/*position_mu_i*/) ;
   }
     RES->add_vector_blocked(one_times_mu, positions);
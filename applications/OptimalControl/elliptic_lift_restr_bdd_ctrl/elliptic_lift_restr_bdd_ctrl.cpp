@@ -844,7 +844,7 @@ void AssembleLiftRestrProblem(MultiLevelProblem& ml_prob) {
   std::vector<int>    positions(global_ctrl_size);
 //  double position_mu_i;
   for (unsigned i = 0; i < positions.size(); i++) {
-    positions[i] = pdeSys->KKoffset[ctrl_index][iproc] + i;
+    positions[i] = pdeSys->GetKKDof(ctrl_index, iproc, i);
 //     position_mu_i = pdeSys->KKoffset[mu_index][iproc] + i;
 //     std::cout << position_mu_i << std::endl;
     one_times_mu[i] = ineq_flag * 1. * (*sol->_Sol[solIndex_mu])(i/*position_mu_i*/) ;
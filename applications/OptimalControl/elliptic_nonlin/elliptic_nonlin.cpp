@@ -673,7 +673,7 @@ void AssembleProblem(MultiLevelProblem& ml_prob) {
   std::vector<int>        positions(global_ctrl_size);
 //  double position_mu_i;
   for (unsigned i = 0; i < positions.size(); i++) {
-    positions[i] = pdeSys->KKoffset[pos_ctrl][iproc] + i;
+    positions[i] = pdeSys->GetKKDof(pos_ctrl, iproc, i);
 //     position_mu_i = pdeSys->KKoffset[pos_mu][iproc] + i;
 //     std::cout << position_mu_i << std::endl;
     one_times_mu[i] =  m_b_f[pos_ctrl][pos_mu] * ineq_flag * 1. * (*sol->_Sol[SolIndex[pos_mu]])(i/*position_mu_i*/) ;
@@ -654,7 +654,7 @@ void AssembleNavierStokesOpt(MultiLevelProblem& ml_prob){
   
    //STATE###################################################################  
     unsigned int fake_iel_flag = 0;
-    unsigned int global_row_index_bdry_constr = pdeSys->KKoffset[SolPdeIndex[theta_index]][iproc];
+    unsigned int global_row_index_bdry_constr = pdeSys->GetKKDof(SolPdeIndex[theta_index], iproc, 0);
   for (unsigned  k = 0; k < n_unknowns; k++) {
 	unsigned ndofs_unk = msh->GetElementDofNumber(iel, SolFEType[k]);	//nDofs_V,P_of_st,adj,ctrl
 	Sol_n_el_dofs[k]=ndofs_unk;
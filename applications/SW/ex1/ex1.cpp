@@ -493,7 +493,7 @@ void ETD(MultiLevelProblem& ml_prob, const unsigned& NLayers)
   FNDestroy(&f3);
   FNDestroy(&f4);
 
-  sol->UpdateSol(mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset);
+  sol->UpdateSol(mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset, pdeSys->GetBlockSize());
 
 
 
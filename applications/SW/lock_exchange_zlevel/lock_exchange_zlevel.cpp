@@ -881,7 +881,7 @@ void ETD ( MultiLevelProblem& ml_prob ) {
 //   FNDestroy(&f4);
 
 
-  sol->UpdateSol ( mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset );
+  sol->UpdateSol ( mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset, pdeSys->GetBlockSize() );
 
   unsigned solIndexeta = mlSol->GetIndex ( "eta" );
   unsigned solIndexb = mlSol->GetIndex ( "b" );
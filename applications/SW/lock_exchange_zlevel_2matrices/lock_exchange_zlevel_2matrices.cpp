@@ -834,7 +834,7 @@ void ETD ( MultiLevelProblem& ml_prob ) {
 //   FNDestroy(&f4);
 
 
-  sol->UpdateSol ( mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset );
+  sol->UpdateSol ( mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset, pdeSys->GetBlockSize() );
 
   unsigned solIndexeta = mlSol->GetIndex ( "eta" );
   unsigned solIndexb = mlSol->GetIndex ( "b" );
@@ -1198,7 +1198,7 @@ void ETD2 ( MultiLevelProblem& ml_prob ) {
   MFNSolve ( mfn, v, y );
   MFNDestroy ( &mfn );
 
-  sol->UpdateSol ( mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset );
+  sol->UpdateSol ( mlPdeSys->GetSolPdeIndex(), EPS, pdeSys->KKoffset, pdeSys->GetBlockSize() );
 
   unsigned solIndexeta = mlSol->GetIndex ( "eta" );
   unsigned solIndexb = mlSol->GetIndex ( "b" );
@@ -11,6 +11,7 @@
 #include "petsc.h"
 #include "petscmat.h"
 #include "PetscMatrix.hpp"
+#include "CovarianceOperator.hpp"
 
 #include "slepceps.h"
 
@@ -27,8 +28,12 @@ bool SetBoundaryCondition(const std::vector < double >& x, const char SolName[],
 
 void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::vector < std::pair<double, double> >& eigenvalues);
 
+double GetCovariance(const double *x, const double *y, const unsigned &dim);
+
 void GetQuantityOfInterest(MultiLevelProblem& ml_prob, std::vector < double >&  QoI, const unsigned& m, const double& domainMeasure);
 
+void GetSampleQuantityOfInterest(MultiLevelProblem& ml_prob, const int& sample);
+
 void GetStochasticData(std::vector <double>& QoI);
 
 void PlotStochasticData();
@@ -45,6 +50,7 @@ double meanQoI = 0.; //initialization
 double varianceQoI = 0.; //initialization
 double stdDeviationQoI = 0.; //initialization
 unsigned M = 10000; //number of samples for the Monte Carlo
+std::vector <double> QoI(M, 0.);
 //END
 
 unsigned numberOfUniformLevels = 4;
@@ -162,18 +168,19 @@ int main(int argc, char** argv) {
 
 
 
-  std::vector <double> QoI(M, 0.);
-
-
-  for(unsigned m = 0; m < M; m++) {
-    
-    std::cout<< " --------------------------------------------------- m = " << m << " ---------------------------------------------------  " << std::endl;
+  // the samples can be split between independent runs with -ensemble_group g -ensemble_groups n
+  PetscInt ensembleGroup = 0, ensembleGroups = 1;
+  PetscOptionsGetInt(NULL, NULL, "-ensemble_group", &ensembleGroup, NULL);
+  PetscOptionsGetInt(NULL, NULL, "-ensemble_groups", &ensembleGroups, NULL);
+  system.SetEnsembleGroup(ensembleGroup, ensembleGroups);
 
-    system.MGsolve();
+  // the coefficient changes with the sample, the coarse levels are built on the mean field
+  system.EnsembleSolve(M, SetSample, GetSampleQuantityOfInterest, ENSEMBLE_MEAN_FIELD_PRECONDITIONER);
 
-    GetQuantityOfInterest(ml_prob, QoI, m, domainMeasure);
-
-  }
+  unsigned firstSample = (M * ensembleGroup) / ensembleGroups;
+  unsigned lastSample = (M * (ensembleGroup + 1)) / ensembleGroups;
+  QoI = std::vector <double> (QoI.begin() + firstSample, QoI.begin() + lastSample);
+  M = lastSample - firstSample;
 
   for(unsigned m = 0; m < M; m++) {
     std::cout << "QoI[" << m << "] = " << QoI[m] << std::endl;
@@ -197,6 +204,14 @@ int main(int argc, char** argv) {
 
 } //end main
 
+double GetCovariance(const double *x, const double *y, const unsigned &dim) {
+  double dist = 0.;
+  for(unsigned k = 0; k < dim; k++) {
+    dist += fabs(x[k] - y[k]);
+  }
+  return stdDeviationInput * stdDeviationInput * exp(- dist / L);
+}
+
 void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::vector < std::pair<double, double> >& eigenvalues) {
 //void GetEigenPair(MultiLevelProblem & ml_prob, Mat &CCSLEPc, Mat &MMSLEPc) {
 
@@ -204,8 +219,6 @@ void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::
 
   unsigned level = numberOfUniformLevels - 1;
 
-  double varianceInput = stdDeviationInput * stdDeviationInput;
-
   Mesh*                    msh = ml_prob._ml_msh->GetLevel(level);    // pointer to the mesh (level) object
   elem*                     el = msh->el;  // pointer to the elem object in msh (level)
 
@@ -233,177 +246,77 @@ void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::
   unsigned xType = 2; // get the finite element type for "x", it is always 2 (LAGRANGE QUADRATIC)
 
   vector < vector < double > > x1(dim);    // local coordinates
-  vector < vector < double > > x2(dim);    // local coordinates
   for(unsigned k = 0; k < dim; k++) {
     x1[k].reserve(maxSize);
-    x2[k].reserve(maxSize);
   }
 
   vector <double> phi_x; // local test function first order partial derivatives
-  
   phi_x.reserve(maxSize * dim);
 
   vector< int > l2GMap1; // local to global mapping
-  vector< int > l2GMap2; // local to global mapping
   l2GMap1.reserve(maxSize);
-  l2GMap2.reserve(maxSize);
 
   vector < double > MMlocal;
   MMlocal.reserve(maxSize * maxSize);
 
-  vector < double > CClocal;
-  CClocal.reserve(maxSize * maxSize);
-
   MM->zero(); // Set to zero all the entries of the Global Matrix
 
-  int MM_size = msh->_dofOffset[solType][nprocs];
-  int MM_local_size = msh->_dofOffset[solType][iproc + 1] - msh->_dofOffset[solType][iproc];
-
-  SparseMatrix* CC;
-  CC = SparseMatrix::build().release();
-  CC->init(MM_size, MM_size, MM_local_size, MM_local_size, MM_local_size, MM_size - MM_local_size);
-  CC->zero();
-
-  for(int kproc = 0; kproc < nprocs; kproc++) {
-    for(int jel = msh->_elementOffset[kproc]; jel < msh->_elementOffset[kproc + 1]; jel++) {
-
-      short unsigned ielGeom2;
-      unsigned nDof2;
-      unsigned nDofx2;
-
-      if(iproc == kproc) {
-        ielGeom2 = msh->GetElementType(jel);
-        nDof2  = msh->GetElementDofNumber(jel, solType);    // number of solution element dofs
-        nDofx2 = msh->GetElementDofNumber(jel, xType);    // number of coordinate element dofs
-      }
+  // element loop: each process loops only on the elements that owns
+  for(int iel = msh->_elementOffset[iproc]; iel < msh->_elementOffset[iproc + 1]; iel++) {
 
-      MPI_Bcast(&ielGeom2, 1, MPI_UNSIGNED_SHORT, kproc, MPI_COMM_WORLD);
-      MPI_Bcast(&nDof2, 1, MPI_UNSIGNED, kproc, MPI_COMM_WORLD);
-      MPI_Bcast(&nDofx2, 1, MPI_UNSIGNED, kproc, MPI_COMM_WORLD);
+    short unsigned ielGeom1 = msh->GetElementType(iel);
+    unsigned nDof1  = msh->GetElementDofNumber(iel, solType);    // number of solution element dofs
+    unsigned nDofx1 = msh->GetElementDofNumber(iel, xType);    // number of coordinate element dofs
 
-      // resize local arrays
-      l2GMap2.resize(nDof2);
+    // resize local arrays
+    l2GMap1.resize(nDof1);
 
-      for(int k = 0; k < dim; k++) {
-        x2[k].resize(nDofx2);
-      }
+    for(int k = 0; k < dim; k++) {
+      x1[k].resize(nDofx1);
+    }
 
-      // local storage of global mapping and solution
-      if(iproc == kproc) {
-        for(unsigned j = 0; j < nDof2; j++) {
-          l2GMap2[j] = pdeSys->GetSystemDof(soluIndex, soluPdeIndex, j, jel);  // global to global mapping between solution node and pdeSys dof
-        }
-      }
-      MPI_Bcast(&l2GMap2[0], nDof2, MPI_UNSIGNED, kproc, MPI_COMM_WORLD);
+    // local storage of global mapping and solution
+    for(unsigned i = 0; i < nDof1; i++) {
+      l2GMap1[i] = pdeSys->GetSystemDof(soluIndex, soluPdeIndex, i, iel);    // global to global mapping between solution node and pdeSys dof
+    }
 
-      // local storage of coordinates
-      if(iproc == kproc) {
-        for(unsigned j = 0; j < nDofx2; j++) {
-          unsigned xDof  = msh->GetSolutionDof(j, jel, xType);  // global to global mapping between coordinates node and coordinate dof
-          for(unsigned k = 0; k < dim; k++) {
-            x2[k][j] = (*msh->_topology->_Sol[k])(xDof);  // global extraction and local storage for the element coordinates
-          }
-        }
-      }
+    // local storage of coordinates
+    for(unsigned i = 0; i < nDofx1; i++) {
+      unsigned xDof  = msh->GetSolutionDof(i, iel, xType);    // global to global mapping between coordinates node and coordinate dof
       for(unsigned k = 0; k < dim; k++) {
-        MPI_Bcast(& x2[k][0], nDofx2, MPI_DOUBLE, kproc, MPI_COMM_WORLD);
+        x1[k][i] = (*msh->_topology->_Sol[k])(xDof);  // global extraction and local storage for the element coordinates
       }
+    }
 
-      unsigned jgNumber = msh->_finiteElement[ielGeom2][solType]->GetGaussPointNumber();
-      vector < vector < double > > xg2(jgNumber);
-      vector <double> weight2(jgNumber);
-      vector < vector <double> > phi2(jgNumber);  // local test function
+    MMlocal.assign(nDof1 * nDof1, 0.);  //resize
 
-      for(unsigned jg = 0; jg < jgNumber; jg++) {
-        msh->_finiteElement[ielGeom2][solType]->Jacobian(x2, jg, weight2[jg], phi2[jg], phi_x);
+    // *** Gauss point loop ***
+    unsigned igNumber = msh->_finiteElement[ielGeom1][solType]->GetGaussPointNumber();
+    double weight1;
+    vector <double> phi1;  // local test function
+    for(unsigned ig = 0; ig < igNumber; ig++) {
 
-        xg2[jg].assign(dim, 0.);
+      msh->_finiteElement[ielGeom1][solType]->Jacobian(x1, ig, weight1, phi1, phi_x);
 
-        for(unsigned j = 0; j < nDof2; j++) {
-          for(unsigned k = 0; k < dim; k++) {
-            xg2[jg][k] += x2[k][j] * phi2[jg][j];
-          }
+      for(unsigned i = 0; i < nDof1; i++) {
+        for(unsigned i1 = 0; i1 < nDof1; i1++) {
+          MMlocal[ i * nDof1 + i1 ] += phi1[i] * phi1[i1] * weight1;
         }
       }
+    } //endl ig loop
+    MM->add_matrix_blocked(MMlocal, l2GMap1, l2GMap1);
+  } // end iel loop
 
-      // element loop: each process loops only on the elements that owns
-      for(int iel = msh->_elementOffset[iproc]; iel < msh->_elementOffset[iproc + 1]; iel++) {
-
-        short unsigned ielGeom1 = msh->GetElementType(iel);
-        unsigned nDof1  = msh->GetElementDofNumber(iel, solType);    // number of solution element dofs
-        unsigned nDofx1 = msh->GetElementDofNumber(iel, xType);    // number of coordinate element dofs
-
-        // resize local arrays
-        l2GMap1.resize(nDof1);
-        //std::vector<bool>bdcDirichlet(nDof1);
-
-        for(int k = 0; k < dim; k++) {
-          x1[k].resize(nDofx1);
-        }
-
-        // local storage of global mapping and solution
-        for(unsigned i = 0; i < nDof1; i++) {
-          l2GMap1[i] = pdeSys->GetSystemDof(soluIndex, soluPdeIndex, i, iel);    // global to global mapping between solution node and pdeSys dof
-          //unsigned solDof = msh->GetSolutionDof(i, iel, solType);    // global to global mapping between solution node and solution dof
-          //bdcDirichlet[i] = ( (*sol->_Bdc[soluIndex])(solDof) < 1.5)? false:false;
-        }
-
-        // local storage of coordinates
-        for(unsigned i = 0; i < nDofx1; i++) {
-          unsigned xDof  = msh->GetSolutionDof(i, iel, xType);    // global to global mapping between coordinates node and coordinate dof
-          for(unsigned k = 0; k < dim; k++) {
-            x1[k][i] = (*msh->_topology->_Sol[k])(xDof);  // global extraction and local storage for the element coordinates
-          }
-        }
-
-        if(iel == jel) MMlocal.assign(nDof1 * nDof1, 0.);  //resize
-        CClocal.assign(nDof1 * nDof2, 0.);   //resize
-
-        // *** Gauss point loop ***
-        unsigned igNumber = msh->_finiteElement[ielGeom1][solType]->GetGaussPointNumber();
-        double weight1;
-        vector <double> phi1;  // local test function
-        for(unsigned ig = 0; ig < igNumber; ig++) {
-
-          msh->_finiteElement[ielGeom1][solType]->Jacobian(x1, ig, weight1, phi1, phi_x);
-
-          // evaluate the solution, the solution derivatives and the coordinates in the gauss point
-          vector < double > xg1(dim, 0.);
-          for(unsigned i = 0; i < nDof1; i++) {
-            for(unsigned k = 0; k < dim; k++) {
-              xg1[k] += x1[k][i] * phi1[i];
-            }
-          }
-
-          if(iel == jel) {
-            for(unsigned i = 0; i < nDof1; i++) {
-              for(unsigned i1 = 0; i1 < nDof1; i1++) {
-                MMlocal[ i * nDof1 + i1 ] += phi1[i] * phi1[i1] * weight1;
-              }
-            }
-          }
+  MM->close();
 
-          for(unsigned jg = 0; jg < jgNumber; jg++) {
-            double dist = 0.;
-            for(unsigned k = 0; k < dim; k++) {
-              dist += fabs(xg1[k] - xg2[jg][k]);
-            }
-            double C = varianceInput * exp(- dist / L);
-            for(unsigned i = 0; i < nDof1; i++) {
-              for(unsigned j = 0; j < nDof2; j++) {
-                CClocal[i * nDof2 + j] += weight1 * phi1[i] * C * phi2[jg][j] * weight2[jg];
-              }//endl j loop
-            } //endl i loop
-          } //endl jg loop
-        } //endl ig loop
-        if(iel == jel) MM->add_matrix_blocked(MMlocal, l2GMap1, l2GMap1);
-        CC->add_matrix_blocked(CClocal, l2GMap1, l2GMap2);
-      } // end iel loop
-    } //end jel loop
-  } //end kproc loop
+  // the covariance matrix is applied as a hierarchical matrix on the Gauss points and it is never assembled
+  PetscReal covarianceTolerance = 1.e-6;
+  PetscOptionsGetReal(NULL, NULL, "-covariance_tolerance", &covarianceTolerance, NULL);
+  CovarianceOperator CC(mlPdeSys, level, "u", GetCovariance, covarianceTolerance);
 
-  MM->close();
-  CC->close();
+  double compression = CC.GetCompressionRatio();
+  MPI_Allreduce(MPI_IN_PLACE, &compression, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  std::cout << " Covariance operator: largest stored fraction of the dense kernel rows = " << compression << std::endl;
 
   //BEGIN solve the eigenvalue problem
 
@@ -413,7 +326,7 @@ void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::
 
   ierr = EPSCreate(PETSC_COMM_WORLD, &eps);
   CHKERRABORT(MPI_COMM_WORLD, ierr);
-  ierr = EPSSetOperators(eps, (static_cast<PetscMatrix*>(CC))->mat(), (static_cast<PetscMatrix*>(MM))->mat());
+  ierr = EPSSetOperators(eps, CC.GetMat(), (static_cast<PetscMatrix*>(MM))->mat());
   CHKERRABORT(MPI_COMM_WORLD, ierr);
   ierr = EPSSetFromOptions(eps);
   CHKERRABORT(MPI_COMM_WORLD, ierr);
@@ -458,8 +371,6 @@ void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::
   ierr = EPSDestroy(&eps);
   CHKERRABORT(MPI_COMM_WORLD, ierr);
 
-  delete CC;
-
   //BEGIN OLD 
 //    std::vector <unsigned> eigfIndex(numberOfEigPairs);
 //   char name[10];
@@ -737,6 +648,10 @@ void GetEigenPair(MultiLevelProblem& ml_prob, const int& numberOfEigPairs, std::
 }
 
 
+void GetSampleQuantityOfInterest(MultiLevelProblem& ml_prob, const int& sample) {
+  GetQuantityOfInterest(ml_prob, QoI, sample, domainMeasure);
+}
+
 void GetQuantityOfInterest(MultiLevelProblem& ml_prob, std::vector < double >&  QoI, const unsigned& m, const double& domainMeasure) {
 
   //  extract pointers to the several objects that we are going to use
@@ -31,6 +31,20 @@ boost::variate_generator < boost::mt19937&,
 
 boost::normal_distribution<> > var_nor(rng, nd);
 
+std::vector <double> yOmega; //KL coefficients of the current sample
+
+void SetSample(MultiLevelProblem& ml_prob, const int& sample) {
+  yOmega.assign(numberOfEigPairs, 0.); // the mean field for sample = -1
+  if(sample >= 0) {
+    // seeded by the sample, so that the realizations do not depend on how the samples are split
+    var_nor.engine().seed(static_cast < boost::mt19937::result_type >(sample) + 1u);
+    var_nor.distribution().reset();
+    for(unsigned eig = 0; eig < numberOfEigPairs; eig++) {
+      yOmega[eig] = var_nor();
+    }
+  }
+}
+
 double GetExactSolutionLaplace(const std::vector < double >& x) {
   double pi = acos(-1.);
   return -pi * pi * cos(pi * x[0]) * cos(pi * x[1]) - pi * pi * cos(pi * x[0]) * cos(pi * x[1]);
@@ -120,14 +134,11 @@ void AssembleUQSys(MultiLevelProblem& ml_prob) {
   vector < double > Jac;
   Jac.reserve(maxSize * maxSize);
 
-  KK->zero(); // Set to zero all the entries of the Global Matrix
+  bool assembleMatrix = mlPdeSys->GetAssembleMatrix();
+  if(assembleMatrix) KK->zero(); // Set to zero all the entries of the Global Matrix
 
-  std::vector <double> yOmega(numberOfEigPairs, 0.);
+  if(yOmega.size() != numberOfEigPairs) SetSample(ml_prob, -1);
   for(unsigned eig = 0; eig < numberOfEigPairs; eig++) {
-    if(iproc == 0) {
-      yOmega[eig] = var_nor();
-    }
-    MPI_Bcast(&yOmega[eig], 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
     std::cout << " ----------------------------- yOmega =" << yOmega[eig] << " ";
   }
   std::cout << std::endl;
@@ -248,12 +259,14 @@ void AssembleUQSys(MultiLevelProblem& ml_prob) {
     // define the independent variables
     s.independent(&solu[0], nDofu);
 
-    // get the jacobian matrix (ordered by row major )
-    Jac.resize(nDofu * nDofu);    //resize
-    s.jacobian(&Jac[0], true);
+    if(assembleMatrix) {
+      // get the jacobian matrix (ordered by row major )
+      Jac.resize(nDofu * nDofu);    //resize
+      s.jacobian(&Jac[0], true);
 
-    //store K in the global matrix KK
-    KK->add_matrix_blocked(Jac, l2GMap, l2GMap);
+      //store K in the global matrix KK
+      KK->add_matrix_blocked(Jac, l2GMap, l2GMap);
+    }
 
     s.clear_independents();
     s.clear_dependents();
@@ -262,7 +275,7 @@ void AssembleUQSys(MultiLevelProblem& ml_prob) {
 
   RES->close();
 
-  KK->close();
+  if(assembleMatrix) KK->close();
 
   // ***************** END ASSEMBLY *******************
 }
@@ -18,7 +18,10 @@
 #include "VTKWriter.hpp"
 #include "GMVWriter.hpp"
 #include "NonLinearImplicitSystem.hpp"
+#include "AssemblyKernels.hpp"
 #include "adept.h"
+#include <cstring>
+#include <cstdlib>
 
 
 using namespace femus;
@@ -50,11 +53,29 @@ bool SetBoundaryCondition(const std::vector < double >& x, const char SolName[],
 
 
 void AssembleBoussinesqAppoximation_AD(MultiLevelProblem& ml_prob);    //, unsigned level, const unsigned &levelMax, const bool &assembleMatrix );
+void AssembleBoussinesqAppoximation(MultiLevelProblem& ml_prob);
 
 
-int main(int argc, char** args) {
+/**
+ * Same problem as AssembleBoussinesqAppoximation_AD, assembled with the Newton kernel of the library
+ **/
+void AssembleBoussinesqAppoximation(MultiLevelProblem& ml_prob) {
+  std::vector < std::string > velocityNames;
+  velocityNames.push_back("U");
+  velocityNames.push_back("V");
+  velocityNames.push_back("W");
+
+  double nu = 1.;
+  AssembleNavierStokes(ml_prob, "NS", velocityNames, "P", nu, NEWTON);
+}
 
 
+int main(int argc, char** args) {
+
+  // "analytic" assembles with the library kernel and its hand-coded Jacobian instead of the adept tape,
+  // the optional second argument is the number of threads of its element loop
+  bool analyticJacobian = (argc >= 2 && !strcmp("analytic", args[1]));
+  unsigned assemblyThreads = (analyticJacobian && argc >= 3) ? atoi(args[2]) : 1;
 
   // init Petsc-MPI communicator
   FemusInit mpinit(argc, args, MPI_COMM_WORLD);
@@ -109,7 +130,9 @@ int main(int argc, char** args) {
   system.AddSolutionToSystemPDE("P");
 
   // attach the assembling function to system
-  system.SetAssembleFunction(AssembleBoussinesqAppoximation_AD);
+  if (analyticJacobian) system.SetAssembleFunction(AssembleBoussinesqAppoximation);
+  else system.SetAssembleFunction(AssembleBoussinesqAppoximation_AD);
+  system.SetNumberOfAssemblyThreads(assemblyThreads);
 
   // initilaize and solve the system
   system.init();
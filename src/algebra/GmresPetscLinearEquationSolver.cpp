@@ -28,6 +28,7 @@
 #include "PetscMatrix.hpp"
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
 
 namespace femus
 {
@@ -74,7 +75,7 @@ namespace femus
       for(unsigned inode_mts = _msh->_dofOffset[soltype][processor_id()];
           inode_mts < _msh->_dofOffset[soltype][processor_id() + 1]; inode_mts++) {
         int local_mts = inode_mts - _msh->_dofOffset[soltype][processor_id()];
-        int idof_kk = KKoffset[k][processor_id()] + local_mts;
+        int idof_kk = GetKKDof(k, processor_id(), local_mts);
 
         if(!ThisSolutionIsIncluded[k] || (* (*_Bdc) [indexSol])(inode_mts) < 1.5) {
           _bdcIndex[count0] = idof_kk;
@@ -340,6 +341,74 @@ namespace femus
 
   // ================================================
 
+  void GmresPetscLinearEquationSolver::MGMatSolve(std::vector < NumericVector* > &RES, std::vector < NumericVector* > &EPS)
+  {
+
+    PetscLogDouble t1;
+    PetscLogDouble t2;
+    PetscTime(&t1);
+
+    PetscInt nrhs = RES.size();
+    std::vector< PetscScalar > zero(_bdcIndex.size(), 0.);
+    for(PetscInt j = 0; j < nrhs; j++) {
+      Vec res = (static_cast< PetscVector* >(RES[j]))->vec();
+      VecSetValues(res, _bdcIndex.size(), &_bdcIndex[0], &zero[0],  INSERT_VALUES);
+      VecAssemblyBegin(res);
+      VecAssemblyEnd(res);
+    }
+
+#if PETSC_VERSION_LT(3,14,0)
+    // no block solve, the right-hand sides share the setup of the KSP
+    for(PetscInt j = 0; j < nrhs; j++) {
+      KSPSolve(_ksp, (static_cast< PetscVector* >(RES[j]))->vec(), (static_cast< PetscVector* >(EPS[j]))->vec());
+    }
+#else
+    PetscInt localSize, globalSize;
+    VecGetLocalSize((static_cast< PetscVector* >(RES[0]))->vec(), &localSize);
+    VecGetSize((static_cast< PetscVector* >(RES[0]))->vec(), &globalSize);
+
+    Mat B, X;
+    MatCreateDense(PETSC_COMM_WORLD, localSize, PETSC_DECIDE, globalSize, nrhs, NULL, &B);
+    MatCreateDense(PETSC_COMM_WORLD, localSize, PETSC_DECIDE, globalSize, nrhs, NULL, &X);
+
+    PetscScalar *b;
+    MatDenseGetArray(B, &b);
+    for(PetscInt j = 0; j < nrhs; j++) {
+      const PetscScalar *res;
+      VecGetArrayRead((static_cast< PetscVector* >(RES[j]))->vec(), &res);
+      std::copy(res, res + localSize, b + j * localSize);
+      VecRestoreArrayRead((static_cast< PetscVector* >(RES[j]))->vec(), &res);
+    }
+    MatDenseRestoreArray(B, &b);
+
+    KSPMatSolve(_ksp, B, X);
+
+    const PetscScalar *x;
+    MatDenseGetArrayRead(X, &x);
+    for(PetscInt j = 0; j < nrhs; j++) {
+      PetscScalar *eps;
+      VecGetArray((static_cast< PetscVector* >(EPS[j]))->vec(), &eps);
+      std::copy(x + j * localSize, x + (j + 1) * localSize, eps);
+      VecRestoreArray((static_cast< PetscVector* >(EPS[j]))->vec(), &eps);
+    }
+    MatDenseRestoreArrayRead(X, &x);
+
+    MatDestroy(&B);
+    MatDestroy(&X);
+#endif
+
+    if(_printSolverInfo) {
+      PetscTime(&t2);
+#if PETSC_VERSION_LT(3,16,0)
+      PetscPrintf(PETSC_COMM_WORLD, "       *************** MG linear solver time for %D right-hand sides: %e \n", nrhs, t2 - t1);
+#else
+      PetscPrintf(PETSC_COMM_WORLD, "       *************** MG linear solver time for %" PetscInt_FMT " right-hand sides: %e \n", nrhs, t2 - t1);
+#endif
+    }
+  }
+
+  // ================================================
+
   void GmresPetscLinearEquationSolver::RemoveNullSpace()
   {
 
@@ -382,7 +451,7 @@ namespace femus
         unsigned owndofs = _msh->_dofOffset[soltype][processor_id() + 1] - _msh->_dofOffset[soltype][processor_id()];
         if(soltype == 4) owndofs /= (_msh->GetDimension() + 1);
         for(unsigned i = 0; i < owndofs; i++) {
-          int idof_kk = KKoffset[k][processor_id()] + i;
+          int idof_kk = GetKKDof(k, processor_id(), i);
           unsigned inode_mts = _msh->_dofOffset[soltype][processor_id()] + i;
           if((* (*_Bdc) [indexSol])(inode_mts) > 1.9) {
             VecSetValue(nullspBase[nullspSize], idof_kk, 1., INSERT_VALUES);
@@ -416,6 +485,11 @@ namespace femus
 
     Mat KK = (static_cast< PetscMatrix* >(_KK))->mat();
 
+    // a matrix-free operator applies the identity on the Dirichlet rows by itself
+    PetscBool isShell;
+    PetscObjectTypeCompare((PetscObject) KK, MATSHELL, &isShell);
+    if(isShell) return;
+
     MatSetOption(KK, MAT_NO_OFF_PROC_ZERO_ROWS, PETSC_TRUE);
     MatSetOption(KK, MAT_KEEP_NONZERO_PATTERN, PETSC_TRUE);
     MatZeroRows(KK, _bdcIndex.size(), &_bdcIndex[0], 1., 0, 0);
@@ -427,6 +501,14 @@ namespace femus
   void GmresPetscLinearEquationSolver::SetPreconditioner(KSP& subksp, PC& subpc)
   {
 
+    // only the diagonal of a matrix-free operator is available
+    PetscBool isShell;
+    PetscObjectTypeCompare((PetscObject)(static_cast< PetscMatrix* >(_KK))->mat(), MATSHELL, &isShell);
+    if(isShell) {
+      PCSetType(subpc, PCJACOBI);
+      return;
+    }
+
     int parallelOverlapping = (_msh->GetIfHomogeneous()) ? 0 : 0;
     PetscPreconditioner::set_petsc_preconditioner_type(this->_preconditioner_type, subpc, parallelOverlapping);
     PetscReal zero = 1.e-16;
@@ -78,6 +78,8 @@ namespace femus {
 
       void MGSolve(const bool ksp_clean);
 
+      void MGMatSolve(std::vector < NumericVector* > &RES, std::vector < NumericVector* > &EPS);
+
       inline void MGClear() {
         KSPDestroy(&_ksp);
       }
@@ -25,6 +25,7 @@
 #include "ParalleltypeEnum.hpp"
 #include "NumericVector.hpp"
 #include "SparseMatrix.hpp"
+#include "Profiler.hpp"
 
 
 namespace femus {
@@ -44,6 +45,11 @@ LinearEquation::LinearEquation(Solution *other_solution){
   _RESC = NULL;
   _KK = NULL;
   _KKamr = NULL;
+  _elementSystemDofCacheIsEnabled = false;
+  _sparsityPatternCSRIsEnabled = false;
+  _interleavedDofOrderingIsEnabled = false;
+  _blockSize = 1;
+  _matrixFreeIsEnabled = false;
 }
 
 //--------------------------------------------------------------------------------
@@ -67,16 +73,30 @@ unsigned LinearEquation::GetIndex(const char name[]) {
 unsigned LinearEquation::GetSystemDof(const unsigned &index_sol, const unsigned &kkindex_sol,
 				      const unsigned &i, const unsigned &iel) const {
 
+  if(_elementSystemDofOffset.size() != 0 && index_sol == _SolPdeIndex[kkindex_sol]) {
+    unsigned ielLocal = iel - _msh->_elementOffset[_iproc]; // wraps around for non-owned elements
+    if(ielLocal < _msh->_elementOffset[_iproc + 1] - _msh->_elementOffset[_iproc]) {
+      return _elementSystemDof[ _elementSystemDofOffset[ielLocal * _SolPdeIndex.size() + kkindex_sol] + i ];
+    }
+  }
+
   unsigned soltype =  _SolType[index_sol];
   unsigned idof= _msh->GetSolutionDof(i, iel, soltype);
 
   unsigned isubdom = _msh->IsdomBisectionSearch(idof, soltype);
-  return KKoffset[kkindex_sol][isubdom] + idof - _msh->_dofOffset[soltype][isubdom];
+  return GetKKDof(kkindex_sol, isubdom, idof - _msh->_dofOffset[soltype][isubdom]);
 }
 
 unsigned LinearEquation::GetSystemDof(const unsigned &soltype, const unsigned &kkindex_sol,
 				      const unsigned &i, const unsigned &iel, const vector < vector <unsigned> > &otherKKoffset) const {
 
+  // otherKKoffset numbers the variables one after the other, as the field split blocks
+  if(_blockSize > 1) {
+    std::cout << "Error in LinearEquation::GetSystemDof: the offsets of other variables require the dofs ordered by variable, "
+              << "disable SetInterleavedDofOrdering" << std::endl;
+    abort();
+  }
+
   //unsigned soltype =  _SolType[index_sol];
   unsigned idof= _msh->GetSolutionDof(i, iel, soltype);
 
@@ -92,14 +112,81 @@ unsigned LinearEquation::GetSystemDof(const unsigned &index_sol, const unsigned
   unsigned idof = _msh->GetSolutionDof(ielc, i0, i1, soltype, mshc);
 
   unsigned isubdom = _msh->IsdomBisectionSearch(idof, soltype);
-  return KKoffset[kkindex_sol][isubdom] + idof - _msh->_dofOffset[soltype][isubdom];
+  return GetKKDof(kkindex_sol, isubdom, idof - _msh->_dofOffset[soltype][isubdom]);
+}
+
+
+//--------------------------------------------------------------------------------
+void LinearEquation::SetElementSystemDofCache(const bool &value) {
+  _elementSystemDofCacheIsEnabled = value;
+  if(!_elementSystemDofCacheIsEnabled) {
+    ClearElementSystemDofCache();
+  }
+  else if(KKoffset.size() != 0) { // InitPde has already been called
+    BuildElementSystemDofCache();
+  }
 }
 
+//--------------------------------------------------------------------------------
+void LinearEquation::ClearElementSystemDofCache() {
+  vector <unsigned> ().swap(_elementSystemDof);
+  vector <unsigned> ().swap(_elementSystemDofOffset);
+}
+
+//--------------------------------------------------------------------------------
+void LinearEquation::BuildElementSystemDofCache() {
+
+  ClearElementSystemDofCache();
+
+  unsigned SolPdeSize = _SolPdeIndex.size();
+  unsigned elementStart = _msh->_elementOffset[_iproc];
+  unsigned elementEnd = _msh->_elementOffset[_iproc + 1];
+
+  vector <unsigned> elementSystemDofOffset((elementEnd - elementStart) * SolPdeSize + 1);
+  elementSystemDofOffset[0] = 0;
+  unsigned counter = 0;
+  for(unsigned iel = elementStart; iel < elementEnd; iel++) {
+    for(unsigned k = 0; k < SolPdeSize; k++) {
+      elementSystemDofOffset[counter + 1] = elementSystemDofOffset[counter] + _msh->GetElementDofNumber(iel, _SolType[_SolPdeIndex[k]]);
+      counter++;
+    }
+  }
+
+  // fill with the cache still empty, so that GetSystemDof follows the uncached path
+  vector <unsigned> elementSystemDof(elementSystemDofOffset[counter]);
+  counter = 0;
+  for(unsigned iel = elementStart; iel < elementEnd; iel++) {
+    for(unsigned k = 0; k < SolPdeSize; k++) {
+      unsigned nDofs = elementSystemDofOffset[counter + 1] - elementSystemDofOffset[counter];
+      for(unsigned i = 0; i < nDofs; i++) {
+        elementSystemDof[elementSystemDofOffset[counter] + i] = GetSystemDof(_SolPdeIndex[k], k, i, iel);
+      }
+      counter++;
+    }
+  }
+
+  _elementSystemDof.swap(elementSystemDof);
+  _elementSystemDofOffset.swap(elementSystemDofOffset);
+}
+
+//--------------------------------------------------------------------------------
+const unsigned* LinearEquation::GetElementSystemDofs(const unsigned &kkindex_sol, const unsigned &iel) const {
+  unsigned k = (iel - _msh->_elementOffset[_iproc]) * _SolPdeIndex.size() + kkindex_sol;
+  return &_elementSystemDof[ _elementSystemDofOffset[k] ];
+}
+
+//--------------------------------------------------------------------------------
+unsigned LinearEquation::GetElementSystemDofNumber(const unsigned &kkindex_sol, const unsigned &iel) const {
+  unsigned k = (iel - _msh->_elementOffset[_iproc]) * _SolPdeIndex.size() + kkindex_sol;
+  return _elementSystemDofOffset[k + 1] - _elementSystemDofOffset[k];
+}
 
 //--------------------------------------------------------------------------------
 void LinearEquation::InitPde(const vector <unsigned> &SolPdeIndex_other, const  vector <int> &SolType_other,
 		     const vector <char*> &SolName_other, vector <NumericVector*> *Bdc_other,
 		     const unsigned &other_gridn, vector <bool> &SparsityPattern_other) {
+  ProfilerTimer timer("InitPde");
+
   _SolPdeIndex=SolPdeIndex_other;
   _gridn=other_gridn;
 
@@ -135,6 +222,21 @@ void LinearEquation::InitPde(const vector <unsigned> &SolPdeIndex_other, const
     }
   }
 
+  // node-interleaved ordering, only for variables of the same type
+  _blockSize = 1;
+  if(_interleavedDofOrderingIsEnabled && _SolPdeIndex.size() > 1) {
+    bool sameType = true;
+    for(unsigned k = 1; k < _SolPdeIndex.size(); k++) {
+      if(_SolType[_SolPdeIndex[k]] != _SolType[_SolPdeIndex[0]]) sameType = false;
+    }
+    if(sameType) {
+      _blockSize = _SolPdeIndex.size();
+    }
+    else if(processor_id() == 0) {
+      std::cout << "Warning: the PDE variables have different types, the dofs are not interleaved" << std::endl;
+    }
+  }
+
   //ghost size
   KKghostsize.resize(_nprocs,0);
   for(int i=0; i<_nprocs; i++) {
@@ -159,7 +261,7 @@ void LinearEquation::InitPde(const vector <unsigned> &SolPdeIndex_other, const
 	 //gambit ghost node
 	 unsigned idof_metis = _msh->_ghostDofs[_SolType[indexSol]][i][k];
 	 unsigned isubdom = _msh->IsdomBisectionSearch(idof_metis, _SolType[indexSol]);
-         KKghost_nd[i][counter] = KKoffset[j][isubdom] + idof_metis - _msh->_dofOffset[_SolType[indexSol]][isubdom];
+         KKghost_nd[i][counter] = GetKKDof(j, isubdom, idof_metis - _msh->_dofOffset[_SolType[indexSol]][isubdom]);
 	 counter++;
        }
      }
@@ -185,6 +287,15 @@ void LinearEquation::InitPde(const vector <unsigned> &SolPdeIndex_other, const
   _RESC = NumericVector::build().release();
   _RESC->init(*_EPS);
 
+  if(_elementSystemDofCacheIsEnabled) {
+    BuildElementSystemDofCache();
+  }
+
+  _KKamr = SparseMatrix::build().release();
+
+  if(_matrixFreeIsEnabled) {
+    return;
+  }
 
   GetSparsityPatternSize();
 
@@ -194,8 +305,38 @@ void LinearEquation::InitPde(const vector <unsigned> &SolPdeIndex_other, const
   int KK_local_size =KKoffset[KKIndex.size()-1][processor_id()] - KKoffset[0][processor_id()];
 
   _KK = SparseMatrix::build().release();
-  _KK->init(KK_size,KK_size,KK_local_size,KK_local_size,d_nnz,o_nnz);
-  _KKamr = SparseMatrix::build().release();
+  if(_blockSize > 1) {
+    // all the variables have the same type, so a row of the variable k couples the same nodes in each of its coupled variables
+    vector < int > coupledVariables(_blockSize, 0);
+    for(unsigned k = 0; k < _blockSize; k++) {
+      for(unsigned l = 0; l < _blockSize; l++) {
+        coupledVariables[k] += _SparsityPattern[k * _blockSize + l];
+      }
+    }
+    unsigned nBlockRows = KK_local_size / _blockSize;
+    vector < int > d_nnzBlock(nBlockRows, 0);
+    vector < int > o_nnzBlock(nBlockRows, 0);
+    for(unsigned i = 0; i < nBlockRows; i++) {
+      for(unsigned k = 0; k < _blockSize; k++) {
+        if(coupledVariables[k] == 0) continue;
+        int dBlocks = d_nnz[i * _blockSize + k] / coupledVariables[k];
+        int oBlocks = o_nnz[i * _blockSize + k] / coupledVariables[k];
+        if(dBlocks > d_nnzBlock[i]) d_nnzBlock[i] = dBlocks;
+        if(oBlocks > o_nnzBlock[i]) o_nnzBlock[i] = oBlocks;
+      }
+    }
+    _KK->init_blocked(KK_size,KK_size,KK_local_size,KK_local_size,_blockSize,d_nnzBlock,o_nnzBlock);
+    vector < int > ().swap(_csrRowOffset);
+    vector < int > ().swap(_csrColumn);
+  }
+  else if(_sparsityPatternCSRIsEnabled) {
+    _KK->init_csr(KK_size,KK_size,KK_local_size,KK_local_size,_csrRowOffset,_csrColumn);
+    vector < int > ().swap(_csrRowOffset);
+    vector < int > ().swap(_csrColumn);
+  }
+  else {
+    _KK->init(KK_size,KK_size,KK_local_size,KK_local_size,d_nnz,o_nnz);
+  }
 }
 
 //--------------------------------------------------------------------------------
@@ -246,6 +387,8 @@ void LinearEquation::DeletePde() {
   if(_RESC)
     delete _RESC;
 
+  ClearElementSystemDofCache();
+
 }
 
   void LinearEquation::GetSparsityPatternSize() {
@@ -264,122 +407,181 @@ void LinearEquation::DeletePde() {
       exit(0);
     }
 
-    const int dim = _msh->GetDimension();
+    int this_proc = _msh->processor_id();
+    int nprocs = _msh->n_processors();
 
-    const int max_size = static_cast< int > (ceil(pow(3,dim)));
-
-    vector < vector < int > > dofsVAR(_SolPdeIndex.size());
+    int IndexStart= KKoffset[0][this_proc];
+    int IndexEnd  = KKoffset[KKIndex.size()-1][this_proc];
+    int owned_dofs    = IndexEnd-IndexStart;
 
-    for(int i=0;i<_SolPdeIndex.size();i++){
-      dofsVAR[i].reserve(max_size);
+    unsigned elementStart = _msh->_elementOffset[this_proc];
+    unsigned elementEnd = _msh->_elementOffset[this_proc + 1];
+    unsigned nel = elementEnd - elementStart;
+
+    //BEGIN system dofs of the owned elements, [element][variable] as in the element dof cache
+    vector < unsigned > elementDofOffset(nel * SolPdeSize + 1);
+    elementDofOffset[0] = 0;
+    unsigned counter = 0;
+    for(unsigned iel = elementStart; iel < elementEnd; iel++) {
+      for(unsigned k = 0; k < SolPdeSize; k++) {
+        elementDofOffset[counter + 1] = elementDofOffset[counter] + _msh->GetElementDofNumber(iel, _SolType[_SolPdeIndex[k]]);
+        counter++;
+      }
     }
 
-    // mesh and procs
-    int nel    = _msh->GetNumberOfElements();
-    int igrid  = _msh->GetLevel();
-    int this_proc  = _msh->processor_id();
-    int nprocs=	      _msh->n_processors();
+    vector < int > elementDof(elementDofOffset[counter]);
+    counter = 0;
+    for(unsigned iel = elementStart; iel < elementEnd; iel++) {
+      for(unsigned k = 0; k < SolPdeSize; k++) {
+        unsigned nDofs = elementDofOffset[counter + 1] - elementDofOffset[counter];
+        for(unsigned i = 0; i < nDofs; i++) {
+          elementDof[elementDofOffset[counter] + i] = GetSystemDof(_SolPdeIndex[k], k, i, iel);
+        }
+        counter++;
+      }
+    }
+    //END system dofs
 
-    // *** element loop ***
+    //BEGIN rows touched by the owned elements: owned rows first, then the sorted non-owned rows
+    vector < int > ghostRow;
+    for(unsigned i = 0; i < elementDof.size(); i++) {
+      if(elementDof[i] < IndexStart || elementDof[i] >= IndexEnd) ghostRow.push_back(elementDof[i]);
+    }
+    std::sort(ghostRow.begin(), ghostRow.end());
+    ghostRow.erase(std::unique(ghostRow.begin(), ghostRow.end()), ghostRow.end());
 
-    int IndexStart= KKoffset[0][this_proc];
-    int IndexEnd  = KKoffset[KKIndex.size()-1][this_proc];
-    int owned_dofs    = IndexEnd-IndexStart;
+    unsigned nRows = owned_dofs + ghostRow.size();
 
-    vector < std::map < int, bool > > BlgToMe_d(owned_dofs);
-    vector < std::map < int, bool > > BlgToMe_o(owned_dofs);
-    std::map < int, std::map <int, bool > > DnBlgToMe_o;
-    std::map < int, std::map <int, bool > > DnBlgToMe_d;
+    // row of every element dof, reused by the two passes below
+    vector < unsigned > elementRow(elementDof.size());
+    for(unsigned i = 0; i < elementDof.size(); i++) {
+      int idof = elementDof[i];
+      elementRow[i] = (idof >= IndexStart && idof < IndexEnd) ? idof - IndexStart :
+                      owned_dofs + (std::lower_bound(ghostRow.begin(), ghostRow.end(), idof) - ghostRow.begin());
+    }
+    //END rows
 
-    for(int kel=_msh->_elementOffset[this_proc]; kel < _msh->_elementOffset[this_proc+1]; kel++) {
+    //BEGIN (element, variable) pairs of every row in CSR format, the first pass counts and the second pass inserts
+    vector < unsigned > rowOffset(nRows + 1, 0);
+    for(unsigned i = 0; i < elementRow.size(); i++) {
+      rowOffset[elementRow[i] + 1]++;
+    }
+    for(unsigned r = 0; r < nRows; r++) {
+      rowOffset[r + 1] += rowOffset[r];
+    }
 
-      short int kelt = _msh->GetElementType(kel);
-      vector < int > nve(_SolPdeIndex.size());
-      for(int i=0;i<_SolPdeIndex.size();i++){
-	nve[i] = _msh->GetElementDofNumber(kel,_SolType[_SolPdeIndex[i]]);
-      }
-      for(int i=0; i<_SolPdeIndex.size(); i++) {
-	dofsVAR[i].resize(nve[i]);
+    vector < unsigned > rowEntry(rowOffset[nRows]);
+    {
+      vector < unsigned > position(rowOffset.begin(), rowOffset.end() - 1);
+      for(unsigned ielk = 0; ielk < nel * SolPdeSize; ielk++) {
+        for(unsigned i = elementDofOffset[ielk]; i < elementDofOffset[ielk + 1]; i++) {
+          rowEntry[position[elementRow[i]]++] = ielk;
+        }
       }
+    }
+    vector < unsigned > ().swap(elementRow);
+    //END (element, variable) pairs
 
-      for(int i=0; i<_SolPdeIndex.size(); i++) {
-	int ThisSolType=_SolType[_SolPdeIndex[i]];
-	for (int j=0;j<nve[i];j++) {
-          int inode=_msh->GetSolutionDof(j, kel, ThisSolType);
-	  dofsVAR[i][j]= GetSystemDof(_SolPdeIndex[i],i,j,kel);
-	}
-      }
-      for(int i=0;i<_SolPdeIndex.size();i++){
-	for(int inode=0;inode<nve[i];inode++){
-	  int idof_local=dofsVAR[i][inode] - IndexStart;
-	  for(int j=0;j<_SolPdeIndex.size();j++){
-	    if(_SparsityPattern[_SolPdeIndex.size()*i+j]){
-	      for(int jnode=0;jnode<nve[j];jnode++){
-	        int jdof_local=dofsVAR[j][jnode] - IndexStart;
-
-		if(idof_local >= 0){ // i-row belogns to this proc
-		  if(jdof_local >= 0){ // j-row belongs to this proc (diagonal)
-		    BlgToMe_d[ idof_local ][ jdof_local ] = 1;
-		  }
-		  else { // j-row does not belong to this proc (off-diagonal)
-		    BlgToMe_o[ idof_local ][ dofsVAR[j][jnode] ]=1;
-		  }
-		}
-		else{ // i-row does not belong to this proc
-		  // identify the process the i-row belogns to
-		  int iproc=0;
-		  while (dofsVAR[i][inode] >= KKoffset[KKIndex.size()-1][iproc]) iproc++;
-
-		  // identify the process the j-column belogns to
-		  int jproc=0;
-		  while (dofsVAR[j][jnode] >= KKoffset[KKIndex.size()-1][jproc]) jproc++;
-		  if (iproc != jproc){ // if diagonal
-		    DnBlgToMe_o[dofsVAR[i][inode]][dofsVAR[j][jnode]]=1;
-		  }
-		  else if (iproc == jproc){ // if off-diagonal
-		    DnBlgToMe_d[dofsVAR[i][inode]][dofsVAR[j][jnode]]=1;
-		  }
-		}
-	      }
-	    }
-	  }
-	}
-      }
+    vector < int > columns;
+
+    //BEGIN column lists of the non-owned rows, sent to the owner process
+    vector < int > procEnd(nprocs);
+    for(int p = 0; p < nprocs; p++) {
+      procEnd[p] = KKoffset[KKIndex.size()-1][p];
     }
 
-    NumericVector  *sizeDnBM_o = NumericVector::build().release();
-    sizeDnBM_o->init(*_EPS);
-    sizeDnBM_o->zero();
-    for (std::map < int, std::map <int, bool > >::iterator it=DnBlgToMe_o.begin(); it!=DnBlgToMe_o.end(); ++it){
-      sizeDnBM_o->add(it->first,it->second.size());
+    vector < int > sendBuffer;
+    vector < int > sendCount(nprocs, 0);
+    for(unsigned g = 0; g < ghostRow.size(); g++) {
+      GetSparsityPatternRowColumns(rowOffset, rowEntry, elementDofOffset, elementDof, owned_dofs + g, columns);
+      std::sort(columns.begin(), columns.end());
+      columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+      int iproc = std::upper_bound(procEnd.begin(), procEnd.end(), ghostRow[g]) - procEnd.begin();
+      sendBuffer.push_back(ghostRow[g]);
+      sendBuffer.push_back(columns.size());
+      sendBuffer.insert(sendBuffer.end(), columns.begin(), columns.end());
+      sendCount[iproc] += 2 + columns.size();
     }
-    sizeDnBM_o->close();
 
+    vector < int > recvCount(nprocs);
+    MPI_Alltoall(&sendCount[0], 1, MPI_INT, &recvCount[0], 1, MPI_INT, PETSC_COMM_WORLD);
 
-    NumericVector  *sizeDnBM_d = NumericVector::build().release();
-    sizeDnBM_d->init(*_EPS);
-    sizeDnBM_d->zero();
-    for (std::map < int, std::map <int, bool > >::iterator it=DnBlgToMe_d.begin(); it!=DnBlgToMe_d.end(); ++it){
-      sizeDnBM_d->add(it->first,it->second.size());
+    vector < int > sendDispl(nprocs, 0);
+    vector < int > recvDispl(nprocs, 0);
+    for(int p = 1; p < nprocs; p++) {
+      sendDispl[p] = sendDispl[p - 1] + sendCount[p - 1];
+      recvDispl[p] = recvDispl[p - 1] + recvCount[p - 1];
     }
-    sizeDnBM_d->close();
-
+    vector < int > recvBuffer(recvDispl[nprocs - 1] + recvCount[nprocs - 1]);
+    MPI_Alltoallv((sendBuffer.size() > 0) ? &sendBuffer[0] : NULL, &sendCount[0], &sendDispl[0], MPI_INT,
+                  (recvBuffer.size() > 0) ? &recvBuffer[0] : NULL, &recvCount[0], &recvDispl[0], MPI_INT, PETSC_COMM_WORLD);
+    vector < int > ().swap(sendBuffer);
+
+    // received column lists of every owned row in CSR format, recvEntry points to the list length in recvBuffer
+    vector < unsigned > recvRowOffset(owned_dofs + 1, 0);
+    for(unsigned pos = 0; pos < recvBuffer.size(); pos += 2 + recvBuffer[pos + 1]) {
+      recvRowOffset[recvBuffer[pos] - IndexStart + 1]++;
+    }
+    for(int r = 0; r < owned_dofs; r++) {
+      recvRowOffset[r + 1] += recvRowOffset[r];
+    }
+    vector < unsigned > recvEntry(recvRowOffset[owned_dofs]);
+    {
+      vector < unsigned > position(recvRowOffset.begin(), recvRowOffset.end() - 1);
+      for(unsigned pos = 0; pos < recvBuffer.size(); pos += 2 + recvBuffer[pos + 1]) {
+        recvEntry[position[recvBuffer[pos] - IndexStart]++] = pos + 1;
+      }
+    }
+    //END column lists of the non-owned rows
 
+    //BEGIN exact nonzeros of the owned rows
     d_nnz.resize(owned_dofs);
     o_nnz.resize(owned_dofs);
 
-    int d_max=owned_dofs;
-    int o_max=KKIndex[KKIndex.size()-1u]-owned_dofs;
+    bool csr = _sparsityPatternCSRIsEnabled;
+    if(csr) {
+      _csrRowOffset.resize(owned_dofs + 1);
+      _csrRowOffset[0] = 0;
+      _csrColumn.resize(0);
+    }
+
+    for(int r = 0; r < owned_dofs; r++) {
+      GetSparsityPatternRowColumns(rowOffset, rowEntry, elementDofOffset, elementDof, r, columns);
+      for(unsigned j = recvRowOffset[r]; j < recvRowOffset[r + 1]; j++) {
+        unsigned pos = recvEntry[j];
+        columns.insert(columns.end(), recvBuffer.begin() + pos + 1, recvBuffer.begin() + pos + 1 + recvBuffer[pos]);
+      }
+      std::sort(columns.begin(), columns.end());
+      columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+      int d = std::lower_bound(columns.begin(), columns.end(), IndexEnd) - std::lower_bound(columns.begin(), columns.end(), IndexStart);
+      d_nnz[r] = d;
+      o_nnz[r] = columns.size() - d;
 
-    for(int i=0; i<owned_dofs;i++){
-     d_nnz[i]=static_cast <int> ((*sizeDnBM_d)(IndexStart+i))+BlgToMe_d[i].size();
-     if (d_nnz[i] > d_max) d_nnz[i] = d_max;
-     o_nnz[i]=static_cast <int> ((*sizeDnBM_o)(IndexStart+i))+BlgToMe_o[i].size();
-     if (o_nnz[i] > o_max) o_nnz[i] = o_max;
+      if(csr) {
+        _csrColumn.insert(_csrColumn.end(), columns.begin(), columns.end());
+        _csrRowOffset[r + 1] = _csrColumn.size();
+      }
     }
+    //END exact nonzeros
+  }
 
-    delete sizeDnBM_o;
-    delete sizeDnBM_d;
+  void LinearEquation::GetSparsityPatternRowColumns(const vector < unsigned > &rowOffset, const vector < unsigned > &rowEntry,
+                                                    const vector < unsigned > &elementDofOffset, const vector < int > &elementDof,
+                                                    const unsigned &row, vector < int > &columns) const {
+    unsigned SolPdeSize = _SolPdeIndex.size();
+    columns.resize(0);
+    for(unsigned j = rowOffset[row]; j < rowOffset[row + 1]; j++) {
+      unsigned iel = rowEntry[j] / SolPdeSize;
+      unsigned k = rowEntry[j] % SolPdeSize;
+      for(unsigned l = 0; l < SolPdeSize; l++) {
+        if(_SparsityPattern[SolPdeSize * k + l]) {
+          unsigned ielk = iel * SolPdeSize + l;
+          columns.insert(columns.end(), elementDof.begin() + elementDofOffset[ielk], elementDof.begin() + elementDofOffset[ielk + 1]);
+        }
+      }
+    }
   }
 }
 
@@ -54,8 +54,37 @@ public:
                const vector <char*> &SolName, vector <NumericVector*> *Bdc_other,
                const unsigned &other_gridn, vector < bool > &SparsityPattern_other);
 
+  /** Exact d_nnz and o_nnz of the owned rows, and their CSR structure if enabled with SetSparsityPatternCSR.
+   * The columns of every row are gathered from the elements sharing it and sorted, the rows of other processes
+   * touched by the owned elements are sent to their owners */
   void GetSparsityPatternSize();
 
+  /** Preallocate the matrix with its full CSR structure instead of the number of nonzeros per row */
+  void SetSparsityPatternCSR(const bool &value = true) {
+    _sparsityPatternCSRIsEnabled = value;
+  }
+
+  /** Order the system dofs node by node, KK index = KKoffset[0][isubdom] + i * nvar + k, and store the matrix in block format (BAIJ).
+   *  It is applied only if all the PDE variables have the same type, otherwise the dofs stay ordered by variable */
+  void SetInterleavedDofOrdering(const bool &value = true) {
+    _interleavedDofOrderingIsEnabled = value;
+  }
+
+  /** Do not allocate the matrix, _KK is left NULL and set by the owner to a matrix-free operator. Call it before InitPde */
+  void SetMatrixFree(const bool &value = true) {
+    _matrixFreeIsEnabled = value;
+  }
+
+  /** Number of interleaved variables, 1 if the dofs are ordered by variable */
+  unsigned GetBlockSize() const {
+    return _blockSize;
+  }
+
+  /** System dof of the i-th owned dof of the PDE variable kkindex_sol on the process isubdom */
+  unsigned GetKKDof(const unsigned &kkindex_sol, const unsigned &isubdom, const unsigned &i) const {
+    return (_blockSize == 1) ? KKoffset[kkindex_sol][isubdom] + i : KKoffset[0][isubdom] + i * _blockSize + kkindex_sol;
+  }
+
   /** To be Added */
   void DeletePde();
 
@@ -71,7 +100,27 @@ public:
 			
   unsigned GetSystemDof(const unsigned &soltype, const unsigned &kkindex_sol,
 			const unsigned &i, const unsigned &iel, const vector < vector <unsigned> > &otherKKoffset) const;
-			
+
+  /** Enable or disable the cache of the owned element to system dof map used by GetSystemDof */
+  void SetElementSystemDofCache(const bool &value = true);
+
+  /** Build the owned element to system dof cache, call it again after the mesh has been changed or repartitioned */
+  void BuildElementSystemDofCache();
+
+  /** Free the owned element to system dof cache */
+  void ClearElementSystemDofCache();
+
+  /** Return true if the owned element to system dof cache has been built */
+  bool ElementSystemDofCacheIsBuilt() const {
+    return _elementSystemDofOffset.size() != 0;
+  }
+
+  /** Return the contiguous system dofs of the owned element iel for the PDE variable kkindex_sol, requires the cache */
+  const unsigned* GetElementSystemDofs(const unsigned &kkindex_sol, const unsigned &iel) const;
+
+  /** Return the number of system dofs of the owned element iel for the PDE variable kkindex_sol, requires the cache */
+  unsigned GetElementSystemDofNumber(const unsigned &kkindex_sol, const unsigned &iel) const;
+
 
   /** To be Added */
   void SetResZero();
@@ -122,6 +171,26 @@ protected:
   const vector <NumericVector*> *_Bdc;       // size [SolPdeIndex]
   vector <bool> _SparsityPattern;            // size [SolPdeIndex]
 
+  bool _elementSystemDofCacheIsEnabled;
+  vector <unsigned> _elementSystemDof;       // size [sum of the element dofs of all the PDE variables]
+  vector <unsigned> _elementSystemDofOffset; // size [owned elements * SolPdeIndex + 1]
+
+  bool _sparsityPatternCSRIsEnabled;
+  vector <int> _csrRowOffset;                // size [owned_dofs + 1], freed after the matrix preallocation
+  vector <int> _csrColumn;                   // size [owned nonzeros]
+
+  bool _interleavedDofOrderingIsEnabled;
+  unsigned _blockSize;
+
+  bool _matrixFreeIsEnabled;
+
+private:
+
+  /** Unsorted columns, with repetitions, of the row coupled through the (element, variable) pairs rowEntry */
+  void GetSparsityPatternRowColumns(const vector < unsigned > &rowOffset, const vector < unsigned > &rowEntry,
+                                    const vector < unsigned > &elementDofOffset, const vector < int > &elementDof,
+                                    const unsigned &row, vector < int > &columns) const;
+
 };
 
 } //end namespace femus
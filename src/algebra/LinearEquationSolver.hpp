@@ -96,6 +96,13 @@ namespace femus {
                               ) = 0;
 
       virtual void MGSolve(const bool ksp_clean) = 0;
+
+      /** Solve with the multigrid KSP already set up by MGSolve for all the right-hand sides RES, the corrections are
+       *  written in EPS */
+      virtual void MGMatSolve(std::vector < NumericVector* > &RES, std::vector < NumericVector* > &EPS) {
+        std::cout << "Warning MGMatSolve(...) is not available for this smoother\n";
+        abort();
+      }
       
       virtual void SetRichardsonScaleFactor(const double & richardsonScaleFactor) = 0; 
 
@@ -147,6 +147,89 @@ namespace femus {
     this->zero();
   }
 
+  void PetscMatrix::init_csr(const int m, const int n, const int m_l, const int n_l,
+                             const std::vector< int > &rowOffset, const std::vector< int > &columns) {
+    _m = m;
+    _n = n;
+    _m_l = m_l;
+    _n_l = n_l;
+
+    if(this->initialized())
+      this->clear();
+
+    this->_is_initialized = true;
+
+    int n_procs;
+    MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+    assert(rowOffset.size() == _m_l + 1);
+
+    // with the structure given, PETSc allocates the rows exactly and inserts the zeros once
+    int ierr = 0;
+    ierr = MatCreate(MPI_COMM_WORLD, &_mat);
+    CHKERRABORT(MPI_COMM_WORLD, ierr);
+    ierr = MatSetSizes(_mat, _m_l, _n_l, _m, _n);
+    CHKERRABORT(MPI_COMM_WORLD, ierr);
+    if(n_procs == 1) {
+      ierr = MatSetType(_mat, MATSEQAIJ);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      ierr = MatSetFromOptions(_mat);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      ierr = MatSeqAIJSetPreallocationCSR(_mat, &rowOffset[0], columns.data(), PETSC_NULL);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+    }
+    else {
+      parallel_only();
+      ierr = MatSetType(_mat, MATMPIAIJ);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      ierr = MatMPIAIJSetPreallocationCSR(_mat, &rowOffset[0], columns.data(), PETSC_NULL);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+    }
+    this->zero();
+  }
+
+  void PetscMatrix::init_blocked(const int m, const int n, const int m_l, const int n_l, const int blockSize,
+                                 const std::vector< int > &n_nz, const std::vector< int > &n_oz) {
+    _m = m;
+    _n = n;
+    _m_l = m_l;
+    _n_l = n_l;
+
+    if(this->initialized())
+      this->clear();
+
+    this->_is_initialized = true;
+    _blockSize = blockSize;
+
+    int n_procs;
+    MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+    assert(n_nz.size() * _blockSize == _m_l);
+
+    int ierr = 0;
+    ierr = MatCreate(MPI_COMM_WORLD, &_mat);
+    CHKERRABORT(MPI_COMM_WORLD, ierr);
+    ierr = MatSetSizes(_mat, _m_l, _n_l, _m, _n);
+    CHKERRABORT(MPI_COMM_WORLD, ierr);
+    if(n_procs == 1) {
+      ierr = MatSetType(_mat, MATSEQBAIJ);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      ierr = MatSetFromOptions(_mat);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      ierr = MatSeqBAIJSetPreallocation(_mat, _blockSize, 0, &n_nz[0]);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+    }
+    else {
+      parallel_only();
+      assert(n_oz.size() == n_nz.size());
+      ierr = MatSetType(_mat, MATMPIBAIJ);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      ierr = MatMPIBAIJSetPreallocation(_mat, _blockSize, 0, &n_nz[0], 0, &n_oz[0]);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+    }
+    this->zero();
+  }
+
 // =====================================0
   void PetscMatrix::update_sparsity_pattern(
     int m_global,                          // # global rows
@@ -379,6 +462,52 @@ namespace femus {
       CHKERRABORT(MPI_COMM_WORLD, ierr);
       this->_is_initialized = false;
     }
+    if(_aijOperand != NULL) {
+      ierr = MatDestroy(&_aijOperand);
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      _aijOperand = NULL;
+    }
+    _blockSize = 1;
+    _productRevision.resize(0);
+    _productNonzeroState.resize(0);
+    NewStructureRevision();
+  }
+
+  bool PetscMatrix::ProductOperandsAreUnchanged(const std::vector < const PetscMatrix* > &operands) const {
+    if(!this->initialized() || _productRevision.size() != operands.size()) return false;
+    for(unsigned i = 0; i < operands.size(); i++) {
+      PetscObjectState nonzeroState;
+      MatGetNonzeroState(operands[i]->_mat, &nonzeroState);
+      if(operands[i]->GetStructureRevision() != _productRevision[i] || nonzeroState != _productNonzeroState[i]) return false;
+    }
+    return true;
+  }
+
+  Mat PetscMatrix::GetAIJOperand(const PetscMatrix* operand, const bool &reuse) {
+    if(operand->_blockSize == 1) return operand->_mat;
+
+    int ierr;
+    if(reuse && _aijOperand != NULL) {
+      ierr = MatConvert(operand->_mat, MATAIJ, MAT_REUSE_MATRIX, &_aijOperand);
+    }
+    else {
+      if(_aijOperand != NULL) {
+        ierr = MatDestroy(&_aijOperand);
+        CHKERRABORT(MPI_COMM_WORLD, ierr);
+      }
+      ierr = MatConvert(operand->_mat, MATAIJ, MAT_INITIAL_MATRIX, &_aijOperand);
+    }
+    CHKERRABORT(MPI_COMM_WORLD, ierr);
+    return _aijOperand;
+  }
+
+  void PetscMatrix::SetProductOperands(const std::vector < const PetscMatrix* > &operands) {
+    _productRevision.resize(operands.size());
+    _productNonzeroState.resize(operands.size());
+    for(unsigned i = 0; i < operands.size(); i++) {
+      _productRevision[i] = operands[i]->GetStructureRevision();
+      MatGetNonzeroState(operands[i]->_mat, &_productNonzeroState[i]);
+    }
   }
 
 // ============================================
@@ -409,6 +538,15 @@ namespace femus {
     return value;
   }
 
+// ==========================================
+  double PetscMatrix::GetMemoryUsage() const {
+    if(!this->initialized()) return 0.;
+    MatInfo info;
+    int ierr = MatGetInfo(_mat, MAT_LOCAL, &info);
+    CHKERRABORT(MPI_COMM_WORLD, ierr);
+    return static_cast<double>(info.memory);
+  }
+
 // ===================================================
   void PetscMatrix::print_personal(
     std::ostream& os // pointer stream
@@ -644,6 +782,49 @@ void PetscMatrix::print_matlab(const std::string& name, const std::string& forma
     const  int n = (int)cols.size();
     assert(m * n == mat_values.size());
 
+    if(_blockSize > 1) {
+      // the local dofs are ordered by variable, rows[i + k * mb] = bs * I + k, with I the block row of the node i
+      const int bs = _blockSize;
+      const int mb = m / bs;
+      const int nb = n / bs;
+      bool blocked = (m % bs == 0 && n % bs == 0);
+      for(int i = 0; blocked && i < mb; i++) {
+        for(int k = 0; k < bs; k++) {
+          if(rows[i + k * mb] != rows[i] + k || rows[i] % bs != 0) blocked = false;
+        }
+      }
+      for(int j = 0; blocked && j < nb; j++) {
+        for(int k = 0; k < bs; k++) {
+          if(cols[j + k * nb] != cols[j] + k || cols[j] % bs != 0) blocked = false;
+        }
+      }
+
+      if(blocked) {
+        _blockRows.resize(mb);
+        _blockCols.resize(nb);
+        _blockValues.resize(m * n);
+        for(int i = 0; i < mb; i++) _blockRows[i] = rows[i] / bs;
+        for(int j = 0; j < nb; j++) _blockCols[j] = cols[j] / bs;
+        for(int ki = 0; ki < bs; ki++) {
+          for(int i = 0; i < mb; i++) {
+            const double *rowValues = &mat_values[(i + ki * mb) * n];
+            double *blockRowValues = &_blockValues[(i * bs + ki) * n];
+            for(int kj = 0; kj < bs; kj++) {
+              for(int j = 0; j < nb; j++) {
+                blockRowValues[j * bs + kj] = rowValues[j + kj * nb];
+              }
+            }
+          }
+        }
+        ierr = MatSetValuesBlocked(_mat, mb, &_blockRows[0], nb, &_blockCols[0], &_blockValues[0], ADD_VALUES);
+      }
+      else {
+        ierr = MatSetValues(_mat, m, &rows[0], n, &cols[0], (PetscScalar*) &mat_values[0], ADD_VALUES);
+      }
+      CHKERRABORT(MPI_COMM_WORLD, ierr);
+      return;
+    }
+
     //These casts are required for PETSc <= 2.1.5
     ierr = MatSetValuesBlocked(_mat, m, &rows[0], n, &cols[0],
                                (PetscScalar*) &mat_values[0], ADD_VALUES);
@@ -665,13 +846,22 @@ void PetscMatrix::print_matlab(const std::string& name, const std::string& forma
     P->close();
 
     int ierr = 0;
-    if(mat_reuse) {
-      ierr = MatPtAP(const_cast<PetscMatrix*>(A)->mat(), const_cast<PetscMatrix*>(P)->mat(), MAT_REUSE_MATRIX, 1.0, &_mat);
+    // the symbolic product is kept until P or A change structure (new level, AMR, new sparsity pattern)
+    std::vector < const PetscMatrix* > operands(2);
+    operands[0] = P;
+    operands[1] = A;
+    bool reuse = mat_reuse || ProductOperandsAreUnchanged(operands);
+    if(!reuse) this->clear();
+
+    // the products are implemented for AIJ matrices, a block matrix is converted first, and its copy is kept with the product
+    Mat matA = GetAIJOperand(A, reuse);
+    if(reuse) {
+      ierr = MatPtAP(matA, const_cast<PetscMatrix*>(P)->mat(), MAT_REUSE_MATRIX, 1.0, &_mat);
     }
     else {
-      this->clear();
-      ierr = MatPtAP(const_cast<PetscMatrix*>(A)->mat(), const_cast<PetscMatrix*>(P)->mat(), MAT_INITIAL_MATRIX , 1.0, &_mat);
+      ierr = MatPtAP(matA, const_cast<PetscMatrix*>(P)->mat(), MAT_INITIAL_MATRIX , 1.0, &_mat);
       this->_is_initialized = true;
+      SetProductOperands(operands);
     }
     CHKERRABORT(MPI_COMM_WORLD, ierr);
   }
@@ -690,15 +880,23 @@ void PetscMatrix::print_matlab(const std::string& name, const std::string& forma
     C->close();
 
     int ierr = 0;
-    if(mat_reuse) {
-      ierr = MatMatMatMult(const_cast<PetscMatrix*>(A)->mat(), const_cast<PetscMatrix*>(B)->mat(),
+    std::vector < const PetscMatrix* > operands(3);
+    operands[0] = A;
+    operands[1] = B;
+    operands[2] = C;
+    bool reuse = mat_reuse || ProductOperandsAreUnchanged(operands);
+    if(!reuse) this->clear();
+
+    Mat matB = GetAIJOperand(B, reuse);
+    if(reuse) {
+      ierr = MatMatMatMult(const_cast<PetscMatrix*>(A)->mat(), matB,
                            const_cast<PetscMatrix*>(C)->mat(), MAT_REUSE_MATRIX, 1.0, &_mat);
     }
     else {
-      this->clear();
-      ierr = MatMatMatMult(const_cast<PetscMatrix*>(A)->mat(), const_cast<PetscMatrix*>(B)->mat(),
+      ierr = MatMatMatMult(const_cast<PetscMatrix*>(A)->mat(), matB,
                            const_cast<PetscMatrix*>(C)->mat(), MAT_INITIAL_MATRIX, 1.0, &_mat);
       this->_is_initialized = true;
+      SetProductOperands(operands);
     }
     CHKERRABORT(MPI_COMM_WORLD, ierr);
   }
@@ -881,8 +1079,10 @@ void PetscMatrix::print_matlab(const std::string& name, const std::string& forma
     CHKERRABORT(MPI_COMM_WORLD, ierr);
 #else
     // FIXME - we can probably use MAT_REUSE_MATRIX in more situations
-    if(&petsc_dest == this)
+    if(&petsc_dest == this) {
       ierr = MatTranspose(_mat, MAT_REUSE_MATRIX, &petsc_dest._mat);
+      petsc_dest.NewStructureRevision();
+    }
     else
       ierr = MatTranspose(_mat, MAT_INITIAL_MATRIX, &petsc_dest._mat);
     CHKERRABORT(MPI_COMM_WORLD, ierr);
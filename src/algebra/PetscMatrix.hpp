@@ -73,6 +73,19 @@ private:
   // data ------------------------------------
   Mat _mat;                 ///< Petsc matrix pointer
   bool _destroy_mat_on_exit;///< Boolean value (false)
+  int _blockSize;           ///< block size of a BAIJ matrix, 1 for AIJ
+  std::vector < int > _blockRows, _blockCols;  ///< block indices used by add_matrix_blocked
+  std::vector < double > _blockValues;         ///< values reordered by blocks used by add_matrix_blocked
+  std::vector < unsigned long > _productRevision;        ///< structure revisions of the operands of the last product
+  std::vector < PetscObjectState > _productNonzeroState; ///< nonzero states of the operands of the last product
+  Mat _aijOperand;          ///< AIJ copy of the block operand of the last product, NULL if none
+
+  /** True if this matrix holds a product of operands with the same structure as the given ones */
+  bool ProductOperandsAreUnchanged(const std::vector < const PetscMatrix* > &operands) const;
+  void SetProductOperands(const std::vector < const PetscMatrix* > &operands);
+
+  /** The operand itself if it is AIJ, otherwise its AIJ copy, converted again in place if reuse is true */
+  Mat GetAIJOperand(const PetscMatrix* operand, const bool &reuse);
 
 public:
   // Constructor ---------------------------------------------------------
@@ -86,6 +99,10 @@ public:
             const int nnz=0, const int noz=0);
   void init( const  int m, const  int n, const  int m_l, const  int n_l,
 			const std::vector< int > & n_nz, const std::vector< int > & n_oz);
+  void init_csr(const int m, const int n, const int m_l, const int n_l,
+                const std::vector< int > &rowOffset, const std::vector< int > &columns);
+  void init_blocked(const int m, const int n, const int m_l, const int n_l, const int blockSize,
+                    const std::vector< int > &n_nz, const std::vector< int > &n_oz);
   
   void init (const int m,  const int n) {
     _m=m;
@@ -168,6 +185,8 @@ public:
   double l1_norm() const;
   /// Return the linfty-norm of the matrix
   double linfty_norm() const;
+  /// Return the memory in bytes allocated by this process for the matrix
+  double GetMemoryUsage() const;
 
   /// Petsc matrix has been closed and fully assembled
   bool closed() const;
@@ -209,10 +228,10 @@ protected:
 // ===============================================
 
 // ===============================================
-inline PetscMatrix::PetscMatrix()  : _destroy_mat_on_exit(true) {}
+inline PetscMatrix::PetscMatrix()  : _destroy_mat_on_exit(true), _blockSize(1), _aijOperand(NULL) {}
 
 // =================================================================
-inline PetscMatrix::PetscMatrix(Mat m): _destroy_mat_on_exit(false) {
+inline PetscMatrix::PetscMatrix(Mat m): _destroy_mat_on_exit(false), _blockSize(1), _aijOperand(NULL) {
   this->_mat = m;
   this->_is_initialized = true;
 }
@@ -424,6 +443,10 @@ inline void PetscMatrix::swap(
 ) {// =========================================
   std::swap(_mat, m._mat);
   std::swap(_destroy_mat_on_exit, m._destroy_mat_on_exit);
+  std::swap(_blockSize, m._blockSize);
+  std::swap(_structureRevision, m._structureRevision);
+  std::swap(_productRevision, m._productRevision);
+  std::swap(_productNonzeroState, m._productNonzeroState);
 }
 
 // =========================================================
@@ -28,6 +28,7 @@
 namespace femus
 {
 
+  unsigned long SparseMatrix::_structureRevisionCounter = 0;
 
 
 // ====================================================================
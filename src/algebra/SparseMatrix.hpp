@@ -49,7 +49,7 @@ class SparseMatrix {
 public:
 
     /** Constructor;  before usage call init(...). */
-    SparseMatrix():_is_initialized(false) {}
+    SparseMatrix():_is_initialized(false), _structureRevision(++_structureRevisionCounter) {}
 
     /** Destructor */
     virtual ~SparseMatrix () {}
@@ -57,6 +57,11 @@ public:
     /** Release all memory and return */
     virtual void clear () = 0;
 
+    /** Revision of the nonzero structure: it changes every time the matrix is created again and it is never shared by two matrices */
+    unsigned long GetStructureRevision() const {
+      return _structureRevision;
+    }
+
     /** Builds a \p SparseMatrix using the linear solver package specified by \p solver_package */
     static std::unique_ptr<SparseMatrix>  build(const SolverPackage solver_package = LSOLVER);
 
@@ -71,6 +76,12 @@ public:
     /** To be Added */
     virtual void init( const  int m, const  int n, const  int m_l, const  int n_l,
 		       const std::vector< int > & n_nz, const std::vector< int > & n_oz) = 0;
+    /** Initialize with the exact structure of the local rows in CSR format, with global column indices */
+    virtual void init_csr(const int m, const int n, const int m_l, const int n_l,
+                          const std::vector< int > &rowOffset, const std::vector< int > &columns) = 0;
+    /** Initialize in block format, with the number of nonzero blocks per local block row */
+    virtual void init_blocked(const int m, const int n, const int m_l, const int n_l, const int blockSize,
+                              const std::vector< int > &n_nz, const std::vector< int > &n_oz) = 0;
     /** To be Added */
     virtual void init (const int  m,  const int  n) {
         _m=m;  ///< Initialize  matrix  with dims
@@ -170,10 +181,11 @@ public:
     /** To be Addded */
     virtual void matrix_add (const double a_in, SparseMatrix &X_in, const char pattern []) = 0;
 
-    /** To be Addded */
+    /** this = P^T A P. With reuse the symbolic product of the previous call is reused; it is also reused when P and A
+     *  have kept the structure of the previous call, see GetStructureRevision */
     virtual void matrix_PtAP(const SparseMatrix &mat_P, const SparseMatrix &mat_A, const bool &reuse) = 0;
 
-    /** To be Addded */
+    /** this = A B C, with the same reuse of matrix_PtAP */
     virtual void matrix_ABC(const SparseMatrix &mat_A,const SparseMatrix &mat_B, const SparseMatrix &mat_C, const bool &reuse) = 0;
 
     /** To be Addded */
@@ -200,6 +212,11 @@ public:
     /** Return the linfty-norm */
     virtual double linfty_norm () const = 0;
 
+    /** Return the memory in bytes allocated by this process for the matrix */
+    virtual double GetMemoryUsage () const {
+      return 0.;
+    }
+
     /** Multiplies the matrix with \p arg and stores the result in \p dest. */
     void vector_mult (NumericVector& dest,const NumericVector& arg) const;
 
@@ -288,6 +305,14 @@ protected:
     /** Flag indicating whether or not the matrix has been initialized. */
     bool _is_initialized;
 
+    /** To be called every time the matrix is created again with a possibly different structure */
+    void NewStructureRevision() {
+      _structureRevision = ++_structureRevisionCounter;
+    }
+
+    unsigned long _structureRevision;
+    static unsigned long _structureRevisionCounter;
+
 };
 
 /**
@@ -0,0 +1,10 @@
+#ifndef __femus_enums_EnsembleTypeEnum_hpp__
+#define __femus_enums_EnsembleTypeEnum_hpp__
+
+enum EnsembleType {
+  ENSEMBLE_SHARED_OPERATOR = 0,
+  ENSEMBLE_MEAN_FIELD_PRECONDITIONER
+};
+
+
+#endif
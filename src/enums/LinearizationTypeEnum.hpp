@@ -0,0 +1,11 @@
+#ifndef __femus_enums_LinearizationTypeEnum_hpp__
+#define __femus_enums_LinearizationTypeEnum_hpp__
+
+enum  LinearizationType {
+  STOKES = 0,
+  PICARD,
+  NEWTON
+};
+
+
+#endif
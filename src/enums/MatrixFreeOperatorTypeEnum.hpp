@@ -0,0 +1,10 @@
+#ifndef __femus_enums_MatrixFreeOperatorTypeEnum_hpp__
+#define __femus_enums_MatrixFreeOperatorTypeEnum_hpp__
+
+enum  MatrixFreeOperatorType {
+  MATRIX_FREE_LAPLACIAN = 0,
+  MATRIX_FREE_LINEAR_ELASTICITY
+};
+
+
+#endif
@@ -0,0 +1,676 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: AssemblyKernels
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "AssemblyKernels.hpp"
+#include "MultiLevelProblem.hpp"
+#include "LinearImplicitSystem.hpp"
+#include "LinearEquationSolver.hpp"
+#include "SparseMatrix.hpp"
+#include "NumericVector.hpp"
+#include "ElemType.hpp"
+#include "ElemTypeTemplate.hpp"
+#include "ThreadedAssembly.hpp"
+#include <cstdlib>
+#include <functional>
+
+namespace femus {
+
+  //BEGIN Gauss point kernels
+
+  void LaplacianKernel(const unsigned &dim, const std::vector < double > &phi, const std::vector < double > &phi_x,
+                       const std::vector < double > &gradSol, const double &nu, const double &f, const double &weight,
+                       std::vector < double > &Res, std::vector < double > &Jac) {
+
+    const unsigned nDofs = phi.size();
+
+    for(unsigned i = 0; i < nDofs; i++) {
+      double laplace = 0.;
+      for(unsigned k = 0; k < dim; k++) {
+        laplace += phi_x[i * dim + k] * gradSol[k];
+      }
+      Res[i] += (f * phi[i] - nu * laplace) * weight;
+
+      for(unsigned j = 0; j < nDofs; j++) {
+        laplace = 0.;
+        for(unsigned k = 0; k < dim; k++) {
+          laplace += phi_x[i * dim + k] * phi_x[j * dim + k];
+        }
+        Jac[i * nDofs + j] += nu * laplace * weight;
+      }
+    }
+  }
+
+  void ConvectionDiffusionKernel(const unsigned &dim, const std::vector < double > &phi, const std::vector < double > &phi_x,
+                                 const std::vector < double > &gradSol, const std::vector < double > &a,
+                                 const double &nu, const double &f, const double &weight,
+                                 std::vector < double > &Res, std::vector < double > &Jac) {
+
+    const unsigned nDofs = phi.size();
+
+    double advection = 0.;
+    for(unsigned k = 0; k < dim; k++) {
+      advection += a[k] * gradSol[k];
+    }
+
+    for(unsigned i = 0; i < nDofs; i++) {
+      double laplace = 0.;
+      for(unsigned k = 0; k < dim; k++) {
+        laplace += phi_x[i * dim + k] * gradSol[k];
+      }
+      Res[i] += ((f - advection) * phi[i] - nu * laplace) * weight;
+
+      for(unsigned j = 0; j < nDofs; j++) {
+        laplace = 0.;
+        double advectionj = 0.;
+        for(unsigned k = 0; k < dim; k++) {
+          laplace += phi_x[i * dim + k] * phi_x[j * dim + k];
+          advectionj += a[k] * phi_x[j * dim + k];
+        }
+        Jac[i * nDofs + j] += (nu * laplace + phi[i] * advectionj) * weight;
+      }
+    }
+  }
+
+  void NavierStokesKernel(const unsigned &dim, const std::vector < double > &phiV, const std::vector < double > &phiV_x,
+                          const double *phiP, const unsigned &nDofsP,
+                          const std::vector < double > &solV, const std::vector < double > &gradSolV, const double &solP,
+                          const double &nu, const std::vector < double > &bodyForce, const LinearizationType &linearization,
+                          const double &weight, std::vector < double > &Res, std::vector < double > &Jac) {
+
+    const unsigned nDofsV = phiV.size();
+    const unsigned nDofsVP = dim * nDofsV + nDofsP;
+    const bool convection = (linearization != STOKES);
+    const bool newton = (linearization == NEWTON);
+    const bool force = (bodyForce.size() == dim);
+
+    double divergence = 0.;
+    double convectionV[3] = {0., 0., 0.};
+    for(unsigned k = 0; k < dim; k++) {
+      divergence += gradSolV[k * dim + k];
+      for(unsigned j = 0; j < dim; j++) {
+        convectionV[k] += solV[j] * gradSolV[k * dim + j];
+      }
+    }
+
+    // momentum rows
+    for(unsigned i = 0; i < nDofsV; i++) {
+      for(unsigned k = 0; k < dim; k++) {
+        double NSV = - solP * phiV_x[i * dim + k];
+        for(unsigned j = 0; j < dim; j++) {
+          NSV += nu * phiV_x[i * dim + j] * (gradSolV[k * dim + j] + gradSolV[j * dim + k]);
+        }
+        if(convection) NSV += phiV[i] * convectionV[k];
+        if(force) NSV -= bodyForce[k] * phiV[i];
+        Res[k * nDofsV + i] -= NSV * weight;
+      }
+
+      for(unsigned j = 0; j < nDofsV; j++) {
+        double laplace = 0.;
+        double advection = 0.;
+        for(unsigned m = 0; m < dim; m++) {
+          laplace += phiV_x[i * dim + m] * phiV_x[j * dim + m];
+          advection += solV[m] * phiV_x[j * dim + m];
+        }
+        double diagonal = nu * laplace + ((convection) ? phiV[i] * advection : 0.);
+        double phiVij = phiV[i] * phiV[j];
+
+        for(unsigned k = 0; k < dim; k++) {
+          unsigned irow = (k * nDofsV + i) * nDofsVP;
+          for(unsigned l = 0; l < dim; l++) {
+            double value = nu * phiV_x[i * dim + l] * phiV_x[j * dim + k];
+            if(k == l) value += diagonal;
+            if(newton) value += phiVij * gradSolV[k * dim + l];
+            Jac[irow + l * nDofsV + j] += value * weight;
+          }
+        }
+      }
+
+      for(unsigned j = 0; j < nDofsP; j++) {
+        for(unsigned k = 0; k < dim; k++) {
+          Jac[(k * nDofsV + i) * nDofsVP + dim * nDofsV + j] -= phiV_x[i * dim + k] * phiP[j] * weight;
+        }
+      }
+    }
+
+    // continuity rows
+    for(unsigned i = 0; i < nDofsP; i++) {
+      Res[dim * nDofsV + i] += divergence * phiP[i] * weight;
+
+      unsigned irow = (dim * nDofsV + i) * nDofsVP;
+      for(unsigned j = 0; j < nDofsV; j++) {
+        for(unsigned l = 0; l < dim; l++) {
+          Jac[irow + l * nDofsV + j] -= phiP[i] * phiV_x[j * dim + l] * weight;
+        }
+      }
+    }
+  }
+
+  void LinearElasticityKernel(const unsigned &dim, const std::vector < double > &phi, const std::vector < double > &phi_x,
+                              const std::vector < double > &gradSolD, const double &lambda, const double &mu,
+                              const std::vector < double > &bodyForce, const double &weight,
+                              std::vector < double > &Res, std::vector < double > &Jac) {
+
+    const unsigned nDofs = phi.size();
+    const unsigned nDofsD = dim * nDofs;
+    const bool force = (bodyForce.size() == dim);
+
+    double divergence = 0.;
+    for(unsigned k = 0; k < dim; k++) {
+      divergence += gradSolD[k * dim + k];
+    }
+
+    for(unsigned i = 0; i < nDofs; i++) {
+      for(unsigned k = 0; k < dim; k++) {
+        double stress = lambda * divergence * phi_x[i * dim + k];
+        for(unsigned j = 0; j < dim; j++) {
+          stress += mu * phi_x[i * dim + j] * (gradSolD[k * dim + j] + gradSolD[j * dim + k]);
+        }
+        if(force) stress -= bodyForce[k] * phi[i];
+        Res[k * nDofs + i] -= stress * weight;
+      }
+
+      for(unsigned j = 0; j < nDofs; j++) {
+        double laplace = 0.;
+        for(unsigned m = 0; m < dim; m++) {
+          laplace += phi_x[i * dim + m] * phi_x[j * dim + m];
+        }
+        for(unsigned k = 0; k < dim; k++) {
+          unsigned irow = (k * nDofs + i) * nDofsD;
+          for(unsigned l = 0; l < dim; l++) {
+            double value = lambda * phi_x[i * dim + k] * phi_x[j * dim + l] + mu * phi_x[i * dim + l] * phi_x[j * dim + k];
+            if(k == l) value += mu * laplace;
+            Jac[irow + l * nDofs + j] += value * weight;
+          }
+        }
+      }
+    }
+  }
+
+  //END Gauss point kernels
+
+  //BEGIN element loops
+
+  static void GetElementCoordinates(Mesh *msh, const unsigned &iel, std::vector < std::vector < double > > &coordX) {
+    const unsigned dim = msh->GetDimension();
+    const unsigned nDofsX = msh->GetElementDofNumber(iel, 2);
+    coordX.resize(dim);
+    for(unsigned k = 0; k < dim; k++) {
+      coordX[k].resize(nDofsX);
+    }
+    for(unsigned i = 0; i < nDofsX; i++) {
+      unsigned coordXDof = msh->GetSolutionDof(i, iel, 2);
+      for(unsigned k = 0; k < dim; k++) {
+        coordX[k][i] = (*msh->_topology->_Sol[k])(coordXDof);
+      }
+    }
+  }
+
+  /** Laplacian of one element with the specialized kernel of ElemTypeTemplate, so that all the loops have static bounds.
+   * It adds to Res and Jac the same terms as LaplacianKernel */
+  struct LaplacianElementBlock {
+
+    LaplacianElementBlock(const std::vector < std::vector < double > > &coordX, const std::vector < double > &solu,
+                          const elem_type *feX, const double &nu, AssemblySourceFunction source,
+                          std::vector < double > &x, std::vector < double > &Res, std::vector < double > &Jac) :
+      _coordX(coordX), _solu(solu), _feX(feX), _nu(nu), _source(source), _x(x), _Res(Res), _Jac(Jac) {
+    }
+
+    template < class FeT >
+    void operator()(const FeT &feT) {
+
+      const unsigned dim = FeT::Dim;
+      const unsigned nDofs = FeT::NDofs;
+      const unsigned nDofsX = _coordX[0].size();
+
+      // the solution dofs are the first nodes of the coordinate element
+      typename FeT::template Coordinates < double > vt;
+      for(unsigned k = 0; k < dim; k++) {
+        for(unsigned i = 0; i < nDofs; i++) {
+          vt[k][i] = _coordX[k][i];
+        }
+      }
+
+      typename FeT::template Gradient < double > phi_x;
+      double weight;
+
+      for(unsigned ig = 0; ig < FeT::NGauss; ig++) {
+        feT.Jacobian(vt, ig, weight, phi_x);
+        const double *phi = feT.GetPhi(ig);
+
+        double gradSolu[FeT::Dim] = {};
+        for(unsigned i = 0; i < nDofs; i++) {
+          for(unsigned k = 0; k < dim; k++) {
+            gradSolu[k] += phi_x[i * dim + k] * _solu[i];
+          }
+        }
+
+        double f = 0.;
+        if(_source != NULL) {
+          const double *phiX = _feX->GetPhi(ig);
+          std::fill(_x.begin(), _x.end(), 0.);
+          for(unsigned i = 0; i < nDofsX; i++) {
+            for(unsigned k = 0; k < dim; k++) {
+              _x[k] += phiX[i] * _coordX[k][i];
+            }
+          }
+          f = _source(_x);
+        }
+
+        for(unsigned i = 0; i < nDofs; i++) {
+          double laplace = 0.;
+          for(unsigned k = 0; k < dim; k++) {
+            laplace += phi_x[i * dim + k] * gradSolu[k];
+          }
+          _Res[i] += (f * phi[i] - _nu * laplace) * weight;
+
+          for(unsigned j = 0; j < nDofs; j++) {
+            laplace = 0.;
+            for(unsigned k = 0; k < dim; k++) {
+              laplace += phi_x[i * dim + k] * phi_x[j * dim + k];
+            }
+            _Jac[i * nDofs + j] += _nu * laplace * weight;
+          }
+        }
+      }
+    }
+
+    const std::vector < std::vector < double > > &_coordX;
+    const std::vector < double > &_solu;
+    const elem_type *_feX;
+    const double &_nu;
+    AssemblySourceFunction _source;
+    std::vector < double > &_x;
+    std::vector < double > &_Res;
+    std::vector < double > &_Jac;
+  };
+
+  /** Laplacian over the owned elements of the geometry ielGeom, with the specialized kernel selected once for all of them
+   * by DispatchElemTypeTemplate. prepare gathers the data of the element iel for the thread ithread and returns its
+   * LaplacianElementBlock, add inserts its residual and Jacobian */
+  struct LaplacianGroupBlock {
+
+    typedef std::function < LaplacianElementBlock (const unsigned &iel, const unsigned &ithread) > PrepareFunction;
+
+    LaplacianGroupBlock(ThreadedAssembly &threads, Mesh *msh, const short unsigned &ielGeom, const PrepareFunction &prepare,
+                        const ThreadedAssembly::ElementFunction &add) :
+      _threads(threads), _msh(msh), _ielGeom(ielGeom), _prepare(prepare), _add(add) {
+    }
+
+    template < class FeT >
+    void operator()(const FeT &feT) {
+      _threads.Run(_msh, [&](const unsigned & iel, const unsigned & ithread) {
+        if(_msh->GetElementType(iel) != _ielGeom) return;
+        LaplacianElementBlock element = _prepare(iel, ithread);
+        element(feT);
+        _add(iel, ithread);
+      });
+    }
+
+    ThreadedAssembly &_threads;
+    Mesh *_msh;
+    short unsigned _ielGeom;
+    const PrepareFunction &_prepare;
+    const ThreadedAssembly::ElementFunction &_add;
+  };
+
+  static void AssembleScalarProblem(MultiLevelProblem &ml_prob, const std::string &systemName, const std::string &solName,
+                                    const std::vector < std::string > &velocityNames, const double &nu,
+                                    AssemblySourceFunction source) {
+
+    LinearImplicitSystem* mlPdeSys = &ml_prob.get_system<LinearImplicitSystem> (systemName);
+    const unsigned level = mlPdeSys->GetLevelToAssemble();
+
+    Mesh* msh = ml_prob._ml_msh->GetLevel(level);
+    MultiLevelSolution* mlSol = ml_prob._ml_sol;
+    Solution* sol = ml_prob._ml_sol->GetSolutionLevel(level);
+
+    LinearEquationSolver* pdeSys = mlPdeSys->_LinSolver[level];
+    // with a matrix-free finest level only the residual is assembled there
+    SparseMatrix* KK = mlPdeSys->GetAssembleMatrix() ? pdeSys->_KK : NULL;
+    NumericVector* RES = pdeSys->_RES;
+
+    const unsigned dim = msh->GetDimension();
+    const bool convection = !velocityNames.empty();
+
+    if(convection && velocityNames.size() < dim) {
+      std::cout << "Error in AssembleConvectionDiffusion: " << dim << " velocity components are required" << std::endl;
+      abort();
+    }
+
+    unsigned solIndex = mlSol->GetIndex(solName.c_str());
+    unsigned solType = mlSol->GetSolutionType(solIndex);
+    unsigned solPdeIndex = mlPdeSys->GetSolPdeIndex(solName.c_str());
+
+    std::vector < unsigned > solAIndex(dim);
+    unsigned solAType = solType;
+    if(convection) {
+      for(unsigned k = 0; k < dim; k++) {
+        solAIndex[k] = mlSol->GetIndex(velocityNames[k].c_str());
+      }
+      solAType = mlSol->GetSolutionType(solAIndex[0]);
+    }
+
+    struct LocalData {
+      std::vector < double > solu;
+      std::vector < std::vector < double > > solA;
+      std::vector < std::vector < double > > coordX;
+      std::vector < double > phi, phi_x, phi_xx;
+      std::vector < double > gradSolu, a, x;
+      std::vector < int > sysDof;
+      std::vector < double > Res;
+      std::vector < double > Jac;
+    };
+
+    ThreadedAssembly serial;
+    ThreadedAssembly &threads = (mlPdeSys->GetThreadedAssembly() != NULL) ? *mlPdeSys->GetThreadedAssembly() : serial;
+    std::vector < LocalData > local(threads.GetNumberOfThreads());
+    for(unsigned t = 0; t < local.size(); t++) {
+      local[t].solA.resize(dim);
+      local[t].gradSolu.resize(dim);
+      local[t].a.resize(dim);
+      local[t].x.resize(dim);
+    }
+
+    ThreadedAssembly::PrepareSolution(sol);
+    if(KK != NULL) KK->zero();
+
+    // the element data of the thread ithread
+    ThreadedAssembly::ElementFunction prepare = [&](const unsigned & iel, const unsigned & ithread) {
+
+      LocalData &l = local[ithread];
+
+      unsigned nDofs = msh->GetElementDofNumber(iel, solType);
+
+      l.solu.resize(nDofs);
+      l.sysDof.resize(nDofs);
+      for(unsigned i = 0; i < nDofs; i++) {
+        unsigned solDof = msh->GetSolutionDof(i, iel, solType);
+        l.solu[i] = (*sol->_Sol[solIndex])(solDof);
+        l.sysDof[i] = pdeSys->GetSystemDof(solIndex, solPdeIndex, i, iel);
+      }
+
+      if(convection) {
+        unsigned nDofsA = msh->GetElementDofNumber(iel, solAType);
+        for(unsigned k = 0; k < dim; k++) {
+          l.solA[k].resize(nDofsA);
+        }
+        for(unsigned i = 0; i < nDofsA; i++) {
+          unsigned solADof = msh->GetSolutionDof(i, iel, solAType);
+          for(unsigned k = 0; k < dim; k++) {
+            l.solA[k][i] = (*sol->_Sol[solAIndex[k]])(solADof);
+          }
+        }
+      }
+
+      GetElementCoordinates(msh, iel, l.coordX);
+
+      l.Res.assign(nDofs, 0.);
+      l.Jac.assign(nDofs * nDofs, 0.);
+    };
+
+    ThreadedAssembly::ElementFunction add = [&](const unsigned &, const unsigned & ithread) {
+      LocalData &l = local[ithread];
+      threads.AddElementResidualAndJacobian(RES, KK, l.Res, l.Jac, l.sysDof, ithread);
+    };
+
+    // the Hex and Quad elements of the Laplacian go through the kernels with static sizes, selected once for each geometry
+    bool generic[6] = {true, true, true, true, true, true};
+    if(!convection) {
+      bool present[6] = {false, false, false, false, false, false};
+      for(unsigned iel = msh->_elementOffset[msh->processor_id()]; iel < msh->_elementOffset[msh->processor_id() + 1]; iel++) {
+        present[msh->GetElementType(iel)] = true;
+      }
+
+      LaplacianGroupBlock::PrepareFunction prepareLaplacian = [&](const unsigned & iel, const unsigned & ithread) {
+        prepare(iel, ithread);
+        LocalData &l = local[ithread];
+        return LaplacianElementBlock(l.coordX, l.solu, msh->_finiteElement[msh->GetElementType(iel)][2], nu, source,
+                                     l.x, l.Res, l.Jac);
+      };
+
+      for(short unsigned ielGeom = 0; ielGeom < 6; ielGeom++) {
+        if(present[ielGeom]) {
+          LaplacianGroupBlock block(threads, msh, ielGeom, prepareLaplacian, add);
+          generic[ielGeom] = !DispatchElemTypeTemplate(*msh->_finiteElement[ielGeom][solType], ielGeom, solType, block);
+        }
+      }
+    }
+
+    // all the other elements go through the virtual elem_type API
+    threads.Run(msh, [&](const unsigned & iel, const unsigned & ithread) {
+
+      short unsigned ielGeom = msh->GetElementType(iel);
+      if(!generic[ielGeom]) return;
+
+      prepare(iel, ithread);
+
+      LocalData &l = local[ithread];
+      double weight;
+
+      unsigned nDofs = l.solu.size();
+      unsigned nDofsA = (convection) ? l.solA[0].size() : 0;
+      unsigned nDofsX = l.coordX[0].size();
+
+      for(unsigned ig = 0; ig < msh->_finiteElement[ielGeom][solType]->GetGaussPointNumber(); ig++) {
+        msh->_finiteElement[ielGeom][solType]->Jacobian(l.coordX, ig, weight, l.phi, l.phi_x, l.phi_xx);
+
+        std::fill(l.gradSolu.begin(), l.gradSolu.end(), 0.);
+        for(unsigned i = 0; i < nDofs; i++) {
+          for(unsigned k = 0; k < dim; k++) {
+            l.gradSolu[k] += l.phi_x[i * dim + k] * l.solu[i];
+          }
+        }
+
+        double f = 0.;
+        if(source != NULL) {
+          const double *phiX = msh->_finiteElement[ielGeom][2]->GetPhi(ig);
+          std::fill(l.x.begin(), l.x.end(), 0.);
+          for(unsigned i = 0; i < nDofsX; i++) {
+            for(unsigned k = 0; k < dim; k++) {
+              l.x[k] += phiX[i] * l.coordX[k][i];
+            }
+          }
+          f = source(l.x);
+        }
+
+        if(convection) {
+          const double *phiA = msh->_finiteElement[ielGeom][solAType]->GetPhi(ig);
+          std::fill(l.a.begin(), l.a.end(), 0.);
+          for(unsigned i = 0; i < nDofsA; i++) {
+            for(unsigned k = 0; k < dim; k++) {
+              l.a[k] += phiA[i] * l.solA[k][i];
+            }
+          }
+          ConvectionDiffusionKernel(dim, l.phi, l.phi_x, l.gradSolu, l.a, nu, f, weight, l.Res, l.Jac);
+        }
+        else {
+          LaplacianKernel(dim, l.phi, l.phi_x, l.gradSolu, nu, f, weight, l.Res, l.Jac);
+        }
+      }
+
+      add(iel, ithread);
+    });
+
+    RES->close();
+    if(KK != NULL) KK->close();
+  }
+
+  /** Vector problems with dim components of the same FE type, followed by the pressure if pressureName is not empty */
+  static void AssembleVectorProblem(MultiLevelProblem &ml_prob, const std::string &systemName,
+                                    const std::vector < std::string > &solVNames, const std::string &pressureName,
+                                    const double &nu, const LinearizationType &linearization,
+                                    const double &lambda, const double &mu, const std::vector < double > &bodyForce) {
+
+    LinearImplicitSystem* mlPdeSys = &ml_prob.get_system<LinearImplicitSystem> (systemName);
+    const unsigned level = mlPdeSys->GetLevelToAssemble();
+
+    Mesh* msh = ml_prob._ml_msh->GetLevel(level);
+    MultiLevelSolution* mlSol = ml_prob._ml_sol;
+    Solution* sol = ml_prob._ml_sol->GetSolutionLevel(level);
+
+    LinearEquationSolver* pdeSys = mlPdeSys->_LinSolver[level];
+    // with a matrix-free finest level only the residual is assembled there
+    SparseMatrix* KK = mlPdeSys->GetAssembleMatrix() ? pdeSys->_KK : NULL;
+    NumericVector* RES = pdeSys->_RES;
+
+    const unsigned dim = msh->GetDimension();
+    const bool pressure = !pressureName.empty();
+
+    if(solVNames.size() < dim) {
+      std::cout << "Error in " << ((pressure) ? "AssembleNavierStokes" : "AssembleLinearElasticity")
+                << ": " << dim << " components are required" << std::endl;
+      abort();
+    }
+
+    std::vector < unsigned > solVIndex(dim);
+    std::vector < unsigned > solVPdeIndex(dim);
+    for(unsigned k = 0; k < dim; k++) {
+      solVIndex[k] = mlSol->GetIndex(solVNames[k].c_str());
+      solVPdeIndex[k] = mlPdeSys->GetSolPdeIndex(solVNames[k].c_str());
+    }
+    unsigned solVType = mlSol->GetSolutionType(solVIndex[0]);
+
+    unsigned solPIndex = 0;
+    unsigned solPPdeIndex = 0;
+    unsigned solPType = 0;
+    if(pressure) {
+      solPIndex = mlSol->GetIndex(pressureName.c_str());
+      solPPdeIndex = mlPdeSys->GetSolPdeIndex(pressureName.c_str());
+      solPType = mlSol->GetSolutionType(solPIndex);
+    }
+
+    struct LocalData {
+      std::vector < std::vector < double > > solV;
+      std::vector < double > solP;
+      std::vector < std::vector < double > > coordX;
+      std::vector < double > phiV, phiV_x, phiV_xx;
+      std::vector < double > solV_gss, gradSolV_gss;
+      std::vector < int > sysDof;
+      std::vector < double > Res;
+      std::vector < double > Jac;
+    };
+
+    ThreadedAssembly serial;
+    ThreadedAssembly &threads = (mlPdeSys->GetThreadedAssembly() != NULL) ? *mlPdeSys->GetThreadedAssembly() : serial;
+    std::vector < LocalData > local(threads.GetNumberOfThreads());
+    for(unsigned t = 0; t < local.size(); t++) {
+      local[t].solV.resize(dim);
+      local[t].solV_gss.resize(dim);
+      local[t].gradSolV_gss.resize(dim * dim);
+    }
+
+    ThreadedAssembly::PrepareSolution(sol);
+    if(KK != NULL) KK->zero();
+
+    threads.Run(msh, [&](const unsigned & iel, const unsigned & ithread) {
+
+      LocalData &l = local[ithread];
+      double weight;
+
+      short unsigned ielGeom = msh->GetElementType(iel);
+      unsigned nDofsV = msh->GetElementDofNumber(iel, solVType);
+      unsigned nDofsP = (pressure) ? msh->GetElementDofNumber(iel, solPType) : 0;
+      unsigned nDofsVP = dim * nDofsV + nDofsP;
+
+      l.sysDof.resize(nDofsVP);
+      for(unsigned k = 0; k < dim; k++) {
+        l.solV[k].resize(nDofsV);
+      }
+      l.solP.resize(nDofsP);
+
+      for(unsigned i = 0; i < nDofsV; i++) {
+        unsigned solVDof = msh->GetSolutionDof(i, iel, solVType);
+        for(unsigned k = 0; k < dim; k++) {
+          l.solV[k][i] = (*sol->_Sol[solVIndex[k]])(solVDof);
+          l.sysDof[i + k * nDofsV] = pdeSys->GetSystemDof(solVIndex[k], solVPdeIndex[k], i, iel);
+        }
+      }
+
+      for(unsigned i = 0; i < nDofsP; i++) {
+        unsigned solPDof = msh->GetSolutionDof(i, iel, solPType);
+        l.solP[i] = (*sol->_Sol[solPIndex])(solPDof);
+        l.sysDof[i + dim * nDofsV] = pdeSys->GetSystemDof(solPIndex, solPPdeIndex, i, iel);
+      }
+
+      GetElementCoordinates(msh, iel, l.coordX);
+
+      l.Res.assign(nDofsVP, 0.);
+      l.Jac.assign(nDofsVP * nDofsVP, 0.);
+
+      for(unsigned ig = 0; ig < msh->_finiteElement[ielGeom][solVType]->GetGaussPointNumber(); ig++) {
+        msh->_finiteElement[ielGeom][solVType]->Jacobian(l.coordX, ig, weight, l.phiV, l.phiV_x, l.phiV_xx);
+
+        std::fill(l.solV_gss.begin(), l.solV_gss.end(), 0.);
+        std::fill(l.gradSolV_gss.begin(), l.gradSolV_gss.end(), 0.);
+        for(unsigned i = 0; i < nDofsV; i++) {
+          for(unsigned k = 0; k < dim; k++) {
+            l.solV_gss[k] += l.phiV[i] * l.solV[k][i];
+            for(unsigned j = 0; j < dim; j++) {
+              l.gradSolV_gss[k * dim + j] += l.phiV_x[i * dim + j] * l.solV[k][i];
+            }
+          }
+        }
+
+        if(pressure) {
+          const double *phiP = msh->_finiteElement[ielGeom][solPType]->GetPhi(ig);
+          double solP_gss = 0.;
+          for(unsigned i = 0; i < nDofsP; i++) {
+            solP_gss += phiP[i] * l.solP[i];
+          }
+          NavierStokesKernel(dim, l.phiV, l.phiV_x, phiP, nDofsP, l.solV_gss, l.gradSolV_gss, solP_gss,
+                             nu, bodyForce, linearization, weight, l.Res, l.Jac);
+        }
+        else {
+          LinearElasticityKernel(dim, l.phiV, l.phiV_x, l.gradSolV_gss, lambda, mu, bodyForce, weight, l.Res, l.Jac);
+        }
+      }
+
+      threads.AddElementResidualAndJacobian(RES, KK, l.Res, l.Jac, l.sysDof, ithread);
+    });
+
+    RES->close();
+    if(KK != NULL) KK->close();
+  }
+
+  //END element loops
+
+  void AssembleLaplacian(MultiLevelProblem &ml_prob, const std::string &systemName, const std::string &solName,
+                         const double &nu, AssemblySourceFunction source) {
+    AssembleScalarProblem(ml_prob, systemName, solName, std::vector < std::string > (), nu, source);
+  }
+
+  void AssembleConvectionDiffusion(MultiLevelProblem &ml_prob, const std::string &systemName, const std::string &solName,
+                                   const std::vector < std::string > &velocityNames, const double &nu,
+                                   AssemblySourceFunction source) {
+    AssembleScalarProblem(ml_prob, systemName, solName, velocityNames, nu, source);
+  }
+
+  void AssembleNavierStokes(MultiLevelProblem &ml_prob, const std::string &systemName,
+                            const std::vector < std::string > &velocityNames, const std::string &pressureName,
+                            const double &nu, const LinearizationType &linearization,
+                            const std::vector < double > &bodyForce) {
+    AssembleVectorProblem(ml_prob, systemName, velocityNames, pressureName, nu, linearization, 0., 0., bodyForce);
+  }
+
+  void AssembleLinearElasticity(MultiLevelProblem &ml_prob, const std::string &systemName,
+                                const std::vector < std::string > &displacementNames, const double &lambda, const double &mu,
+                                const std::vector < double > &bodyForce) {
+    AssembleVectorProblem(ml_prob, systemName, displacementNames, "", 0., STOKES, lambda, mu, bodyForce);
+  }
+
+}
@@ -0,0 +1,95 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: AssemblyKernels
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_equations_AssemblyKernels_hpp__
+#define __femus_equations_AssemblyKernels_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "LinearizationTypeEnum.hpp"
+#include <vector>
+#include <string>
+
+namespace femus {
+
+  class MultiLevelProblem;
+
+  /**
+   * Assembly of common operators with hand-coded Jacobians, as an alternative to recording an adept tape per element.
+   * Every kernel follows the Newton convention of the applications: the residual Res = - F(u) and the Jacobian Jac = dF/du,
+   * so that Jac w = Res and u = u0 + w. Linear problems are assembled in the same way, then one iteration gives the solution.
+   *
+   * The Gauss point kernels add weight times their contribution to the local Res and Jac (row-major), with the local dofs
+   * ordered in blocks by variable, as sysDof[i + k * nDofs] in the applications. The Assemble* functions loop over the owned
+   * elements of the level to assemble; since the assemble function of a system has the signature void (MultiLevelProblem &),
+   * an application sets them through a short wrapper, e.g.
+   *
+   *   void AssembleNS(MultiLevelProblem& ml_prob) {
+   *     AssembleNavierStokes(ml_prob, "NS", velocityNames, "P", nu, NEWTON);
+   *   }
+   *
+   * The element loops run on the thread pool of the system, see LinearImplicitSystem::SetNumberOfAssemblyThreads.
+   */
+
+  /** Source term, evaluated at the Gauss point coordinates x */
+  typedef double (*AssemblySourceFunction)(const std::vector < double > &x);
+
+  /** -nu Laplace(u) = f, with one dof block */
+  void LaplacianKernel(const unsigned &dim, const std::vector < double > &phi, const std::vector < double > &phi_x,
+                       const std::vector < double > &gradSol, const double &nu, const double &f, const double &weight,
+                       std::vector < double > &Res, std::vector < double > &Jac);
+
+  /** -nu Laplace(u) + a . grad(u) = f, with a given (not differentiated) advection field a */
+  void ConvectionDiffusionKernel(const unsigned &dim, const std::vector < double > &phi, const std::vector < double > &phi_x,
+                                 const std::vector < double > &gradSol, const std::vector < double > &a,
+                                 const double &nu, const double &f, const double &weight,
+                                 std::vector < double > &Res, std::vector < double > &Jac);
+
+  /** Stokes / Navier-Stokes with the stress form of the viscous term, dim velocity blocks and one pressure block.
+   * gradSolV is [k * dim + j] = d V_k / d x_j. With PICARD the residual is exact and the Jacobian keeps only the
+   * frozen-velocity convection, with STOKES the convection is dropped */
+  void NavierStokesKernel(const unsigned &dim, const std::vector < double > &phiV, const std::vector < double > &phiV_x,
+                          const double *phiP, const unsigned &nDofsP,
+                          const std::vector < double > &solV, const std::vector < double > &gradSolV, const double &solP,
+                          const double &nu, const std::vector < double > &bodyForce, const LinearizationType &linearization,
+                          const double &weight, std::vector < double > &Res, std::vector < double > &Jac);
+
+  /** Linear elasticity with Lame coefficients lambda and mu, dim displacement blocks */
+  void LinearElasticityKernel(const unsigned &dim, const std::vector < double > &phi, const std::vector < double > &phi_x,
+                              const std::vector < double > &gradSolD, const double &lambda, const double &mu,
+                              const std::vector < double > &bodyForce, const double &weight,
+                              std::vector < double > &Res, std::vector < double > &Jac);
+
+  void AssembleLaplacian(MultiLevelProblem &ml_prob, const std::string &systemName, const std::string &solName,
+                         const double &nu, AssemblySourceFunction source = NULL);
+
+  /** The advection field is read from the solutions velocityNames, which are not differentiated */
+  void AssembleConvectionDiffusion(MultiLevelProblem &ml_prob, const std::string &systemName, const std::string &solName,
+                                   const std::vector < std::string > &velocityNames, const double &nu,
+                                   AssemblySourceFunction source = NULL);
+
+  void AssembleNavierStokes(MultiLevelProblem &ml_prob, const std::string &systemName,
+                            const std::vector < std::string > &velocityNames, const std::string &pressureName,
+                            const double &nu, const LinearizationType &linearization,
+                            const std::vector < double > &bodyForce = std::vector < double > ());
+
+  void AssembleLinearElasticity(MultiLevelProblem &ml_prob, const std::string &systemName,
+                                const std::vector < std::string > &displacementNames, const double &lambda, const double &mu,
+                                const std::vector < double > &bodyForce = std::vector < double > ());
+
+} //end namespace femus
+
+#endif
@@ -0,0 +1,473 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: CovarianceOperator
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "CovarianceOperator.hpp"
+#include "LinearImplicitSystem.hpp"
+#include "LinearEquationSolver.hpp"
+#include "MultiLevelProblem.hpp"
+#include "MultiLevelSolution.hpp"
+#include "Mesh.hpp"
+#include "ElemType.hpp"
+#include "NumericVector.hpp"
+#include "PetscVector.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace femus {
+
+  // maximum number of points in a leaf of the cluster trees
+  static const unsigned leafSize = 32;
+
+  static PetscErrorCode MatMultCovariance(Mat A, Vec x, Vec y) {
+    void *ctx;
+    MatShellGetContext(A, &ctx);
+    static_cast < CovarianceOperator* >(ctx)->Mult(x, y);
+    return 0;
+  }
+
+  CovarianceOperator::CovarianceOperator(LinearImplicitSystem *mlPdeSys, const unsigned &level, const char solName[],
+                                         CovarianceFunction covariance, const double &tolerance, const double &eta) {
+
+    _pdeSys = mlPdeSys->_LinSolver[level];
+    _covariance = covariance;
+    _tolerance = tolerance;
+    _eta = eta;
+    _dim = _pdeSys->_msh->GetDimension();
+
+    Setup(mlPdeSys, solName);
+
+    //BEGIN cluster trees and hierarchical kernel matrix
+    _rowPerm.resize(_gaussWeight.size());
+    for(unsigned i = 0; i < _rowPerm.size(); i++) _rowPerm[i] = i;
+    _colPerm.resize(_colPoint.size() / 3);
+    for(unsigned j = 0; j < _colPerm.size(); j++) _colPerm[j] = j;
+
+    _rowTree.resize(0);
+    _colTree.resize(0);
+    _block.resize(0);
+    _data.resize(0);
+
+    if(_rowPerm.size() > 0) {
+      BuildClusterTree(_rowPoint, _rowPerm, _rowTree, 0, _rowPerm.size());
+      BuildClusterTree(_colPoint, _colPerm, _colTree, 0, _colPerm.size());
+      BuildBlocks(0, 0);
+    }
+    //END
+
+    _g.resize(_rowPerm.size());
+    _gGlobal.resize(_colPerm.size());
+    _gPerm.resize(_colPerm.size());
+    _hPerm.resize(_rowPerm.size());
+
+    unsigned iproc = _pdeSys->processor_id();
+    unsigned nvar = _pdeSys->KKIndex.size() - 1u;
+    PetscInt ownedSize = _pdeSys->KKoffset[nvar][iproc] - _pdeSys->KKoffset[0][iproc];
+    PetscInt globalSize = _pdeSys->KKIndex[nvar];
+
+    MatCreateShell(PETSC_COMM_WORLD, ownedSize, ownedSize, globalSize, globalSize, this, &_mat);
+    MatShellSetOperation(_mat, MATOP_MULT, (void(*)(void)) MatMultCovariance);
+    MatSetOption(_mat, MAT_SYMMETRIC, PETSC_TRUE);
+  }
+
+  CovarianceOperator::~CovarianceOperator() {
+    MatDestroy(&_mat);
+    VecScatterDestroy(&_scatter);
+    VecDestroy(&_xLocal);
+    VecDestroy(&_yLocal);
+  }
+
+  void CovarianceOperator::Setup(LinearImplicitSystem *mlPdeSys, const char solName[]) {
+
+    Mesh *msh = _pdeSys->_msh;
+    MultiLevelSolution *mlSol = mlPdeSys->GetMLProb()._ml_sol;
+
+    const unsigned solIndex = mlSol->GetIndex(solName);
+    const unsigned solType = mlSol->GetSolutionType(solIndex);
+    const unsigned solPdeIndex = mlPdeSys->GetSolPdeIndex(solName);
+    const unsigned xType = 2;
+
+    const unsigned iproc = msh->processor_id();
+    const unsigned nprocs = msh->n_processors();
+
+    //BEGIN Gauss points of the owned elements
+    _rowPoint.resize(0);
+    _gaussWeight.resize(0);
+    _gaussPhi.resize(0);
+    _gaussDofOffset.assign(1, 0);
+    std::vector < PetscInt > globalDof;
+
+    // coordinates of the solution nodes in the JacobianBatch layout, the padding stays zero
+    std::vector < double > x;
+    std::vector < PetscInt > elementDof;
+    std::vector < double > weight;
+    elem_type::BatchWorkspace batchWork;
+
+    for(unsigned iel = msh->_elementOffset[iproc]; iel < msh->_elementOffset[iproc + 1]; iel++) {
+
+      short unsigned ielGeom = msh->GetElementType(iel);
+      unsigned nDofs  = msh->GetElementDofNumber(iel, solType);
+
+      elementDof.resize(nDofs);
+      for(unsigned i = 0; i < nDofs; i++) {
+        elementDof[i] = _pdeSys->GetSystemDof(solIndex, solPdeIndex, i, iel);
+      }
+
+      const elem_type *fe = msh->_finiteElement[ielGeom][solType];
+      const unsigned ncPadded = fe->GetPaddedDofNumber();
+      const unsigned nGauss = fe->GetGaussPointNumber();
+
+      // the solution dofs are the first nodes of the coordinate element
+      x.assign(_dim * ncPadded, 0.);
+      for(unsigned i = 0; i < nDofs; i++) {
+        unsigned xDof  = msh->GetSolutionDof(i, iel, xType);
+        for(unsigned k = 0; k < _dim; k++) {
+          x[k * ncPadded + i] = (*msh->_topology->_Sol[k])(xDof);
+        }
+      }
+
+      weight.resize(nGauss);
+      fe->JacobianBatch(&x[0], 1, &weight[0], NULL, batchWork);
+
+      for(unsigned ig = 0; ig < nGauss; ig++) {
+        const double *phi = fe->GetPhi(ig);
+
+        double xg[3] = {0., 0., 0.};
+        for(unsigned i = 0; i < nDofs; i++) {
+          for(unsigned k = 0; k < _dim; k++) {
+            xg[k] += x[k * ncPadded + i] * phi[i];
+          }
+        }
+        _rowPoint.insert(_rowPoint.end(), xg, xg + 3);
+        _gaussWeight.push_back(weight[ig]);
+
+        for(unsigned i = 0; i < nDofs; i++) {
+          _gaussPhi.push_back(phi[i]);
+          globalDof.push_back(elementDof[i]);
+        }
+        _gaussDofOffset.push_back(globalDof.size());
+      }
+    }
+    //END
+
+    //BEGIN all the Gauss points
+    int nLocal = _gaussWeight.size();
+    _gaussCount.resize(nprocs);
+    _gaussOffset.resize(nprocs + 1);
+    MPI_Allgather(&nLocal, 1, MPI_INT, &_gaussCount[0], 1, MPI_INT, MPI_COMM_WORLD);
+
+    _gaussOffset[0] = 0;
+    for(unsigned jproc = 0; jproc < nprocs; jproc++) {
+      _gaussOffset[jproc + 1] = _gaussOffset[jproc] + _gaussCount[jproc];
+    }
+
+    std::vector < int > pointCount(nprocs), pointOffset(nprocs);
+    for(unsigned jproc = 0; jproc < nprocs; jproc++) {
+      pointCount[jproc] = 3 * _gaussCount[jproc];
+      pointOffset[jproc] = 3 * _gaussOffset[jproc];
+    }
+    _colPoint.resize(3 * _gaussOffset[nprocs]);
+    MPI_Allgatherv(_rowPoint.data(), 3 * nLocal, MPI_DOUBLE, _colPoint.data(), &pointCount[0], &pointOffset[0], MPI_DOUBLE,
+                   MPI_COMM_WORLD);
+    //END
+
+    //BEGIN local work vectors and scatter
+    std::vector < PetscInt > localDof(globalDof);
+    std::sort(localDof.begin(), localDof.end());
+    localDof.erase(std::unique(localDof.begin(), localDof.end()), localDof.end());
+
+    _gaussDof.resize(globalDof.size());
+    for(unsigned i = 0; i < globalDof.size(); i++) {
+      _gaussDof[i] = std::lower_bound(localDof.begin(), localDof.end(), globalDof[i]) - localDof.begin();
+    }
+
+    IS isFrom, isTo;
+    ISCreateGeneral(PETSC_COMM_SELF, localDof.size(), localDof.data(), PETSC_COPY_VALUES, &isFrom);
+    ISCreateStride(PETSC_COMM_SELF, localDof.size(), 0, 1, &isTo);
+    VecCreateSeq(PETSC_COMM_SELF, localDof.size(), &_xLocal);
+    VecDuplicate(_xLocal, &_yLocal);
+    VecScatterCreate((static_cast < PetscVector* >(_pdeSys->_EPS))->vec(), isFrom, _xLocal, isTo, &_scatter);
+    ISDestroy(&isFrom);
+    ISDestroy(&isTo);
+    //END
+  }
+
+  void CovarianceOperator::BuildClusterTree(const std::vector < double > &point, std::vector < unsigned > &perm,
+                                            std::vector < Cluster > &tree, const unsigned &begin, const unsigned &end) {
+
+    Cluster cluster;
+    cluster.begin = begin;
+    cluster.end = end;
+    cluster.child[0] = cluster.child[1] = -1;
+    for(unsigned k = 0; k < 3; k++) {
+      cluster.min[k] = cluster.max[k] = point[3 * perm[begin] + k];
+    }
+    for(unsigned i = begin + 1; i < end; i++) {
+      for(unsigned k = 0; k < 3; k++) {
+        cluster.min[k] = std::min(cluster.min[k], point[3 * perm[i] + k]);
+        cluster.max[k] = std::max(cluster.max[k], point[3 * perm[i] + k]);
+      }
+    }
+
+    unsigned index = tree.size();
+    tree.push_back(cluster);
+
+    if(end - begin > leafSize) {
+      unsigned d = 0;
+      for(unsigned k = 1; k < 3; k++) {
+        if(cluster.max[k] - cluster.min[k] > cluster.max[d] - cluster.min[d]) d = k;
+      }
+      unsigned middle = (begin + end) / 2;
+      std::nth_element(perm.begin() + begin, perm.begin() + middle, perm.begin() + end,
+      [&point, d](const unsigned & a, const unsigned & b) {
+        return point[3 * a + d] < point[3 * b + d];
+      });
+
+      // the reference to tree[index] may be invalid after push_back
+      int child0 = tree.size();
+      BuildClusterTree(point, perm, tree, begin, middle);
+      int child1 = tree.size();
+      BuildClusterTree(point, perm, tree, middle, end);
+      tree[index].child[0] = child0;
+      tree[index].child[1] = child1;
+    }
+  }
+
+  void CovarianceOperator::BuildBlocks(const unsigned &rowCluster, const unsigned &colCluster) {
+
+    const Cluster &row = _rowTree[rowCluster];
+    const Cluster &col = _colTree[colCluster];
+
+    double rowDiam2 = 0., colDiam2 = 0., dist2 = 0.;
+    for(unsigned k = 0; k < 3; k++) {
+      rowDiam2 += (row.max[k] - row.min[k]) * (row.max[k] - row.min[k]);
+      colDiam2 += (col.max[k] - col.min[k]) * (col.max[k] - col.min[k]);
+      double gap = std::max(0., std::max(row.min[k] - col.max[k], col.min[k] - row.max[k]));
+      dist2 += gap * gap;
+    }
+
+    Block block;
+    block.rowBegin = row.begin;
+    block.rowEnd = row.end;
+    block.colBegin = col.begin;
+    block.colEnd = col.end;
+    block.rank = 0;
+    block.offset = _data.size();
+
+    bool admissible = (dist2 > 0. && std::min(rowDiam2, colDiam2) <= _eta * _eta * dist2);
+
+    if(admissible && AdaptiveCrossApproximation(block)) {
+      _block.push_back(block);
+    }
+    else if(admissible || (row.child[0] < 0 && col.child[0] < 0)) {
+      block.lowRank = false;
+      _data.resize(block.offset);
+      for(unsigned i = block.rowBegin; i < block.rowEnd; i++) {
+        for(unsigned j = block.colBegin; j < block.colEnd; j++) {
+          _data.push_back(Kernel(i, j));
+        }
+      }
+      _block.push_back(block);
+    }
+    else if(row.child[0] < 0) {
+      int child[2] = {col.child[0], col.child[1]};
+      BuildBlocks(rowCluster, child[0]);
+      BuildBlocks(rowCluster, child[1]);
+    }
+    else if(col.child[0] < 0) {
+      int child[2] = {row.child[0], row.child[1]};
+      BuildBlocks(child[0], colCluster);
+      BuildBlocks(child[1], colCluster);
+    }
+    else {
+      int rowChild[2] = {row.child[0], row.child[1]};
+      int colChild[2] = {col.child[0], col.child[1]};
+      for(unsigned i = 0; i < 2; i++) {
+        for(unsigned j = 0; j < 2; j++) {
+          BuildBlocks(rowChild[i], colChild[j]);
+        }
+      }
+    }
+  }
+
+  bool CovarianceOperator::AdaptiveCrossApproximation(Block &block) {
+
+    const unsigned m = block.rowEnd - block.rowBegin;
+    const unsigned n = block.colEnd - block.colBegin;
+
+    // a larger rank does not save memory with respect to the dense block
+    const unsigned maxRank = (m * n) / (m + n);
+
+    std::vector < double > U, V;
+    std::vector < double > u(m), v(n);
+    std::vector < bool > usedRow(m, false);
+
+    unsigned rank = 0;
+    unsigned pivotRow = 0;
+    double norm2 = 0.;
+    bool converged = false;
+
+    while(!converged && rank < maxRank) {
+
+      usedRow[pivotRow] = true;
+
+      // residual row
+      unsigned pivotCol = 0;
+      for(unsigned j = 0; j < n; j++) {
+        v[j] = Kernel(block.rowBegin + pivotRow, block.colBegin + j);
+        for(unsigned l = 0; l < rank; l++) {
+          v[j] -= U[l * m + pivotRow] * V[l * n + j];
+        }
+        if(fabs(v[j]) > fabs(v[pivotCol])) pivotCol = j;
+      }
+
+      if(v[pivotCol] != 0.) {
+        double pivot = v[pivotCol];
+        for(unsigned j = 0; j < n; j++) {
+          v[j] /= pivot;
+        }
+
+        // residual column
+        for(unsigned i = 0; i < m; i++) {
+          u[i] = Kernel(block.rowBegin + i, block.colBegin + pivotCol);
+          for(unsigned l = 0; l < rank; l++) {
+            u[i] -= U[l * m + i] * V[l * n + pivotCol];
+          }
+        }
+
+        // Frobenius norm of the approximation, updated with the new cross
+        double uu = 0., vv = 0., cross = 0.;
+        for(unsigned i = 0; i < m; i++) uu += u[i] * u[i];
+        for(unsigned j = 0; j < n; j++) vv += v[j] * v[j];
+        for(unsigned l = 0; l < rank; l++) {
+          double ul = 0., vl = 0.;
+          for(unsigned i = 0; i < m; i++) ul += U[l * m + i] * u[i];
+          for(unsigned j = 0; j < n; j++) vl += V[l * n + j] * v[j];
+          cross += ul * vl;
+        }
+        norm2 += uu * vv + 2. * cross;
+
+        U.insert(U.end(), u.begin(), u.end());
+        V.insert(V.end(), v.begin(), v.end());
+        rank++;
+
+        converged = (sqrt(uu * vv) <= _tolerance * sqrt(fabs(norm2)));
+      }
+
+      // next pivot row, the unused row with the largest entry in the last column
+      int next = -1;
+      for(unsigned i = 0; i < m; i++) {
+        if(!usedRow[i] && (next < 0 || (v[pivotCol] != 0. && fabs(u[i]) > fabs(u[next])))) next = i;
+      }
+      if(next < 0) {
+        converged = true;
+      }
+      else {
+        pivotRow = next;
+      }
+    }
+
+    if(!converged) return false;
+
+    block.lowRank = true;
+    block.rank = rank;
+    block.offset = _data.size();
+    _data.insert(_data.end(), U.begin(), U.end());
+    _data.insert(_data.end(), V.begin(), V.end());
+    return true;
+  }
+
+  void CovarianceOperator::Mult(Vec x, Vec y) {
+
+    VecScatterBegin(_scatter, x, _xLocal, INSERT_VALUES, SCATTER_FORWARD);
+    VecScatterEnd(_scatter, x, _xLocal, INSERT_VALUES, SCATTER_FORWARD);
+
+    // weighted values at the owned Gauss points, g = W Phi x
+    const PetscScalar *xLocal;
+    VecGetArrayRead(_xLocal, &xLocal);
+    for(unsigned q = 0; q < _g.size(); q++) {
+      double value = 0.;
+      for(unsigned k = _gaussDofOffset[q]; k < _gaussDofOffset[q + 1]; k++) {
+        value += _gaussPhi[k] * xLocal[_gaussDof[k]];
+      }
+      _g[q] = _gaussWeight[q] * value;
+    }
+    VecRestoreArrayRead(_xLocal, &xLocal);
+
+    MPI_Allgatherv(_g.data(), _g.size(), MPI_DOUBLE, _gGlobal.data(), &_gaussCount[0], &_gaussOffset[0], MPI_DOUBLE,
+                   MPI_COMM_WORLD);
+    for(unsigned j = 0; j < _gPerm.size(); j++) {
+      _gPerm[j] = _gGlobal[_colPerm[j]];
+    }
+
+    // h = K g, on the owned rows
+    std::fill(_hPerm.begin(), _hPerm.end(), 0.);
+    for(unsigned b = 0; b < _block.size(); b++) {
+      const Block &block = _block[b];
+      const unsigned m = block.rowEnd - block.rowBegin;
+      const unsigned n = block.colEnd - block.colBegin;
+      const double *g = &_gPerm[block.colBegin];
+      double *h = &_hPerm[block.rowBegin];
+
+      if(block.lowRank) {
+        const double *U = &_data[block.offset];
+        const double *V = U + block.rank * m;
+        _work.resize(block.rank);
+        for(unsigned l = 0; l < block.rank; l++) {
+          double value = 0.;
+          for(unsigned j = 0; j < n; j++) value += V[l * n + j] * g[j];
+          _work[l] = value;
+        }
+        for(unsigned l = 0; l < block.rank; l++) {
+          for(unsigned i = 0; i < m; i++) h[i] += U[l * m + i] * _work[l];
+        }
+      }
+      else {
+        const double *D = &_data[block.offset];
+        for(unsigned i = 0; i < m; i++) {
+          double value = 0.;
+          for(unsigned j = 0; j < n; j++) value += D[i * n + j] * g[j];
+          h[i] += value;
+        }
+      }
+    }
+
+    // y = Phi^T W h
+    VecSet(_yLocal, 0.);
+    PetscScalar *yLocal;
+    VecGetArray(_yLocal, &yLocal);
+    for(unsigned i = 0; i < _rowPerm.size(); i++) {
+      unsigned q = _rowPerm[i];
+      double value = _gaussWeight[q] * _hPerm[i];
+      for(unsigned k = _gaussDofOffset[q]; k < _gaussDofOffset[q + 1]; k++) {
+        yLocal[_gaussDof[k]] += _gaussPhi[k] * value;
+      }
+    }
+    VecRestoreArray(_yLocal, &yLocal);
+
+    VecSet(y, 0.);
+    VecScatterBegin(_scatter, _yLocal, y, ADD_VALUES, SCATTER_REVERSE);
+    VecScatterEnd(_scatter, _yLocal, y, ADD_VALUES, SCATTER_REVERSE);
+  }
+
+  double CovarianceOperator::GetCompressionRatio() const {
+    double dense = static_cast < double >(_rowPerm.size()) * _colPerm.size();
+    return (dense > 0.) ? _data.size() / dense : 1.;
+  }
+
+} //end namespace femus
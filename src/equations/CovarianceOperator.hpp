@@ -0,0 +1,120 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: CovarianceOperator
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_equations_CovarianceOperator_hpp__
+#define __femus_equations_CovarianceOperator_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include <vector>
+#include <petscmat.h>
+
+namespace femus {
+
+  class LinearImplicitSystem;
+  class LinearEquationSolver;
+
+  /**
+   * Covariance operator C_ij = int int phi_i(x) c(x, y) phi_j(y) dx dy of one variable of a LinearImplicitSystem level,
+   * wrapped in a PETSc MATSHELL for the Karhunen-Loeve eigenproblem, so that the dense matrix is never stored.
+   * The operator is factored as Phi^T W K W Phi: Phi and W interpolate the dofs at the Gauss points of the owned elements,
+   * and the kernel matrix K = c(x_p, x_q) between the owned and all the Gauss points is compressed as a hierarchical matrix.
+   * The blocks between well separated clusters, min(diam) <= eta dist, are approximated by adaptive cross approximation
+   * with relative tolerance, the others are stored dense.
+   * The kernel has to be asymptotically smooth away from x = y, as the exponential and Gaussian covariances.
+   */
+  class CovarianceOperator {
+    public:
+
+      typedef double (*CovarianceFunction)(const double *x, const double *y, const unsigned &dim);
+
+      CovarianceOperator(LinearImplicitSystem *mlPdeSys, const unsigned &level, const char solName[],
+                         CovarianceFunction covariance, const double &tolerance = 1.e-6, const double &eta = 2.);
+
+      ~CovarianceOperator();
+
+      /** The MATSHELL of the operator, owned by this object */
+      Mat GetMat() {
+        return _mat;
+      }
+
+      /** y = C x */
+      void Mult(Vec x, Vec y);
+
+      /** Stored doubles of the kernel blocks over the size of the dense kernel rows of this process */
+      double GetCompressionRatio() const;
+
+    private:
+
+      struct Cluster {
+        unsigned begin, end;  // range in the permutation
+        double min[3], max[3]; // bounding box
+        int child[2];
+      };
+
+      struct Block {
+        unsigned rowBegin, rowEnd, colBegin, colEnd;
+        bool lowRank;
+        unsigned rank;
+        unsigned long offset; // dense rows, or U^T (rank x rows) followed by V (rank x cols), in _data
+      };
+
+      /** Gauss points, weights, shape functions and element dofs of the owned elements, and all the Gauss points */
+      void Setup(LinearImplicitSystem *mlPdeSys, const char solName[]);
+
+      /** Recursive bisection of the points along the longest side of their bounding box */
+      static void BuildClusterTree(const std::vector < double > &point, std::vector < unsigned > &perm,
+                                   std::vector < Cluster > &tree, const unsigned &begin, const unsigned &end);
+
+      void BuildBlocks(const unsigned &rowCluster, const unsigned &colCluster);
+
+      /** Cross approximation of the block, false if the rank is too large to save memory */
+      bool AdaptiveCrossApproximation(Block &block);
+
+      double Kernel(const unsigned &i, const unsigned &j) const {
+        return _covariance(&_rowPoint[3 * _rowPerm[i]], &_colPoint[3 * _colPerm[j]], _dim);
+      }
+
+      LinearEquationSolver *_pdeSys;
+      CovarianceFunction _covariance;
+      double _tolerance;
+      double _eta;
+      unsigned _dim;
+
+      std::vector < double > _rowPoint;       // owned Gauss points, [3 * q + d]
+      std::vector < double > _colPoint;       // all the Gauss points, ordered by process
+      std::vector < unsigned > _rowPerm, _colPerm;
+      std::vector < Cluster > _rowTree, _colTree;
+      std::vector < int > _gaussCount, _gaussOffset;
+
+      std::vector < double > _gaussWeight;
+      std::vector < unsigned > _gaussDofOffset;  // the dofs of the Gauss point q are [_gaussDofOffset[q], _gaussDofOffset[q + 1])
+      std::vector < PetscInt > _gaussDof;        // index in the local work vectors
+      std::vector < double > _gaussPhi;
+
+      std::vector < Block > _block;
+      std::vector < double > _data;
+
+      Mat _mat;
+      Vec _xLocal, _yLocal;
+      VecScatter _scatter;
+
+      std::vector < double > _g, _gGlobal, _gPerm, _hPerm, _work;
+  };
+
+} //end namespace femus
+
+#endif
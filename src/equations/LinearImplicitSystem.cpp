@@ -18,6 +18,10 @@
 #include "SparseMatrix.hpp"
 #include "NumericVector.hpp"
 #include "ElemType.hpp"
+#include "MatrixFreeOperator.hpp"
+#include "ThreadedAssembly.hpp"
+#include "PetscMatrix.hpp"
+#include "Profiler.hpp"
 #include <iomanip>
 
 namespace femus {
@@ -43,12 +47,28 @@ namespace femus {
     _MGmatrixFineReuse(false),
     _MGmatrixCoarseReuse(false),
     _printSolverInfo(false),
-    _assembleMatrix(true) {
+    _assembleMatrix(true),
+    _elementSystemDofCache(false),
+    _sparsityPatternCSR(false),
+    _interleavedDofOrdering(false),
+    _matrixFree(false),
+    _matrixFreeType(MATRIX_FREE_LAPLACIAN),
+    _matrixFreeOperator(NULL),
+    _threadedAssembly(NULL) {
         
     _SparsityPattern.resize(0);
     _outer_ksp_solver = "gmres";
     _totalAssemblyTime = 0.;
     _totalSolverTime =0.;
+    // the defaults of GmresPetscLinearEquationSolver, until SetTolerances is called
+    _rtol = 1.e-5;
+    _atol = 1.e-50;
+    _divtol = 1.e+5;
+    _maxits = 1000;
+    _restart = 30;
+    _ensembleBatchSize = 16;
+    _ensembleGroup = 0;
+    _ensembleNumberOfGroups = 1;
     
   }
 
@@ -56,6 +76,14 @@ namespace femus {
 
   LinearImplicitSystem::~LinearImplicitSystem() {
     this->clear();
+    delete _threadedAssembly;
+  }
+
+  // ********************************************
+
+  void LinearImplicitSystem::SetNumberOfAssemblyThreads(const unsigned &nThreads) {
+    delete _threadedAssembly;
+    _threadedAssembly = (nThreads > 1) ? new ThreadedAssembly(nThreads) : NULL;
   }
 
   // ********************************************
@@ -71,6 +99,12 @@ namespace femus {
       if(_RRamr[ig]) delete _RRamr[ig];
     }
 
+    // the finest _KK only wraps the shell matrix, which is destroyed here
+    if(_matrixFreeOperator) {
+      delete _matrixFreeOperator;
+      _matrixFreeOperator = NULL;
+    }
+
     _NSchurVar_test = 0;
     _numblock_test = 0;
     _numblock_all_test = 0;
@@ -93,6 +127,16 @@ namespace femus {
 
   // ********************************************
 
+  void LinearImplicitSystem::SetElementSystemDofCache(const bool &value) {
+    _elementSystemDofCache = value;
+
+    for(unsigned i = 0; i < _LinSolver.size(); i++) {
+      _LinSolver[i]->SetElementSystemDofCache(_elementSystemDofCache);
+    }
+  }
+
+  // ********************************************
+
   void LinearImplicitSystem::init() {
 
     _LinSolver.resize(_gridn);
@@ -103,11 +147,36 @@ namespace femus {
       _LinSolver[i] = LinearEquationSolver::build(i, _solution[i], _SmootherType).release();
     }
 
+    // the field split index sets are built on the dofs ordered by variable
+    bool interleavedDofOrdering = _interleavedDofOrdering && _SmootherType != FIELDSPLIT_SMOOTHER;
+
+    bool matrixFree = _matrixFree;
+    if(matrixFree) {
+      bool homogeneous = true;
+      for(unsigned i = 0; i < _gridn; i++) {
+        if(!_ml_msh->GetLevel(i)->GetIfHomogeneous()) homogeneous = false;
+      }
+      if(_SmootherType != GMRES_SMOOTHER || _gridn < 2 || !homogeneous) {
+        std::cout << "Warning: the matrix-free operator requires the gmres smoother, at least two levels and no AMR, "
+                  << "the finest matrix is assembled" << std::endl;
+        matrixFree = false;
+      }
+    }
+
     for(unsigned i = 0; i < _gridn; i++) {
+      _LinSolver[i]->SetElementSystemDofCache(_elementSystemDofCache);
+      _LinSolver[i]->SetSparsityPatternCSR(_sparsityPatternCSR);
+      _LinSolver[i]->SetInterleavedDofOrdering(interleavedDofOrdering);
+      _LinSolver[i]->SetMatrixFree(matrixFree && i == _gridn - 1u);
       _LinSolver[i]->InitPde(_SolSystemPdeIndex, _ml_sol->GetSolType(),
                              _ml_sol->GetSolName(), &_solution[i]->_Bdc, _gridn, _SparsityPattern);
     }
 
+    if(matrixFree) {
+      _matrixFreeOperator = new MatrixFreeOperator(this, _gridn - 1u, _matrixFreeType, _matrixFreeCoefficients);
+      _LinSolver[_gridn - 1u]->_KK = new PetscMatrix(_matrixFreeOperator->GetMat());
+    }
+
     _PP.resize(_gridn);
     _RR.resize(_gridn);
     for(unsigned i = 0; i < _gridn; i++) {
@@ -156,7 +225,8 @@ namespace femus {
 
     _bitFlipCounter = 0;
     
-    clock_t start_mg_time = clock();
+    Profiler::Start("LinearSolve");
+    double start_mg_time = Profiler::GetWallTime();
 
     unsigned grid0;
 
@@ -183,16 +253,18 @@ namespace femus {
 restart:
       if(ThisIsAMR) _solution[igridn]->InitAMREps();
 
-      clock_t start_preparation_time = clock();
+      double start_preparation_time = Profiler::GetWallTime();
 
       _levelToAssemble = igridn; //Be carefull!!!! this is needed in the _assemble_function
       _LinSolver[igridn]->SetResZero();
       _assembleMatrix = true;
-      clock_t start_assembly_time = clock();
+      double start_assembly_time = Profiler::GetWallTime();
+      Profiler::Start("Assembly");
       _assemble_system_function(_equation_systems);
-      std::cout << std::endl << " ****** Level Max " << igridn + 1 << " ASSEMBLY TIME:\t" << static_cast<double>((clock() - start_assembly_time)) / CLOCKS_PER_SEC << std::endl;  
-      
+      Profiler::Stop();
+      std::cout << std::endl << " ****** Level Max " << igridn + 1 << " ASSEMBLY TIME:\t" << (Profiler::GetWallTime() - start_assembly_time) << std::endl;  
       
+      Profiler::Start("MGProjectionMatrices");
       if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
         if(!_RRamr[igridn]) {
           (_LinSolver[igridn]->_RESC)->matrix_mult_transpose(*_LinSolver[igridn]->_RES, *_PPamr[igridn]);
@@ -211,34 +283,13 @@ restart:
 
       _MGmatrixFineReuse = false;
       _MGmatrixCoarseReuse = (igridn - grid0 > 0) ?  true : _MGmatrixFineReuse;
-      for(unsigned i = igridn; i > 0; i--) {
-        if(_RR[i]) {
-          if(i == igridn)
-            _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixFineReuse);
-          else {
-            _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixCoarseReuse);
-            if(_LinSolver[i - 1u]->_KKamr) {
-              delete _LinSolver[i - 1u]->_KKamr;
-              _LinSolver[i - 1u]->_KKamr = NULL;
-            }
-          }
-        }
-        else {
-          if(i == igridn)
-            _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixFineReuse);
-          else {
-            _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixCoarseReuse);
-            if(_LinSolver[i - 1u]->_KKamr) {
-              delete _LinSolver[i - 1u]->_KKamr;
-              _LinSolver[i - 1u]->_KKamr = NULL;
-            }
-          }
-        }
-      }
+      BuildCoarseLevelMatrices(igridn);
+      Profiler::Stop();
 
-      std::cout << std::endl << " ****** Level Max " << igridn + 1 << " PREPARATION TIME:\t" << static_cast<double>((clock() - start_preparation_time)) / CLOCKS_PER_SEC << std::endl;
+      std::cout << std::endl << " ****** Level Max " << igridn + 1 << " PREPARATION TIME:\t" << (Profiler::GetWallTime() - start_preparation_time) << std::endl;
 
       if(_MGsolver) {
+        Profiler::Start("MGSetup");
         _LinSolver[igridn]->MGInit(mgSmootherType, igridn + 1, _outer_ksp_solver.c_str());
 
         for(unsigned i = 0; i < igridn + 1; i++) {
@@ -247,6 +298,7 @@ restart:
           else
             _LinSolver[i]->MGSetLevel(_LinSolver[igridn], igridn, _VariablesToBeSolvedIndex, _PP[i], _PP[i], _npre, _npost);
         }
+        Profiler::Stop();
 
         MGVcycle(igridn, mgSmootherType);
 
@@ -271,10 +323,206 @@ restart:
     }
 
     std::cout << std::endl << " *** Linear " << _solverType << " TIME: " << std::setw(11) << std::setprecision(6) << std::fixed
-              << static_cast<double>((clock() - start_mg_time)) / CLOCKS_PER_SEC << std::endl;
+              << (Profiler::GetWallTime() - start_mg_time) << std::endl;
 	      
     _totalAssemblyTime += 0.;
-    _totalSolverTime += static_cast<double>((clock() - start_mg_time)) / CLOCKS_PER_SEC;     
+    _totalSolverTime += (Profiler::GetWallTime() - start_mg_time);     
+    Profiler::Stop();
+  }
+
+  // ********************************************
+
+  void LinearImplicitSystem::EnsembleSolve(const unsigned &numberOfSamples, EnsembleSampleFunction setSample,
+                                           EnsembleSampleFunction postSolve, const EnsembleType &ensembleType,
+                                           const MgSmootherType& mgSmootherType) {
+
+    ProfilerTimer timer("EnsembleSolve");
+    double start_ensemble_time = Profiler::GetWallTime();
+
+    _solverType = "MultiGrid";
+    _MLsolver = false;
+    _MGsolver = true;
+
+    const unsigned level = _gridn - 1u;
+    if(!_ml_msh->GetLevel(level)->GetIfHomogeneous()) {
+      std::cout << "Error in EnsembleSolve: AMR levels are not supported" << std::endl;
+      abort();
+    }
+
+    const unsigned first = (numberOfSamples * _ensembleGroup) / _ensembleNumberOfGroups;
+    const unsigned last = (numberOfSamples * (_ensembleGroup + 1u)) / _ensembleNumberOfGroups;
+    const bool sharedOperator = (ensembleType == ENSEMBLE_SHARED_OPERATOR);
+
+    std::cout << std::endl << " *** Start Ensemble of samples [" << first << ", " << last << ") ";
+    if(sharedOperator) std::cout << "with shared operator, batch size " << _ensembleBatchSize << " ***" << std::endl;
+    else std::cout << "with mean-field preconditioner ***" << std::endl;
+
+    if(first == last) return;
+
+    //BEGIN matrix and multigrid hierarchy, built once
+    setSample(_equation_systems, sharedOperator ? static_cast < int >(first) : -1);
+
+    _levelToAssemble = level;
+    _LinSolver[level]->SetResZero();
+    _assembleMatrix = true;
+    Profiler::Start("Assembly");
+    _assemble_system_function(_equation_systems);
+    Profiler::Stop();
+
+    Profiler::Start("MGProjectionMatrices");
+    _MGmatrixFineReuse = false;
+    _MGmatrixCoarseReuse = false;
+    BuildCoarseLevelMatrices(level);
+    Profiler::Stop();
+
+    Profiler::Start("MGSetup");
+    _LinSolver[level]->MGInit(mgSmootherType, level + 1, _outer_ksp_solver.c_str());
+    for(unsigned i = 0; i < level + 1; i++) {
+      if(_RR[i])
+        _LinSolver[i]->MGSetLevel(_LinSolver[level], level, _VariablesToBeSolvedIndex, _PP[i], _RR[i], _npre, _npost);
+      else
+        _LinSolver[i]->MGSetLevel(_LinSolver[level], level, _VariablesToBeSolvedIndex, _PP[i], _PP[i], _npre, _npost);
+    }
+    Profiler::Stop();
+    //END
+
+    if(!sharedOperator) {
+      // only the finest matrix changes, the coarse levels keep the mean field
+      for(unsigned sample = first; sample < last; sample++) {
+        setSample(_equation_systems, sample);
+        _LinSolver[level]->SetResZero();
+        _assembleMatrix = true;
+        Profiler::Start("Assembly");
+        _assemble_system_function(_equation_systems);
+        Profiler::Stop();
+        MGVcycle(level, mgSmootherType);
+        postSolve(_equation_systems, sample);
+      }
+    }
+    else {
+      // the first sample sets up the KSP
+      MGVcycle(level, mgSmootherType);
+      postSolve(_equation_systems, first);
+
+      // the residuals of a batch are computed from the same solution and solved together
+      std::vector < NumericVector* > sol0(_SolSystemPdeIndex.size());
+      for(unsigned k = 0; k < _SolSystemPdeIndex.size(); k++) {
+        sol0[k] = NumericVector::build().release();
+        sol0[k]->init(*_solution[level]->_Sol[_SolSystemPdeIndex[k]]);
+        *sol0[k] = *_solution[level]->_Sol[_SolSystemPdeIndex[k]];
+      }
+
+      std::vector < NumericVector* > RES, EPS;
+      RES.reserve(_ensembleBatchSize);
+      EPS.reserve(_ensembleBatchSize);
+
+      for(unsigned batchFirst = first + 1u; batchFirst < last; batchFirst += _ensembleBatchSize) {
+        unsigned batchSize = (last - batchFirst < _ensembleBatchSize) ? last - batchFirst : _ensembleBatchSize;
+
+        while(RES.size() < batchSize) {
+          RES.push_back(NumericVector::build().release());
+          RES.back()->init(*_LinSolver[level]->_RES);
+          EPS.push_back(NumericVector::build().release());
+          EPS.back()->init(*_LinSolver[level]->_EPS);
+        }
+        std::vector < NumericVector* > batchRES(RES.begin(), RES.begin() + batchSize);
+        std::vector < NumericVector* > batchEPS(EPS.begin(), EPS.begin() + batchSize);
+
+        for(unsigned k = 0; k < _SolSystemPdeIndex.size(); k++) {
+          *_solution[level]->_Sol[_SolSystemPdeIndex[k]] = *sol0[k];
+        }
+
+        Profiler::Start("Assembly");
+        _assembleMatrix = false;
+        for(unsigned j = 0; j < batchSize; j++) {
+          setSample(_equation_systems, batchFirst + j);
+          _LinSolver[level]->SetResZero();
+          _assemble_system_function(_equation_systems);
+          *batchRES[j] = *_LinSolver[level]->_RES;
+          batchEPS[j]->zero();
+        }
+        Profiler::Stop();
+
+        Profiler::Start("KSPMatSolve");
+        _LinSolver[level]->MGMatSolve(batchRES, batchEPS);
+        Profiler::Stop();
+
+        for(unsigned j = 0; j < batchSize; j++) {
+          for(unsigned k = 0; k < _SolSystemPdeIndex.size(); k++) {
+            *_solution[level]->_Sol[_SolSystemPdeIndex[k]] = *sol0[k];
+          }
+          _solution[level]->UpdateSol(_SolSystemPdeIndex, batchEPS[j], _LinSolver[level]->KKoffset,
+                                      _LinSolver[level]->GetBlockSize());
+          postSolve(_equation_systems, batchFirst + j);
+        }
+      }
+
+      for(unsigned k = 0; k < sol0.size(); k++) delete sol0[k];
+      for(unsigned j = 0; j < RES.size(); j++) {
+        delete RES[j];
+        delete EPS[j];
+      }
+    }
+
+    _LinSolver[level]->MGClear();
+    _assembleMatrix = true;
+
+    std::cout << std::endl << " *** Ensemble " << _solverType << " TIME: " << std::setw(11) << std::setprecision(6) << std::fixed
+              << (Profiler::GetWallTime() - start_ensemble_time) << " for " << last - first << " samples" << std::endl;
+    _totalSolverTime += (Profiler::GetWallTime() - start_ensemble_time);
+  }
+
+  // ********************************************
+
+  void LinearImplicitSystem::BuildCoarseLevelMatrices(const unsigned &igridn) {
+
+    if(IsMatrixFreeLevel(igridn)) {
+      AssembleCoarseLevels(igridn);
+    }
+    else {
+      for(unsigned i = igridn; i > 0; i--) {
+        if(_RR[i]) {
+          if(i == igridn)
+            _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixFineReuse);
+          else {
+            _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixCoarseReuse);
+            if(_LinSolver[i - 1u]->_KKamr) {
+              delete _LinSolver[i - 1u]->_KKamr;
+              _LinSolver[i - 1u]->_KKamr = NULL;
+            }
+          }
+        }
+        else {
+          if(i == igridn)
+            _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixFineReuse);
+          else {
+            _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixCoarseReuse);
+            if(_LinSolver[i - 1u]->_KKamr) {
+              delete _LinSolver[i - 1u]->_KKamr;
+              _LinSolver[i - 1u]->_KKamr = NULL;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // ********************************************
+
+  void LinearImplicitSystem::AssembleCoarseLevels(const unsigned &igridn) {
+
+    unsigned levelToAssemble = _levelToAssemble;
+    bool assembleMatrix = _assembleMatrix;
+
+    _assembleMatrix = true;
+    for(unsigned i = igridn; i > 0; i--) {
+      _levelToAssemble = i - 1u;
+      _LinSolver[i - 1u]->SetResZero();
+      _assemble_system_function(_equation_systems);
+    }
+
+    _levelToAssemble = levelToAssemble;
+    _assembleMatrix = assembleMatrix;
   }
 
   // ********************************************
@@ -318,6 +566,8 @@ restart:
 
   void LinearImplicitSystem::ProlongatorSol(unsigned gridf) {
 
+    ProfilerTimer timer("Prolongation");
+
     for(unsigned k = 0; k < _SolSystemPdeIndex.size(); k++) {
 
       unsigned SolIndex = _SolSystemPdeIndex[k];
@@ -333,7 +583,9 @@ restart:
 
   bool LinearImplicitSystem::MGVcycle(const unsigned& level, const MgSmootherType& mgSmootherType) {
 
-    clock_t start_mg_time = clock();
+    ProfilerTimer timer("MGVcycle");
+
+    double start_mg_time = Profiler::GetWallTime();
 
     _LinSolver[level]->SetEpsZero();
 
@@ -343,8 +595,11 @@ restart:
 
       std::cout << "       *************** Linear iteration " << linearIterator + 1 << " ***********" << std::endl;
       bool ksp_clean = !linearIterator * _assembleMatrix;
+      Profiler::Start("KSPSolve");
       _LinSolver[level]->MGSolve(ksp_clean);
-      _solution[level]->UpdateRes(_SolSystemPdeIndex, _LinSolver[level]->_RES, _LinSolver[level]->KKoffset);
+      Profiler::Stop();
+      _solution[level]->UpdateRes(_SolSystemPdeIndex, _LinSolver[level]->_RES, _LinSolver[level]->KKoffset,
+                                  _LinSolver[level]->GetBlockSize());
       linearIsConverged = IsLinearConverged(level);
 
       if(linearIsConverged || _bitFlipOccurred)  break;
@@ -355,10 +610,11 @@ restart:
 	(_LinSolver[level]->_EPSC)->matrix_mult(*_LinSolver[level]->_EPS, *_PPamr[level]);
 	*(_LinSolver[level]->_EPS) = *(_LinSolver[level]->_EPSC);
       }
-      _solution[level]->UpdateSol(_SolSystemPdeIndex, _LinSolver[level]->_EPS, _LinSolver[level]->KKoffset);
+      _solution[level]->UpdateSol(_SolSystemPdeIndex, _LinSolver[level]->_EPS, _LinSolver[level]->KKoffset,
+                                  _LinSolver[level]->GetBlockSize());
     }
     std::cout << "       *************** Linear-Cycle TIME:\t" << std::setw(11) << std::setprecision(6) << std::fixed
-              << static_cast<double>((clock() - start_mg_time)) / CLOCKS_PER_SEC << std::endl;
+              << (Profiler::GetWallTime() - start_mg_time) << std::endl;
     return linearIsConverged;
   }
 
@@ -366,7 +622,9 @@ restart:
 
   bool LinearImplicitSystem::MLVcycle(const unsigned& level) {
 
-    clock_t start_mg_time = clock();
+    ProfilerTimer timer("MLVcycle");
+
+    double start_mg_time = Profiler::GetWallTime();
 
     _LinSolver[level]->SetEpsZero();
 
@@ -378,6 +636,7 @@ restart:
 
       bool ksp_clean = !linearIterator * _assembleMatrix;
 
+      Profiler::Start("Smoothing");
       for(unsigned ig = level; ig > 0; ig--) {
         // ============== Presmoothing ==============
         for(unsigned k = 0; k < _npre*(0*ig*ig+1); k++) {
@@ -399,9 +658,11 @@ restart:
           _LinSolver[ig]->Solve(_VariablesToBeSolvedIndex, ksp_clean * (!_npre) * (!k));
         }
       }
+      Profiler::Stop();
 
       // ============== Update Fine Residual ==============
-      _solution[level]->UpdateRes(_SolSystemPdeIndex, _LinSolver[level]->_RES, _LinSolver[level]->KKoffset);
+      _solution[level]->UpdateRes(_SolSystemPdeIndex, _LinSolver[level]->_RES, _LinSolver[level]->KKoffset,
+                                  _LinSolver[level]->GetBlockSize());
       linearIsConverged = IsLinearConverged(level);
       
         if (_debug_linear)  {
@@ -427,11 +688,12 @@ restart:
 	(_LinSolver[level]->_EPSC)->matrix_mult(*_LinSolver[level]->_EPS, *_PPamr[level]);
 	*(_LinSolver[level]->_EPS) = *(_LinSolver[level]->_EPSC);
       }
-      _solution[level]->UpdateSol(_SolSystemPdeIndex, _LinSolver[level]->_EPS, _LinSolver[level]->KKoffset);
+      _solution[level]->UpdateSol(_SolSystemPdeIndex, _LinSolver[level]->_EPS, _LinSolver[level]->KKoffset,
+                                  _LinSolver[level]->GetBlockSize());
     }
 
     std::cout << "\n ************ Linear-Cycle TIME:\t" << std::setw(11) << std::setprecision(6) << std::fixed
-              << static_cast<double>((clock() - start_mg_time)) / CLOCKS_PER_SEC << std::endl;
+              << (Profiler::GetWallTime() - start_mg_time) << std::endl;
 
     return linearIsConverged;
   }
@@ -494,6 +756,11 @@ restart:
 
   void LinearImplicitSystem::AddSystemLevel() {
 
+    if(_matrixFreeOperator) {
+      std::cout << "Error: a level cannot be added to a system with a matrix-free operator" << std::endl;
+      abort();
+    }
+
     _equation_systems.AddLevel();
 
     _msh.resize(_gridn + 1);
@@ -509,6 +776,9 @@ restart:
 
     _LinSolver[_gridn] = LinearEquationSolver::build(_gridn, _solution[_gridn], _SmootherType).release();
 
+    _LinSolver[_gridn]->SetElementSystemDofCache(_elementSystemDofCache);
+    _LinSolver[_gridn]->SetSparsityPatternCSR(_sparsityPatternCSR);
+    _LinSolver[_gridn]->SetInterleavedDofOrdering(_interleavedDofOrdering && _SmootherType != FIELDSPLIT_SMOOTHER);
     _LinSolver[_gridn]->InitPde(_SolSystemPdeIndex, _ml_sol->GetSolType(),
                                 _ml_sol->GetSolName(), &_solution[_gridn]->_Bdc,  _gridn + 1, _SparsityPattern);
 
@@ -700,13 +970,13 @@ restart:
 
       unsigned solIndex = _SolSystemPdeIndex[k];
       unsigned solType = _ml_sol->GetSolutionType(solIndex);
-      unsigned kOffset = LinSol->KKoffset[k][iproc];
 
       unsigned solOffset = mesh->_dofOffset[solType][iproc];
       unsigned solOffsetp1 = mesh->_dofOffset[solType][iproc + 1];
       for(unsigned i = solOffset; i < solOffsetp1; i++) {
+        unsigned irow = LinSol->GetKKDof(k, iproc, i - solOffset);
         if(solType > 2 || amrRestriction[solType].find(i) == amrRestriction[solType].end()) {
-          NNZ_d->set(kOffset + (i - solOffset), 1);
+          NNZ_d->set(irow, 1);
         }
         else {
           double cnt_d = 0;
@@ -719,8 +989,8 @@ restart:
               cnt_o++;
             }
           }
-          NNZ_d->set(kOffset + (i - solOffset), cnt_d);
-          NNZ_o->set(kOffset + (i - solOffset), cnt_o);
+          NNZ_d->set(irow, cnt_d);
+          NNZ_o->set(irow, cnt_o);
         }
       }
     }
@@ -747,13 +1017,11 @@ restart:
       unsigned solIndex = _SolSystemPdeIndex[k];
       unsigned  solType = _ml_sol->GetSolutionType(solIndex);
 
-      unsigned kOffset = LinSol->KKoffset[k][iproc];
-
       unsigned solOffset = mesh->_dofOffset[solType][iproc];
       unsigned solOffsetp1 = mesh->_dofOffset[solType][iproc + 1];
 
       for(unsigned i = solOffset; i < solOffsetp1; i++) {
-        unsigned irow = kOffset + (i - solOffset);
+        unsigned irow = LinSol->GetKKDof(k, iproc, i - solOffset);
         if(solType > 2 || amrRestriction[solType].find(i) == amrRestriction[solType].end()) {
           std::vector <int> col(1, irow);
           double value = 1.;
@@ -766,11 +1034,11 @@ restart:
           unsigned j = 0;
           for(std::map<unsigned, double> ::iterator it = amrRestriction[solType][i].begin(); it != amrRestriction[solType][i].end(); it++) {
             if(it->first >= solOffset && it->first < solOffsetp1) {
-              col[j] = kOffset + (it->first - solOffset);
+              col[j] = LinSol->GetKKDof(k, iproc, it->first - solOffset);
             }
             else {
               unsigned jproc = _msh[level]->IsdomBisectionSearch(it->first, solType);
-              col[j] = LinSol->KKoffset[k][jproc] + (it->first - mesh->_dofOffset[solType][jproc]);
+              col[j] = LinSol->GetKKDof(k, jproc, it->first - mesh->_dofOffset[solType][jproc]);
             }
             value[j] = it->second;
             j++;
@@ -806,7 +1074,7 @@ restart:
 
       for(unsigned inode_mts = mesh->_dofOffset[solType][iproc]; inode_mts < mesh->_dofOffset[solType][iproc + 1]; inode_mts++) {
         int local_mts = inode_mts - mesh->_dofOffset[solType][iproc];
-        int idof_kk = LinSol->KKoffset[k][iproc] + local_mts;
+        int idof_kk = LinSol->GetKKDof(k, iproc, local_mts);
         double bcvalue = (*solution->_Bdc[solIndex])(inode_mts);
         if(bcvalue < 1.5) {
           dirichletNodeIndex[count] = idof_kk;
@@ -847,7 +1115,7 @@ restart:
 
       for(unsigned inode_mts = mesh->_dofOffset[solType][iproc]; inode_mts < mesh->_dofOffset[solType][iproc + 1]; inode_mts++) {
         int local_mts = inode_mts - mesh->_dofOffset[solType][iproc];
-        int idof_kk = LinSol->KKoffset[k][iproc] + local_mts;
+        int idof_kk = LinSol->GetKKDof(k, iproc, local_mts);
         double bcvalue = (*solution->_Bdc[solIndex])(inode_mts);
         if(bcvalue < 1.5) {
           dirichletNodeIndex[count] = idof_kk;
@@ -1214,7 +1482,7 @@ restart:
 
 ///  std::cout << "************ BEGIN ONE PRE-SMOOTHING *****************"<< std::endl;
 #ifdef DEFAULT_PRINT_TIME
-      std::clock_t start_time = std::clock();
+      double start_time = Profiler::GetWallTime();
 #endif
 #ifdef DEFAULT_PRINT_CONV
       _LinSolver[Level]->_EPS->close();
@@ -1232,8 +1500,8 @@ restart:
       std::cout << " Pre Lev: " << Level << ", res-norm: " << rest.second << " n-its: " << rest.first << std::endl;
 #endif
 #ifdef DEFAULT_PRINT_TIME
-      std::clock_t end_time = std::clock();
-      std::cout << " time =" << double(end_time - start_time) / CLOCKS_PER_SEC << std::endl;
+      double end_time = Profiler::GetWallTime();
+      std::cout << " time =" << (end_time - start_time) << std::endl;
 #endif
 
       _LinSolver[Level]->_RES->resid(*_LinSolver[Level]->_RESC, *_LinSolver[Level]->_EPS, *_LinSolver[Level]->_KK);   //********** compute the residual
@@ -1269,7 +1537,7 @@ restart:
 ///   std::cout << "************ BEGIN ONE POST-SMOOTHING *****************"<< std::endl;
       // postsmooting (Nc_post)
 #ifdef DEFAULT_PRINT_TIME
-      start_time = std::clock();
+      start_time = Profiler::GetWallTime();
 #endif
 #ifdef DEFAULT_PRINT_CONV
       _LinSolver[Level]->_EPS->close();
@@ -1287,8 +1555,8 @@ restart:
       std::cout << " Post Lev: " << Level << ", res-norm: " << rest.second << " n-its: " << rest.first << std::endl;
 #endif
 #ifdef DEFAULT_PRINT_TIME
-      end_time = std::clock();
-      std::cout << " time =" << double(end_time - start_time) / CLOCKS_PER_SEC << std::endl;
+      end_time = Profiler::GetWallTime();
+      std::cout << " time =" << (end_time - start_time) << std::endl;
 #endif
 
       _LinSolver[Level]->_RES->resid(*_LinSolver[Level]->_RESC, *_LinSolver[Level]->_EPS, *_LinSolver[Level]->_KK);   //*******  compute the residual
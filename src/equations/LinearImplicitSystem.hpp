@@ -24,6 +24,8 @@
 #include "MgTypeEnum.hpp"
 #include "DirichletBCTypeEnum.hpp"
 #include "MgSmootherEnum.hpp"
+#include "MatrixFreeOperatorTypeEnum.hpp"
+#include "EnsembleTypeEnum.hpp"
 #include "FemusDefault.hpp"
 
 #include <petscksp.h>
@@ -34,6 +36,8 @@ namespace femus {
 //------------------------------------------------------------------------------
 // Forward declarations
 //------------------------------------------------------------------------------
+  class MatrixFreeOperator;
+  class ThreadedAssembly;
 
   class LinearImplicitSystem : public ImplicitSystem {
 
@@ -210,10 +214,73 @@ namespace femus {
       /** enforce sparcity pattern for setting uncoupled variables and save on memory allocation **/
       void SetSparsityPattern(vector < bool > other_sparcity_pattern);
 
+      /** Cache the owned element to system dof map on every level, so that GetSystemDof avoids the bisection search **/
+      void SetElementSystemDofCache(const bool &value = true);
+
+      /** Preallocate the matrices of every level with their exact CSR structure, call it before init() **/
+      void SetSparsityPatternCSR(const bool &value = true) {
+        _sparsityPatternCSR = value;
+      }
+
+      /** Order the dofs of same-type variables node by node and store the matrices in block format (BAIJ), call it before init().
+       *  It is ignored by the field split smoother **/
+      void SetInterleavedDofOrdering(const bool &value = true) {
+        _interleavedDofOrdering = value;
+      }
+
+      /** Apply the operator of the finest level matrix-free (see MatrixFreeOperator), call it before init().
+       *  The finest level is smoothed with Jacobi and only its residual is assembled, so the assemble function must honour
+       *  GetAssembleMatrix(). The coarse levels are assembled by the same function instead of the Galerkin products.
+       *  Requires the gmres smoother, at least two levels and no AMR **/
+      void SetMatrixFreeOperator(const MatrixFreeOperatorType &type, const std::vector < double > &coefficients) {
+        _matrixFree = true;
+        _matrixFreeType = type;
+        _matrixFreeCoefficients = coefficients;
+      }
+
+      /** Return true if the level igrid is applied matrix-free */
+      bool IsMatrixFreeLevel(const unsigned &igrid) const {
+        return _matrixFreeOperator != NULL && igrid == _gridn - 1u;
+      }
+
+      /** Number of threads of the element loops of the library assembly kernels (see AssemblyKernels), the thread pool
+       *  belongs to the system and is released with it **/
+      void SetNumberOfAssemblyThreads(const unsigned &nThreads);
+
+      /** Thread pool of the element loops, NULL for a single thread */
+      ThreadedAssembly *GetThreadedAssembly() {
+        return _threadedAssembly;
+      }
+
 
 
+      /** Sample function of EnsembleSolve, sample = -1 is the mean field */
+      typedef void (*EnsembleSampleFunction)(MultiLevelProblem &ml_prob, const int &sample);
+
+      /** Set the number of samples whose right-hand sides are solved together by EnsembleSolve */
+      void SetEnsembleBatchSize(const unsigned &batchSize) {
+        _ensembleBatchSize = (batchSize > 0) ? batchSize : 1;
+      }
+
+      /** Split the samples of EnsembleSolve in numberOfGroups contiguous ranges and solve only the range group, so that
+       *  independent runs share a Monte Carlo study */
+      void SetEnsembleGroup(const unsigned &group, const unsigned &numberOfGroups) {
+        _ensembleGroup = group;
+        _ensembleNumberOfGroups = (numberOfGroups > 0) ? numberOfGroups : 1;
+      }
+
+      /** Monte Carlo loop on the finest level with the multigrid solver. For each sample of the group, setSample(sample)
+       *  prepares the data of the realization before the assembly and postSolve(sample) reads its solution.
+       *  ENSEMBLE_SHARED_OPERATOR: the matrix does not depend on the sample, the hierarchy is built once and the residuals
+       *  of a batch (the assemble function must honour GetAssembleMatrix()) are solved together by MGMatSolve.
+       *  ENSEMBLE_MEAN_FIELD_PRECONDITIONER: the coarse levels are built once on the mean field (sample -1) and only the
+       *  finest matrix is assembled for each sample. No AMR */
+      void EnsembleSolve(const unsigned &numberOfSamples, EnsembleSampleFunction setSample, EnsembleSampleFunction postSolve,
+                         const EnsembleType &ensembleType, const MgSmootherType& mgSmootherType = MULTIPLICATIVE);
+
+      /** Return true if the assemble function has to build the matrix of the level to assemble, false for the residual only */
       bool GetAssembleMatrix() {
-        return _assembleMatrix;
+        return _assembleMatrix && !IsMatrixFreeLevel(_levelToAssemble);
       }
 
       vector < SparseMatrix* > &GetProjectionMatrix() {
@@ -233,6 +300,16 @@ namespace femus {
       bool _assembleMatrix;
       void AddAMRLevel(unsigned &AMRCounter);
 
+      /** Assemble the matrices of the levels igridn - 1, ..., 0, used when the level igridn is matrix-free */
+      void AssembleCoarseLevels(const unsigned &igridn);
+
+      /** Build the matrices of the levels igridn - 1, ..., 0 from the level igridn, by Galerkin products or by assembly */
+      void BuildCoarseLevelMatrices(const unsigned &igridn);
+
+      unsigned _ensembleBatchSize;
+      unsigned _ensembleGroup;
+      unsigned _ensembleNumberOfGroups;
+
       bool MLVcycle(const unsigned &gridn);
       bool MGVcycle(const unsigned & gridn, const MgSmootherType& mgSmootherType);
 
@@ -307,6 +384,17 @@ namespace femus {
 
       vector <bool> _SparsityPattern;
 
+      bool _elementSystemDofCache;
+      bool _sparsityPatternCSR;
+      bool _interleavedDofOrdering;
+
+      bool _matrixFree;
+      MatrixFreeOperatorType _matrixFreeType;
+      std::vector < double > _matrixFreeCoefficients;
+      MatrixFreeOperator *_matrixFreeOperator;
+
+      ThreadedAssembly *_threadedAssembly;
+
       /** Solves the system. */
       virtual void solve(const MgSmootherType& mgSmootherType = MULTIPLICATIVE);
             
@@ -0,0 +1,492 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: MatrixFreeOperator
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "MatrixFreeOperator.hpp"
+#include "LinearImplicitSystem.hpp"
+#include "LinearEquationSolver.hpp"
+#include "MultiLevelProblem.hpp"
+#include "MultiLevelSolution.hpp"
+#include "Solution.hpp"
+#include "Mesh.hpp"
+#include "ElemType.hpp"
+#include "NumericVector.hpp"
+#include "PetscVector.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace femus {
+
+  static PetscErrorCode MatMultMatrixFree(Mat A, Vec x, Vec y) {
+    void *ctx;
+    MatShellGetContext(A, &ctx);
+    static_cast < MatrixFreeOperator* >(ctx)->Mult(x, y);
+    return 0;
+  }
+
+  static PetscErrorCode MatGetDiagonalMatrixFree(Mat A, Vec d) {
+    void *ctx;
+    MatShellGetContext(A, &ctx);
+    static_cast < MatrixFreeOperator* >(ctx)->GetDiagonal(d);
+    return 0;
+  }
+
+  MatrixFreeOperator::MatrixFreeOperator(LinearImplicitSystem *mlPdeSys, const unsigned &level, const MatrixFreeOperatorType &type,
+                                         const std::vector < double > &coefficients) {
+
+    _mlPdeSys = mlPdeSys;
+    _level = level;
+    _pdeSys = mlPdeSys->_LinSolver[level];
+    _type = type;
+    _coefficients = coefficients;
+    _isSetup = false;
+
+    unsigned nCoefficients = (_type == MATRIX_FREE_LAPLACIAN) ? 1 : 2;
+    if(_coefficients.size() < nCoefficients) {
+      std::cout << "Error in MatrixFreeOperator: " << nCoefficients << " coefficients are required" << std::endl;
+      abort();
+    }
+
+    _dim = _pdeSys->_msh->GetDimension();
+    _nVariables = mlPdeSys->GetSolPdeIndex().size();
+    _nNodes = (_dim == 3) ? 27 : 9;
+    _nGeometry = (_type == MATRIX_FREE_LAPLACIAN) ? _dim * _dim : _dim * _dim + 1;
+
+    if(_dim == 1) {
+      std::cout << "Error in MatrixFreeOperator: only Quad9 and Hex27 meshes are supported" << std::endl;
+      abort();
+    }
+    if(_type == MATRIX_FREE_LINEAR_ELASTICITY && _nVariables != _dim) {
+      std::cout << "Error in MatrixFreeOperator: linear elasticity requires " << _dim << " displacement variables" << std::endl;
+      abort();
+    }
+
+    //BEGIN 1D basis at the 3 Gauss-Legendre points
+    const double gaussPoint[3] = { -sqrt(0.6), 0., sqrt(0.6)};
+    const double gaussWeight[3] = {5. / 9., 8. / 9., 5. / 9.};
+
+    for(unsigned ig = 0; ig < 3; ig++) {
+      double x = gaussPoint[ig];
+      _B[ig][0] = 0.5 * x * (x - 1.);
+      _B[ig][1] = (1. - x) * (1. + x);
+      _B[ig][2] = 0.5 * x * (x + 1.);
+      _D[ig][0] = x - 0.5;
+      _D[ig][1] = -2. * x;
+      _D[ig][2] = x + 0.5;
+    }
+
+    _weight.resize(_nNodes);
+    for(unsigned ig = 0; ig < _nNodes; ig++) {
+      _weight[ig] = gaussWeight[ig % 3] * gaussWeight[(ig / 3) % 3];
+      if(_dim == 3) _weight[ig] *= gaussWeight[ig / 9];
+    }
+    //END
+
+    _u.resize(_nVariables * _nNodes);
+    _v.resize(_nVariables * _nNodes);
+    _gradient.resize(2 * _nVariables * _dim * _nNodes);
+    _work0.resize(_nNodes);
+    _work1.resize(_nNodes);
+
+    // gradients of the basis functions, used by the diagonal
+    _referenceGradient.resize(_nNodes * _dim * _nNodes);
+    std::vector < double > unit(_nNodes, 0.);
+    for(unsigned i = 0; i < _nNodes; i++) {
+      unit[i] = 1.;
+      ReferenceGradient(&unit[0], &_referenceGradient[i * _dim * _nNodes]);
+      unit[i] = 0.;
+    }
+
+    Setup();
+
+    unsigned iproc = _pdeSys->processor_id();
+    unsigned nvar = _pdeSys->KKIndex.size() - 1u;
+    PetscInt ownedSize = _pdeSys->KKoffset[nvar][iproc] - _pdeSys->KKoffset[0][iproc];
+    PetscInt globalSize = _pdeSys->KKIndex[nvar];
+
+    MatCreateShell(PETSC_COMM_WORLD, ownedSize, ownedSize, globalSize, globalSize, this, &_mat);
+    MatShellSetOperation(_mat, MATOP_MULT, (void(*)(void)) MatMultMatrixFree);
+    MatShellSetOperation(_mat, MATOP_GET_DIAGONAL, (void(*)(void)) MatGetDiagonalMatrixFree);
+  }
+
+  MatrixFreeOperator::~MatrixFreeOperator() {
+    MatDestroy(&_mat);
+    if(_isSetup) {
+      VecScatterDestroy(&_scatter);
+      VecDestroy(&_xLocal);
+      VecDestroy(&_yLocal);
+    }
+  }
+
+  void MatrixFreeOperator::Setup() {
+
+    Mesh *msh = _pdeSys->_msh;
+    Solution *sol = _pdeSys->_solution;
+    MultiLevelSolution *mlSol = _mlPdeSys->GetMLProb()._ml_sol;
+    const std::vector < unsigned > &solPdeIndex = _mlPdeSys->GetSolPdeIndex();
+
+    const unsigned iproc = msh->processor_id();
+    const short unsigned hexOrQuad = (_dim == 3) ? 0 : 3;
+
+    for(unsigned k = 0; k < _nVariables; k++) {
+      if(mlSol->GetSolutionType(solPdeIndex[k]) != 2) {
+        std::cout << "Error in MatrixFreeOperator: the variable " << mlSol->GetSolutionName(solPdeIndex[k])
+                  << " is not biquadratic (SECOND)" << std::endl;
+        abort();
+      }
+    }
+
+    const unsigned elementBegin = msh->_elementOffset[iproc];
+    const unsigned elementEnd = msh->_elementOffset[iproc + 1];
+    _nElements = elementEnd - elementBegin;
+
+    // lexicographic position of the femus local nodes
+    std::vector < unsigned > lex(_nNodes);
+    const basis *base = msh->_finiteElement[hexOrQuad][2]->GetBasis();
+    for(unsigned i = 0; i < _nNodes; i++) {
+      const int *IND = base->GetIND(i);
+      lex[i] = IND[0] + 3 * IND[1] + ((_dim == 3) ? 9 * IND[2] : 0);
+    }
+
+    //BEGIN element dofs and geometric factors
+    std::vector < PetscInt > globalDof(_nElements * _nVariables * _nNodes);
+    _geometry.resize(_nElements * _nNodes * _nGeometry);
+
+    std::vector < double > coordinates(_dim * _nNodes);
+    std::vector < double > gradX(_dim * _dim * _nNodes);
+
+    for(unsigned iel = elementBegin; iel < elementEnd; iel++) {
+      unsigned jel = iel - elementBegin;
+
+      if(msh->GetElementType(iel) != hexOrQuad) {
+        std::cout << "Error in MatrixFreeOperator: only Quad9 and Hex27 meshes are supported" << std::endl;
+        abort();
+      }
+
+      for(unsigned i = 0; i < _nNodes; i++) {
+        for(unsigned k = 0; k < _nVariables; k++) {
+          globalDof[(jel * _nVariables + k) * _nNodes + lex[i]] = _pdeSys->GetSystemDof(solPdeIndex[k], k, i, iel);
+        }
+        unsigned xDof = msh->GetSolutionDof(i, iel, 2);
+        for(unsigned d = 0; d < _dim; d++) {
+          coordinates[d * _nNodes + lex[i]] = (*msh->_topology->_Sol[d])(xDof);
+        }
+      }
+
+      for(unsigned i = 0; i < _dim; i++) {
+        ReferenceGradient(&coordinates[i * _nNodes], &gradX[i * _dim * _nNodes]);
+      }
+
+      for(unsigned ig = 0; ig < _nNodes; ig++) {
+        // J[i][d] = d x_i / d xi_d and its inverse invJ[d][i] = d xi_d / d x_i
+        double J[3][3], invJ[3][3], detJ;
+        for(unsigned i = 0; i < _dim; i++) {
+          for(unsigned d = 0; d < _dim; d++) {
+            J[i][d] = gradX[(i * _dim + d) * _nNodes + ig];
+          }
+        }
+
+        if(_dim == 2) {
+          detJ = J[0][0] * J[1][1] - J[0][1] * J[1][0];
+          invJ[0][0] =  J[1][1] / detJ;
+          invJ[0][1] = -J[0][1] / detJ;
+          invJ[1][0] = -J[1][0] / detJ;
+          invJ[1][1] =  J[0][0] / detJ;
+        }
+        else {
+          detJ = J[0][0] * (J[1][1] * J[2][2] - J[1][2] * J[2][1])
+                 - J[0][1] * (J[1][0] * J[2][2] - J[1][2] * J[2][0])
+                 + J[0][2] * (J[1][0] * J[2][1] - J[1][1] * J[2][0]);
+          invJ[0][0] = (J[1][1] * J[2][2] - J[1][2] * J[2][1]) / detJ;
+          invJ[0][1] = (J[0][2] * J[2][1] - J[0][1] * J[2][2]) / detJ;
+          invJ[0][2] = (J[0][1] * J[1][2] - J[0][2] * J[1][1]) / detJ;
+          invJ[1][0] = (J[1][2] * J[2][0] - J[1][0] * J[2][2]) / detJ;
+          invJ[1][1] = (J[0][0] * J[2][2] - J[0][2] * J[2][0]) / detJ;
+          invJ[1][2] = (J[0][2] * J[1][0] - J[0][0] * J[1][2]) / detJ;
+          invJ[2][0] = (J[1][0] * J[2][1] - J[1][1] * J[2][0]) / detJ;
+          invJ[2][1] = (J[0][1] * J[2][0] - J[0][0] * J[2][1]) / detJ;
+          invJ[2][2] = (J[0][0] * J[1][1] - J[0][1] * J[1][0]) / detJ;
+        }
+
+        double weight = _weight[ig] * fabs(detJ);
+        double *geometry = &_geometry[(jel * _nNodes + ig) * _nGeometry];
+
+        if(_type == MATRIX_FREE_LAPLACIAN) {
+          for(unsigned d = 0; d < _dim; d++) {
+            for(unsigned e = 0; e < _dim; e++) {
+              double value = 0.;
+              for(unsigned i = 0; i < _dim; i++) {
+                value += invJ[d][i] * invJ[e][i];
+              }
+              geometry[d * _dim + e] = _coefficients[0] * weight * value;
+            }
+          }
+        }
+        else {
+          for(unsigned d = 0; d < _dim; d++) {
+            for(unsigned i = 0; i < _dim; i++) {
+              geometry[d * _dim + i] = invJ[d][i];
+            }
+          }
+          geometry[_dim * _dim] = weight;
+        }
+      }
+    }
+    //END
+
+    //BEGIN local work vectors and scatter
+    std::vector < PetscInt > localDof(globalDof);
+    std::sort(localDof.begin(), localDof.end());
+    localDof.erase(std::unique(localDof.begin(), localDof.end()), localDof.end());
+
+    _elementDof.resize(globalDof.size());
+    for(unsigned i = 0; i < globalDof.size(); i++) {
+      _elementDof[i] = std::lower_bound(localDof.begin(), localDof.end(), globalDof[i]) - localDof.begin();
+    }
+
+    if(_isSetup) {
+      VecScatterDestroy(&_scatter);
+      VecDestroy(&_xLocal);
+      VecDestroy(&_yLocal);
+    }
+
+    IS isFrom, isTo;
+    ISCreateGeneral(PETSC_COMM_SELF, localDof.size(), &localDof[0], PETSC_COPY_VALUES, &isFrom);
+    ISCreateStride(PETSC_COMM_SELF, localDof.size(), 0, 1, &isTo);
+    VecCreateSeq(PETSC_COMM_SELF, localDof.size(), &_xLocal);
+    VecDuplicate(_xLocal, &_yLocal);
+    VecScatterCreate((static_cast < PetscVector* >(_pdeSys->_EPS))->vec(), isFrom, _xLocal, isTo, &_scatter);
+    ISDestroy(&isFrom);
+    ISDestroy(&isTo);
+    //END
+
+    //BEGIN Dirichlet rows
+    _dirichletRow.resize(0);
+    const unsigned rowBegin = _pdeSys->KKoffset[0][iproc];
+    for(unsigned k = 0; k < _nVariables; k++) {
+      unsigned solIndex = solPdeIndex[k];
+      for(unsigned inode = msh->_dofOffset[2][iproc]; inode < msh->_dofOffset[2][iproc + 1]; inode++) {
+        if((*sol->_Bdc[solIndex])(inode) < 1.5) {
+          _dirichletRow.push_back(_pdeSys->GetKKDof(k, iproc, inode - msh->_dofOffset[2][iproc]) - rowBegin);
+        }
+      }
+    }
+    //END
+
+    _isSetup = true;
+  }
+
+  void MatrixFreeOperator::ApplyAlongDirection(const double M[3][3], const bool &transpose, const unsigned &dir,
+                                               const double *in, double *out) {
+    const unsigned stride = (dir == 0) ? 1 : (dir == 1) ? 3 : 9;
+    for(unsigned i = 0; i < _nNodes; i++) {
+      if((i / stride) % 3 != 0) continue;
+      for(unsigned q = 0; q < 3; q++) {
+        double value = 0.;
+        for(unsigned a = 0; a < 3; a++) {
+          value += ((transpose) ? M[a][q] : M[q][a]) * in[i + a * stride];
+        }
+        out[i + q * stride] = value;
+      }
+    }
+  }
+
+  void MatrixFreeOperator::ReferenceGradient(const double *u, double *gradient) {
+    for(unsigned d = 0; d < _dim; d++) {
+      const double *in = u;
+      for(unsigned dir = 0; dir < _dim; dir++) {
+        double *out = (dir + 1 == _dim) ? &gradient[d * _nNodes] : (dir == 0) ? &_work0[0] : &_work1[0];
+        ApplyAlongDirection((dir == d) ? _D : _B, false, dir, in, out);
+        in = out;
+      }
+    }
+  }
+
+  void MatrixFreeOperator::AddReferenceGradientTranspose(const double *gradient, double *v) {
+    for(unsigned d = 0; d < _dim; d++) {
+      const double *in = &gradient[d * _nNodes];
+      for(unsigned dir = _dim; dir-- > 0;) {
+        double *out = (dir == _dim - 1) ? &_work0[0] : (in == &_work0[0]) ? &_work1[0] : &_work0[0];
+        ApplyAlongDirection((dir == d) ? _D : _B, true, dir, in, out);
+        in = out;
+      }
+      for(unsigned i = 0; i < _nNodes; i++) {
+        v[i] += in[i];
+      }
+    }
+  }
+
+  void MatrixFreeOperator::ElementLoop(const double *x, double *y, const bool &diagonal) {
+
+    const unsigned dim2 = _dim * _dim;
+    double *flux = &_gradient[_nVariables * _dim * _nNodes];
+
+    for(unsigned jel = 0; jel < _nElements; jel++) {
+      const PetscInt *elementDof = &_elementDof[jel * _nVariables * _nNodes];
+      const double *geometry = &_geometry[jel * _nNodes * _nGeometry];
+
+      std::fill(_v.begin(), _v.end(), 0.);
+
+      if(diagonal) {
+        for(unsigned i = 0; i < _nNodes; i++) {
+          const double *phi_xi = &_referenceGradient[i * _dim * _nNodes];
+          for(unsigned ig = 0; ig < _nNodes; ig++) {
+            const double *G = &geometry[ig * _nGeometry];
+            if(_type == MATRIX_FREE_LAPLACIAN) {
+              double value = 0.;
+              for(unsigned d = 0; d < _dim; d++) {
+                for(unsigned e = 0; e < _dim; e++) {
+                  value += phi_xi[d * _nNodes + ig] * G[d * _dim + e] * phi_xi[e * _nNodes + ig];
+                }
+              }
+              for(unsigned k = 0; k < _nVariables; k++) {
+                _v[k * _nNodes + i] += value;
+              }
+            }
+            else {
+              double phi_x[3] = {0., 0., 0.};
+              double laplace = 0.;
+              for(unsigned j = 0; j < _dim; j++) {
+                for(unsigned d = 0; d < _dim; d++) {
+                  phi_x[j] += phi_xi[d * _nNodes + ig] * G[d * _dim + j];
+                }
+                laplace += phi_x[j] * phi_x[j];
+              }
+              for(unsigned k = 0; k < _dim; k++) {
+                _v[k * _nNodes + i] += (_coefficients[1] * laplace + (_coefficients[0] + _coefficients[1]) * phi_x[k] * phi_x[k]) * G[dim2];
+              }
+            }
+          }
+        }
+      }
+      else {
+        for(unsigned i = 0; i < _nVariables * _nNodes; i++) {
+          _u[i] = x[elementDof[i]];
+        }
+        for(unsigned k = 0; k < _nVariables; k++) {
+          ReferenceGradient(&_u[k * _nNodes], &_gradient[k * _dim * _nNodes]);
+        }
+
+        for(unsigned ig = 0; ig < _nNodes; ig++) {
+          const double *G = &geometry[ig * _nGeometry];
+          if(_type == MATRIX_FREE_LAPLACIAN) {
+            for(unsigned k = 0; k < _nVariables; k++) {
+              const double *gradU = &_gradient[k * _dim * _nNodes];
+              for(unsigned d = 0; d < _dim; d++) {
+                double value = 0.;
+                for(unsigned e = 0; e < _dim; e++) {
+                  value += G[d * _dim + e] * gradU[e * _nNodes + ig];
+                }
+                flux[(k * _dim + d) * _nNodes + ig] = value;
+              }
+            }
+          }
+          else {
+            // physical displacement gradient gradU[k][j] and stress
+            double gradU[3][3], stress[3][3];
+            double divergence = 0.;
+            for(unsigned k = 0; k < _dim; k++) {
+              for(unsigned j = 0; j < _dim; j++) {
+                gradU[k][j] = 0.;
+                for(unsigned d = 0; d < _dim; d++) {
+                  gradU[k][j] += _gradient[(k * _dim + d) * _nNodes + ig] * G[d * _dim + j];
+                }
+              }
+              divergence += gradU[k][k];
+            }
+            for(unsigned k = 0; k < _dim; k++) {
+              for(unsigned j = 0; j < _dim; j++) {
+                stress[k][j] = _coefficients[1] * (gradU[k][j] + gradU[j][k]);
+              }
+              stress[k][k] += _coefficients[0] * divergence;
+            }
+            for(unsigned k = 0; k < _dim; k++) {
+              for(unsigned d = 0; d < _dim; d++) {
+                double value = 0.;
+                for(unsigned j = 0; j < _dim; j++) {
+                  value += stress[k][j] * G[d * _dim + j];
+                }
+                flux[(k * _dim + d) * _nNodes + ig] = value * G[dim2];
+              }
+            }
+          }
+        }
+
+        for(unsigned k = 0; k < _nVariables; k++) {
+          AddReferenceGradientTranspose(&flux[k * _dim * _nNodes], &_v[k * _nNodes]);
+        }
+      }
+
+      for(unsigned i = 0; i < _nVariables * _nNodes; i++) {
+        y[elementDof[i]] += _v[i];
+      }
+    }
+  }
+
+  void MatrixFreeOperator::Mult(Vec x, Vec y) {
+
+    VecScatterBegin(_scatter, x, _xLocal, INSERT_VALUES, SCATTER_FORWARD);
+    VecScatterEnd(_scatter, x, _xLocal, INSERT_VALUES, SCATTER_FORWARD);
+    VecSet(_yLocal, 0.);
+
+    const PetscScalar *xLocal;
+    PetscScalar *yLocal;
+    VecGetArrayRead(_xLocal, &xLocal);
+    VecGetArray(_yLocal, &yLocal);
+    ElementLoop(xLocal, yLocal, false);
+    VecRestoreArrayRead(_xLocal, &xLocal);
+    VecRestoreArray(_yLocal, &yLocal);
+
+    VecSet(y, 0.);
+    VecScatterBegin(_scatter, _yLocal, y, ADD_VALUES, SCATTER_REVERSE);
+    VecScatterEnd(_scatter, _yLocal, y, ADD_VALUES, SCATTER_REVERSE);
+
+    // identity rows as after MatZeroRows in SetPenalty, the columns are kept
+    const PetscScalar *xArray;
+    PetscScalar *yArray;
+    VecGetArrayRead(x, &xArray);
+    VecGetArray(y, &yArray);
+    for(unsigned i = 0; i < _dirichletRow.size(); i++) {
+      yArray[_dirichletRow[i]] = xArray[_dirichletRow[i]];
+    }
+    VecRestoreArrayRead(x, &xArray);
+    VecRestoreArray(y, &yArray);
+  }
+
+  void MatrixFreeOperator::GetDiagonal(Vec d) {
+
+    VecSet(_yLocal, 0.);
+
+    PetscScalar *yLocal;
+    VecGetArray(_yLocal, &yLocal);
+    ElementLoop(NULL, yLocal, true);
+    VecRestoreArray(_yLocal, &yLocal);
+
+    VecSet(d, 0.);
+    VecScatterBegin(_scatter, _yLocal, d, ADD_VALUES, SCATTER_REVERSE);
+    VecScatterEnd(_scatter, _yLocal, d, ADD_VALUES, SCATTER_REVERSE);
+
+    PetscScalar *dArray;
+    VecGetArray(d, &dArray);
+    for(unsigned i = 0; i < _dirichletRow.size(); i++) {
+      dArray[_dirichletRow[i]] = 1.;
+    }
+    VecRestoreArray(d, &dArray);
+  }
+
+}
@@ -0,0 +1,108 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: MatrixFreeOperator
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_equations_MatrixFreeOperator_hpp__
+#define __femus_equations_MatrixFreeOperator_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "MatrixFreeOperatorTypeEnum.hpp"
+#include <vector>
+#include <petscmat.h>
+
+namespace femus {
+
+  class LinearImplicitSystem;
+  class LinearEquationSolver;
+
+  /**
+   * Matrix-free operator of one level of a LinearImplicitSystem, wrapped in a PETSc MATSHELL.
+   * The product is computed element by element with sum factorization on the tensor-product Gauss points of
+   * biquadratic (SECOND) variables on Hex27 or Quad9 meshes, so that no global matrix is stored:
+   * MATRIX_FREE_LAPLACIAN applies -nu Laplace(u) to every PDE variable, coefficients = {nu};
+   * MATRIX_FREE_LINEAR_ELASTICITY applies the linear elasticity operator to dim displacement variables, coefficients = {lambda, mu}.
+   * The operator is the Jacobian of the assembly kernels, and the Dirichlet rows (Bdc < 1.5) are the identity, as after SetPenalty.
+   * The diagonal is available for Jacobi smoothing.
+   */
+  class MatrixFreeOperator {
+    public:
+
+      MatrixFreeOperator(LinearImplicitSystem *mlPdeSys, const unsigned &level, const MatrixFreeOperatorType &type,
+                         const std::vector < double > &coefficients);
+
+      ~MatrixFreeOperator();
+
+      /** Store the element dofs, the geometric factors at the Gauss points and the Dirichlet rows,
+       * call it again if the mesh or the boundary conditions change */
+      void Setup();
+
+      /** The MATSHELL of the operator, owned by this object */
+      Mat GetMat() {
+        return _mat;
+      }
+
+      /** y = A x */
+      void Mult(Vec x, Vec y);
+
+      /** d = diag(A) */
+      void GetDiagonal(Vec d);
+
+    private:
+
+      /** Gradient in the reference coordinates of the lexicographic nodal values u at all the Gauss points, gradient[d * _nGauss + ig] */
+      void ReferenceGradient(const double *u, double *gradient);
+
+      /** Transpose of ReferenceGradient, the result is added to v */
+      void AddReferenceGradientTranspose(const double *gradient, double *v);
+
+      /** out = M in along the direction dir of the 3^dim tensor in, or M^T in if transpose */
+      void ApplyAlongDirection(const double M[3][3], const bool &transpose, const unsigned &dir, const double *in, double *out);
+
+      /** Accumulate the local element products (or diagonals) to the owned entries of y */
+      void ElementLoop(const double *x, double *y, const bool &diagonal);
+
+      LinearEquationSolver *_pdeSys;
+      LinearImplicitSystem *_mlPdeSys;
+      unsigned _level;
+      MatrixFreeOperatorType _type;
+      std::vector < double > _coefficients;
+
+      unsigned _dim;
+      unsigned _nVariables;
+      unsigned _nNodes;              // 3^dim nodes and Gauss points per element
+      unsigned _nGeometry;           // geometric factors per Gauss point
+      unsigned _nElements;
+
+      double _B[3][3];               // 1D biquadratic basis at the 1D Gauss points, _B[ig][i]
+      double _D[3][3];               // and its derivative
+      std::vector < double > _weight; // tensor-product Gauss weights
+      std::vector < double > _referenceGradient; // [(i * _dim + d) * _nNodes + ig] of the lexicographic node i
+
+      std::vector < PetscInt > _elementDof;   // [(iel * _nVariables + k) * _nNodes + i], index in the local work vectors
+      std::vector < double > _geometry;       // [(iel * _nNodes + ig) * _nGeometry + j]
+      std::vector < PetscInt > _dirichletRow; // owned identity rows, relative to the first owned row
+
+      Mat _mat;
+      Vec _xLocal, _yLocal;
+      VecScatter _scatter;
+      bool _isSetup;
+
+      std::vector < double > _u, _v, _gradient, _work0, _work1;
+  };
+
+} //end namespace femus
+
+#endif
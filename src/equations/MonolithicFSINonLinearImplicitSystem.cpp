@@ -168,13 +168,13 @@ namespace femus {
 
       unsigned solIndex = _SolSystemPdeIndex[k];
       unsigned solType = _ml_sol->GetSolutionType(solIndex);
-      unsigned kOffset = LinSol->KKoffset[k][iproc];
 
       unsigned solOffset = mesh->_dofOffset[solType][iproc];
       unsigned solOffsetp1 = mesh->_dofOffset[solType][iproc + 1];
       for(unsigned i = solOffset; i < solOffsetp1; i++) {
+        unsigned irow = LinSol->GetKKDof(k, iproc, i - solOffset);
         if(solType > 2 || amrRestriction[solType].find(i) == amrRestriction[solType].end()) {
-          NNZ_d->set(kOffset + (i - solOffset), 1);
+          NNZ_d->set(irow, 1);
         }
         else {
           double cnt_d = 0;
@@ -187,8 +187,8 @@ namespace femus {
               cnt_o++;
             }
           }
-          NNZ_d->set(kOffset + (i - solOffset), cnt_d);
-          NNZ_o->set(kOffset + (i - solOffset), cnt_o);
+          NNZ_d->set(irow, cnt_d);
+          NNZ_o->set(irow, cnt_o);
         }
       }
     }
@@ -221,16 +221,13 @@ namespace femus {
       
       unsigned kPair = GetSolPdeIndex(_ml_sol->GetSolutionName(solPairIndex));
             
-      unsigned kOffset = LinSol->KKoffset[k][iproc];
-      unsigned kPairOffset = LinSol->KKoffset[kPair][iproc];
-      
       unsigned solType = _ml_sol->GetSolutionType(solIndex);
 
       unsigned solOffset = mesh->_dofOffset[solType][iproc];
       unsigned solOffsetp1 = mesh->_dofOffset[solType][iproc + 1];
 
       for(unsigned i = solOffset; i < solOffsetp1; i++) {
-	unsigned irow = kOffset + (i - solOffset);
+	unsigned irow = LinSol->GetKKDof(k, iproc, i - solOffset);
         if(solType > 2 || amrRestriction[solType].find(i) == amrRestriction[solType].end()) {
           std::vector <int> col(1, irow);
           double value = 1.;
@@ -248,22 +245,22 @@ namespace femus {
           for(std::map<unsigned, double> ::iterator it = amrRestriction[solType][i].begin(); it != amrRestriction[solType][i].end(); it++) {
 	    bool solidMarkj = amrSolidMark[solType][it->first];
             if(it->first >= solOffset && it->first < solOffsetp1) {
-              colPP[j] = kOffset + (it->first - solOffset);
+              colPP[j] = LinSol->GetKKDof(k, iproc, it->first - solOffset);
 	      if(solidMarki == true && solidMarkj == false && k != kPair){
-		colRR[j] = kPairOffset + (it->first - solOffset);
+		colRR[j] = LinSol->GetKKDof(kPair, iproc, it->first - solOffset);
 	      }
 	      else{
-		colRR[j] = kOffset + (it->first - solOffset);
+		colRR[j] = LinSol->GetKKDof(k, iproc, it->first - solOffset);
 	      }
             }
             else {
               unsigned jproc = _msh[level]->IsdomBisectionSearch(it->first, solType);
-              colPP[j] = LinSol->KKoffset[k][jproc] + (it->first - mesh->_dofOffset[solType][jproc]);
+              colPP[j] = LinSol->GetKKDof(k, jproc, it->first - mesh->_dofOffset[solType][jproc]);
 	      if(solidMarki == true && solidMarkj == false && k != kPair){
-		colRR[j] = LinSol->KKoffset[kPair][jproc] + (it->first - mesh->_dofOffset[solType][jproc]);
+		colRR[j] = LinSol->GetKKDof(kPair, jproc, it->first - mesh->_dofOffset[solType][jproc]);
 	      }
 	      else{
-		colRR[j] = LinSol->KKoffset[k][jproc] + (it->first - mesh->_dofOffset[solType][jproc]);
+		colRR[j] = LinSol->GetKKDof(k, jproc, it->first - mesh->_dofOffset[solType][jproc]);
 	      }
             }
             valuePP[j] = it->second;
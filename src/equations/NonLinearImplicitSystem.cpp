@@ -16,7 +16,9 @@
 #include "NonLinearImplicitSystem.hpp"
 #include "LinearEquationSolver.hpp"
 #include "NumericVector.hpp"
+#include "Profiler.hpp"
 #include "iomanip"
+#include <cmath>
 
 namespace femus {
 
@@ -34,7 +36,14 @@ namespace femus {
     _maxNumberOfResidualUpdateIterations(1),
     _debug_nonlinear(false),
     _debug_function(NULL),
-    _debug_function_is_initialized(false)
+    _debug_function_is_initialized(false),
+    _jacobianRebuildFrequency(1),
+    _jacobianStallRatio(0.5),
+    _useEisenstatWalker(false),
+    _ewEtaInitial(0.3),
+    _ewEtaMax(0.9),
+    _ewGamma(0.9),
+    _ewAlpha(1.618)
   {
 
   }
@@ -98,11 +107,27 @@ namespace femus {
 
   // ********************************************
 
+  double NonLinearImplicitSystem::GetNonLinearResidualNorm(const unsigned &igridn) {
+
+    // UpdateRes copies only the non-Dirichlet dofs
+    _solution[igridn]->UpdateRes(_SolSystemPdeIndex, _LinSolver[igridn]->_RES, _LinSolver[igridn]->KKoffset,
+                                 _LinSolver[igridn]->GetBlockSize());
+    double norm2 = 0.;
+    for(unsigned k = 0; k < _SolSystemPdeIndex.size(); k++) {
+      double L2normRes = _solution[igridn]->_Res[_SolSystemPdeIndex[k]]->l2_norm();
+      norm2 += L2normRes * L2normRes;
+    }
+    return sqrt(norm2);
+  }
+
+  // ********************************************
+
   void NonLinearImplicitSystem::solve(const MgSmootherType& mgSmootherType) {
 
     _bitFlipCounter = 0;
     
-    clock_t start_mg_time = clock();
+    Profiler::Start("NonLinearSolve");
+    double start_mg_time = Profiler::GetWallTime();
 
     double totalAssembyTime = 0.;
 
@@ -125,13 +150,20 @@ namespace femus {
 
     for(unsigned igridn = grid0; igridn < _gridn; igridn++) {     //_igridn
       std::cout << std::endl << "   ****** Start Level Max " << igridn + 1 << " ******" << std::endl;
-      clock_t start_nl_time = clock();
+      double start_nl_time = Profiler::GetWallTime();
 
       bool ThisIsAMR = (_mg_type == F_CYCLE && _AMRtest &&  AMRCounter < _maxAMRlevels && igridn == _gridn - 1u) ? 1 : 0;
       
 restart:
       if(ThisIsAMR) _solution[igridn]->InitAMREps();
 
+      bool solverIsBuilt = false;
+      unsigned lastBuildIterator = 0;
+      bool stalled = false;
+      double previousNonLinearEps = 0.;
+      double eta = _ewEtaInitial;
+      double previousResidualNorm = 0.;
+      const double linearAbsoluteConvergenceTolerance = _linearAbsoluteConvergenceTolerance;
       
       for(unsigned nonLinearIterator = 0; nonLinearIterator < _n_max_nonlinear_iterations; nonLinearIterator++) {
 
@@ -145,14 +177,18 @@ restart:
       
         std::cout << std::endl << "   ********* Nonlinear iteration " << nonLinearIterator + 1 << " *********" << std::endl;
 
-        clock_t start_preparation_time = clock();
-        clock_t start_assembly_time = clock();
+        double start_preparation_time = Profiler::GetWallTime();
+        double start_assembly_time = Profiler::GetWallTime();
         _levelToAssemble = igridn; //Be carefull!!!! this is needed in the _assemble_function
         _LinSolver[igridn]->SetResZero();
-        _assembleMatrix = _buildSolver;
+        bool buildSolver = _buildSolver && (!solverIsBuilt || stalled ||
+                                            nonLinearIterator - lastBuildIterator >= _jacobianRebuildFrequency);
+        _assembleMatrix = buildSolver;
+        Profiler::Start("Assembly");
         _assemble_system_function(_equation_systems);
+        Profiler::Stop();
         std::cout << "   ********* Level Max " << igridn + 1 << " ASSEMBLY TIME:\t" << \
-                  static_cast<double>((clock() - start_assembly_time)) / CLOCKS_PER_SEC << std::endl;
+                  (Profiler::GetWallTime() - start_assembly_time) << std::endl;
 	
         if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
           if(!_RRamr[igridn]) {
@@ -164,13 +200,31 @@ restart:
           *(_LinSolver[igridn]->_RES) = *(_LinSolver[igridn]->_RESC);
         }
 
-        if(_buildSolver) {
+        if(_useEisenstatWalker) {
+          double residualNorm = GetNonLinearResidualNorm(igridn);
+          if(nonLinearIterator > 0 && previousResidualNorm > 0.) {
+            double etaNew = _ewGamma * pow(residualNorm / previousResidualNorm, _ewAlpha);
+            double etaSafeguard = _ewGamma * pow(eta, _ewAlpha);
+            if(etaSafeguard > 0.1 && etaSafeguard > etaNew) etaNew = etaSafeguard;
+            eta = (etaNew < _ewEtaMax) ? etaNew : _ewEtaMax;
+          }
+          previousResidualNorm = residualNorm;
 
-          _MGmatrixFineReuse = (0 == nonLinearIterator) ? false : true;
-          _MGmatrixCoarseReuse = (igridn - grid0 > 0) ?  true : _MGmatrixFineReuse;
+          double rtol = (eta > _rtol) ? eta : _rtol;
+          if(_MGsolver) {
+            _LinSolver[igridn]->SetTolerances(rtol, _atol, _divtol, _maxits, _restart);
+            // a reused KSP does not read the tolerances of the solver again
+            if(!buildSolver) KSPSetTolerances(*_LinSolver[igridn]->GetKSP(), rtol, _atol, _divtol, _maxits);
+          }
+          _linearAbsoluteConvergenceTolerance = (rtol * residualNorm > linearAbsoluteConvergenceTolerance) ?
+                                                rtol * residualNorm : linearAbsoluteConvergenceTolerance;
+          std::cout << "   ********* Level Max " << igridn + 1 << " LINEAR FORCING TERM:\t" << rtol << std::endl;
+        }
 
-          if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
-            _LinSolver[igridn]->SwapMatrices();
+        if(_buildSolver && !_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
+          _MGmatrixFineReuse = (0 == nonLinearIterator) ? false : true;
+          _LinSolver[igridn]->SwapMatrices();
+          if(buildSolver) {
             if(!_RRamr[igridn]) {
               _LinSolver[igridn]->_KK->matrix_PtAP(*_PPamr[igridn], *_LinSolver[igridn]->_KKamr, _MGmatrixFineReuse);
             }
@@ -178,37 +232,55 @@ restart:
               _LinSolver[igridn]->_KK->matrix_ABC(*_RRamr[igridn], *_LinSolver[igridn]->_KKamr, *_PPamr[igridn], _MGmatrixFineReuse);
             }
           }
+        }
 
-          clock_t mg_proj_mat_time = clock();
-          for(unsigned i = igridn; i > 0; i--) {
-            if(_RR[i]) {
-              if(i == igridn)
-                _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixFineReuse);
-              else {
-                _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixCoarseReuse);
-                if(_LinSolver[i - 1u]->_KKamr) {
-                  delete _LinSolver[i - 1u]->_KKamr;
-                  _LinSolver[i - 1u]->_KKamr = NULL;
+        if(buildSolver) {
+
+          if(solverIsBuilt && _MGsolver) {
+            _LinSolver[igridn]->MGClear();
+          }
+
+          _MGmatrixFineReuse = (0 == nonLinearIterator) ? false : true;
+          _MGmatrixCoarseReuse = (igridn - grid0 > 0) ?  true : _MGmatrixFineReuse;
+
+          double mg_proj_mat_time = Profiler::GetWallTime();
+          Profiler::Start("MGProjectionMatrices");
+          if(IsMatrixFreeLevel(igridn)) {
+            AssembleCoarseLevels(igridn);
+          }
+          else {
+            for(unsigned i = igridn; i > 0; i--) {
+              if(_RR[i]) {
+                if(i == igridn)
+                  _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixFineReuse);
+                else {
+                  _LinSolver[i - 1u]->_KK->matrix_ABC(*_RR[i], *_LinSolver[i]->_KK, *_PP[i], _MGmatrixCoarseReuse);
+                  if(_LinSolver[i - 1u]->_KKamr) {
+                    delete _LinSolver[i - 1u]->_KKamr;
+                    _LinSolver[i - 1u]->_KKamr = NULL;
+                  }
                 }
               }
-            }
-            else {
-              if(i == igridn)
-                _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixFineReuse);
               else {
-                _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixCoarseReuse);
-                if(_LinSolver[i - 1u]->_KKamr) {
-                  delete _LinSolver[i - 1u]->_KKamr;
-                  _LinSolver[i - 1u]->_KKamr = NULL;
+                if(i == igridn)
+                  _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixFineReuse);
+                else {
+                  _LinSolver[i - 1u]->_KK->matrix_PtAP(*_PP[i], *_LinSolver[i]->_KK, _MGmatrixCoarseReuse);
+                  if(_LinSolver[i - 1u]->_KKamr) {
+                    delete _LinSolver[i - 1u]->_KKamr;
+                    _LinSolver[i - 1u]->_KKamr = NULL;
+                  }
                 }
               }
             }
           }
+          Profiler::Stop();
           std::cout << "   ********* Level Max " << igridn + 1 << " MG PROJECTION MATRICES TIME:\t" \
-                    << static_cast<double>((clock() - mg_proj_mat_time)) / CLOCKS_PER_SEC << std::endl;
+                    << (Profiler::GetWallTime() - mg_proj_mat_time) << std::endl;
 
-          clock_t mg_init_time = clock();
+          double mg_init_time = Profiler::GetWallTime();
           if(_MGsolver) {
+            ProfilerTimer timer("MGSetup");
             _LinSolver[igridn]->MGInit(mgSmootherType, igridn + 1, _outer_ksp_solver.c_str());
 
             for(unsigned i = 0; i <= igridn; i++) {
@@ -219,13 +291,19 @@ restart:
             }
           }
           std::cout << "   ********* Level Max " << igridn + 1 << " MGINIT TIME:\t" \
-                    << static_cast<double>((clock() - mg_init_time)) / CLOCKS_PER_SEC << std::endl;
+                    << (Profiler::GetWallTime() - mg_init_time) << std::endl;
+
+          solverIsBuilt = true;
+          lastBuildIterator = nonLinearIterator;
+        }
+        else if(_buildSolver) {
+          std::cout << "   ********* Level Max " << igridn + 1 << " REUSE JACOBIAN BUILT AT ITERATION " << lastBuildIterator + 1 << std::endl;
         }
         
-        totalAssembyTime += static_cast<double>((clock() - start_assembly_time)) / CLOCKS_PER_SEC;
+        totalAssembyTime += (Profiler::GetWallTime() - start_assembly_time);
         std::cout << "   ********* Level Max " << igridn + 1 << " PREPARATION TIME:\t" << \
-                  static_cast<double>((clock() - start_preparation_time)) / CLOCKS_PER_SEC << std::endl;
-        clock_t startUpdateResidualTime = clock();
+                  (Profiler::GetWallTime() - start_preparation_time) << std::endl;
+        double startUpdateResidualTime = Profiler::GetWallTime();
 
         for(unsigned updateResidualIterator = 0; updateResidualIterator < _maxNumberOfResidualUpdateIterations; updateResidualIterator++) {
 
@@ -240,7 +318,9 @@ restart:
 
           _LinSolver[igridn]->SetResZero();
           _assembleMatrix = false;
+          Profiler::Start("ResidualAssembly");
           _assemble_system_function(_equation_systems);
+          Profiler::Stop();
           if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
             if(!_RRamr[igridn]) {
               (_LinSolver[igridn]->_RESC)->matrix_mult_transpose(*_LinSolver[igridn]->_RES, *_PPamr[igridn]);
@@ -253,20 +333,19 @@ restart:
           if(_bitFlipOccurred) break;
         }
 
-        if(_buildSolver) {
-          if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
-            _LinSolver[igridn]->SwapMatrices();
-          }
-          if(_MGsolver) {
-            _LinSolver[igridn]->MGClear();
-          }
+        if(_buildSolver && !_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
+          _LinSolver[igridn]->SwapMatrices();
         }
 
         double nonLinearEps;
         bool nonLinearIsConverged = HasNonLinearConverged(igridn, nonLinearEps);
 
+        // a lagged Jacobian that no longer reduces the correction enough is rebuilt at the next iteration
+        stalled = (!buildSolver && nonLinearEps > _jacobianStallRatio * previousNonLinearEps);
+        previousNonLinearEps = nonLinearEps;
+
         std::cout << "     ********* Linear Cycle + Residual Update-Cycle TIME:\t" << std::setw(11) << std::setprecision(6) << std::fixed
-                  << static_cast<double>((clock() - startUpdateResidualTime)) / CLOCKS_PER_SEC << std::endl;
+                  << (Profiler::GetWallTime() - startUpdateResidualTime) << std::endl;
 
                   
        if (_debug_nonlinear)  {
@@ -290,6 +369,14 @@ restart:
         if(nonLinearIsConverged || _bitFlipOccurred) break;
 
       }  //end nonlinear iterations
+
+      if(solverIsBuilt && _MGsolver) {
+        _LinSolver[igridn]->MGClear();
+      }
+      if(_useEisenstatWalker) {
+        _linearAbsoluteConvergenceTolerance = linearAbsoluteConvergenceTolerance;
+        if(_MGsolver) _LinSolver[igridn]->SetTolerances(_rtol, _atol, _divtol, _maxits, _restart);
+      }
       
       _last_nonliniteration = _nonliniteration;
       
@@ -304,18 +391,19 @@ restart:
 
 
       std::cout << std::endl << "   ****** Nonlinear-Cycle TIME: " << std::setw(11) << std::setprecision(6) << std::fixed
-                << static_cast<double>((clock() - start_nl_time)) / CLOCKS_PER_SEC << std::endl;
+                << (Profiler::GetWallTime() - start_nl_time) << std::endl;
 
       std::cout << std::endl << "   ****** End Level Max " << igridn + 1 << " ******" << std::endl;
     }
 
-    double totalSolverTime = static_cast<double>((clock() - start_mg_time)) / CLOCKS_PER_SEC;
+    double totalSolverTime = (Profiler::GetWallTime() - start_mg_time);
     std::cout << std::endl << "   *** Nonlinear " << _solverType << " TIME: " << std::setw(11) << std::setprecision(6) << std::fixed
               << totalSolverTime <<  " = assembly TIME( " << totalAssembyTime << " ) + "
               << " solver TIME( " << totalSolverTime - totalAssembyTime << " ) " << std::endl;
 
     _totalAssemblyTime += totalAssembyTime;
     _totalSolverTime += totalSolverTime - totalAssembyTime;
+    Profiler::Stop();
   }
 
   
@@ -104,6 +104,27 @@ public:
     }
     
     void compute_convergence_rate() const;
+
+    /** Rebuild the Jacobian and the multigrid hierarchy every rebuildFrequency nonlinear iterations, or after an iteration
+     * that reduced the nonlinear correction by less than stallRatio. The iterations in between assemble only the residual
+     * and reuse the last matrices, projections and KSP. The default rebuildFrequency = 1 rebuilds at every iteration */
+    void SetJacobianReuse(const unsigned &rebuildFrequency, const double &stallRatio = 0.5) {
+        _jacobianRebuildFrequency = (rebuildFrequency > 0) ? rebuildFrequency : 1;
+        _jacobianStallRatio = stallRatio;
+    }
+
+    /** Adaptive relative tolerance of the linear solve (Eisenstat-Walker, choice 2):
+     * eta_k = gamma (|F_k| / |F_k-1|)^alpha, safeguarded by gamma eta_k-1^alpha, eta_0 = etaInitial and eta_k <= etaMax.
+     * It is used as rtol of the outer KSP and, times |F_k|, as linear residual tolerance; the tolerances set on the system
+     * are the lower bounds */
+    void SetEisenstatWalker(const bool &useEisenstatWalker, const double &etaInitial = 0.3, const double &etaMax = 0.9,
+                            const double &gamma = 0.9, const double &alpha = 1.618) {
+        _useEisenstatWalker = useEisenstatWalker;
+        _ewEtaInitial = etaInitial;
+        _ewEtaMax = etaMax;
+        _ewGamma = gamma;
+        _ewAlpha = alpha;
+    }
     
 protected:
 
@@ -135,6 +156,17 @@ protected:
     
     /** Current nonlinear iteration index */
     unsigned _nonliniteration;
+
+    /** Jacobian reuse policy */
+    unsigned _jacobianRebuildFrequency;
+    double _jacobianStallRatio;
+
+    /** Eisenstat-Walker forcing term parameters */
+    bool _useEisenstatWalker;
+    double _ewEtaInitial;
+    double _ewEtaMax;
+    double _ewGamma;
+    double _ewAlpha;
     
     /** Solves the system. */
     virtual void solve (const MgSmootherType& mgSmootherType = MULTIPLICATIVE);
@@ -144,6 +176,9 @@ private:
     /** To be Added */
     void CreateSystemPDEStructure();
 
+    /** l2 norm of the assembled residual on the non-Dirichlet dofs, over all the variables of the system */
+    double GetNonLinearResidualNorm(const unsigned &igridn);
+
 };
 
 
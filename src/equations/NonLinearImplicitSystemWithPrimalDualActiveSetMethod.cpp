@@ -16,6 +16,7 @@
 #include "NonLinearImplicitSystemWithPrimalDualActiveSetMethod.hpp"
 #include "LinearEquationSolver.hpp"
 #include "NumericVector.hpp"
+#include "Profiler.hpp"
 #include "iomanip"
 
 namespace femus {
@@ -38,7 +39,8 @@ namespace femus {
 
     _bitFlipCounter = 0;
     
-    clock_t start_mg_time = clock();
+    Profiler::Start("NonLinearSolve");
+    double start_mg_time = Profiler::GetWallTime();
 
     double totalAssembyTime = 0.;
 
@@ -61,7 +63,7 @@ namespace femus {
 
     for(unsigned igridn = grid0; igridn < _gridn; igridn++) {     //_igridn
       std::cout << std::endl << "   ****** Start Level Max " << igridn + 1 << " ******" << std::endl;
-      clock_t start_nl_time = clock();
+      double start_nl_time = Profiler::GetWallTime();
 
       bool ThisIsAMR = (_mg_type == F_CYCLE && _AMRtest &&  AMRCounter < _maxAMRlevels && igridn == _gridn - 1u) ? 1 : 0;
 restart:
@@ -79,14 +81,16 @@ restart:
             
         std::cout << std::endl << "   ********* Nonlinear iteration " << nonLinearIterator + 1 << " *********" << std::endl;
 
-        clock_t start_preparation_time = clock();
-        clock_t start_assembly_time = clock();
+        double start_preparation_time = Profiler::GetWallTime();
+        double start_assembly_time = Profiler::GetWallTime();
         _levelToAssemble = igridn; //Be carefull!!!! this is needed in the _assemble_function
         _LinSolver[igridn]->SetResZero();
         _assembleMatrix = _buildSolver;
+        Profiler::Start("Assembly");
         _assemble_system_function(_equation_systems);
+        Profiler::Stop();
         std::cout << "   ********* Level Max " << igridn + 1 << " ASSEMBLY TIME:\t" << \
-                  static_cast<double>((clock() - start_assembly_time)) / CLOCKS_PER_SEC << std::endl;
+                  (Profiler::GetWallTime() - start_assembly_time) << std::endl;
 	
         if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
           if(!_RRamr[igridn]) {
@@ -113,7 +117,8 @@ restart:
             }
           }
 
-          clock_t mg_proj_mat_time = clock();
+          double mg_proj_mat_time = Profiler::GetWallTime();
+          Profiler::Start("MGProjectionMatrices");
           for(unsigned i = igridn; i > 0; i--) {
             if(_RR[i]) {
               if(i == igridn)
@@ -138,11 +143,13 @@ restart:
               }
             }
           }
+          Profiler::Stop();
           std::cout << "   ********* Level Max " << igridn + 1 << " MG PROJECTION MATRICES TIME:\t" \
-                    << static_cast<double>((clock() - mg_proj_mat_time)) / CLOCKS_PER_SEC << std::endl;
+                    << (Profiler::GetWallTime() - mg_proj_mat_time) << std::endl;
 
-          clock_t mg_init_time = clock();
+          double mg_init_time = Profiler::GetWallTime();
           if(_MGsolver) {
+            ProfilerTimer timer("MGSetup");
             _LinSolver[igridn]->MGInit(mgSmootherType, igridn + 1, _outer_ksp_solver.c_str());
 
             for(unsigned i = 0; i <= igridn; i++) {
@@ -153,12 +160,12 @@ restart:
             }
           }
           std::cout << "   ********* Level Max " << igridn + 1 << " MGINIT TIME:\t" \
-                    << static_cast<double>((clock() - mg_init_time)) / CLOCKS_PER_SEC << std::endl;
+                    << (Profiler::GetWallTime() - mg_init_time) << std::endl;
         }
-        totalAssembyTime += static_cast<double>((clock() - start_assembly_time)) / CLOCKS_PER_SEC;
+        totalAssembyTime += (Profiler::GetWallTime() - start_assembly_time);
         std::cout << "   ********* Level Max " << igridn + 1 << " PREPARATION TIME:\t" << \
-                  static_cast<double>((clock() - start_preparation_time)) / CLOCKS_PER_SEC << std::endl;
-        clock_t startUpdateResidualTime = clock();
+                  (Profiler::GetWallTime() - start_preparation_time) << std::endl;
+        double startUpdateResidualTime = Profiler::GetWallTime();
 
         for(unsigned updateResidualIterator = 0; updateResidualIterator < _maxNumberOfResidualUpdateIterations; updateResidualIterator++) {
 
@@ -173,7 +180,9 @@ restart:
 
           _LinSolver[igridn]->SetResZero();
           _assembleMatrix = false;
+          Profiler::Start("ResidualAssembly");
           _assemble_system_function(_equation_systems);
+          Profiler::Stop();
           if(!_ml_msh->GetLevel(igridn)->GetIfHomogeneous()) {
             if(!_RRamr[igridn]) {
               (_LinSolver[igridn]->_RESC)->matrix_mult_transpose(*_LinSolver[igridn]->_RES, *_PPamr[igridn]);
@@ -199,7 +208,7 @@ restart:
         bool nonLinearIsConverged = HasNonLinearConverged(igridn, nonLinearEps);
 
         std::cout << "     ********* Linear Cycle + Residual Update-Cycle TIME:\t" << std::setw(11) << std::setprecision(6) << std::fixed
-                  << static_cast<double>((clock() - startUpdateResidualTime)) / CLOCKS_PER_SEC << std::endl;
+                  << (Profiler::GetWallTime() - startUpdateResidualTime) << std::endl;
 
                   
        if (_debug_nonlinear)  {
@@ -248,18 +257,19 @@ restart:
 
 
       std::cout << std::endl << "   ****** Nonlinear-Cycle TIME: " << std::setw(11) << std::setprecision(6) << std::fixed
-                << static_cast<double>((clock() - start_nl_time)) / CLOCKS_PER_SEC << std::endl;
+                << (Profiler::GetWallTime() - start_nl_time) << std::endl;
 
       std::cout << std::endl << "   ****** End Level Max " << igridn + 1 << " ******" << std::endl;
     }
 
-    double totalSolverTime = static_cast<double>((clock() - start_mg_time)) / CLOCKS_PER_SEC;
+    double totalSolverTime = (Profiler::GetWallTime() - start_mg_time);
     std::cout << std::endl << "   *** Nonlinear " << _solverType << " TIME: " << std::setw(11) << std::setprecision(6) << std::fixed
               << totalSolverTime <<  " = assembly TIME( " << totalAssembyTime << " ) + "
               << " solver TIME( " << totalSolverTime - totalAssembyTime << " ) " << std::endl;
 
     _totalAssemblyTime += totalAssembyTime;
     _totalSolverTime += totalSolverTime - totalAssembyTime;
+    Profiler::Stop();
   }
 
 
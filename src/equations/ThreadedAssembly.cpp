@@ -0,0 +1,204 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: ThreadedAssembly
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ThreadedAssembly.hpp"
+#include "Mesh.hpp"
+#include "Solution.hpp"
+#include "NumericVector.hpp"
+#include "SparseMatrix.hpp"
+#include "adept.h"
+#include <iostream>
+
+namespace femus {
+
+  ThreadedAssembly::ThreadedAssembly(const unsigned &nThreads) {
+
+    _nThreads = (nThreads > 0) ? nThreads : 1;
+    if(_nThreads > 1 && adept::is_thread_unsafe()) {
+      std::cout << "Warning: adept has been compiled without thread local stacks, the assembly runs on one thread" << std::endl;
+      _nThreads = 1;
+    }
+
+    _generation = 0;
+    _running = 0;
+    _stop = false;
+    _elementFunction = NULL;
+    _elements = NULL;
+    _size = 0;
+    _chunk = 1;
+    _next = 0;
+
+    _insertBuffer.resize(_nThreads);
+    for(unsigned ithread = 0; ithread < _nThreads; ithread++) {
+      _insertBuffer[ithread].size = 0;
+    }
+
+    for(unsigned ithread = 1; ithread < _nThreads; ithread++) {
+      _threads.push_back(std::thread(&ThreadedAssembly::Worker, this, ithread));
+    }
+  }
+
+  ThreadedAssembly::~ThreadedAssembly() {
+    {
+      std::unique_lock < std::mutex > lock(_mutex);
+      _stop = true;
+    }
+    _startCondition.notify_all();
+    for(unsigned i = 0; i < _threads.size(); i++) {
+      _threads[i].join();
+    }
+  }
+
+  adept::Stack &ThreadedAssembly::GetAdeptStack() {
+    return *adept::active_stack();
+  }
+
+  void ThreadedAssembly::PrepareVector(NumericVector *v) {
+    if(v != NULL && v->local_size() > 0) {
+      (*v)(v->first_local_index());
+    }
+  }
+
+  void ThreadedAssembly::PrepareSolution(Solution *sol) {
+    for(unsigned i = 0; i < sol->_Sol.size(); i++) {
+      PrepareVector(sol->_Sol[i]);
+      if(i < sol->_SolOld.size()) PrepareVector(sol->_SolOld[i]);
+      if(i < sol->_Bdc.size()) PrepareVector(sol->_Bdc[i]);
+    }
+  }
+
+  void ThreadedAssembly::AddElementResidualAndJacobian(NumericVector *RES, SparseMatrix *KK, const std::vector < double > &Res,
+                                                       const std::vector < double > &Jac, const std::vector < int > &sysDof,
+                                                       const unsigned &ithread) {
+    if(_elementFunction == NULL || _nThreads == 1) {
+      RES->add_vector_blocked(Res, sysDof);
+      if(KK != NULL) KK->add_matrix_blocked(Jac, sysDof, sysDof);
+      return;
+    }
+
+    // only the thread ithread touches its buffer until the end of the color
+    InsertBuffer &buffer = _insertBuffer[ithread];
+    if(buffer.size == buffer.entry.size()) {
+      buffer.entry.resize(buffer.size + 1);
+    }
+    InsertEntry &entry = buffer.entry[buffer.size];
+    entry.RES = RES;
+    entry.KK = KK;
+    entry.Res.assign(Res.begin(), Res.end());
+    if(KK != NULL) entry.Jac.assign(Jac.begin(), Jac.end());
+    entry.sysDof.assign(sysDof.begin(), sysDof.end());
+    buffer.size++;
+  }
+
+  void ThreadedAssembly::FlushInsertBuffers() {
+    for(unsigned ithread = 0; ithread < _nThreads; ithread++) {
+      InsertBuffer &buffer = _insertBuffer[ithread];
+      for(unsigned i = 0; i < buffer.size; i++) {
+        InsertEntry &entry = buffer.entry[i];
+        entry.RES->add_vector_blocked(entry.Res, entry.sysDof);
+        if(entry.KK != NULL) entry.KK->add_matrix_blocked(entry.Jac, entry.sysDof, entry.sysDof);
+      }
+      buffer.size = 0;
+    }
+  }
+
+  void ThreadedAssembly::RunColor(const unsigned &ithread) {
+    while(true) {
+      unsigned begin = _next.fetch_add(_chunk);
+      if(begin >= _size) break;
+      unsigned end = (begin + _chunk < _size) ? begin + _chunk : _size;
+      for(unsigned i = begin; i < end; i++) {
+        (*_elementFunction)(_elements[i], ithread);
+      }
+    }
+  }
+
+  void ThreadedAssembly::Worker(const unsigned ithread) {
+
+    // the stack is activated on this thread only
+    adept::Stack stack;
+
+    unsigned generation = 0;
+    while(true) {
+      {
+        std::unique_lock < std::mutex > lock(_mutex);
+        _startCondition.wait(lock, [&] { return _stop || _generation != generation; });
+        if(_stop) return;
+        generation = _generation;
+      }
+
+      RunColor(ithread);
+
+      {
+        std::unique_lock < std::mutex > lock(_mutex);
+        _running--;
+      }
+      _doneCondition.notify_all();
+    }
+  }
+
+  void ThreadedAssembly::Run(Mesh *msh, const ElementFunction &elementFunction) {
+
+    for(unsigned k = 0; k < 3; k++) {
+      PrepareVector(msh->_topology->_Sol[k]);
+    }
+
+    if(_nThreads == 1) {
+      unsigned iproc = msh->processor_id();
+      for(unsigned iel = msh->_elementOffset[iproc]; iel < msh->_elementOffset[iproc + 1]; iel++) {
+        elementFunction(iel, 0);
+      }
+      return;
+    }
+
+    const std::vector < unsigned > &colorOffset = msh->GetElementColorOffset();
+    const std::vector < unsigned > &coloredElement = msh->GetColoredElements();
+
+    _elementFunction = &elementFunction;
+
+    for(unsigned c = 0; c + 1 < colorOffset.size(); c++) {
+      _size = colorOffset[c + 1] - colorOffset[c];
+      if(_size == 0) continue;
+      _elements = &coloredElement[colorOffset[c]];
+      _chunk = _size / (8 * _nThreads);
+      if(_chunk == 0) _chunk = 1;
+      _next = 0;
+
+      {
+        std::unique_lock < std::mutex > lock(_mutex);
+        _running = _nThreads - 1;
+        _generation++;
+      }
+      _startCondition.notify_all();
+
+      RunColor(0);
+
+      // all the elements of this color must be done before the next color starts
+      {
+        std::unique_lock < std::mutex > lock(_mutex);
+        _doneCondition.wait(lock, [&] { return _running == 0; });
+      }
+
+      FlushInsertBuffers();
+    }
+
+    _elementFunction = NULL;
+    _elements = NULL;
+  }
+
+}
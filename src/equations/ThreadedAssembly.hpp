@@ -0,0 +1,127 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: ThreadedAssembly
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_equations_ThreadedAssembly_hpp__
+#define __femus_equations_ThreadedAssembly_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace adept {
+  class Stack;
+}
+
+namespace femus {
+
+  class Mesh;
+  class Solution;
+  class NumericVector;
+  class SparseMatrix;
+
+  /**
+   * Thread pool for the element loops inside one process.
+   * With more than one thread, Run hands out the owned elements of the mesh one color at a time (see Mesh::GetColoredElements),
+   * so elements assembled concurrently never share a dof. The calling thread works as thread 0 with FemusInit::_adeptStack,
+   * every other thread owns its adept stack, returned by GetAdeptStack() inside the element function.
+   * The element function must keep its local vectors per thread, indexed by ithread.
+   * Since PETSc is not thread safe, the additions to the global matrix and residual go through AddElementResidualAndJacobian:
+   * during a threaded Run every thread appends its elements to its own buffer, and the calling thread adds all the buffers
+   * to PETSc at the end of each color, without locks.
+   * The NumericVectors read by the element function must be prepared with PrepareSolution or PrepareVector.
+   */
+  class ThreadedAssembly {
+    public:
+
+      typedef std::function < void (const unsigned &iel, const unsigned &ithread) > ElementFunction;
+
+      ThreadedAssembly(const unsigned &nThreads = 1);
+
+      ~ThreadedAssembly();
+
+      unsigned GetNumberOfThreads() const {
+        return _nThreads;
+      }
+
+      /** Call elementFunction for all the elements owned by this process, the mesh coordinates are prepared here */
+      void Run(Mesh *msh, const ElementFunction &elementFunction);
+
+      /** Adept stack of the calling thread */
+      static adept::Stack &GetAdeptStack();
+
+      /** Get the local array of the vector, so that concurrent reads do not race on it */
+      static void PrepareVector(NumericVector *v);
+
+      /** Prepare all the allocated vectors of sol */
+      static void PrepareSolution(Solution *sol);
+
+      /** Addition of the local residual and jacobian (row-major) to the global RES and KK from the thread ithread,
+       * buffered until the end of the color inside a threaded Run. KK can be NULL */
+      void AddElementResidualAndJacobian(NumericVector *RES, SparseMatrix *KK, const std::vector < double > &Res,
+                                         const std::vector < double > &Jac, const std::vector < int > &sysDof,
+                                         const unsigned &ithread);
+
+    private:
+
+      void Worker(const unsigned ithread);
+
+      /** Loop over the elements of the current color, taking chunks from _next */
+      void RunColor(const unsigned &ithread);
+
+      /** Add the buffered elements of all the threads to PETSc, from the calling thread */
+      void FlushInsertBuffers();
+
+      struct InsertEntry {
+        NumericVector *RES;
+        SparseMatrix *KK;
+        std::vector < double > Res;
+        std::vector < double > Jac;
+        std::vector < int > sysDof;
+      };
+
+      /** Elements of one thread waiting for the insertion, the first size entries are used and the others keep their memory */
+      struct InsertBuffer {
+        unsigned size;
+        std::vector < InsertEntry > entry;
+      };
+
+      unsigned _nThreads;
+      std::vector < std::thread > _threads;
+
+      std::mutex _mutex;
+      std::condition_variable _startCondition;
+      std::condition_variable _doneCondition;
+      unsigned _generation;
+      unsigned _running;
+      bool _stop;
+
+      const ElementFunction *_elementFunction;
+      const unsigned *_elements;
+      unsigned _size;
+      unsigned _chunk;
+      std::atomic < unsigned > _next;
+
+      std::vector < InsertBuffer > _insertBuffer;
+  };
+
+} //end namespace femus
+
+#endif
@@ -22,6 +22,8 @@
 #include "FETypeEnum.hpp"
 #include "Elem.hpp"
 #include "NumericVector.hpp"
+#include <stdint.h>
+#include <algorithm>
 
 using std::cout;
 using std::endl;
@@ -51,6 +53,12 @@ namespace femus {
       
       
     isMpGDAllocated = false;
+
+    _ncPadded = 0;
+    _ngPadded = 0;
+    _shapeTableMemory = NULL;
+    _shapeTable = NULL;
+    _dphiNodeMajor = NULL;
     
       if ( !strcmp(geom_elem, "quad") || !strcmp(geom_elem, "tri") ) { //QUAD or TRI ///@todo delete in the destructor 
            _gauss_bdry = new  Gauss("line",order_gauss);
@@ -77,6 +85,8 @@ namespace femus {
 
     delete _pt_basis;
 
+    delete [] _shapeTableMemory;
+
     if(isMpGDAllocated) {
       for(int g = 0; g < GetGaussRule().GetGaussPointsNumber(); g++) {
         delete [] _phi_mapGD[g];
@@ -665,6 +675,171 @@ namespace femus {
 
   
    }
+
+
+//----------------------------------------------------------------------------------------------------
+// aligned shape tables and batched Jacobian
+//-----------------------------------------------------------------------------------------------------
+
+  void elem_type::BuildShapeTables() {
+
+    const unsigned nGauss = _gauss.GetGaussPointsNumber();
+    _ncPadded = (_nc + 3) / 4 * 4;
+    _ngPadded = (nGauss + 3) / 4 * 4;
+
+    unsigned tableSize = nGauss * (_dim + 1) * _ncPadded;
+    unsigned nodeMajorSize = _nc * _dim * _ngPadded;
+
+    // 3 extra doubles to align the tables on 32 bytes
+    delete [] _shapeTableMemory;
+    _shapeTableMemory = new double [tableSize + nodeMajorSize + 3];
+    std::fill(_shapeTableMemory, _shapeTableMemory + tableSize + nodeMajorSize + 3, 0.);
+    _shapeTable = reinterpret_cast < double* >((reinterpret_cast < uintptr_t >(_shapeTableMemory) + 31) & ~static_cast < uintptr_t >(31));
+    _dphiNodeMajor = _shapeTable + tableSize;
+
+    for(unsigned ig = 0; ig < nGauss; ig++) {
+      double* table = _shapeTable + ig * (_dim + 1) * _ncPadded;
+      const double* phi = GetPhi(ig);
+      for(unsigned i = 0; i < _nc; i++) {
+        table[i] = phi[i];
+      }
+      for(unsigned d = 0; d < _dim; d++) {
+        const double* dphi = (this->*_DPhiXiEtaZetaPtr[d])(ig);
+        for(unsigned i = 0; i < _nc; i++) {
+          table[(1 + d) * _ncPadded + i] = dphi[i];
+          _dphiNodeMajor[(i * _dim + d) * _ngPadded + ig] = dphi[i];
+        }
+      }
+    }
+  }
+
+  void elem_type::JacobianBatch(const double* vt, const unsigned& nElements, double* weight, double* gradPhi,
+                                BatchWorkspace& work) const {
+
+    const unsigned dim = _dim;
+    const unsigned nc = _nc;
+    const unsigned ncp = _ncPadded;
+    const unsigned ngp = _ngPadded;
+    const unsigned nGauss = _gauss.GetGaussPointsNumber();
+    const double* gaussWeight = _gauss.GetGaussWeightsPointer();
+
+    // Jac[(a * dim + b) * ngp + ig] = d x_b / d xi_a and JacI in the same layout, as in Jacobian
+    work.Jac.resize(dim * dim * ngp);
+    work.JacI.resize(dim * dim * ngp);
+    work.det.resize(ngp);
+    double* Jac = &work.Jac[0];
+    double* JacI = &work.JacI[0];
+    double* det = &work.det[0];
+
+    for(unsigned iel = 0; iel < nElements; iel++) {
+
+      const double* x = vt + iel * dim * ncp;
+      std::fill(Jac, Jac + dim * dim * ngp, 0.);
+
+      // the loop over the Gauss points is innermost, so that it vectorizes without reordering the sums
+      for(unsigned i = 0; i < nc; i++) {
+        for(unsigned a = 0; a < dim; a++) {
+          const double* dphi = _dphiNodeMajor + (i * dim + a) * ngp;
+          for(unsigned b = 0; b < dim; b++) {
+            const double xb = x[b * ncp + i];
+            double* J = &Jac[(a * dim + b) * ngp];
+            for(unsigned ig = 0; ig < nGauss; ig++) {
+              J[ig] += dphi[ig] * xb;
+            }
+          }
+        }
+      }
+
+      if(dim == 1) {
+        for(unsigned ig = 0; ig < nGauss; ig++) {
+          det[ig] = Jac[ig];
+          JacI[ig] = 1. / Jac[ig];
+        }
+      }
+      else if(dim == 2) {
+        const double* J00 = &Jac[0];
+        const double* J01 = &Jac[ngp];
+        const double* J10 = &Jac[2 * ngp];
+        const double* J11 = &Jac[3 * ngp];
+        for(unsigned ig = 0; ig < nGauss; ig++) {
+          det[ig] = J00[ig] * J11[ig] - J01[ig] * J10[ig];
+          double detI = 1. / det[ig];
+          JacI[ig] = J11[ig] * detI;
+          JacI[ngp + ig] = -J01[ig] * detI;
+          JacI[2 * ngp + ig] = -J10[ig] * detI;
+          JacI[3 * ngp + ig] = J00[ig] * detI;
+        }
+      }
+      else {
+        const double* J[3][3];
+        double* JI[3][3];
+        for(unsigned a = 0; a < 3; a++) {
+          for(unsigned b = 0; b < 3; b++) {
+            J[a][b] = &Jac[(a * 3 + b) * ngp];
+            JI[a][b] = &JacI[(a * 3 + b) * ngp];
+          }
+        }
+        for(unsigned ig = 0; ig < nGauss; ig++) {
+          det[ig] = (J[0][0][ig] * (J[1][1][ig] * J[2][2][ig] - J[1][2][ig] * J[2][1][ig]) +
+                     J[0][1][ig] * (J[1][2][ig] * J[2][0][ig] - J[1][0][ig] * J[2][2][ig]) +
+                     J[0][2][ig] * (J[1][0][ig] * J[2][1][ig] - J[1][1][ig] * J[2][0][ig]));
+          double detI = 1. / det[ig];
+          JI[0][0][ig] = (-J[1][2][ig] * J[2][1][ig] + J[1][1][ig] * J[2][2][ig]) * detI;
+          JI[0][1][ig] = (J[0][2][ig] * J[2][1][ig] - J[0][1][ig] * J[2][2][ig]) * detI;
+          JI[0][2][ig] = (-J[0][2][ig] * J[1][1][ig] + J[0][1][ig] * J[1][2][ig]) * detI;
+          JI[1][0][ig] = (J[1][2][ig] * J[2][0][ig] - J[1][0][ig] * J[2][2][ig]) * detI;
+          JI[1][1][ig] = (-J[0][2][ig] * J[2][0][ig] + J[0][0][ig] * J[2][2][ig]) * detI;
+          JI[1][2][ig] = (J[0][2][ig] * J[1][0][ig] - J[0][0][ig] * J[1][2][ig]) * detI;
+          JI[2][0][ig] = (-J[1][1][ig] * J[2][0][ig] + J[1][0][ig] * J[2][1][ig]) * detI;
+          JI[2][1][ig] = (J[0][1][ig] * J[2][0][ig] - J[0][0][ig] * J[2][1][ig]) * detI;
+          JI[2][2][ig] = (-J[0][1][ig] * J[1][0][ig] + J[0][0][ig] * J[1][1][ig]) * detI;
+        }
+      }
+
+      double* w = weight + iel * nGauss;
+      for(unsigned ig = 0; ig < nGauss; ig++) {
+        w[ig] = det[ig] * gaussWeight[ig];
+      }
+
+      if(gradPhi != NULL) {
+        // gradphi_d = sum_a dphi/dxi_a JacI[d][a], the loop over the padded dofs is innermost
+        for(unsigned ig = 0; ig < nGauss; ig++) {
+          const double* dphi = GetShapeTable(ig) + ncp;
+          for(unsigned d = 0; d < dim; d++) {
+            double* gradPhi_d = gradPhi + ((iel * nGauss + ig) * dim + d) * ncp;
+            for(unsigned i = 0; i < ncp; i++) {
+              gradPhi_d[i] = 0.;
+            }
+            for(unsigned a = 0; a < dim; a++) {
+              const double JIda = JacI[(d * dim + a) * ngp + ig];
+              const double* dphi_a = dphi + a * ncp;
+              for(unsigned i = 0; i < ncp; i++) {
+                gradPhi_d[i] += dphi_a[i] * JIda;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void elem_type::JacobianBatch(const vector < vector < double > >& vt, vector < double >& weight, vector < double >& gradPhi,
+                                BatchWorkspace& work) const {
+
+    const unsigned nGauss = _gauss.GetGaussPointsNumber();
+
+    // the padding is zero
+    work.coordinates.assign(_dim * _ncPadded, 0.);
+    for(unsigned d = 0; d < _dim; d++) {
+      for(unsigned i = 0; i < _nc; i++) {
+        work.coordinates[d * _ncPadded + i] = vt[d][i];
+      }
+    }
+
+    weight.resize(nGauss);
+    gradPhi.resize(nGauss * _dim * _ncPadded);
+    JacobianBatch(&work.coordinates[0], 1, &weight[0], &gradPhi[0], work);
+  }
    
     
 
@@ -792,6 +967,8 @@ namespace femus {
 //=====================
     EvaluateShapeAtQP(geom_elem, fe_order);
 
+    BuildShapeTables();
+
     delete linearElement;
 
   }
@@ -988,6 +1165,8 @@ namespace femus {
 //=====================
     EvaluateShapeAtQP(geom_elem, fe_order);
 
+    BuildShapeTables();
+
     //std::cout << std::endl;
 
     delete linearElement;
@@ -1264,6 +1443,8 @@ namespace femus {
 //=====================
     EvaluateShapeAtQP(geom_elem, fe_order);
 
+    BuildShapeTables();
+
     //std::cout << std::endl;
 
     delete linearElement;
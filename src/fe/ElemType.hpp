@@ -168,6 +168,33 @@ namespace femus
         return _dim;
       };
 
+      /** Number of dofs rounded up to a multiple of 4, the row length of the shape tables and of the batched arrays */
+      inline unsigned GetPaddedDofNumber() const {
+        return _ncPadded;
+      };
+
+      /** Gauss point major table of the shape functions and of their derivatives in the reference coordinates, 32-byte aligned
+       *  and zero padded: GetShapeTable(ig)[c * GetPaddedDofNumber() + i], with c = 0 for phi and c = 1 + d for d phi / d xi_d */
+      inline const double* GetShapeTable(const unsigned& ig) const {
+        return _shapeTable + ig * (_dim + 1) * _ncPadded;
+      };
+
+      /** Work arrays of JacobianBatch, owned by the caller, one for each thread; they are sized on the first call */
+      struct BatchWorkspace {
+        std::vector < double > Jac, JacI, det;
+        std::vector < double > coordinates;
+      };
+
+      /** Weights and physical gradients at all the Gauss points of nElements elements, written to be vectorized by the compiler.
+       *  vt[(iel * _dim + d) * GetPaddedDofNumber() + i] are the coordinates of the nodes, weight[iel * nGauss + ig] and
+       *  gradPhi[((iel * nGauss + ig) * _dim + d) * GetPaddedDofNumber() + i] the results, gradPhi can be NULL */
+      void JacobianBatch(const double* vt, const unsigned& nElements, double* weight, double* gradPhi,
+                         BatchWorkspace& work) const;
+
+      /** JacobianBatch of one element, with the coordinates as in Jacobian */
+      void JacobianBatch(const vector < vector < double > >& vt, vector < double >& weight, vector < double >& gradPhi,
+                         BatchWorkspace& work) const;
+
       /** Set numbers of coarse and fine dofs for 1 element */
       void set_coarse_and_fine_elem_data(const basis* pt_basis_in);
       
@@ -183,6 +210,9 @@ namespace femus
    
       /** Compute element prolongation operator */
       void set_element_prolongation(const basis* linearElement);
+
+      /** Fill the aligned shape tables, called at the end of the constructors of the derived classes */
+      void BuildShapeTables();
       
      // member data
       static unsigned _refindex;
@@ -231,6 +261,12 @@ namespace femus
       
       basis* _pt_basis;  /* FE basis functions*/
 
+      unsigned _ncPadded;         /* _nc rounded up to a multiple of 4 */
+      unsigned _ngPadded;         /* number of Gauss points rounded up to a multiple of 4 */
+      double* _shapeTableMemory;
+      double* _shapeTable;        /* [n_gauss][1 + _dim][_ncPadded], 32-byte aligned */
+      double* _dphiNodeMajor;     /* [_nc][_dim][_ngPadded], so that the Jacobian is accumulated over the Gauss points */
+
 //  Gauss
       const Gauss _gauss;
             Gauss* _gauss_bdry;
@@ -0,0 +1,220 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: ElemTypeTemplate
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_fe_ElemTypeTemplate_hpp__
+#define __femus_fe_ElemTypeTemplate_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ElemType.hpp"
+#include "GeomElTypeEnum.hpp"
+#include <array>
+#include <iostream>
+#include <cstdlib>
+
+namespace femus {
+
+  /** Dimension and number of dofs of the FE family FEOrder (0 linear, 1 quadratic, 2 biquadratic) on the element GeomEl */
+  template < GeomElType GeomEl, unsigned FEOrder > struct ElemTypeTraits;
+
+  template <> struct ElemTypeTraits < HEX, 0 > {
+    static constexpr unsigned Dim = 3, NDofs = 8;
+  };
+  template <> struct ElemTypeTraits < HEX, 1 > {
+    static constexpr unsigned Dim = 3, NDofs = 20;
+  };
+  template <> struct ElemTypeTraits < HEX, 2 > {
+    static constexpr unsigned Dim = 3, NDofs = 27;
+  };
+  template <> struct ElemTypeTraits < QUAD, 0 > {
+    static constexpr unsigned Dim = 2, NDofs = 4;
+  };
+  template <> struct ElemTypeTraits < QUAD, 1 > {
+    static constexpr unsigned Dim = 2, NDofs = 8;
+  };
+  template <> struct ElemTypeTraits < QUAD, 2 > {
+    static constexpr unsigned Dim = 2, NDofs = 9;
+  };
+
+  /** Determinant and inverse of the Jacobian matrix, with the formulas of elem_type */
+  template < unsigned Dim > struct ElemTypeJacobianInverse;
+
+  template <> struct ElemTypeJacobianInverse < 2 > {
+    template < class type >
+    static type Apply(const type(&Jac)[2][2], type(&JacI)[2][2]) {
+      type det = (Jac[0][0] * Jac[1][1] - Jac[0][1] * Jac[1][0]);
+      JacI[0][0] = Jac[1][1] / det;
+      JacI[0][1] = -Jac[0][1] / det;
+      JacI[1][0] = -Jac[1][0] / det;
+      JacI[1][1] = Jac[0][0] / det;
+      return det;
+    }
+  };
+
+  template <> struct ElemTypeJacobianInverse < 3 > {
+    template < class type >
+    static type Apply(const type(&Jac)[3][3], type(&JacI)[3][3]) {
+      type det = (Jac[0][0] * (Jac[1][1] * Jac[2][2] - Jac[1][2] * Jac[2][1]) +
+                  Jac[0][1] * (Jac[1][2] * Jac[2][0] - Jac[1][0] * Jac[2][2]) +
+                  Jac[0][2] * (Jac[1][0] * Jac[2][1] - Jac[1][1] * Jac[2][0]));
+      JacI[0][0] = (-Jac[1][2] * Jac[2][1] + Jac[1][1] * Jac[2][2]) / det;
+      JacI[0][1] = (Jac[0][2] * Jac[2][1] - Jac[0][1] * Jac[2][2]) / det;
+      JacI[0][2] = (-Jac[0][2] * Jac[1][1] + Jac[0][1] * Jac[1][2]) / det;
+      JacI[1][0] = (Jac[1][2] * Jac[2][0] - Jac[1][0] * Jac[2][2]) / det;
+      JacI[1][1] = (-Jac[0][2] * Jac[2][0] + Jac[0][0] * Jac[2][2]) / det;
+      JacI[1][2] = (Jac[0][2] * Jac[1][0] - Jac[0][0] * Jac[1][2]) / det;
+      JacI[2][0] = (-Jac[1][1] * Jac[2][0] + Jac[1][0] * Jac[2][1]) / det;
+      JacI[2][1] = (Jac[0][1] * Jac[2][0] - Jac[0][0] * Jac[2][1]) / det;
+      JacI[2][2] = (-Jac[0][1] * Jac[1][0] + Jac[0][0] * Jac[1][1]) / det;
+      return det;
+    }
+  };
+
+  /**
+   * Element kernels with the number of dofs, Gauss points and the dimension known at compile time, so that the loops
+   * of Jacobian have static bounds and the element data fit in fixed-size arrays. The tables are copied from the
+   * elem_type of the same element, FE family and Gauss rule, whose virtual API is the fallback for all the other cases.
+   * The objects are shared, see GetElemTypeTemplate, and are selected once per element block with DispatchElemTypeTemplate.
+   */
+  template < GeomElType GeomEl, unsigned FEOrder, unsigned NGaussPoints >
+  class elem_type_T {
+    public:
+
+      static constexpr unsigned Dim = ElemTypeTraits < GeomEl, FEOrder >::Dim;
+      static constexpr unsigned NDofs = ElemTypeTraits < GeomEl, FEOrder >::NDofs;
+      static constexpr unsigned NGauss = NGaussPoints;
+
+      /** Coordinates of the element nodes, vt[d][i] */
+      template < class type > using Coordinates = std::array < std::array < type, NDofs >, Dim >;
+
+      /** Physical gradients of the shape functions, gradphi[i * Dim + d] as in elem_type::Jacobian */
+      template < class type > using Gradient = std::array < type, NDofs * Dim >;
+
+      explicit elem_type_T(const elem_type &fe) {
+        if(fe.GetDim() != Dim || fe.GetNDofs() != static_cast < int >(NDofs) || fe.GetGaussPointNumber() != NGauss) {
+          std::cout << "Error in elem_type_T: the element type does not match the template parameters" << std::endl;
+          abort();
+        }
+        const unsigned ncPadded = fe.GetPaddedDofNumber();
+        for(unsigned ig = 0; ig < NGauss; ig++) {
+          const double* table = fe.GetShapeTable(ig);
+          for(unsigned i = 0; i < NDofs; i++) {
+            _phi[ig * NDofs + i] = table[i];
+            for(unsigned d = 0; d < Dim; d++) {
+              _dphidxi[(ig * Dim + d) * NDofs + i] = table[(1 + d) * ncPadded + i];
+            }
+          }
+          _weight[ig] = fe.GetGaussWeight(ig);
+        }
+      }
+
+      /** Shape functions at the Gauss point ig */
+      const double* GetPhi(const unsigned &ig) const {
+        return &_phi[ig * NDofs];
+      }
+
+      /** Weight and physical gradients at the Gauss point ig */
+      template < class type >
+      void Jacobian(const Coordinates < type > &vt, const unsigned &ig, type &weight, Gradient < type > &gradphi) const {
+
+        const double* dphidxi = &_dphidxi[ig * Dim * NDofs];
+
+        type Jac[Dim][Dim];
+        for(unsigned a = 0; a < Dim; a++) {
+          for(unsigned b = 0; b < Dim; b++) {
+            Jac[a][b] = 0.;
+            for(unsigned i = 0; i < NDofs; i++) {
+              Jac[a][b] += dphidxi[a * NDofs + i] * vt[b][i];
+            }
+          }
+        }
+
+        type JacI[Dim][Dim];
+        type det = ElemTypeJacobianInverse < Dim >::Apply(Jac, JacI);
+        weight = det * _weight[ig];
+
+        for(unsigned i = 0; i < NDofs; i++) {
+          for(unsigned d = 0; d < Dim; d++) {
+            type value = 0.;
+            for(unsigned a = 0; a < Dim; a++) {
+              value += dphidxi[a * NDofs + i] * JacI[d][a];
+            }
+            gradphi[i * Dim + d] = value;
+          }
+        }
+      }
+
+    private:
+
+      std::array < double, NGauss * NDofs > _phi;
+      std::array < double, NGauss * Dim * NDofs > _dphidxi;   // [ig][d][i]
+      std::array < double, NGauss > _weight;
+  };
+
+  /** The kernel object of fe, built once for each specialization */
+  template < GeomElType GeomEl, unsigned FEOrder, unsigned NGauss >
+  const elem_type_T < GeomEl, FEOrder, NGauss > &GetElemTypeTemplate(const elem_type &fe) {
+    static const elem_type_T < GeomEl, FEOrder, NGauss > feT(fe);
+    return feT;
+  }
+
+  /** Pick the specialization for the Gauss rule of fe */
+  template < GeomElType GeomEl, unsigned FEOrder, unsigned NGauss0, unsigned NGauss1, class Block >
+  bool DispatchElemTypeTemplateGauss(const elem_type &fe, Block &block) {
+    if(fe.GetGaussPointNumber() == NGauss0) {
+      block(GetElemTypeTemplate < GeomEl, FEOrder, NGauss0 > (fe));
+      return true;
+    }
+    else if(fe.GetGaussPointNumber() == NGauss1) {
+      block(GetElemTypeTemplate < GeomEl, FEOrder, NGauss1 > (fe));
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Call block(feT) with the specialized kernel of the element type ielGeom and FE family solType, once for a block of
+   * elements of that type. Block is a functor with a template operator() on the kernel type, e.g.
+   *
+   *   struct MassBlock {
+   *     template < class FeT > void operator()(const FeT &feT) {
+   *       for(each element of the block) { ... feT.Jacobian(vt, ig, weight, gradphi); ... }
+   *     }
+   *   };
+   *
+   * The Hex8/Hex20/Hex27 and Quad4/Quad8/Quad9 families with the "second"/"third" and "fourth"/"fifth" Gauss rules are
+   * specialized. Return false if there is no specialization, then the caller uses the virtual elem_type API, which stays
+   * the interface of all the other element types and of the assembly with adept. AssembleLaplacian dispatches once for
+   * each element geometry of the mesh.
+   */
+  template < class Block >
+  bool DispatchElemTypeTemplate(const elem_type &fe, const short unsigned &ielGeom, const unsigned &solType, Block &block) {
+    if(ielGeom == HEX) {
+      if(solType == 0) return DispatchElemTypeTemplateGauss < HEX, 0, 8, 27 > (fe, block);
+      if(solType == 1) return DispatchElemTypeTemplateGauss < HEX, 1, 8, 27 > (fe, block);
+      if(solType == 2) return DispatchElemTypeTemplateGauss < HEX, 2, 8, 27 > (fe, block);
+    }
+    else if(ielGeom == QUAD) {
+      if(solType == 0) return DispatchElemTypeTemplateGauss < QUAD, 0, 4, 9 > (fe, block);
+      if(solType == 1) return DispatchElemTypeTemplateGauss < QUAD, 1, 4, 9 > (fe, block);
+      if(solType == 2) return DispatchElemTypeTemplateGauss < QUAD, 2, 4, 9 > (fe, block);
+    }
+    return false;
+  }
+
+} //end namespace femus
+
+#endif
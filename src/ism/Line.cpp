@@ -18,8 +18,10 @@
 //----------------------------------------------------------------------------
 #include "Marker.hpp"
 #include "Line.hpp"
+#include "MarkerSet.hpp"
 #include "NumericVector.hpp"
 #include <cmath>
+#include <algorithm>
 #include "PolynomialBases.hpp"
 #include <boost/math/special_functions/ellint_1.hpp>
 #include <boost/math/special_functions/ellint_2.hpp>
@@ -64,7 +66,9 @@ namespace femus
 
   Line::Line(const std::vector < std::vector < double > > x, const std::vector < double > &mass,
              const std::vector <MarkerType>& markerType,
-             Solution* sol, const unsigned& solType)
+             Solution* sol, const unsigned& solType) :
+    _markers(sol->GetMesh()->GetDimension(), true),
+    _marker(sol->GetMesh()->GetDimension(), solType)
   {
     _sol = sol;
     _mesh = _sol->GetMesh();
@@ -73,26 +77,27 @@ namespace femus
 
     _size = x.size();
 
-    std::vector < Marker*> particles(_size);
-
     _dim = _mesh->GetDimension();
 
     _markerOffset.resize(_nprocs + 1);
     _markerOffset[_nprocs] = _size;
 
-    _particles.resize(_size);
+    _markers.Resize(_size);
     _printList.resize(_size);
 
     for(unsigned j = 0; j < _size; j++) {
-      particles[j] = new Marker(x[j], mass[j], markerType[j], _sol, solType, true);
+      Marker marker(x[j], mass[j], markerType[j], _sol, solType, true);
+      _markers.SetMarker(j, j, &marker);
     }
-    Reorder(particles);
+    Reorder();
 
   }
 
   Line::Line(const std::vector < std::vector < double > > x,
              const std::vector <MarkerType>& markerType,
-             Solution* sol, const unsigned& solType)
+             Solution* sol, const unsigned& solType) :
+    _markers(sol->GetMesh()->GetDimension()),
+    _marker(sol->GetMesh()->GetDimension(), solType)
   {
 
     _sol = sol;
@@ -102,613 +107,141 @@ namespace femus
 
     _size = x.size();
 
-    std::vector < Marker*> particles(_size);
-
     _dim = _mesh->GetDimension();
 
     _markerOffset.resize(_nprocs + 1);
     _markerOffset[_nprocs] = _size;
 
-    _particles.resize(_size);
+    _markers.Resize(_size);
     _printList.resize(_size);
 
     for(unsigned j = 0; j < _size; j++) {
-      particles[j] = new Marker(x[j], 0., markerType[j], _sol, solType, true);
+      Marker marker(x[j], 0., markerType[j], _sol, solType, true);
+      _markers.SetMarker(j, j, &marker);
     }
-    Reorder(particles);
+    Reorder();
   }
 
-  void Line::Reorder(std::vector < Marker*> &particles)
+  void Line::Reorder()
   {
 
-    //BEGIN TEST ASSIGNATION
-
-//     std::vector <double> xtry(_dim);
-//     std::vector <double> xitry(_dim);
-//
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//
-//       unsigned proc;
-//       unsigned elem;
-//       proc = particles[j]->GetMarkerProc();
-//       elem = particles[j]->GetMarkerElement();
-//
-//       std::cout << "proc = " << proc << " , " << "elem = " << elem <<
-//                 " , " << std::endl;
-//       particles[j]->GetMarkerCoordinates(xtry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "x[" << i << "]=" << xtry[i] << std::endl;
-//       }
-//       particles[j]->GetMarkerLocalCoordinatesLine(xitry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "xi[" << i << "]=" << xitry[i] << std::endl;
-//       }
-//     }
-//
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//       _particles[j] = particles[j];
-//     }
-//
-//     std::cout << " ------------------------------------------------------------------------------------------------ " << std::endl;
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//
-//       unsigned proc;
-//       unsigned elem;
-//       proc = _particles[j]->GetMarkerProc();
-//       elem = _particles[j]->GetMarkerElement();
-//       std::cout << "proc = " << proc << " , " << "elem = " << elem <<
-//                 " , " << std::endl;
-//       _particles[j]->GetMarkerCoordinates(xtry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "x[" << i << "]=" << xtry[i] << std::endl;
-//       }
-//       _particles[j]->GetMarkerLocalCoordinatesLine(xitry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "xi[" << i << "]=" << xitry[i] << std::endl;
-//       }
-//     }
-
-
-    //END TEST ASSIGNATION
-
-
-//     std::cout << "FIRST OF ALL" << std::endl;
-//     for(unsigned i = 0; i < _size; i++) {
-//       unsigned proc;
-//       particles[i]->GetMarkerProcLine(proc);
-//       unsigned elem;
-//       particles[i]->GetMarkerElementLine(elem);
-//       std::cout << "Particle: " << i << " , " << "Processor: " << proc << " , "
-//                 << "Element: " << elem << " " << std::endl;
-//     }
-
-    //BEGIN reorder the markers by proc
-    unsigned counter = 0;
-
-    for(unsigned iproc = 0; iproc < _nprocs; iproc++) {
-      _markerOffset[iproc] = counter;
+    //BEGIN reorder the markers by proc and by element
+    std::vector < unsigned > newPosition;
+    SortParticles(newPosition);
 
-      //unsigned  offsetCounter = counter;
-      for(unsigned j = 0; j < _size; j++) {
-        unsigned markerProc = particles[j]->GetMarkerProc(_sol);
-
-        if(markerProc == iproc) {
-          _particles[counter] = particles[j];
-          _printList[j] = counter;
-          counter++;
-        }
-      }
+    for(unsigned j = 0; j < _size; j++) {
+      _printList[j] = newPosition[j];
     }
+    //END reorder the markers by proc and by element
 
-    //END reorder the markers by proc
-
-
-
-
-//     std::cout << "AFTER THE REORDERING BY PROC" << std::endl;
-//     for(unsigned i = 0; i < _size; i++) {
-//       unsigned proc;
-//       _particles[i]->GetMarkerProcLine(proc);
-//       unsigned elem;
-//       _particles[i]->GetMarkerElementLine(elem);
-//       std::cout << "Particle: " << i << " , " << "Processor: " << proc << " , "
-//                 << "Element: " << elem << " " << std::endl;
-//     }
-//
-//     for(unsigned iproc = 0; iproc <= _nprocs; iproc++) {
-//       std::cout << "_markerOffset[" << iproc << "]= " << _markerOffset[iproc] << std::endl;
-//     }
-
-//         for(unsigned i = 0; i < _size; i++) {
-//           std::cout << "_printList[ " << i << "] = " << _printList[i] << std::endl;
-//         }
-//
-//
-//         std::cout << " ------------------------------------------------------------------------------------------------ " << std::endl;
+    GatherLine();
+  };
 
+  void Line::SortParticles(std::vector < unsigned > &newPosition)
+  {
+    // the elements are numbered contiguously by process, so a stable bucket sort by element groups the markers
+    // by process and by element at once. The markers outside the domain belong to iproc 0 and follow its elements
 
-    //BEGIN reorder markers also by element
+    std::vector < unsigned > elem(_size);
 
     for(unsigned j = 0; j < _size; j++) {
-      particles[j] = _particles[j];
+      elem[j] = _markers.GetMarkerElement(j);
     }
 
-    std::vector < unsigned> printList(_size);
-    printList = _printList;
-
     unsigned meshElements = _mesh->GetNumberOfElements();
-    std::vector< bool > elementList(meshElements, false);
-
-
-    //flags to see if we already ordered by that element, 0 = not considered yet
-//     for(unsigned iFlag = 0; iFlag < meshElements; iFlag++) {
-//       elementList[iFlag] = 0;
-//     }
-
-    for(unsigned iproc = 0; iproc < _nprocs; iproc++) {
-
-      bool someMarkersOutsideDomain = false;
-      counter = 0;
-
-      for(unsigned jp = _markerOffset[iproc]; jp < _markerOffset[iproc + 1]; jp++) {
-
-        unsigned jel;
-        jel = particles[jp]->GetMarkerElement();
-
-        if(jel != UINT_MAX) {
-
-          if(elementList[jel] == false) {
-
-            elementList[jel] = true;
-
-            _particles[_markerOffset[iproc] + counter] = particles[jp];
-
-            for(unsigned iList = 0; iList < _size; iList++) {
-              if(printList[iList] == jp) {
-                _printList[iList] = _markerOffset[iproc] + counter;
-                break;
-              }
-            }
-
-            counter++;
-
-
-            for(unsigned ip = jp + 1; ip < _markerOffset[iproc + 1]; ip++) {
-              unsigned iel;
-              iel = particles[ip]->GetMarkerElement();
-
-              if(iel == jel) {
-                _particles[_markerOffset[iproc] + counter] = particles[ip];
-
-                for(unsigned iList = 0; iList < _size; iList++) {
-                  if(printList[iList] == ip) {
-                    _printList[iList] = _markerOffset[iproc] + counter;
-                    break;
-                  }
-                }
-
-                counter++;
-              }
-            }
-          }
-        }
-        else {
-          someMarkersOutsideDomain = true;
-        }
-      }
-
-      if(someMarkersOutsideDomain == true) {
-        if(iproc == 0) {
-          for(unsigned i = 0; i < _size; i++) {
-            unsigned iel = particles[i]->GetMarkerElement();
-
-            if(iel == UINT_MAX) {
-
-              _particles[_markerOffset[0] + counter] = particles[i];
-
-              for(unsigned iList = 0; iList < _size; iList++) {
-                if(printList[iList] == i) {
-                  _printList[iList] = _markerOffset[0] + counter;
-                  break;
-                }
-              }
-
-              counter++;
-            }
-          }
-        }
-        else {
-          std::cout << "warning" << std::endl;
-          std::cout << "the marker is outside the domain but not in iproc 0" << std::endl;
-          abort();
-        }
-      }
-
-    }
-
-
-
-
-    //END reorder markers also by element
-
-
-
-//     //BEGIN reorder markers also by element
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//       particles[j] = _particles[j];
-//     }
-//
-//     unsigned* elementList = new unsigned [_sol->GetMesh()->GetNumberOfElements()];
-//
-//     std::cout << "number of elements = " <<  _sol->GetMesh()->GetNumberOfElements() << std::endl;
-//
-//     std::vector < unsigned> printList(_size);
-//
-//     //flags to see if we already ordered by that element, 0 = not considered yet
-//     for(unsigned iFlag = 0; iFlag < _mesh->GetNumberOfElements(); iFlag++) {
-//       elementList[iFlag] = 0;
-//     }
-//
-//     printList = _printList;
-//
-//     for(unsigned iproc = 0; iproc < _nprocs; iproc++) {
-//
-//       counter = 0;
-//
-//       for(unsigned jp = _markerOffset[iproc]; jp < _markerOffset[iproc + 1]; jp++) {
-//
-//         unsigned jel;
-//         jel = particles[jp]->GetMarkerElement();
-//
-// 	std::cout<< " Marker in element jel = " << jel << std::endl;
-//
-//         if(elementList[jel] == 0) {
-//
-//           elementList[jel] = 1;
-//
-//           _particles[_markerOffset[iproc] + counter] = particles[jp];
-//           for(unsigned iList = 0; iList < _size; iList++) {
-//             if(printList[iList] == jp) {
-//               _printList[iList] = _markerOffset[iproc] + counter;
-//               break;
-//             }
-//           }
-//           counter++;
-//
-//
-//           for(unsigned ip = _markerOffset[iproc]; ip < _markerOffset[iproc + 1]; ip++) {
-//             unsigned iel;
-//             iel = particles[ip]->GetMarkerElement();
-//             if(ip != jp && iel == jel) {
-//               //std::cout << " jel =" << jel << " , " << "ip = " << ip << " , " << "jp = " << jp <<  std::endl;
-//               elementList[iel] = 1;
-//               _particles[_markerOffset[iproc] + counter] = particles[ip];
-//               for(unsigned iList = 0; iList < _size; iList++) {
-//                 if(printList[iList] == ip) {
-//                   _printList[iList] = _markerOffset[iproc] + counter;
-//                   break;
-//                 }
-//               }
-//               counter++;
-//             }
-//           }
-//         }
-//       }
-//     }
-//
-//     //END reorder markers also by element
-
-//         for(unsigned i = 0; i < _size; i++) {
-//           std::cout << "_printList[ " << i << "] = " << _printList[i] << std::endl;
-//         }
-
-
-//     std::cout << "AFTER THE REORDERING BY ELEM" << std::endl;
-//     for(unsigned i = 0; i < _size; i++) {
-//       unsigned proc;
-//       _particles[i]->GetMarkerProcLine(proc);
-//       unsigned elem;
-//       _particles[i]->GetMarkerElementLine(elem);
-//       std::cout << "Particle: " << i << " , " << "Processor: " << proc << " , "
-//                 << "Element: " << elem << " " << "Pointer: " << _particles[i] << std::endl;
-//     }
-
-
-    _line.resize(_size + 1);
+    std::vector < unsigned > bucketOffset;
+    MarkerSet::BucketSortByElement(elem, 0, meshElements, _mesh->_elementOffset[1], bucketOffset, newPosition);
 
-    for(unsigned j = 0; j < _size; j++) {
-      _particles[_printList[j]]->GetMarkerCoordinates(_line[j]);
+    _markerOffset[0] = 0;
+    for(unsigned iproc = 1; iproc < _nprocs; iproc++) {
+      _markerOffset[iproc] = bucketOffset[_mesh->_elementOffset[iproc] + 1];
     }
+    _markerOffset[_nprocs] = _size;
 
-    _particles[_printList[0]]->GetMarkerCoordinates(_line[_size]);
-
-    // delete[] elementList;
-    // std::vector < unsigned > ().swap(printList);
+    _markers.Permute(newPosition);
+  }
 
+  Line::~Line()
+  {
+  }
 
-//     for(unsigned i=0;i<_size;i++){
-//       if(_printList[i] == 3395){
-// 	std::cout << i<< std::endl;
-//       }
-//     }
-//
-//     exit(0);
-  };
+  void Line::LoadMarker(const unsigned &i)
+  {
+    _markers.GetMarker(i, &_marker);
+    _marker.SetMarkerProc(_iproc);
+  }
 
-  Line::~Line()
+  void Line::StoreMarker(const unsigned &i)
   {
-    for(unsigned j = 0; j < _size; j++) {
-      //std::cout << j << " " << _particles[j] << std::endl<< std::flush;
-      delete _particles[j];
-    }
+    _markers.SetMarker(i, _markers.GetMarkerId(i), &_marker);
   }
 
   void Line::UpdateLine()
   {
 
-    std::vector < Marker*> particles(_size);
     std::vector < unsigned> printList(_size);
 
-    for(unsigned j = 0; j < _size; j++) {
-      particles[j] = _particles[j];
-    }
-
     printList = _printList;
 
+    //BEGIN reorder the markers by proc and by element
+    std::vector < unsigned > newPosition;
+    SortParticles(newPosition);
 
-    //BEGIN TEST ASSIGNATION
-
-//     std::vector <double> xtry(_dim);
-//     std::vector <double> xitry(_dim);
-//
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//
-//       unsigned proc;
-//       unsigned elem;
-//       proc = particles[j]->GetMarkerProc();
-//       elem = particles[j]->GetMarkerElement();
-//
-//       std::cout << "proc = " << proc << " , " << "elem = " << elem <<
-//                 " , " << std::endl;
-//       particles[j]->GetMarkerCoordinates(xtry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "x[" << i << "]=" << xtry[i] << std::endl;
-//       }
-//       particles[j]->GetMarkerLocalCoordinatesLine(xitry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "xi[" << i << "]=" << xitry[i] << std::endl;
-//       }
-//     }
-//
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//       _particles[j] = particles[j];
-//     }
-//
-//     std::cout << " ------------------------------------------------------------------------------------------------ " << std::endl;
-//
-//     for(unsigned j = 0; j < _size; j++) {
-//
-//       unsigned proc;
-//       unsigned elem;
-//       proc = _particles[j]->GetMarkerProc();
-//       elem = _particles[j]->GetMarkerElement();
-//       std::cout << "proc = " << proc << " , " << "elem = " << elem <<
-//                 " , " << std::endl;
-//       _particles[j]->GetMarkerCoordinates(xtry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "x[" << i << "]=" << xtry[i] << std::endl;
-//       }
-//       _particles[j]->GetMarkerLocalCoordinatesLine(xitry);
-//       for(unsigned i = 0 ; i < _dim; i++) {
-//         std::cout << "xi[" << i << "]=" << xitry[i] << std::endl;
-//       }
-//     }
-
-
-    //END TEST ASSIGNATION
-
-
-
-
-
-
-
-//     std::cout << "FIRST OF ALL ----------------------- UPDATE LINE" << std::endl;
-//     for(unsigned i = 0; i < _size; i++) {
-//       unsigned proc;
-//       unsigned elem;
-//       std::vector <double> chiappe;
-//       chiappe = _particles[_printList[i]]->GetIprocMarkerCoordinates();
-//       proc = _particles[_printList[i]]->GetMarkerProc();
-//       elem = _particles[_printList[i]]->GetMarkerElement();
-//       std::cout << "Particle: " << i << " , " << "Processor: " << proc << " , "
-//                 << "Element: " << elem << " ";
-//       for(unsigned i = 0; i < _dim; i++) {
-//         std::cout << "x[" << i << "]=" << chiappe[i] << " ";
-//       }
-//       std::cout << std::endl;
-//     }
-
-    //BEGIN reorder the markers by proc
-    unsigned counter = 0;
-
-    for(unsigned iproc = 0; iproc < _nprocs; iproc++) {
-      _markerOffset[iproc] = counter;
-
-      for(unsigned j = 0; j < _size; j++) {
-        unsigned markerProc = particles[j]->GetMarkerProc(_sol);
-
-        if(markerProc == iproc) {
-          _particles[counter] = particles[j];
-
-          for(unsigned iList = 0; iList < _size; iList++) {
-            if(printList[iList] == j) {
-              _printList[iList] = counter;
-              break;
-            }
-          }
-
-          counter++;
-        }
-      }
+    for(unsigned iList = 0; iList < _size; iList++) {
+      _printList[iList] = newPosition[printList[iList]];
     }
+    //END reorder the markers by proc and by element
 
-    //END reorder the markers by proc
-
-//     for(unsigned iproc = 0; iproc <= _nprocs; iproc++) {
-//       std::cout << "_markerOffset[" << iproc << "]= " << _markerOffset[iproc] << std::endl;
-//     }
-
-//     std::cout << "-----------------------------------------  UPDATE LINE  BY PROCS  -----------------------------------------" << std::endl;
-//     for(unsigned i = 0; i < _size; i++) {
-//       unsigned proc;
-//       unsigned elem;
-//       proc = _particles[i]->GetMarkerProc();
-//       elem = _particles[i]->GetMarkerElement();
-//       std::cout << "Particle: " << i << " , " << "Processor: " << proc << " , "
-//                 << "Element: " << elem << " " << std::endl;
-//     }
-
-
-
-    //BEGIN reorder markers also by element
+    GatherLine();
+  }
 
-    for(unsigned j = 0; j < _size; j++) {
-      particles[j] = _particles[j];
+  void Line::GatherLine()
+  {
+    // the markers are sorted by process, each process shares the coordinates of its own markers with one collective
+    std::vector < int > recvCount(_nprocs), recvOffset(_nprocs);
+    for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+      recvOffset[jproc] = _dim * _markerOffset[jproc];
+      recvCount[jproc] = _dim * (_markerOffset[jproc + 1] - _markerOffset[jproc]);
     }
 
-    printList = _printList;
-
-    unsigned meshElements = _mesh->GetNumberOfElements();
-    std::vector< bool > elementList(meshElements, false);
-
-
-    //flags to see if we already ordered by that element, 0 = not considered yet
-//     for(unsigned iFlag = 0; iFlag < meshElements; iFlag++) {
-//       elementList[iFlag] = 0;
-//     }
-
-    for(unsigned iproc = 0; iproc < _nprocs; iproc++) {
-
-      bool someMarkersOutsideDomain = false;
-      counter = 0;
-
-      for(unsigned jp = _markerOffset[iproc]; jp < _markerOffset[iproc + 1]; jp++) {
-
-        unsigned jel;
-        jel = particles[jp]->GetMarkerElement();
-
-        if(jel != UINT_MAX) {
-
-          if(elementList[jel] == false) {
-
-            elementList[jel] = true;
-
-            _particles[_markerOffset[iproc] + counter] = particles[jp];
-
-            for(unsigned iList = 0; iList < _size; iList++) {
-              if(printList[iList] == jp) {
-                _printList[iList] = _markerOffset[iproc] + counter;
-                break;
-              }
-            }
-
-            counter++;
-
-
-            for(unsigned ip = jp + 1; ip < _markerOffset[iproc + 1]; ip++) {
-              unsigned iel;
-              iel = particles[ip]->GetMarkerElement();
-
-              if(iel == jel) {
-                _particles[_markerOffset[iproc] + counter] = particles[ip];
-
-                for(unsigned iList = 0; iList < _size; iList++) {
-                  if(printList[iList] == ip) {
-                    _printList[iList] = _markerOffset[iproc] + counter;
-                    break;
-                  }
-                }
-
-                counter++;
-              }
-            }
-          }
-        }
-        else {
-          someMarkersOutsideDomain = true;
-        }
-      }
-
-      if(someMarkersOutsideDomain == true) {
-        if(iproc == 0) {
-          for(unsigned i = 0; i < _size; i++) {
-            unsigned iel = particles[i]->GetMarkerElement();
-
-            if(iel == UINT_MAX) {
-
-              _particles[_markerOffset[0] + counter] = particles[i];
-
-              for(unsigned iList = 0; iList < _size; iList++) {
-                if(printList[iList] == i) {
-                  _printList[iList] = _markerOffset[0] + counter;
-                  break;
-                }
-              }
-
-              counter++;
-            }
-          }
-        }
-        else {
-          std::cout << "warning" << std::endl;
-          std::cout << "the marker is outside the domain but not in iproc 0" << std::endl;
-          abort();
-        }
+    std::vector < double > ownedX(recvCount[_iproc]);
+    for(unsigned k = 0; k < _dim; k++) {
+      const double *x = _markers.GetCoordinates(k);
+      for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
+        ownedX[_dim * (iMarker - _markerOffset[_iproc]) + k] = x[iMarker];
       }
-
     }
 
+    std::vector < double > allX(_dim * _size);
+    MPI_Allgatherv(ownedX.data(), recvCount[_iproc], MPI_DOUBLE,
+                   allX.data(), &recvCount[0], &recvOffset[0], MPI_DOUBLE, PETSC_COMM_WORLD);
 
-
-
-    //END reorder markers also by element
-
+    _line.resize(_size + 1);
     for(unsigned j = 0; j < _size; j++) {
-
-      _particles[_printList[j]]->GetMarkerCoordinates(_line[j]);
+      _line[j].assign(allX.begin() + _dim * _printList[j], allX.begin() + _dim * (_printList[j] + 1));
     }
+    if(_size > 0) _line[_size] = _line[0];
+  }
 
-    _particles[_printList[0]]->GetMarkerCoordinates(_line[_size]);
-
-    //delete[] elementList;
-    //std::vector < unsigned > ().swap(printList);
-    //std::vector < unsigned > ().swap(elementList);
-
-
-//     std::cout << "-----------------------------------------  UPDATE LINE  BY ELEMENTS-----------------------------------------" << std::endl;
-//     for(unsigned i = 0; i < _size; i++) {
-//       unsigned proc;
-//       unsigned elem;
-//       //std::vector <double> chiappe;
-//       //chiappe = _particles[_printList[i]]->GetIprocMarkerCoordinates();
-//       proc = _particles[i]->GetMarkerProc(_sol);
-//       elem = _particles[i]->GetMarkerElement();
-//       std::cout << "Particle: " << i << " , " << "Processor: " << proc << " , "
-//                 << "Element: " << elem << " " <<  " "  ;
-// //       for(unsigned j = 0; j < _dim; j++) {
-// //         std::cout << "x[" << j << "]=" << chiappe[j] << " " ;
-// //       }
-//       std::cout << std::endl;
-//     }
+  void Line::GetOwnedMarkers(MarkerSet &markerSet)
+  {
+    markerSet.Resize(_markerOffset[_iproc + 1] - _markerOffset[_iproc]);
 
+    for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
+      markerSet.SetMarker(iMarker - _markerOffset[_iproc], iMarker, _markers, iMarker);
+    }
+  }
 
+  void Line::SetOwnedMarkers(const MarkerSet &markerSet)
+  {
+    for(unsigned i = 0; i < markerSet.size(); i++) {
+      unsigned iMarker = markerSet.GetMarkerId(i);
+      if(iMarker < _markerOffset[_iproc] || iMarker >= _markerOffset[_iproc + 1]) {
+        std::cout << "Line::SetOwnedMarkers: marker " << iMarker << " is not owned by process " << _iproc << std::endl;
+        abort();
+      }
+      _markers.SetMarker(iMarker, _markers.GetMarkerId(iMarker), markerSet, i);
+    }
   }
 
   void Line::AdvectionParallel(const unsigned& n, const double& T, const unsigned& order, ForceFunction force)
@@ -739,13 +272,6 @@ namespace femus
     //BEGIN declare marker instances
     unsigned step;
     std::vector < double > x(_dim);
-    std::vector < double > x0(_dim);
-    std::vector < std::vector < double > > K(order);
-
-    for(unsigned j = 0; j < order; j++) {
-      K[j].resize(_dim);
-    }
-
     //END
 
     unsigned integrationIsOverCounter = 0; // when integrationIsOverCounter = _size (which is the number of particles) it means all particles have been advected;
@@ -753,9 +279,9 @@ namespace femus
 
     //BEGIN Numerical integration scheme
 
-    for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
-      _particles[iMarker]->InitializeMarkerForAdvection(order);
-    }
+    // x0 = x, K = 0 and step = 0, the stages of the markers are kept in _markers and migrate with them
+    _markers.SetOrder(order);
+    _markers.InitializeStep();
 
 //     unsigned maxload = 0;
 //     for(unsigned jproc=0; jproc<_nprocs;jproc++){
@@ -777,58 +303,42 @@ namespace femus
 
         //std::cout << _printList[iMarker] <<" "<<std::flush;
 
-        unsigned currentElem = _particles[iMarker]->GetMarkerElement();
+        unsigned currentElem = _markers.GetMarkerElement(iMarker);
         bool markerOutsideDomain = (currentElem != UINT_MAX) ? false : true;
 
-        step = _particles[iMarker]->GetIprocMarkerStep();
+        step = _markers.GetMarkerStep(iMarker);
 
         if(!markerOutsideDomain) {
 
-          while(step < n * order) {
+          LoadMarker(iMarker);
 
-            x = _particles[iMarker]->GetIprocMarkerCoordinates();
-            x0 = _particles[iMarker]->GetIprocMarkerOldCoordinates();
-            K = _particles[iMarker]->GetIprocMarkerK();
+          while(step < n * order) {
 
             bool elementUpdate = (aX.find(currentElem) != aX.end()) ? false : true;     //update if currentElem was never updated
 
             clock_t localTime = clock();
-            _particles[iMarker]->GetMarkerS(n, order, s);
-            _particles[iMarker]->FindLocalCoordinates(solVType, aX[currentElem], elementUpdate, _sol, s);
-            _particles[iMarker]->updateVelocity(V, solVIndex, solVType, aV[currentElem], phi, elementUpdate, _sol);   // we put pcElemUpdate instead of true but it wasn't running
+            _marker.GetMarkerS(n, order, s);
+            _marker.FindLocalCoordinates(solVType, aX[currentElem], elementUpdate, _sol, s);
+            _marker.updateVelocity(V, solVIndex, solVType, aV[currentElem], phi, elementUpdate, _sol);   // we put pcElemUpdate instead of true but it wasn't running
             _time[3] += static_cast<double>((clock() - localTime)) / CLOCKS_PER_SEC;
 
-            unsigned tstep = step / order;
             unsigned istep = step % order;
 
             if(istep == 0) {
-              x0 = x;
-
-              for(unsigned j = 0; j < order; j++) {
-                K[j].assign(_dim, 0.);
-              }
+              _markers.InitializeStep(iMarker);
             }
 
-            // double s = (tstep + _c[order - 1][istep]) / n;
-
-
-            //std::cout<<"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
+            for(unsigned k = 0; k < _dim; k++) {
+              x[k] = _markers.GetCoordinates(k)[iMarker];
+            }
 
             if(force != NULL) {
-              //else if (_sol->GetIfFSI()) {
               unsigned material = _sol->GetMesh()->GetElementMaterial(currentElem);
-//               MagneticForce(x, Fm, material, 0);
               force(x, Fm, material);
             }
 
-            //std::cout<<"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA"<<std::flush;
-
-//             for(unsigned l = 0; l < Fm.size(); l++) {
-//               std::cout << "Fm[" << l << "]=" << Fm[l] << std::endl;
-//             }
-
             for(unsigned k = 0; k < _dim; k++) {
-              K[istep][k] = (s * V[0][k] + (1. - s) * V[1][k] + Fm[k]) * h;
+              _markers.GetK(istep, k)[iMarker] = (s * V[0][k] + (1. - s) * V[1][k] + Fm[k]) * h;
             }
 
             counter++;
@@ -836,50 +346,31 @@ namespace femus
             step++;
             istep++;
 
+            // x = x0 + sum_j a_j K_j for the next stage, x = x0 + sum_j b_j K_j at the end of the time step
+            _markers.UpdateCoordinates(iMarker, (istep < order) ? _a[order - 1][istep] : _b[order - 1], order);
 
-            if(istep < order) {
-              for(unsigned k = 0; k < _dim; k++) {
-                x[k] = x0[k];
-
-                for(unsigned j = 0; j < order; j++) {
-                  x[k] +=  _a[order - 1][istep][j] * K[j][k];
-                }
-              }
-            }
-            else {
-              for(unsigned i = 0; i < _dim; i++) {
-                x[i] = x0[i];
-
-                for(unsigned j = 0; j < order; j++) {
-                  x[i] += _b[order - 1][j] * K[j][i];
-                }
-              }
+            for(unsigned k = 0; k < _dim; k++) {
+              x[k] = _markers.GetCoordinates(k)[iMarker];
             }
+            _marker.SetIprocMarkerCoordinates(x);
 
-            _particles[iMarker]->SetIprocMarkerOldCoordinates(x0);
-            _particles[iMarker]->SetIprocMarkerCoordinates(x);
-            _particles[iMarker]->SetIprocMarkerK(K);
-
-            _particles[iMarker]->SetIprocMarkerStep(step);
-            _particles[iMarker]->GetMarkerS(n, order, s);
+            _marker.SetIprocMarkerStep(step);
+            _marker.GetMarkerS(n, order, s);
 
-            //std::cout << step <<" "<< istep<< " AAAAAAAAAAAAA"<<std::endl<<std::flush;
             unsigned previousElem = currentElem;
             localTime = clock();
-            _particles[iMarker]->GetElementSerial(previousElem, _sol, s);
+            _marker.GetElementSerial(previousElem, _sol, s);
             _time[4] += static_cast<double>((clock() - localTime)) / CLOCKS_PER_SEC;
-            localTime = clock();
-            // std::cout << step <<" "<< istep<< " BBBBBBBBBBBBB"<<std::endl<<std::flush;
 
-            _particles[iMarker]->SetIprocMarkerPreviousElement(previousElem);
+            _marker.SetIprocMarkerPreviousElement(previousElem);
 
-            currentElem = _particles[iMarker]->GetMarkerElement();
-            unsigned mproc = _particles[iMarker]->GetMarkerProc(_sol);
+            currentElem = _marker.GetMarkerElement();
+            unsigned mproc = _marker.GetMarkerProc(_sol);
 
             if(currentElem == UINT_MAX) {    // the marker has been advected outside the domain
               markerOutsideDomain = true;
               step = UINT_MAX;
-              _particles[iMarker]->SetIprocMarkerStep(step);
+              _marker.SetIprocMarkerStep(step);
               break;
             }
             else if(_iproc != mproc) {    // the marker has been advected outise the process
@@ -889,12 +380,14 @@ namespace femus
 
           if(step == n * order) {
             step = UINT_MAX;
-            _particles[iMarker]->SetIprocMarkerStep(step);
+            _marker.SetIprocMarkerStep(step);
           }
+
+          StoreMarker(iMarker);
         }
         else {   // the marker started outise the domain
           step = UINT_MAX;
-          _particles[iMarker]->SetIprocMarkerStep(step);
+          _markers.SetMarkerStep(iMarker, step);
         }
 
         if(step == UINT_MAX || markerOutsideDomain) {
@@ -910,117 +403,16 @@ namespace femus
       startTime = clock();
       //END LOCAL ADVECTION INSIDE IPROC
 
-      integrationIsOverCounter = 0;
-
-      for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
-        integrationIsOverCounterProc.broadcast(jproc);
-        integrationIsOverCounter += integrationIsOverCounterProc[jproc];
-        integrationIsOverCounterProc.clearBroadcast();
-      }
-
-//       MPI_Barrier( PETSC_COMM_WORLD );
-//       _time[1] += static_cast<double>((clock() - startTime)) / CLOCKS_PER_SEC;
-//       startTime = clock();
-
-      // std::cout << "DOPO integrationIsOverCounter = " << integrationIsOverCounter << std::endl;
+      MPI_Allreduce(&integrationIsOverCounterProc[_iproc], &integrationIsOverCounter, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
 
       //BEGIN exchange on information
 
-      //std::cout << " ----------------------------------PROCESSES EXCHANGE INFO ---------------------------------- " << std::endl;
-      for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
-        for(unsigned iMarker = _markerOffset[jproc]; iMarker < _markerOffset[jproc + 1]; iMarker++) {
-          unsigned elem =  _particles[iMarker]->GetMarkerElement();
-          MPI_Bcast(& elem, 1, MPI_UNSIGNED, jproc, PETSC_COMM_WORLD);
-          _particles[iMarker]->SetMarkerElement(elem);
-
-          unsigned step =  _particles[iMarker]->GetIprocMarkerStep();
-          MPI_Bcast(& step, 1, MPI_UNSIGNED, jproc, PETSC_COMM_WORLD);
-          _particles[iMarker]->SetIprocMarkerStep(step);
-
-          if(elem != UINT_MAX) {    // if it is outside jproc, ACTUALLY IF WE ARE HERE IT COULD STILL BE IN JPROC but not outside the domain
-            unsigned mproc = _particles[iMarker]->GetMarkerProc(_sol);
-            _particles[iMarker]->SetMarkerProc(mproc);
-
-            if(mproc != jproc) {
-              unsigned prevElem = _particles[iMarker]->GetIprocMarkerPreviousElement();
-              _particles[iMarker]->GetMarkerS(n, order, s);
-              _particles[iMarker]->GetElement(prevElem, jproc, _sol, s);
-              _particles[iMarker]->SetIprocMarkerPreviousElement(prevElem);
-            }
-
-            elem = _particles[iMarker]->GetMarkerElement();
-
-            if(elem != UINT_MAX) {    // if it is not outside the domain
-              unsigned mproc = _particles[iMarker]->GetMarkerProc(_sol);
-
-              if(mproc != jproc) {
-                if(jproc == _iproc) {
-
-                  unsigned step =  _particles[iMarker]->GetIprocMarkerStep();
-                  MPI_Send(& step, 1, MPI_UNSIGNED, mproc, order + 1, PETSC_COMM_WORLD);
-
-                  unsigned istep = step % order;
-
-                  if(istep != 0) {
-                    K = _particles[iMarker]->GetIprocMarkerK();
-
-                    for(int i = 0; i < order; i++) {
-                      MPI_Send(&K[i][0], _dim, MPI_DOUBLE, mproc, i , PETSC_COMM_WORLD);
-                    }
-
-                    x0 = _particles[iMarker]->GetIprocMarkerOldCoordinates();
-                    MPI_Send(&x0[0], _dim, MPI_DOUBLE, mproc, order , PETSC_COMM_WORLD);
-                  }
-
-                  _particles[iMarker]->FreeVariables();
-
-                }
-                else if(mproc == _iproc) {
-
-                  _particles[iMarker]->InitializeVariables(order);
-
-                  unsigned step;
-                  MPI_Recv(& step, 1, MPI_UNSIGNED, jproc, order + 1, PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-                  _particles[iMarker]->SetIprocMarkerStep(step);
-
-                  unsigned istep = step % order;
-
-                  if(istep != 0) {
-                    for(int i = 0; i < order; i++) {
-                      MPI_Recv(&K[i][0], _dim, MPI_DOUBLE, jproc, i , PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-                      _particles[iMarker]->SetIprocMarkerK(K);
-                    }
-
-                    MPI_Recv(&x0[0], _dim, MPI_DOUBLE, jproc, order , PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-                    _particles[iMarker]->SetIprocMarkerOldCoordinates(x0);
-
-                  }
-                }
-              }
-            }
-          }
-
-          if(elem == UINT_MAX && jproc != 0) {    // elem = UINT_MAX, but not yet in jproc = 0
-            if(jproc == _iproc) {
-              x = _particles[iMarker]->GetIprocMarkerCoordinates();
-              MPI_Send(&x[0], _dim, MPI_DOUBLE, 0, 1 , PETSC_COMM_WORLD);
-              _particles[iMarker]->FreeVariables();
-            }
-            else if(_iproc == 0) {
-              _particles[iMarker]->InitializeX();
-              MPI_Recv(&x[0], _dim, MPI_DOUBLE, jproc, 1 , PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-              _particles[iMarker]->SetIprocMarkerCoordinates(x);
-            }
-          }
-        }
-      }
+      MigrateMarkers(n, order, false);
 
       MPI_Barrier(PETSC_COMM_WORLD);
       _time[1] += static_cast<double>((clock() - startTime)) / CLOCKS_PER_SEC;
       startTime = clock();
 
-      //std::cout << " ----------------------------------END PROCESSES EXCHANGE INFO ---------------------------------- " << std::endl;
-
       //END exchange of information
 
 
@@ -1075,13 +467,135 @@ namespace femus
   }
 
 
+  /** Move all the markers whose element is no longer owned by this process to the process owning it (or to process 0
+   *  when they are outside the domain). The markers leaving each process are packed together and exchanged with one
+   *  MPI_Alltoallv per hop, the element search then continues on the receiving process. At the end the new elements and
+   *  steps of all the markers are gathered, so that every process has consistent elements in _markers.
+   **/
+  void Line::MigrateMarkers(const unsigned& n, const unsigned& order, const bool& MPM)
+  {
+
+    if(_size == 0) return;
+
+    unsigned packedSize = _markers.GetPackedMarkerSize();
+
+    std::vector < unsigned > ownedMarkers;
+    ownedMarkers.reserve(_markerOffset[_iproc + 1] - _markerOffset[_iproc]);
+
+    std::vector < std::vector < double > > sendBuffer(_nprocs);
+    unsigned sendCounter = 0;
+
+    for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
+      unsigned mproc = GetMarkerProc(iMarker);
+      if(mproc == _iproc) {
+        ownedMarkers.push_back(iMarker);
+      }
+      else {
+        _markers.PackMarker(iMarker, sendBuffer[mproc]);
+        sendCounter++;
+      }
+    }
+
+    unsigned globalSendCounter;
+    MPI_Allreduce(&sendCounter, &globalSendCounter, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+
+    std::vector < int > sendCount(_nprocs), sendOffset(_nprocs);
+    std::vector < int > recvCount(_nprocs), recvOffset(_nprocs);
+    std::vector < double > sendData;
+    std::vector < double > recvData;
+
+    while(globalSendCounter > 0) {
+
+      unsigned sendSize = 0;
+      for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+        sendCount[jproc] = sendBuffer[jproc].size();
+        sendOffset[jproc] = sendSize;
+        sendSize += sendCount[jproc];
+      }
+
+      MPI_Alltoall(&sendCount[0], 1, MPI_INT, &recvCount[0], 1, MPI_INT, PETSC_COMM_WORLD);
+
+      unsigned recvSize = 0;
+      for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+        recvOffset[jproc] = recvSize;
+        recvSize += recvCount[jproc];
+      }
+
+      sendData.resize(sendSize);
+      for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+        std::copy(sendBuffer[jproc].begin(), sendBuffer[jproc].end(), sendData.begin() + sendOffset[jproc]);
+        sendBuffer[jproc].resize(0);
+      }
+      recvData.resize(recvSize);
+
+      MPI_Alltoallv(sendData.data(), &sendCount[0], &sendOffset[0], MPI_DOUBLE,
+                    recvData.data(), &recvCount[0], &recvOffset[0], MPI_DOUBLE, PETSC_COMM_WORLD);
+
+      sendCounter = 0;
+
+      for(unsigned i = 0; i < recvSize; i += packedSize) {
+        unsigned iMarker = _markers.UnpackMarker(&recvData[i]);
+
+        if(_markers.GetMarkerElement(iMarker) != UINT_MAX) {
+          LoadMarker(iMarker);
+          double s = 0.;
+          if(!MPM) _marker.GetMarkerS(n, order, s);
+          unsigned previousElem = _marker.GetIprocMarkerPreviousElement();
+          _marker.GetElementSerial(previousElem, _sol, s);
+          _marker.SetIprocMarkerPreviousElement(previousElem);
+          StoreMarker(iMarker);
+        }
+
+        unsigned mproc = GetMarkerProc(iMarker);
+        if(mproc == _iproc) {
+          ownedMarkers.push_back(iMarker);
+        }
+        else { // the marker crossed another process boundary, forward it
+          _markers.PackMarker(iMarker, sendBuffer[mproc]);
+          sendCounter++;
+        }
+      }
+
+      MPI_Allreduce(&sendCounter, &globalSendCounter, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+    }
+
+    //BEGIN gather the new element and step of all the markers
+    std::vector < unsigned > ownedData(3 * ownedMarkers.size());
+    for(unsigned i = 0; i < ownedMarkers.size(); i++) {
+      ownedData[3 * i] = ownedMarkers[i];
+      ownedData[3 * i + 1] = _markers.GetMarkerElement(ownedMarkers[i]);
+      ownedData[3 * i + 2] = _markers.GetMarkerStep(ownedMarkers[i]);
+    }
+
+    int ownedSize = ownedData.size();
+    MPI_Allgather(&ownedSize, 1, MPI_INT, &recvCount[0], 1, MPI_INT, PETSC_COMM_WORLD);
+
+    unsigned recvSize = 0;
+    for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+      recvOffset[jproc] = recvSize;
+      recvSize += recvCount[jproc];
+    }
+
+    std::vector < unsigned > allData(recvSize);
+    MPI_Allgatherv(ownedData.data(), ownedSize, MPI_UNSIGNED,
+                   allData.data(), &recvCount[0], &recvOffset[0], MPI_UNSIGNED, PETSC_COMM_WORLD);
+
+    for(unsigned i = 0; i < recvSize; i += 3) {
+      _markers.SetMarkerElement(allData[i], allData[i + 1]);
+      _markers.SetMarkerStep(allData[i], allData[i + 2]);
+    }
+    //END gather the new element and step of all the markers
+
+  }
+
+
   unsigned Line::NumberOfParticlesOutsideTheDomain()
   {
 
     unsigned counter = 0;
 
     for(unsigned iMarker = _markerOffset[0]; iMarker < _markerOffset[1]; iMarker++) {
-      unsigned elem =  _particles[iMarker]->GetMarkerElement();
+      unsigned elem =  _markers.GetMarkerElement(iMarker);
 
       if(elem == UINT_MAX) {
         counter++;
@@ -1113,15 +627,13 @@ namespace femus
     // set all element with at least one marker to 3 and all nodes of the element to 1
     for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
 
-      unsigned iel = _particles[iMarker]->GetMarkerElement();
+      unsigned iel = _markers.GetMarkerElement(iMarker);
       unsigned ielType =  _mesh->GetElementType(iel);
       bool elementUpdate = (aX.find(iel) != aX.end()) ? false : true;     //update if iel was never updated
 
-      std::vector <double> xi1 = _particles[iMarker]->GetMarkerLocalCoordinates();
-
-      _particles[iMarker]->FindLocalCoordinates(2., aX[iel], elementUpdate, _sol, s);
-
-      std::vector <double> xi = _particles[iMarker]->GetMarkerLocalCoordinates();
+      LoadMarker(iMarker);
+      _marker.FindLocalCoordinates(2., aX[iel], elementUpdate, _sol, s);
+      StoreMarker(iMarker);
 
       for(unsigned j = 0; j < _mesh->GetElementDofNumber(iel, solTypeM); j++) {
         unsigned jdof = _mesh->GetSolutionDof(j, iel, solTypeM);
@@ -1194,7 +706,7 @@ namespace femus
 
     for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
 
-      unsigned iel = _particles[iMarker]->GetMarkerElement();
+      unsigned iel = _markers.GetMarkerElement(iMarker);
       unsigned ielType =  _mesh->GetElementType(iel);
       for(unsigned j = 0; j < _mesh->GetElementDofNumber(iel, solTypeM); j++) {
 
@@ -1212,91 +724,14 @@ namespace femus
 
 
     for(unsigned iMarker = _markerOffset[_iproc]; iMarker < _markerOffset[_iproc + 1]; iMarker++) {
-      unsigned elem =  _particles[iMarker]->GetMarkerElement();
-      _particles[iMarker]->GetElementSerial(elem, _sol, 0.);
-      _particles[iMarker]->SetIprocMarkerPreviousElement(elem);
+      unsigned elem =  _markers.GetMarkerElement(iMarker);
+      LoadMarker(iMarker);
+      _marker.GetElementSerial(elem, _sol, 0.);
+      _marker.SetIprocMarkerPreviousElement(elem);
+      StoreMarker(iMarker);
     }
 
-    for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
-      for(unsigned iMarker = _markerOffset[jproc]; iMarker < _markerOffset[jproc + 1]; iMarker++) {
-
-        unsigned elem =  _particles[iMarker]->GetMarkerElement();
-        MPI_Bcast(& elem, 1, MPI_UNSIGNED, jproc, PETSC_COMM_WORLD);
-        _particles[iMarker]->SetMarkerElement(elem);
-
-        if(elem != UINT_MAX) {
-          unsigned mproc = _particles[iMarker]->GetMarkerProc(_sol); //WARNING you don't know if this is your real process
-          _particles[iMarker]->SetMarkerProc(mproc);
-
-          if(mproc != jproc) {  //this means, if we think the particle moved from jproc (which means element serial shouldn't have found the actual element)
-            unsigned prevElem = _particles[iMarker]->GetIprocMarkerPreviousElement();
-            _particles[iMarker]->GetElement(prevElem, jproc, _sol, 0.);
-            _particles[iMarker]->SetIprocMarkerPreviousElement(prevElem);
-          }
-
-          elem = _particles[iMarker]->GetMarkerElement(); //TODO shouldn't this be inside the if ? If we don't go in the if I think we already know who elem is
-
-          if(elem != UINT_MAX) {    // if it is not outside the domain
-            unsigned mproc = _particles[iMarker]->GetMarkerProc(_sol);  //actual mproc
-
-            if(mproc != jproc) {  //there is no need to send/receive if the particle didn't change process (which is when mproc == jproc)
-              if(jproc == _iproc) {
-
-                unsigned order = 0;
-                std::vector <double> MPMQuantities = _particles[iMarker]->GetMPMQuantities();
-                unsigned MPMsize =  _particles[iMarker]->GetMPMSize();
-                MPI_Send(&MPMQuantities[0], MPMsize, MPI_DOUBLE, mproc, order, PETSC_COMM_WORLD);
-
-                std::vector < std::vector < double > > Fp = _particles[iMarker]->GetDeformationGradient();
-                for(unsigned i = 0; i < _dim; i++) {
-                  MPI_Send(&Fp[i][0], _dim, MPI_DOUBLE, mproc, order + 1, PETSC_COMM_WORLD);
-                }
-
-                _particles[iMarker]->FreeVariables();
-
-              }
-              else if(mproc == _iproc) {
-
-                unsigned order = 0;
-                _particles[iMarker]->InitializeVariables(order);
-
-                unsigned MPMsize =  _particles[iMarker]->GetMPMSize();
-                std::vector <double> MPMQuantities(MPMsize);
-
-                MPI_Recv(&MPMQuantities[0], MPMsize, MPI_DOUBLE, jproc, order, PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-                _particles[iMarker]->SetMPMQuantities(MPMQuantities);
-
-                std::vector < std::vector < double > > Fp(_dim);
-                for(unsigned i = 0; i < _dim; i++) {
-                  Fp[i].resize(_dim);
-                }
-
-                for(unsigned i = 0; i < _dim; i++) {
-                  MPI_Recv(&Fp[i][0], _dim, MPI_DOUBLE, jproc, order + 1, PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-                }
-                _particles[iMarker]->SetDeformationGradient(Fp);
-
-              }
-            }
-          }
-        }
-
-        if(elem == UINT_MAX && jproc != 0) {    // elem = UINT_MAX, but not yet in jproc = 0
-          if(jproc == _iproc) {
-            std::vector<double> x(_dim);
-            x = _particles[iMarker]->GetIprocMarkerCoordinates();
-            MPI_Send(&x[0], _dim, MPI_DOUBLE, 0, 1 , PETSC_COMM_WORLD);
-            _particles[iMarker]->FreeVariables();
-          }
-          else if(_iproc == 0) {
-            std::vector<double> x(_dim);
-            _particles[iMarker]->InitializeX();
-            MPI_Recv(&x[0], _dim, MPI_DOUBLE, jproc, 1 , PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
-            _particles[iMarker]->SetIprocMarkerCoordinates(x);
-          }
-        }
-      }
-    }
+    MigrateMarkers(0, 0, true);
 
     //END find new _elem and _mproc
 
@@ -1307,19 +742,22 @@ namespace femus
   void Line::SetParticlesMass(const double& volume, const double& density)
   {
     double particlesMass = density * volume / _size;
+    double *mass = _markers.GetMPMQuantity(3 * _dim);
     for(unsigned i = _markerOffset[_iproc]; i < _markerOffset[_iproc  + 1]; i++) {
-      _particles[i]->SetMarkerMass(particlesMass);
+      mass[i] = particlesMass;
     }
   }
 
 
   void Line::ScaleParticleMass(double scale(const std::vector <double>& x))
   {
+    double *mass = _markers.GetMPMQuantity(3 * _dim);
+    std::vector<double> x(_dim);
     for(unsigned i = _markerOffset[_iproc]; i < _markerOffset[_iproc  + 1]; i++) {
-      std::vector<double> x(_dim);
-      x = _particles[i]->GetIprocMarkerCoordinates();
-      double mass = _particles[i]->GetMarkerMass();
-      _particles[i]->SetMarkerMass(mass * scale(x));
+      for(unsigned k = 0; k < _dim; k++) {
+        x[k] = _markers.GetCoordinates(k)[i];
+      }
+      mass[i] *= scale(x);
     }
 
   }
@@ -1331,12 +769,11 @@ namespace femus
     
     std::vector < double > xMinLocal(_dim, 1.0e100);
     std::vector < double > xMaxLocal(_dim, -1.0e100);
-    std::vector< double > x;
-    for(unsigned i = _markerOffset[_iproc]; i < _markerOffset[_iproc  + 1]; i++) {
-      x = _particles[i]->GetIprocMarkerCoordinates();
-      for(unsigned k = 0; k < _dim; k++) {
-	xMinLocal[k] = (x[k] < xMinLocal[k]) ? x[k] : xMinLocal[k];
-        xMaxLocal[k] = (x[k] > xMaxLocal[k]) ? x[k] : xMaxLocal[k];
+    for(unsigned k = 0; k < _dim; k++) {
+      const double *x = _markers.GetCoordinates(k);
+      for(unsigned i = _markerOffset[_iproc]; i < _markerOffset[_iproc  + 1]; i++) {
+        xMinLocal[k] = (x[i] < xMinLocal[k]) ? x[i] : xMinLocal[k];
+        xMaxLocal[k] = (x[i] > xMaxLocal[k]) ? x[i] : xMaxLocal[k];
       }
     }
     for(unsigned k = 0; k < _dim; k++) {
@@ -24,6 +24,7 @@
 #include "ParallelObject.hpp"
 #include "Mesh.hpp"
 #include "Marker.hpp"
+#include "MarkerSet.hpp"
 
 #include "vector"
 #include "map"
@@ -32,6 +33,12 @@
 namespace femus
 {
 
+  /**
+   * Line of markers advected by a velocity field or moved by the material point method. The markers are stored in a
+   * MarkerSet, sorted by process and by element, every process has all the markers, but the coordinates and the other
+   * quantities of a marker are meaningful only on the process owning its element. A single work Marker is used for the
+   * element search and the interpolation of the marker being moved.
+   */
   class Line : public ParallelObject
   {
     public:
@@ -65,20 +72,27 @@ namespace femus
         return _markerOffset;
       }
 
-      std::vector <Marker*> GetParticles() {
-        return _particles;
+      const MarkerSet& GetMarkers() const {
+        return _markers;
       }
 
       void AdvectionParallel(const unsigned& n, const double& T, const unsigned& order, ForceFunction Force = NULL);
 
       void UpdateLine();
 
+      /** Copy the markers owned by this process into markerSet, the marker id is its position in GetMarkers() */
+      void GetOwnedMarkers(MarkerSet &markerSet);
+
+      /** Copy back the markers of markerSet, which must still be owned by this process */
+      void SetOwnedMarkers(const MarkerSet &markerSet);
+
       unsigned NumberOfParticlesOutsideTheDomain();
 
       void GetParticlesToGridMaterial();
 
       void UpdateLineMPM();
 
+      /** The mass is stored only by the lines built with the mass of the markers */
       void SetParticlesMass(const double& volume, const double& density);
 
       void ScaleParticleMass(double scale(const std::vector <double>& x));
@@ -87,13 +101,30 @@ namespace femus
 
     private:
       std::vector < std::vector < double > > _line;
-      std::vector < Marker*> _particles;
+      MarkerSet _markers;
+      Marker _marker; // work marker for the element search, filled from and stored back into _markers
       std::vector < unsigned > _markerOffset;
       std::vector < unsigned > _printList;
       unsigned _size;
       unsigned _dim;
       
-      void Reorder(std::vector < Marker*> &particles);
+      void Reorder();
+
+      /** Coordinates of the markers in the order of _printList, from the owner processes */
+      void GatherLine();
+
+      void SortParticles(std::vector < unsigned > &newPosition);
+
+      /** Copy the owned marker i into the work marker, and back */
+      void LoadMarker(const unsigned &i);
+      void StoreMarker(const unsigned &i);
+
+      unsigned GetMarkerProc(const unsigned &i) const {
+        unsigned elem = _markers.GetMarkerElement(i);
+        return (elem == UINT_MAX) ? 0 : _mesh->IsdomBisectionSearch(elem, 3);
+      }
+
+      void MigrateMarkers(const unsigned &n, const unsigned &order, const bool &MPM);
 
       static const double _a[4][4][4];
       static const double _b[4][4];
@@ -17,6 +17,7 @@
 // includes :
 //----------------------------------------------------------------------------
 #include "Marker.hpp"
+#include "ElementSearchGrid.hpp"
 #include "Line.hpp"
 #include "NumericVector.hpp"
 #include <math.h>
@@ -187,39 +188,10 @@ namespace femus
     if (useInitialSearch || _iproc != ielProc) {
 
       //BEGIN SMART search
-      // look to the closest element among a restricted list
-
-      iel = UINT_MAX;
-
-      double modulus = 1.e10;
-
-      for (int jel = sol->GetMesh()->_elementOffset[_iproc]; jel < sol->GetMesh()->_elementOffset[_iproc + 1]; jel += 25) {
-
-        unsigned interiorNode = sol->GetMesh()->GetElementDofNumber(jel, 2) - 1;
-        unsigned jDof  = sol->GetMesh()->GetSolutionDof(interiorNode, jel, 2);    // global to global mapping between coordinates node and coordinate dof
-
-        double distance2 = 0;
-
-        for (unsigned k = 0; k < _dim; k++) {
-          double dk = GetCoordinates(sol, k, jDof, s) - _x[k];   // global extraction and local storage for the element coordinates
-          distance2 += dk * dk;
-        }
-
-        double modulusKel = sqrt(distance2);
-
-        if (modulusKel < modulus) {
-          iel = jel;
-          modulus = modulusKel;
-        }
-      }
-
-      if (iel == UINT_MAX) {
-        //  std::cout << "Warning the marker is located on unreasonable distance from the mesh >= 1.e10" << std::endl;
-      }
-      else {
-        //  std::cout << "the smart search starts from element " << iel << std::endl;
-      }
+      // start from the closest element owned by _iproc, located with the bin grid over the element bounding boxes
+      // the grid uses the undeformed mesh, for moving meshes it only provides the initial guess of the walk
 
+      iel = sol->GetMesh()->GetElementSearchGrid()->GetClosestElement(_x);
 
       //END SMART search:
     }
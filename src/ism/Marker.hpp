@@ -75,6 +75,18 @@ namespace femus {
         }
       };
 
+      /** Work marker owned by this process and outside the domain, to be filled from a MarkerSet with MarkerSet::GetMarker */
+      Marker(const unsigned &dim, const unsigned &solType) {
+        _dim = dim;
+        _solType = solType;
+        _markerType = VOLUME;
+        _elem = UINT_MAX;
+        _previousElem = UINT_MAX;
+        _mproc = _iproc;
+        _step = 0;
+        _MPMSize = 3 * _dim + 1;
+      };
+
       double GetCoordinates(Solution *sol, const unsigned &k, const unsigned &i , const double &s) {
         if(!sol->GetIfFSI()) {
           return (*sol->GetMesh()->_topology->_Sol[k])(i);
@@ -248,6 +260,10 @@ namespace femus {
         return _xi;
       }
 
+      void SetMarkerLocalCoordinates(const std::vector<double> &xi) {
+        _xi = xi;
+      }
+
       void GetMarkerLocalCoordinatesLine(std::vector<double> &xi) {
         xi.resize(_dim);
         if(_mproc == _iproc) {
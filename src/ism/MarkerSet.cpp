@@ -0,0 +1,348 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: MarkerSet
+ Authors: Eugenio Aulisa, Giacomo Capodaglio
+
+ Copyright (c) FEMuS
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "MarkerSet.hpp"
+#include "Marker.hpp"
+
+namespace femus {
+
+  MarkerSet::MarkerSet(const unsigned &dim, const bool &MPM, const unsigned &order) {
+    _dim = dim;
+    _order = 0;
+    _MPM = MPM;
+    _MPMSize = 3 * _dim + 1;
+    _size = 0;
+    _elementBegin = 0;
+
+    _x.resize(_dim);
+    _xi.resize(_dim);
+    if(_MPM) {
+      _MPMQuantities.resize(_MPMSize);
+      _Fp.resize(_dim * _dim);
+    }
+    SetOrder(order);
+  }
+
+  void MarkerSet::SetOrder(const unsigned &order) {
+    if(order == _order) return;
+    _order = order;
+
+    _x0.resize((_order > 0) ? _dim : 0);
+    _K.resize(_order);
+    for(unsigned j = 0; j < _order; j++) {
+      _K[j].resize(_dim);
+    }
+    Resize(_size);
+  }
+
+  void MarkerSet::Resize(const unsigned &size) {
+    _size = size;
+
+    _id.resize(_size);
+    _elem.resize(_size);
+    _previousElem.resize(_size);
+    _step.resize(_size);
+
+    for(unsigned k = 0; k < _dim; k++) {
+      _x[k].resize(_size);
+      _xi[k].resize(_size);
+    }
+    for(unsigned k = 0; k < _x0.size(); k++) {
+      _x0[k].resize(_size);
+    }
+    for(unsigned j = 0; j < _K.size(); j++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        _K[j][k].resize(_size);
+      }
+    }
+    for(unsigned d = 0; d < _MPMQuantities.size(); d++) {
+      _MPMQuantities[d].resize(_size);
+    }
+    for(unsigned d = 0; d < _Fp.size(); d++) {
+      _Fp[d].resize(_size);
+    }
+
+    std::vector < unsigned > ().swap(_elementMarkerOffset);
+  }
+
+  void MarkerSet::SetMarker(const unsigned &i, const unsigned &id, Marker *marker) {
+
+    _id[i] = id;
+    _elem[i] = marker->GetMarkerElement();
+    _previousElem[i] = marker->GetIprocMarkerPreviousElement();
+    _step[i] = marker->GetIprocMarkerStep();
+
+    // the coordinates and the MPM quantities of a Marker exist only on the process that owns it
+    std::vector < double > x = marker->GetIprocMarkerCoordinates();
+    std::vector < double > xi = marker->GetMarkerLocalCoordinates();
+    for(unsigned k = 0; k < _dim; k++) {
+      _x[k][i] = (x.size() == _dim) ? x[k] : 0.;
+      _xi[k][i] = (xi.size() == _dim) ? xi[k] : 0.;
+    }
+
+    if(_MPM) {
+      std::vector < double > MPMQuantities = marker->GetMPMQuantities();
+      for(unsigned d = 0; d < _MPMSize; d++) {
+        _MPMQuantities[d][i] = (MPMQuantities.size() >= _MPMSize) ? MPMQuantities[d] : 0.;
+      }
+      std::vector < std::vector < double > > Fp = marker->GetDeformationGradient();
+      for(unsigned k = 0; k < _dim; k++) {
+        for(unsigned l = 0; l < _dim; l++) {
+          _Fp[k * _dim + l][i] = (Fp.size() == _dim) ? Fp[k][l] : ((k == l) ? 1. : 0.);
+        }
+      }
+    }
+  }
+
+  void MarkerSet::SetMarker(const unsigned &i, const unsigned &id, const MarkerSet &markerSet, const unsigned &j) {
+
+    _id[i] = id;
+    _elem[i] = markerSet._elem[j];
+    _previousElem[i] = markerSet._previousElem[j];
+    _step[i] = markerSet._step[j];
+
+    for(unsigned k = 0; k < _dim; k++) {
+      _x[k][i] = markerSet._x[k][j];
+      _xi[k][i] = markerSet._xi[k][j];
+    }
+    if(_order == markerSet._order) {
+      for(unsigned k = 0; k < _x0.size(); k++) {
+        _x0[k][i] = markerSet._x0[k][j];
+      }
+      for(unsigned l = 0; l < _K.size(); l++) {
+        for(unsigned k = 0; k < _dim; k++) {
+          _K[l][k][i] = markerSet._K[l][k][j];
+        }
+      }
+    }
+    if(_MPM && markerSet._MPM) {
+      for(unsigned d = 0; d < _MPMSize; d++) {
+        _MPMQuantities[d][i] = markerSet._MPMQuantities[d][j];
+      }
+      for(unsigned d = 0; d < _Fp.size(); d++) {
+        _Fp[d][i] = markerSet._Fp[d][j];
+      }
+    }
+  }
+
+  void MarkerSet::GetMarker(const unsigned &i, Marker *marker) const {
+
+    marker->SetMarkerElement(_elem[i]);
+    marker->SetIprocMarkerPreviousElement(_previousElem[i]);
+    marker->SetIprocMarkerStep(_step[i]);
+
+    std::vector < double > x(_dim);
+    std::vector < double > xi(_dim);
+    for(unsigned k = 0; k < _dim; k++) {
+      x[k] = _x[k][i];
+      xi[k] = _xi[k][i];
+    }
+    marker->SetIprocMarkerCoordinates(x);
+    marker->SetMarkerLocalCoordinates(xi);
+
+    if(_MPM) {
+      std::vector < double > MPMQuantities(_MPMSize);
+      for(unsigned d = 0; d < _MPMSize; d++) {
+        MPMQuantities[d] = _MPMQuantities[d][i];
+      }
+      marker->SetMPMQuantities(MPMQuantities);
+
+      std::vector < std::vector < double > > Fp(_dim, std::vector < double > (_dim));
+      for(unsigned k = 0; k < _dim; k++) {
+        for(unsigned l = 0; l < _dim; l++) {
+          Fp[k][l] = _Fp[k * _dim + l][i];
+        }
+      }
+      marker->SetDeformationGradient(Fp);
+    }
+  }
+
+  unsigned MarkerSet::GetPackedMarkerSize() const {
+    return 4 + _dim + ((_MPM) ? _MPMSize + _dim * _dim : 0) + _x0.size() + _order * _dim;
+  }
+
+  void MarkerSet::PackMarker(const unsigned &i, std::vector < double > &buffer) const {
+
+    buffer.push_back(i);
+    buffer.push_back(_elem[i]);
+    buffer.push_back(_previousElem[i]);
+    buffer.push_back(_step[i]);
+
+    for(unsigned k = 0; k < _dim; k++) {
+      buffer.push_back(_x[k][i]);
+    }
+    for(unsigned d = 0; d < _MPMQuantities.size(); d++) {
+      buffer.push_back(_MPMQuantities[d][i]);
+    }
+    for(unsigned d = 0; d < _Fp.size(); d++) {
+      buffer.push_back(_Fp[d][i]);
+    }
+    for(unsigned k = 0; k < _x0.size(); k++) {
+      buffer.push_back(_x0[k][i]);
+    }
+    for(unsigned j = 0; j < _K.size(); j++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        buffer.push_back(_K[j][k][i]);
+      }
+    }
+  }
+
+  unsigned MarkerSet::UnpackMarker(const double *buffer) {
+
+    unsigned i = static_cast < unsigned >(buffer[0]);
+    _elem[i] = static_cast < unsigned >(buffer[1]);
+    _previousElem[i] = static_cast < unsigned >(buffer[2]);
+    _step[i] = static_cast < unsigned >(buffer[3]);
+
+    unsigned counter = 4;
+    for(unsigned k = 0; k < _dim; k++) {
+      _x[k][i] = buffer[counter++];
+    }
+    for(unsigned d = 0; d < _MPMQuantities.size(); d++) {
+      _MPMQuantities[d][i] = buffer[counter++];
+    }
+    for(unsigned d = 0; d < _Fp.size(); d++) {
+      _Fp[d][i] = buffer[counter++];
+    }
+    for(unsigned k = 0; k < _x0.size(); k++) {
+      _x0[k][i] = buffer[counter++];
+    }
+    for(unsigned j = 0; j < _K.size(); j++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        _K[j][k][i] = buffer[counter++];
+      }
+    }
+    return i;
+  }
+
+  void MarkerSet::BucketSortByElement(const std::vector < unsigned > &elem, const unsigned &elementBegin, const unsigned &elementEnd,
+                                      const unsigned &outsideElement, std::vector < unsigned > &bucketOffset,
+                                      std::vector < unsigned > &newPosition) {
+
+    unsigned size = elem.size();
+    unsigned nel = elementEnd - elementBegin;
+    unsigned outsideBucket = outsideElement - elementBegin;
+
+    newPosition.resize(size);
+    bucketOffset.assign(nel + 3, 0);
+
+    // newPosition temporarily stores the bucket of each marker
+    for(unsigned i = 0; i < size; i++) {
+      unsigned iel = elem[i];
+      unsigned bucket;
+      if(iel == UINT_MAX) {
+        bucket = outsideBucket;
+      }
+      else if(iel >= elementBegin && iel < elementEnd) {
+        bucket = (iel < outsideElement) ? iel - elementBegin : iel - elementBegin + 1;
+      }
+      else {
+        bucket = nel + 1;
+      }
+      newPosition[i] = bucket;
+      bucketOffset[bucket + 1]++;
+    }
+
+    for(unsigned b = 0; b < nel + 2; b++) {
+      bucketOffset[b + 1] += bucketOffset[b];
+    }
+
+    std::vector < unsigned > counter(bucketOffset.begin(), bucketOffset.end() - 1);
+    for(unsigned i = 0; i < size; i++) {
+      newPosition[i] = counter[newPosition[i]]++;
+    }
+  }
+
+  void MarkerSet::SortByElement(const unsigned &elementBegin, const unsigned &elementEnd) {
+    _elementBegin = elementBegin;
+    BucketSortByElement(_elem, elementBegin, elementEnd, elementEnd, _elementMarkerOffset, _newPosition);
+    Permute(_newPosition);
+  }
+
+  template <class type>
+  void MarkerSet::PermuteArray(std::vector < type > &v, const std::vector < unsigned > &newPosition) {
+    std::vector < type > w(v.size());
+    for(unsigned i = 0; i < v.size(); i++) {
+      w[newPosition[i]] = v[i];
+    }
+    v.swap(w);
+  }
+
+  void MarkerSet::Permute(const std::vector < unsigned > &newPosition) {
+
+    PermuteArray(_id, newPosition);
+    PermuteArray(_elem, newPosition);
+    PermuteArray(_previousElem, newPosition);
+    PermuteArray(_step, newPosition);
+
+    for(unsigned k = 0; k < _dim; k++) {
+      PermuteArray(_x[k], newPosition);
+      PermuteArray(_xi[k], newPosition);
+    }
+    for(unsigned k = 0; k < _x0.size(); k++) {
+      PermuteArray(_x0[k], newPosition);
+    }
+    for(unsigned j = 0; j < _K.size(); j++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        PermuteArray(_K[j][k], newPosition);
+      }
+    }
+    for(unsigned d = 0; d < _MPMQuantities.size(); d++) {
+      PermuteArray(_MPMQuantities[d], newPosition);
+    }
+    for(unsigned d = 0; d < _Fp.size(); d++) {
+      PermuteArray(_Fp[d], newPosition);
+    }
+  }
+
+  void MarkerSet::InitializeStep() {
+    for(unsigned k = 0; k < _x0.size(); k++) {
+      _x0[k] = _x[k];
+    }
+    for(unsigned i = 0; i < _size; i++) {
+      _step[i] = 0;
+    }
+    for(unsigned j = 0; j < _K.size(); j++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        _K[j][k].assign(_size, 0.);
+      }
+    }
+  }
+
+  void MarkerSet::InitializeStep(const unsigned &i) {
+    for(unsigned k = 0; k < _x0.size(); k++) {
+      _x0[k][i] = _x[k][i];
+    }
+    for(unsigned j = 0; j < _K.size(); j++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        _K[j][k][i] = 0.;
+      }
+    }
+  }
+
+  void MarkerSet::UpdateCoordinates(const unsigned &i, const double *a, const unsigned &nStages) {
+    for(unsigned k = 0; k < _dim; k++) {
+      double x = _x0[k][i];
+      for(unsigned j = 0; j < nStages; j++) {
+        x += a[j] * _K[j][k][i];
+      }
+      _x[k][i] = x;
+    }
+  }
+
+}
@@ -0,0 +1,223 @@
+/*=========================================================================
+
+ Program: FEMuS
+ Module: MarkerSet
+ Authors: Eugenio Aulisa and Giacomo Capodaglio
+
+ Copyright (c) FEMuS
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_ism_MarkerSet_hpp__
+#define __femus_ism_MarkerSet_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ParallelObject.hpp"
+#include "vector"
+#include "climits"
+
+namespace femus {
+
+  class Marker;
+
+  /**
+   * Structure-of-arrays storage of a set of markers. Every quantity is stored component-wise in a contiguous array
+   * indexed by the marker position, for the kernels that sweep over all the markers, as the Runge-Kutta advection of Line
+   * and the particle-to-grid transfers. Line owns the markers of the whole line in a MarkerSet and indexes into it, a
+   * Marker is only a work object for the element search and the interpolation of one marker at a time; the quantities
+   * of a marker are meaningful only on the process that owns its element.
+   * With order > 0 the set keeps the starting coordinates x0 and the stages K of a Runge-Kutta step.
+   * The markers can be bucketed by element with a counting sort, after which the markers of the element iel are the
+   * positions GetElementMarkerBegin(iel) <= i < GetElementMarkerEnd(iel).
+   */
+  class MarkerSet : public ParallelObject {
+    public:
+
+      MarkerSet(const unsigned &dim, const bool &MPM = false, const unsigned &order = 0);
+
+      ~MarkerSet() {};
+
+      /** Resize all the arrays to size markers, the element buckets are invalidated */
+      void Resize(const unsigned &size);
+
+      unsigned size() const {
+        return _size;
+      }
+
+      unsigned GetDimension() const {
+        return _dim;
+      }
+
+      /** Number of Runge-Kutta stages kept for each marker */
+      void SetOrder(const unsigned &order);
+
+      unsigned GetOrder() const {
+        return _order;
+      }
+
+      /** Copy the iproc data of marker into position i, id is the index of the marker in its owner container */
+      void SetMarker(const unsigned &i, const unsigned &id, Marker *marker);
+
+      /** Copy the position j of markerSet into position i */
+      void SetMarker(const unsigned &i, const unsigned &id, const MarkerSet &markerSet, const unsigned &j);
+
+      /** Copy back position i into the iproc data of marker */
+      void GetMarker(const unsigned &i, Marker *marker) const;
+
+      unsigned GetMarkerId(const unsigned &i) const {
+        return _id[i];
+      }
+
+      unsigned GetMarkerElement(const unsigned &i) const {
+        return _elem[i];
+      }
+
+      void SetMarkerElement(const unsigned &i, const unsigned &elem) {
+        _elem[i] = elem;
+      }
+
+      unsigned GetMarkerPreviousElement(const unsigned &i) const {
+        return _previousElem[i];
+      }
+
+      unsigned GetMarkerStep(const unsigned &i) const {
+        return _step[i];
+      }
+
+      void SetMarkerStep(const unsigned &i, const unsigned &step) {
+        _step[i] = step;
+      }
+
+      /** Component k of the coordinates of all the markers */
+      double* GetCoordinates(const unsigned &k) {
+        return (_size > 0) ? &_x[k][0] : NULL;
+      }
+
+      const double* GetCoordinates(const unsigned &k) const {
+        return (_size > 0) ? &_x[k][0] : NULL;
+      }
+
+      double* GetLocalCoordinates(const unsigned &k) {
+        return (_size > 0) ? &_xi[k][0] : NULL;
+      }
+
+      const double* GetLocalCoordinates(const unsigned &k) const {
+        return (_size > 0) ? &_xi[k][0] : NULL;
+      }
+
+      /** MPM quantity d (displacement, velocity, acceleration, mass, as in Marker) of all the markers */
+      double* GetMPMQuantity(const unsigned &d) {
+        return (_size > 0) ? &_MPMQuantities[d][0] : NULL;
+      }
+
+      const double* GetMPMQuantity(const unsigned &d) const {
+        return (_size > 0) ? &_MPMQuantities[d][0] : NULL;
+      }
+
+      /** Entry (i, j) of the deformation gradient of all the markers */
+      double* GetDeformationGradient(const unsigned &i, const unsigned &j) {
+        return (_size > 0) ? &_Fp[i * _dim + j][0] : NULL;
+      }
+
+      const double* GetDeformationGradient(const unsigned &i, const unsigned &j) const {
+        return (_size > 0) ? &_Fp[i * _dim + j][0] : NULL;
+      }
+
+      unsigned GetMPMSize() const {
+        return _MPMSize;
+      }
+
+      /** Component k of the coordinates of all the markers at the beginning of the Runge-Kutta step */
+      double* GetOldCoordinates(const unsigned &k) {
+        return (_size > 0) ? &_x0[k][0] : NULL;
+      }
+
+      /** Component k of the Runge-Kutta stage j of all the markers */
+      double* GetK(const unsigned &j, const unsigned &k) {
+        return (_size > 0) ? &_K[j][k][0] : NULL;
+      }
+
+      /** Start a Runge-Kutta step for all the markers: x0 = x, K = 0 and step = 0 */
+      void InitializeStep();
+
+      /** Restart the Runge-Kutta step of the marker i from its current coordinates: x0 = x, K = 0 */
+      void InitializeStep(const unsigned &i);
+
+      /** x = x0 + sum_j a[j] K_j for the marker i, over the first nStages stages */
+      void UpdateCoordinates(const unsigned &i, const double *a, const unsigned &nStages);
+
+      /** Number of doubles of a packed marker */
+      unsigned GetPackedMarkerSize() const;
+
+      /** Append the position i to buffer: i, element, previous element, step, x, [MPM quantities, Fp], [x0, K] */
+      void PackMarker(const unsigned &i, std::vector < double > &buffer) const;
+
+      /** Copy a packed marker back into its position, which is returned */
+      unsigned UnpackMarker(const double *buffer);
+
+      /** Bucket the markers by element, elements outside [elementBegin, elementEnd) and markers outside the domain are put last */
+      void SortByElement(const unsigned &elementBegin, const unsigned &elementEnd);
+
+      bool ElementBucketsAreBuilt() const {
+        return _elementMarkerOffset.size() > 0;
+      }
+
+      unsigned GetElementMarkerBegin(const unsigned &iel) const {
+        return _elementMarkerOffset[iel - _elementBegin];
+      }
+
+      unsigned GetElementMarkerEnd(const unsigned &iel) const {
+        return _elementMarkerOffset[iel - _elementBegin + 1];
+      }
+
+      /** Move the marker in position i to position newPosition[i] */
+      void Permute(const std::vector < unsigned > &newPosition);
+
+      /**
+       * Stable counting sort by element: the element iel in [elementBegin, elementEnd) goes in the bucket iel - elementBegin,
+       * markers outside the domain (UINT_MAX) go in the bucket outsideElement - elementBegin, ahead of all the elements >= outsideElement,
+       * any other element goes in the last bucket. On exit bucketOffset has size elementEnd - elementBegin + 3 and newPosition[i] is the
+       * sorted position of the marker i.
+       */
+      static void BucketSortByElement(const std::vector < unsigned > &elem, const unsigned &elementBegin, const unsigned &elementEnd,
+                                      const unsigned &outsideElement, std::vector < unsigned > &bucketOffset,
+                                      std::vector < unsigned > &newPosition);
+
+    private:
+
+      template <class type>
+      void PermuteArray(std::vector < type > &v, const std::vector < unsigned > &newPosition);
+
+      unsigned _dim;
+      unsigned _order;
+      bool _MPM;
+      unsigned _MPMSize;
+      unsigned _size;
+
+      std::vector < unsigned > _id;
+      std::vector < unsigned > _elem;
+      std::vector < unsigned > _previousElem;
+      std::vector < unsigned > _step;
+
+      std::vector < std::vector < double > > _x; // [dim][size]
+      std::vector < std::vector < double > > _xi; // [dim][size]
+      std::vector < std::vector < double > > _MPMQuantities; // [MPMSize][size]
+      std::vector < std::vector < double > > _Fp; // [dim * dim][size]
+      std::vector < std::vector < double > > _x0; // [dim][size], only with order > 0
+      std::vector < std::vector < std::vector < double > > > _K; // [order][dim][size]
+
+      unsigned _elementBegin;
+      std::vector < unsigned > _elementMarkerOffset;
+      std::vector < unsigned > _newPosition;
+  };
+
+} //end namespace femus
+
+#endif
@@ -0,0 +1,314 @@
+/*=========================================================================
+
+ Program: FEMuS
+ Module: ParticleGridTransfer
+ Authors: Eugenio Aulisa and Giacomo Capodaglio
+
+ Copyright (c) FEMuS
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ParticleGridTransfer.hpp"
+#include "MarkerSet.hpp"
+#include "Mesh.hpp"
+#include "ElemType.hpp"
+#include "NumericVector.hpp"
+#include "LinearEquation.hpp"
+#include "algorithm"
+#include "iostream"
+
+namespace femus {
+
+  ParticleGridTransfer::ParticleGridTransfer(Mesh *msh, const unsigned &solType, const unsigned &nThreads) :
+    _threads(nThreads) {
+
+    _msh = msh;
+    _solType = solType;
+    _dim = _msh->GetDimension();
+
+    _elementBegin = _msh->_elementOffset[_iproc];
+    const unsigned nel = _msh->_elementOffset[_iproc + 1] - _elementBegin;
+
+    //BEGIN local dofs of the owned elements
+    std::vector < int > globalDof;
+    std::vector < unsigned > globalXDof;
+    _elementDofOffset.resize(nel + 1);
+    _elementDofOffset[0] = 0;
+    for(unsigned jel = 0; jel < nel; jel++) {
+      unsigned iel = _elementBegin + jel;
+      unsigned nDofs = _msh->GetElementDofNumber(iel, _solType);
+      for(unsigned i = 0; i < nDofs; i++) {
+        globalDof.push_back(_msh->GetSolutionDof(i, iel, _solType));
+        globalXDof.push_back(_msh->GetSolutionDof(i, iel, 2));
+      }
+      _elementDofOffset[jel + 1] = globalDof.size();
+    }
+
+    _localDof = globalDof;
+    std::sort(_localDof.begin(), _localDof.end());
+    _localDof.erase(std::unique(_localDof.begin(), _localDof.end()), _localDof.end());
+
+    _elementDof.resize(globalDof.size());
+    _localXDof.resize(_localDof.size());
+    for(unsigned i = 0; i < globalDof.size(); i++) {
+      _elementDof[i] = std::lower_bound(_localDof.begin(), _localDof.end(), globalDof[i]) - _localDof.begin();
+      _localXDof[_elementDof[i]] = globalXDof[i];
+    }
+    //END
+
+    _markerOffset.assign(nel + 1, 0);
+    _basisOffset.assign(1, 0);
+
+    // line3, quad9 and hex27 have the largest number of dofs
+    _gradphi.resize(_threads.GetNumberOfThreads());
+    for(unsigned ithread = 0; ithread < _gradphi.size(); ithread++) {
+      _gradphi[ithread].resize(_dim * 27);
+    }
+  }
+
+  void ParticleGridTransfer::Setup(MarkerSet &markerSet) {
+
+    if(markerSet.GetDimension() != _dim) {
+      std::cout << "ParticleGridTransfer::Setup: the MarkerSet dimension is different from the mesh dimension" << std::endl;
+      abort();
+    }
+
+    const unsigned nel = _markerOffset.size() - 1u;
+    markerSet.SortByElement(_elementBegin, _elementBegin + nel);
+
+    for(unsigned jel = 0; jel < nel; jel++) {
+      _markerOffset[jel + 1] = markerSet.GetElementMarkerEnd(_elementBegin + jel);
+    }
+
+    //BEGIN basis functions and reference derivatives at the markers
+    const unsigned nMarkers = _markerOffset[nel];
+    _basisOffset.resize(nMarkers + 1);
+    for(unsigned jel = 0; jel < nel; jel++) {
+      unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+      for(unsigned p = _markerOffset[jel]; p < _markerOffset[jel + 1]; p++) {
+        _basisOffset[p + 1] = _basisOffset[p] + nDofs;
+      }
+    }
+    _phi.resize(_basisOffset[nMarkers]);
+    _dphi.resize(_dim * _basisOffset[nMarkers]);
+
+    std::vector < const double* > xi(_dim);
+    for(unsigned k = 0; k < _dim; k++) {
+      xi[k] = markerSet.GetLocalCoordinates(k);
+    }
+
+    _threads.Run(_msh, [&](const unsigned & iel, const unsigned &) {
+      const unsigned jel = iel - _elementBegin;
+      const unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+      const basis *base = _msh->_finiteElement[_msh->GetElementType(iel)][_solType]->GetBasis();
+
+      for(unsigned p = _markerOffset[jel]; p < _markerOffset[jel + 1]; p++) {
+        double xip[3] = {0., 0., 0.};
+        for(unsigned k = 0; k < _dim; k++) {
+          xip[k] = xi[k][p];
+        }
+        double *phi = &_phi[_basisOffset[p]];
+        double *dphi = &_dphi[_dim * _basisOffset[p]];
+        for(unsigned i = 0; i < nDofs; i++) {
+          const int *IND = base->GetIND(i);
+          phi[i] = base->eval_phi(IND, xip);
+          for(unsigned d = 0; d < _dim; d++) {
+            dphi[d * nDofs + i] = base->eval_dphidxyz(d, IND, xip);
+          }
+        }
+      }
+    });
+    //END
+  }
+
+  void ParticleGridTransfer::GatherGrid(const std::vector < NumericVector* > &grid, std::vector < double > &local) {
+    const unsigned nLocal = _localDof.size();
+    local.resize(grid.size() * nLocal);
+    for(unsigned k = 0; k < grid.size(); k++) {
+      for(unsigned l = 0; l < nLocal; l++) {
+        local[k * nLocal + l] = (*grid[k])(_localDof[l]);
+      }
+    }
+  }
+
+  void ParticleGridTransfer::GatherCoordinates(const std::vector < NumericVector* > &displacement) {
+    const unsigned nLocal = _localDof.size();
+    _coordinates.resize(_dim * nLocal);
+    for(unsigned d = 0; d < _dim; d++) {
+      for(unsigned l = 0; l < nLocal; l++) {
+        _coordinates[d * nLocal + l] = (*_msh->_topology->_Sol[d])(_localXDof[l]);
+        if(displacement.size() > d) _coordinates[d * nLocal + l] += (*displacement[d])(_localDof[l]);
+      }
+    }
+  }
+
+  void ParticleGridTransfer::GetGradient(const unsigned &jel, const unsigned &p, double *gradphi) const {
+
+    const unsigned nLocal = _localDof.size();
+    const unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+    const unsigned *dofs = &_elementDof[_elementDofOffset[jel]];
+    const double *dphi = &_dphi[_dim * _basisOffset[p]];
+
+    // J[a][k] = d x_k / d xi_a and its inverse JI[k][a] = d xi_a / d x_k
+    double J[3][3] = {{1., 0., 0.}, {0., 1., 0.}, {0., 0., 1.}};
+    for(unsigned a = 0; a < _dim; a++) {
+      for(unsigned k = 0; k < _dim; k++) {
+        double value = 0.;
+        for(unsigned i = 0; i < nDofs; i++) {
+          value += dphi[a * nDofs + i] * _coordinates[k * nLocal + dofs[i]];
+        }
+        J[a][k] = value;
+      }
+    }
+
+    double det = J[0][0] * (J[1][1] * J[2][2] - J[1][2] * J[2][1])
+                 - J[0][1] * (J[1][0] * J[2][2] - J[1][2] * J[2][0])
+                 + J[0][2] * (J[1][0] * J[2][1] - J[1][1] * J[2][0]);
+    double JI[3][3];
+    JI[0][0] = (J[1][1] * J[2][2] - J[1][2] * J[2][1]) / det;
+    JI[0][1] = (J[0][2] * J[2][1] - J[0][1] * J[2][2]) / det;
+    JI[0][2] = (J[0][1] * J[1][2] - J[0][2] * J[1][1]) / det;
+    JI[1][0] = (J[1][2] * J[2][0] - J[1][0] * J[2][2]) / det;
+    JI[1][1] = (J[0][0] * J[2][2] - J[0][2] * J[2][0]) / det;
+    JI[1][2] = (J[0][2] * J[1][0] - J[0][0] * J[1][2]) / det;
+    JI[2][0] = (J[1][0] * J[2][1] - J[1][1] * J[2][0]) / det;
+    JI[2][1] = (J[0][1] * J[2][0] - J[0][0] * J[2][1]) / det;
+    JI[2][2] = (J[0][0] * J[1][1] - J[0][1] * J[1][0]) / det;
+
+    for(unsigned k = 0; k < _dim; k++) {
+      for(unsigned i = 0; i < nDofs; i++) {
+        double value = 0.;
+        for(unsigned a = 0; a < _dim; a++) {
+          value += JI[k][a] * dphi[a * nDofs + i];
+        }
+        gradphi[k * nDofs + i] = value;
+      }
+    }
+  }
+
+  void ParticleGridTransfer::ScatterParticles(const std::vector < const double* > &particle, const double *weight) {
+
+    const unsigned nLocal = _localDof.size();
+    const unsigned nComponents = particle.size();
+    _gridValue.assign(nComponents * nLocal, 0.);
+
+    // the elements of one color do not share dofs, so the threads never add to the same buffer entry
+    _threads.Run(_msh, [&](const unsigned & iel, const unsigned &) {
+      const unsigned jel = iel - _elementBegin;
+      const unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+      const unsigned *dofs = &_elementDof[_elementDofOffset[jel]];
+
+      for(unsigned p = _markerOffset[jel]; p < _markerOffset[jel + 1]; p++) {
+        const double *phi = &_phi[_basisOffset[p]];
+        const double w = (weight != NULL) ? weight[p] : 1.;
+        for(unsigned k = 0; k < nComponents; k++) {
+          double value = w * particle[k][p];
+          double *buffer = &_gridValue[k * nLocal];
+          for(unsigned i = 0; i < nDofs; i++) {
+            buffer[dofs[i]] += phi[i] * value;
+          }
+        }
+      }
+    });
+  }
+
+  void ParticleGridTransfer::ParticlesToGrid(const std::vector < const double* > &particle, const double *weight,
+                                             const std::vector < NumericVector* > &grid) {
+
+    const unsigned nLocal = _localDof.size();
+    ScatterParticles(particle, weight);
+
+    std::vector < double > buffer(nLocal);
+    for(unsigned k = 0; k < grid.size(); k++) {
+      std::copy(_gridValue.begin() + k * nLocal, _gridValue.begin() + (k + 1) * nLocal, buffer.begin());
+      grid[k]->add_vector_blocked(buffer, _localDof);
+    }
+  }
+
+  void ParticleGridTransfer::ParticlesToGrid(const std::vector < const double* > &particle, const double *weight,
+                                             const LinearEquation &pde, const std::vector < unsigned > &indexSol,
+                                             const std::vector < unsigned > &indexPde, NumericVector *grid) {
+
+    const unsigned nLocal = _localDof.size();
+    const unsigned nel = _markerOffset.size() - 1u;
+    ScatterParticles(particle, weight);
+
+    std::vector < double > buffer(nLocal);
+    std::vector < int > systemDof(nLocal);
+    for(unsigned k = 0; k < particle.size(); k++) {
+      for(unsigned jel = 0; jel < nel; jel++) {
+        const unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+        for(unsigned i = 0; i < nDofs; i++) {
+          systemDof[_elementDof[_elementDofOffset[jel] + i]] = pde.GetSystemDof(indexSol[k], indexPde[k], i, _elementBegin + jel);
+        }
+      }
+      std::copy(_gridValue.begin() + k * nLocal, _gridValue.begin() + (k + 1) * nLocal, buffer.begin());
+      grid->add_vector_blocked(buffer, systemDof);
+    }
+  }
+
+  void ParticleGridTransfer::GridToParticles(const std::vector < NumericVector* > &grid, const std::vector < double* > &particle) {
+
+    const unsigned nLocal = _localDof.size();
+    const unsigned nComponents = grid.size();
+    GatherGrid(grid, _gridValue);
+
+    _threads.Run(_msh, [&](const unsigned & iel, const unsigned &) {
+      const unsigned jel = iel - _elementBegin;
+      const unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+      const unsigned *dofs = &_elementDof[_elementDofOffset[jel]];
+
+      for(unsigned p = _markerOffset[jel]; p < _markerOffset[jel + 1]; p++) {
+        const double *phi = &_phi[_basisOffset[p]];
+        for(unsigned k = 0; k < nComponents; k++) {
+          const double *value = &_gridValue[k * nLocal];
+          double sum = 0.;
+          for(unsigned i = 0; i < nDofs; i++) {
+            sum += phi[i] * value[dofs[i]];
+          }
+          particle[k][p] = sum;
+        }
+      }
+    });
+  }
+
+  void ParticleGridTransfer::GridToParticlesGradient(const std::vector < NumericVector* > &grid,
+                                                     const std::vector < NumericVector* > &displacement,
+                                                     const std::vector < double* > &gradient) {
+
+    const unsigned nLocal = _localDof.size();
+    const unsigned nComponents = grid.size();
+    GatherGrid(grid, _gridValue);
+    GatherCoordinates(displacement);
+
+    _threads.Run(_msh, [&](const unsigned & iel, const unsigned & ithread) {
+      const unsigned jel = iel - _elementBegin;
+      const unsigned nDofs = _elementDofOffset[jel + 1] - _elementDofOffset[jel];
+      const unsigned *dofs = &_elementDof[_elementDofOffset[jel]];
+      double *gradphi = &_gradphi[ithread][0];
+
+      for(unsigned p = _markerOffset[jel]; p < _markerOffset[jel + 1]; p++) {
+        GetGradient(jel, p, gradphi);
+        for(unsigned k = 0; k < nComponents; k++) {
+          const double *value = &_gridValue[k * nLocal];
+          for(unsigned j = 0; j < _dim; j++) {
+            double sum = 0.;
+            for(unsigned i = 0; i < nDofs; i++) {
+              sum += gradphi[j * nDofs + i] * value[dofs[i]];
+            }
+            gradient[k * _dim + j][p] = sum;
+          }
+        }
+      }
+    });
+  }
+
+} //end namespace femus
@@ -0,0 +1,116 @@
+/*=========================================================================
+
+ Program: FEMuS
+ Module: ParticleGridTransfer
+ Authors: Eugenio Aulisa and Giacomo Capodaglio
+
+ Copyright (c) FEMuS
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_ism_ParticleGridTransfer_hpp__
+#define __femus_ism_ParticleGridTransfer_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ParallelObject.hpp"
+#include "ThreadedAssembly.hpp"
+#include "vector"
+
+namespace femus {
+
+  class Mesh;
+  class MarkerSet;
+  class NumericVector;
+  class LinearEquation;
+
+  /**
+   * Particle-to-grid and grid-to-particle operators between the markers of a MarkerSet and the nodal fields of one
+   * finite element type, for the material point method.
+   * Setup buckets the markers by the owned elements and evaluates once the basis functions and their reference
+   * derivatives at the local coordinates of all the markers, in contiguous arrays. The transfers then loop over the
+   * owned elements with the threads of a ThreadedAssembly, one color at a time, and work on a local copy of the grid:
+   * a particle-to-grid transfer accumulates all the elements in the local buffer and adds it to each grid vector with a
+   * single blocked insert, a grid-to-particle transfer reads the grid vectors once before the element loop.
+   * The object and its MarkerSet are owned by the caller and can be kept across the time steps on the same mesh, so
+   * that their arrays are reused.
+   * The grid vectors are indexed by the solution dofs of solType, the particle quantities are arrays indexed by the
+   * position in the MarkerSet; the markers outside the owned elements are not touched.
+   * Setup has to be called again whenever the markers change element or local coordinates.
+   */
+  class ParticleGridTransfer : public ParallelObject {
+    public:
+
+      ParticleGridTransfer(Mesh *msh, const unsigned &solType, const unsigned &nThreads = 1);
+
+      ~ParticleGridTransfer() {};
+
+      /** Sort markerSet by the owned elements and evaluate the basis functions at its markers */
+      void Setup(MarkerSet &markerSet);
+
+      /** Number of markers in the owned elements, they are the first positions of the MarkerSet */
+      unsigned GetNumberOfMarkers() const {
+        return _markerOffset.back();
+      }
+
+      /** grid[k]_i += sum_p weight_p phi_i(x_p) particle[k][p], weight can be NULL; the grid vectors are not closed */
+      void ParticlesToGrid(const std::vector < const double* > &particle, const double *weight,
+                           const std::vector < NumericVector* > &grid);
+
+      /** The same transfer added to a vector of the system of pde, e.g. its residual: the component k goes to the system
+       * dofs of the solution indexSol[k] with pde index indexPde[k]; the vector is not closed */
+      void ParticlesToGrid(const std::vector < const double* > &particle, const double *weight, const LinearEquation &pde,
+                           const std::vector < unsigned > &indexSol, const std::vector < unsigned > &indexPde,
+                           NumericVector *grid);
+
+      /** particle[k][p] = sum_i phi_i(x_p) grid[k]_i */
+      void GridToParticles(const std::vector < NumericVector* > &grid, const std::vector < double* > &particle);
+
+      /** gradient[k * dim + j][p] = sum_i dphi_i/dx_j(x_p) grid[k]_i, with the element coordinates X + displacement */
+      void GridToParticlesGradient(const std::vector < NumericVector* > &grid, const std::vector < NumericVector* > &displacement,
+                                   const std::vector < double* > &gradient);
+
+    private:
+
+      /** Accumulate sum_p weight_p phi_i(x_p) particle[k][p] in _gridValue[k * nLocalDofs + l] */
+      void ScatterParticles(const std::vector < const double* > &particle, const double *weight);
+
+      /** Local copy of the grid vectors at the local dofs, [k * nLocalDofs + l] */
+      void GatherGrid(const std::vector < NumericVector* > &grid, std::vector < double > &local);
+
+      /** Nodal coordinates X + displacement at the local dofs, [d * nLocalDofs + l] */
+      void GatherCoordinates(const std::vector < NumericVector* > &displacement);
+
+      /** Physical derivatives gradphi[j * nDofs + i] of the basis functions at the marker p of the owned element jel */
+      void GetGradient(const unsigned &jel, const unsigned &p, double *gradphi) const;
+
+      Mesh *_msh;
+      unsigned _solType;
+      unsigned _dim;
+      ThreadedAssembly _threads;
+
+      unsigned _elementBegin;
+      std::vector < unsigned > _markerOffset;     // markers of the owned element jel: [_markerOffset[jel], _markerOffset[jel + 1])
+      std::vector < unsigned > _elementDofOffset; // dofs of the owned element jel: [_elementDofOffset[jel], _elementDofOffset[jel + 1])
+      std::vector < unsigned > _elementDof;       // position in the local dofs
+      std::vector < int > _localDof;              // sorted solution dofs of the owned elements
+      std::vector < unsigned > _localXDof;        // coordinate dof of each local dof
+
+      std::vector < unsigned > _basisOffset;      // phi of the marker p at _phi[_basisOffset[p]], its reference derivatives at _dphi[dim * _basisOffset[p]]
+      std::vector < double > _phi;
+      std::vector < double > _dphi;               // [dim * _basisOffset[p] + d * nDofs + i]
+
+      std::vector < double > _gridValue;
+      std::vector < double > _coordinates;
+      std::vector < std::vector < double > > _gradphi; // work array of each thread
+  };
+
+} //end namespace femus
+
+#endif
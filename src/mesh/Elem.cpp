@@ -90,22 +90,20 @@ namespace femus
     MyVector <unsigned> rowSizeElDof(_nel);
     MyVector <unsigned> rowSizeElNearFace(_nel);
     unsigned jel = 0;
-    for (unsigned isdom = 0; isdom < elc->_nprocs; isdom++) {
-      elc->_elementType.broadcast(isdom);
-      for (unsigned iel = elc->_elementType.begin(); iel < elc->_elementType.end(); iel++) {
-        short unsigned elType = elc->_elementType[iel];
-        int increment = 1;
-        if (static_cast < short unsigned >(coarseAmrVector[iel] + 0.25) == 1) {
-          increment = NRE[elType];
-        }
-        for (unsigned j = 0; j < increment; j++) {
-          rowSizeElDof[jel + j] += NVE[elType][2];
-          rowSizeElNearFace[jel + j] += NFC[elType][1];
-        }
-        jel += increment;
+    elc->_elementType.localize();
+    for (unsigned iel = elc->_elementType.begin(); iel < elc->_elementType.end(); iel++) {
+      short unsigned elType = elc->_elementType[iel];
+      int increment = 1;
+      if (static_cast < short unsigned >(coarseAmrVector[iel] + 0.25) == 1) {
+        increment = NRE[elType];
       }
-      elc->_elementType.clearBroadcast();
+      for (unsigned j = 0; j < increment; j++) {
+        rowSizeElDof[jel + j] += NVE[elType][2];
+        rowSizeElNearFace[jel + j] += NFC[elType][1];
+      }
+      jel += increment;
     }
+    elc->_elementType.clearBroadcast();
     _elementDof = MyMatrix <unsigned> (rowSizeElDof);
     _elementNearFace = MyMatrix <int> (rowSizeElNearFace, -1);
 
@@ -214,6 +212,14 @@ namespace femus
     _elementNearVertex.clear();
   }
 
+  std::size_t elem::GetMemoryUsage()
+  {
+    return _elementLevel.memory() + _elementType.memory() + _elementGroup.memory() + _elementMaterial.memory() +
+           _elementDof.memory() + _elementNearFace.memory() + _childElem.memory() + _childElemDof.memory() +
+           _elementNearVertex.memory() + _elementNearElement.memory() +
+           (_elementOffset.capacity() + _materialElementCounter.capacity()) * sizeof(unsigned);
+  }
+
   /**
    * Return the number of vertices(type=0) + midpoints(type=1) + facepoints(type=2) + interiorpoits(type=2)
    **/
@@ -543,6 +549,11 @@ namespace femus
     _elementDof.broadcast(jproc);
   }
 
+  void elem::LocalizeElementDof()
+  {
+    _elementDof.localize();
+  }
+
   unsigned elem::GetElementDofIndex(const unsigned& iel, const unsigned& inode)
   {
     return _elementDof[iel][inode];
@@ -563,6 +574,11 @@ namespace femus
     _elementNearFace.broadcast(jproc);
   }
 
+  void elem::LocalizeElementNearFace()
+  {
+    _elementNearFace.localize();
+  }
+
   void elem::FreeLocalizedElementNearFace()
   {
     _elementNearFace.clearBroadcast();
@@ -684,117 +700,115 @@ namespace femus
     for (unsigned soltype = 0; soltype < 3; soltype++) {
       for (int ilevel = 0; ilevel < _level; ilevel++) {
         for (int jlevel = ilevel + 1; jlevel <= _level; jlevel++) {
-          for (unsigned lproc = 0; lproc < _nprocs; lproc++) {
-            interfaceDof[soltype][jlevel].broadcast(lproc);
-            levelInterfaceSolidMark[soltype][jlevel].broadcast(lproc);
-            for (unsigned d = 0; d < dim; d++) {
-              interfaceNodeCoordinates[jlevel][d].broadcast(lproc);
-            }
-            std::map< unsigned, bool> candidateNodes;
-            std::map< unsigned, bool> elementNodes;
+          interfaceDof[soltype][jlevel].localize();
+          levelInterfaceSolidMark[soltype][jlevel].localize();
+          for (unsigned d = 0; d < dim; d++) {
+            interfaceNodeCoordinates[jlevel][d].localize();
+          }
+          std::map< unsigned, bool> candidateNodes;
+          std::map< unsigned, bool> elementNodes;
 
-            for (unsigned i = interfaceDof[soltype][ilevel].begin(); i < interfaceDof[soltype][ilevel].end(); i++) {
+          for (unsigned i = interfaceDof[soltype][ilevel].begin(); i < interfaceDof[soltype][ilevel].end(); i++) {
 
-              candidateNodes.clear();
+            candidateNodes.clear();
 
-              std::vector < std::vector < std::vector <double > > > aP(3);
-              bool aPIsInitialized = false;
+            std::vector < std::vector < std::vector <double > > > aP(3);
+            bool aPIsInitialized = false;
 
-              unsigned iel = interfaceElement[ilevel][i];
-              short unsigned ielType = _elementType[iel];
+            unsigned iel = interfaceElement[ilevel][i];
+            short unsigned ielType = _elementType[iel];
 
-              elementNodes.clear();
-              for (unsigned j = 0; j < GetElementDofNumber(iel, soltype); j++) {
-                unsigned jdof  = msh->GetSolutionDof(j, iel, soltype);
-                elementNodes[jdof] = true;
-              }
+            elementNodes.clear();
+            for (unsigned j = 0; j < GetElementDofNumber(iel, soltype); j++) {
+              unsigned jdof  = msh->GetSolutionDof(j, iel, soltype);
+              elementNodes[jdof] = true;
+            }
 
-              std::vector < std::vector <double > > xv;
-              msh->GetElementNodeCoordinates(xv, iel);
-              unsigned ndofs = xv[0].size();
+            std::vector < std::vector <double > > xv;
+            msh->GetElementNodeCoordinates(xv, iel);
+            unsigned ndofs = xv[0].size();
 
-              double r;
-              std::vector <double> xc;
-              GetConvexHullSphere(xv, xc, r, 0.01);
-              double r2 = r * r;
+            double r;
+            std::vector <double> xc;
+            GetConvexHullSphere(xv, xc, r, 0.01);
+            double r2 = r * r;
 
-              std::vector < std::vector< double > > xe;
-              GetBoundingBox(xv, xe, 0.01);
+            std::vector < std::vector< double > > xe;
+            GetBoundingBox(xv, xe, 0.01);
 
 
-              for (unsigned k = interfaceDof[soltype][jlevel].begin(); k < interfaceDof[soltype][jlevel].end(); k++) {
-                for (unsigned l = interfaceDof[soltype][jlevel].begin(k); l < interfaceDof[soltype][jlevel].end(k); l++) {
-                  unsigned ldof = interfaceDof[soltype][jlevel][k][l];
-                  if (candidateNodes.find(ldof) == candidateNodes.end() || candidateNodes[ldof] != false) {
-                    double d2 = 0.;
-                    std::vector<double> xl(dim);
-                    for (int d = 0; d < dim; d++) {
-                      xl[d] = interfaceNodeCoordinates[jlevel][d][k][l];
-                      d2 += (xl[d] - xc[d]) * (xl[d] - xc[d]);
-                    }
-                    bool insideHull = true;
-                    if (d2 > r2) {
+            for (unsigned k = interfaceDof[soltype][jlevel].begin(); k < interfaceDof[soltype][jlevel].end(); k++) {
+              for (unsigned l = interfaceDof[soltype][jlevel].begin(k); l < interfaceDof[soltype][jlevel].end(k); l++) {
+                unsigned ldof = interfaceDof[soltype][jlevel][k][l];
+                if (candidateNodes.find(ldof) == candidateNodes.end() || candidateNodes[ldof] != false) {
+                  double d2 = 0.;
+                  std::vector<double> xl(dim);
+                  for (int d = 0; d < dim; d++) {
+                    xl[d] = interfaceNodeCoordinates[jlevel][d][k][l];
+                    d2 += (xl[d] - xc[d]) * (xl[d] - xc[d]);
+                  }
+                  bool insideHull = true;
+                  if (d2 > r2) {
+                    insideHull = false;
+                  }
+                  for (unsigned d = 0; d < dim; d++) {
+                    if (xl[d] < xe[d][0] || xl[d] > xe[d][1]) {
                       insideHull = false;
                     }
-                    for (unsigned d = 0; d < dim; d++) {
-                      if (xl[d] < xe[d][0] || xl[d] > xe[d][1]) {
-                        insideHull = false;
-                      }
-                    }
-                    if (insideHull) {
-                      if (elementNodes.find(ldof) == elementNodes.end()) {
-
-                        if (!aPIsInitialized) {
-                          aPIsInitialized = true;
-                          std::vector < std::vector <double> > x1(dim);
-                          for (unsigned jtype = 0; jtype < 3; jtype++) {
-                            ProjectNodalToPolynomialCoefficients(aP[jtype], xv, ielType, jtype) ;
-                          }
+                  }
+                  if (insideHull) {
+                    if (elementNodes.find(ldof) == elementNodes.end()) {
+
+                      if (!aPIsInitialized) {
+                        aPIsInitialized = true;
+                        std::vector < std::vector <double> > x1(dim);
+                        for (unsigned jtype = 0; jtype < 3; jtype++) {
+                          ProjectNodalToPolynomialCoefficients(aP[jtype], xv, ielType, jtype) ;
                         }
+                      }
 
-                        std::vector <double> xi;
-                        GetClosestPointInReferenceElement(xv, xl, ielType, xi);
-                        GetInverseMapping(2, ielType, aP, xl, xi);
-
-                        bool insideDomain = CheckIfPointIsInsideReferenceDomain(xi, ielType, 0.0001);
-                        if (insideDomain) {
-                          for (unsigned j = interfaceDof[soltype][ilevel].begin(i); j < interfaceDof[soltype][ilevel].end(i); j++) {
-                            unsigned jloc = interfaceLocalDof[ilevel][i][j];
-
-                            basis* base = msh->GetBasis(ielType, soltype);
-                            double value = base->eval_phi(jloc, xi);
-
-                            if (fabs(value) >= 1.0e-10) {
-                              unsigned jdof = interfaceDof[soltype][ilevel][i][j];
-                              if (restriction[soltype][jdof].find(jdof) == restriction[soltype][jdof].end()) {
-                                restriction[soltype][jdof][jdof] = 1.;
-                                unsigned jdof2  = msh->GetSolutionDof(jloc, iel, 2);
-                                interfaceSolidMark[soltype][jdof] = levelInterfaceSolidMark[soltype][ilevel][i][j];
-                              }
-                              restriction[soltype][jdof][ldof] = value;
-                              restriction[soltype][ldof][ldof] = 10.;
-                              interfaceSolidMark[soltype][ldof] = levelInterfaceSolidMark[soltype][jlevel][k][l];
-                              candidateNodes[ldof] = true;
+                      std::vector <double> xi;
+                      GetClosestPointInReferenceElement(xv, xl, ielType, xi);
+                      GetInverseMapping(2, ielType, aP, xl, xi);
+
+                      bool insideDomain = CheckIfPointIsInsideReferenceDomain(xi, ielType, 0.0001);
+                      if (insideDomain) {
+                        for (unsigned j = interfaceDof[soltype][ilevel].begin(i); j < interfaceDof[soltype][ilevel].end(i); j++) {
+                          unsigned jloc = interfaceLocalDof[ilevel][i][j];
+
+                          basis* base = msh->GetBasis(ielType, soltype);
+                          double value = base->eval_phi(jloc, xi);
+
+                          if (fabs(value) >= 1.0e-10) {
+                            unsigned jdof = interfaceDof[soltype][ilevel][i][j];
+                            if (restriction[soltype][jdof].find(jdof) == restriction[soltype][jdof].end()) {
+                              restriction[soltype][jdof][jdof] = 1.;
+                              unsigned jdof2  = msh->GetSolutionDof(jloc, iel, 2);
+                              interfaceSolidMark[soltype][jdof] = levelInterfaceSolidMark[soltype][ilevel][i][j];
                             }
+                            restriction[soltype][jdof][ldof] = value;
+                            restriction[soltype][ldof][ldof] = 10.;
+                            interfaceSolidMark[soltype][ldof] = levelInterfaceSolidMark[soltype][jlevel][k][l];
+                            candidateNodes[ldof] = true;
                           }
                         }
-                        else {
-                          candidateNodes[ldof] = false;
-                        }
                       }
                       else {
                         candidateNodes[ldof] = false;
                       }
                     }
+                    else {
+                      candidateNodes[ldof] = false;
+                    }
                   }
                 }
               }
             }
-            interfaceDof[soltype][jlevel].clearBroadcast();
-            levelInterfaceSolidMark[soltype][jlevel].clearBroadcast();
-            for (unsigned d = 0; d < dim; d++) {
-              interfaceNodeCoordinates[jlevel][d].clearBroadcast();
-            }
+          }
+          interfaceDof[soltype][jlevel].clearBroadcast();
+          levelInterfaceSolidMark[soltype][jlevel].clearBroadcast();
+          for (unsigned d = 0; d < dim; d++) {
+            interfaceNodeCoordinates[jlevel][d].clearBroadcast();
           }
         }
       }
@@ -1020,18 +1034,16 @@ namespace femus
       InterfaceSolidMarkNode.stack();
       InterfaceSolidMarkValue.stack();
 
-      for (unsigned lproc = 0; lproc < _nprocs; lproc++) {
-        InterfaceSolidMarkNode.broadcast(lproc);
-        InterfaceSolidMarkValue.broadcast(lproc);
-        for (unsigned i = InterfaceSolidMarkNode.begin(); i < InterfaceSolidMarkNode.end(); i++) {
-          unsigned jnode = InterfaceSolidMarkNode[i];
-          if ( restriction[soltype].find(jnode) != restriction[soltype].end()) {
-            interfaceSolidMark[soltype][jnode] = InterfaceSolidMarkValue[i];
-          }
+      InterfaceSolidMarkNode.localize();
+      InterfaceSolidMarkValue.localize();
+      for (unsigned i = InterfaceSolidMarkNode.begin(); i < InterfaceSolidMarkNode.end(); i++) {
+        unsigned jnode = InterfaceSolidMarkNode[i];
+        if ( restriction[soltype].find(jnode) != restriction[soltype].end()) {
+          interfaceSolidMark[soltype][jnode] = InterfaceSolidMarkValue[i];
         }
-        InterfaceSolidMarkNode.clearBroadcast();
-        InterfaceSolidMarkValue.clearBroadcast();
       }
+      InterfaceSolidMarkNode.clearBroadcast();
+      InterfaceSolidMarkValue.clearBroadcast();
     }
   }
 
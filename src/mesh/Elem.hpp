@@ -55,10 +55,12 @@ namespace femus {
 
       void ScatterElementNearFace();
       void LocalizeElementNearFace(const unsigned& jproc);
+      void LocalizeElementNearFace();
       void FreeLocalizedElementNearFace();
 
       void ScatterElementDof();
       void LocalizeElementDof(const unsigned &jproc);
+      void LocalizeElementDof();
       void FreeLocalizedElementDof();
 
       // reorder the element according to the new element mapping
@@ -152,6 +154,20 @@ namespace femus {
 
       void DeleteElementNearVertex();
 
+      /** Free the children of the elements, see MultiLevelMesh::CompactHierarchy */
+      void FreeChildElements() {
+        _childElem.clear();
+        _childElemDof.clear();
+      }
+
+      /** Free the element near element lists, see MultiLevelMesh::CompactHierarchy */
+      void FreeElementNearElement() {
+        _elementNearElement.clear();
+      }
+
+      /** Bytes allocated by this process for the element arrays */
+      std::size_t GetMemoryUsage();
+
       /** To be Added */
       unsigned GetElementNearVertexNumber(const unsigned& inode);
 
@@ -188,6 +204,12 @@ namespace femus {
         _elementMaterial.broadcast(lproc);
         _elementGroup.broadcast(lproc);
       }
+      void LocalizeElementQuantities() {
+        _elementLevel.localize();
+        _elementType.localize();
+        _elementMaterial.localize();
+        _elementGroup.localize();
+      }
       void FreeLocalizedElementQuantities() {
         _elementLevel.clearBroadcast();
         _elementType.clearBroadcast();
@@ -0,0 +1,263 @@
+/*=========================================================================
+
+ Program: FEMuS
+ Module: ElementSearchGrid
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMuS
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ElementSearchGrid.hpp"
+#include "Mesh.hpp"
+#include "PolynomialBases.hpp"
+#include <cmath>
+#include <climits>
+#include <cstdlib>
+
+namespace femus {
+
+  ElementSearchGrid::ElementSearchGrid(Mesh *mesh) {
+
+    _dim = mesh->GetDimension();
+    _elementBegin = mesh->_elementOffset[_iproc];
+    _nel = mesh->_elementOffset[_iproc + 1] - _elementBegin;
+
+    _xMin.assign(_dim, 0.);
+    _xMax.assign(_dim, 0.);
+    _h.assign(_dim, 1.);
+    _nBins.assign(_dim, 1);
+
+    _elementBox.resize(_nel * _dim * 2);
+    _elementCenter.resize(_nel * _dim);
+
+    //BEGIN element bounding boxes
+    std::vector < std::vector < double > > xv;
+    std::vector < std::vector < double > > xe;
+
+    for(unsigned i = 0; i < _nel; i++) {
+      mesh->GetElementNodeCoordinates(xv, _elementBegin + i);
+      GetBoundingBox(xv, xe, 0.1);
+      for(unsigned d = 0; d < _dim; d++) {
+        _elementBox[(i * _dim + d) * 2] = xe[d][0];
+        _elementBox[(i * _dim + d) * 2 + 1] = xe[d][1];
+        _elementCenter[i * _dim + d] = 0.5 * (xe[d][0] + xe[d][1]);
+        if(i == 0 || xe[d][0] < _xMin[d]) _xMin[d] = xe[d][0];
+        if(i == 0 || xe[d][1] > _xMax[d]) _xMax[d] = xe[d][1];
+      }
+    }
+    //END element bounding boxes
+
+    if(_nel == 0) {
+      _binOffset.assign(2, 0);
+      return;
+    }
+
+    //BEGIN bin sizes: about one element per bin, with bins as close as possible to cubes
+    double volume = 1.;
+    for(unsigned d = 0; d < _dim; d++) {
+      double length = _xMax[d] - _xMin[d];
+      volume *= (length > 0.) ? length : 1.;
+    }
+    double h = pow(volume / _nel, 1. / _dim);
+    unsigned nBins = 1;
+    for(unsigned d = 0; d < _dim; d++) {
+      double length = _xMax[d] - _xMin[d];
+      _nBins[d] = (length > 0.) ? static_cast < unsigned >(ceil(length / h)) : 1;
+      if(_nBins[d] > _nel) _nBins[d] = _nel;
+      if(_nBins[d] == 0) _nBins[d] = 1;
+      _h[d] = (length > 0.) ? length / _nBins[d] : 1.;
+      nBins *= _nBins[d];
+    }
+    //END bin sizes
+
+    //BEGIN fill the bins in CSR format, the first pass counts and the second pass inserts
+    _binOffset.assign(nBins + 1, 0);
+
+    std::vector < unsigned > ijkMin(_dim), ijkMax(_dim), ijk(_dim);
+    std::vector < double > x(_dim);
+
+    for(unsigned pass = 0; pass < 2; pass++) {
+      std::vector < unsigned > counter;
+      if(pass == 1) {
+        for(unsigned b = 0; b < nBins; b++) {
+          _binOffset[b + 1] += _binOffset[b];
+        }
+        _binElement.resize(_binOffset[nBins]);
+        counter.assign(_binOffset.begin(), _binOffset.end() - 1);
+      }
+
+      for(unsigned i = 0; i < _nel; i++) {
+        for(unsigned d = 0; d < _dim; d++) x[d] = _elementBox[(i * _dim + d) * 2];
+        GetBin(x, ijkMin);
+        for(unsigned d = 0; d < _dim; d++) x[d] = _elementBox[(i * _dim + d) * 2 + 1];
+        GetBin(x, ijkMax);
+
+        ijk = ijkMin;
+        bool done = false;
+        while(!done) {
+          unsigned b = 0;
+          for(int d = _dim - 1; d >= 0; d--) {
+            b = b * _nBins[d] + ijk[d];
+          }
+          if(pass == 0) {
+            _binOffset[b + 1]++;
+          }
+          else {
+            _binElement[counter[b]++] = i;
+          }
+
+          done = true;
+          for(unsigned d = 0; d < _dim; d++) {
+            if(ijk[d] < ijkMax[d]) {
+              ijk[d]++;
+              done = false;
+              break;
+            }
+            ijk[d] = ijkMin[d];
+          }
+        }
+      }
+    }
+    //END fill the bins
+  }
+
+  unsigned ElementSearchGrid::GetBin(const std::vector < double > &x, std::vector < unsigned > &ijk) const {
+    ijk.resize(_dim);
+    unsigned b = 0;
+    for(int d = _dim - 1; d >= 0; d--) {
+      double r = (x[d] - _xMin[d]) / _h[d];
+      ijk[d] = (r <= 0.) ? 0 : ((r >= _nBins[d]) ? _nBins[d] - 1 : static_cast < unsigned >(r));
+      b = b * _nBins[d] + ijk[d];
+    }
+    return b;
+  }
+
+  double ElementSearchGrid::BoxDistance2(const unsigned &i, const std::vector < double > &x) const {
+    double distance2 = 0.;
+    for(unsigned d = 0; d < _dim; d++) {
+      double lower = _elementBox[(i * _dim + d) * 2] - x[d];
+      double upper = x[d] - _elementBox[(i * _dim + d) * 2 + 1];
+      double dd = (lower > 0.) ? lower : ((upper > 0.) ? upper : 0.);
+      distance2 += dd * dd;
+    }
+    return distance2;
+  }
+
+  bool ElementSearchGrid::PointIsInsideProcessBoundingBox(const std::vector < double > &x) const {
+    if(_nel == 0) return false;
+    for(unsigned d = 0; d < _dim; d++) {
+      if(x[d] < _xMin[d] || x[d] > _xMax[d]) return false;
+    }
+    return true;
+  }
+
+  void ElementSearchGrid::GetCandidateElements(const std::vector < double > &x, std::vector < unsigned > &candidates) const {
+    candidates.clear();
+    if(!PointIsInsideProcessBoundingBox(x)) return;
+
+    std::vector < unsigned > ijk;
+    unsigned b = GetBin(x, ijk);
+    for(unsigned j = _binOffset[b]; j < _binOffset[b + 1]; j++) {
+      unsigned i = _binElement[j];
+      if(BoxDistance2(i, x) == 0.) {
+        candidates.push_back(_elementBegin + i);
+      }
+    }
+  }
+
+  unsigned ElementSearchGrid::GetClosestElement(const std::vector < double > &x) const {
+
+    if(_nel == 0) return UINT_MAX;
+
+    std::vector < unsigned > ijk;
+    GetBin(x, ijk);
+
+    // look in rings of bins of increasing radius around the bin of x until some element is found,
+    // then one more ring, since an element in the next ring can still be closer
+    unsigned maxRadius = 0;
+    for(unsigned d = 0; d < _dim; d++) {
+      if(_nBins[d] > maxRadius) maxRadius = _nBins[d];
+    }
+
+    unsigned closestElement = UINT_MAX;
+    double closestBoxDistance2 = 1.e300;
+    double closestCenterDistance2 = 1.e300;
+    unsigned lastRadius = maxRadius;
+
+    std::vector < int > l(_dim);
+    std::vector < int > lMin(_dim), lMax(_dim);
+
+    for(unsigned radius = 0; radius <= lastRadius; radius++) {
+      for(unsigned d = 0; d < _dim; d++) {
+        lMin[d] = static_cast < int >(ijk[d]) - static_cast < int >(radius);
+        lMax[d] = static_cast < int >(ijk[d]) + static_cast < int >(radius);
+        if(lMin[d] < 0) lMin[d] = 0;
+        if(lMax[d] > static_cast < int >(_nBins[d]) - 1) lMax[d] = _nBins[d] - 1;
+      }
+
+      l = lMin;
+      bool done = false;
+      while(!done) {
+        bool onRing = false;
+        for(unsigned d = 0; d < _dim; d++) {
+          if(abs(l[d] - static_cast < int >(ijk[d])) == static_cast < int >(radius)) onRing = true;
+        }
+        if(onRing || radius == 0) {
+          unsigned b = 0;
+          for(int d = _dim - 1; d >= 0; d--) {
+            b = b * _nBins[d] + l[d];
+          }
+          for(unsigned j = _binOffset[b]; j < _binOffset[b + 1]; j++) {
+            unsigned i = _binElement[j];
+            double boxDistance2 = BoxDistance2(i, x);
+            double centerDistance2 = 0.;
+            for(unsigned d = 0; d < _dim; d++) {
+              double dd = _elementCenter[i * _dim + d] - x[d];
+              centerDistance2 += dd * dd;
+            }
+            if(boxDistance2 < closestBoxDistance2 ||
+                (boxDistance2 == closestBoxDistance2 && centerDistance2 < closestCenterDistance2)) {
+              closestElement = i;
+              closestBoxDistance2 = boxDistance2;
+              closestCenterDistance2 = centerDistance2;
+            }
+          }
+        }
+
+        done = true;
+        for(unsigned d = 0; d < _dim; d++) {
+          if(l[d] < lMax[d]) {
+            l[d]++;
+            done = false;
+            break;
+          }
+          l[d] = lMin[d];
+        }
+      }
+
+      if(closestElement != UINT_MAX && lastRadius == maxRadius) {
+        if(closestBoxDistance2 == 0.) break;
+        lastRadius = radius + 1;
+      }
+    }
+
+    return _elementBegin + closestElement;
+  }
+
+  void ElementSearchGrid::GetClosestElements(const std::vector < std::vector < double > > &x, std::vector < unsigned > &iel) const {
+    iel.resize(x.size());
+    for(unsigned i = 0; i < x.size(); i++) {
+      iel[i] = GetClosestElement(x[i]);
+    }
+  }
+
+}
@@ -0,0 +1,83 @@
+/*=========================================================================
+
+ Program: FEMuS
+ Module: ElementSearchGrid
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMuS
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_mesh_ElementSearchGrid_hpp__
+#define __femus_mesh_ElementSearchGrid_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ParallelObject.hpp"
+#include "vector"
+
+namespace femus {
+
+  class Mesh;
+
+  /**
+   * Uniform bin grid over the bounding boxes of the elements owned by this process.
+   * Every element is registered in all the bins its bounding box overlaps, so the candidate elements of a point are
+   * the elements of its bin. It is used to start the element walk of the point location close to the point.
+   */
+  class ElementSearchGrid : public ParallelObject {
+    public:
+
+      ElementSearchGrid(Mesh *mesh);
+
+      ~ElementSearchGrid() {};
+
+      /** Bytes allocated by this process for the grid */
+      std::size_t GetMemoryUsage() const {
+        return (_xMin.capacity() + _xMax.capacity() + _h.capacity() + _elementBox.capacity() + _elementCenter.capacity()) * sizeof(double) +
+               (_nBins.capacity() + _binOffset.capacity() + _binElement.capacity()) * sizeof(unsigned);
+      }
+
+      /** Elements owned by this process whose bounding box may contain x, it is empty if x is outside the process bounding box */
+      void GetCandidateElements(const std::vector < double > &x, std::vector < unsigned > &candidates) const;
+
+      /** Owned element whose bounding box contains x with the closest center, or the closest owned element if none contains x.
+       * It returns UINT_MAX only if this process owns no elements */
+      unsigned GetClosestElement(const std::vector < double > &x) const;
+
+      /** Batched version of GetClosestElement, x is [point][dim] */
+      void GetClosestElements(const std::vector < std::vector < double > > &x, std::vector < unsigned > &iel) const;
+
+      /** Check if x is inside the bounding box of all the elements owned by this process */
+      bool PointIsInsideProcessBoundingBox(const std::vector < double > &x) const;
+
+    private:
+
+      unsigned GetBin(const std::vector < double > &x, std::vector < unsigned > &ijk) const;
+      double BoxDistance2(const unsigned &i, const std::vector < double > &x) const;
+
+      unsigned _dim;
+      unsigned _elementBegin;
+      unsigned _nel;
+
+      std::vector < double > _xMin; // [dim]
+      std::vector < double > _xMax; // [dim]
+      std::vector < double > _h; // [dim]
+      std::vector < unsigned > _nBins; // [dim]
+
+      std::vector < double > _elementBox; // [owned element][dim][2]
+      std::vector < double > _elementCenter; // [owned element][dim]
+
+      std::vector < unsigned > _binOffset; // [bins + 1]
+      std::vector < unsigned > _binElement; // local element index, size _binOffset.back()
+  };
+
+} //end namespace femus
+
+#endif
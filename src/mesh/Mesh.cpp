@@ -21,7 +21,9 @@
 #include "MeshMetisPartitioning.hpp"
 #include "GambitIO.hpp"
 #include "MED_IO.hpp"
+#include "MeshCache.hpp"
 #include "NumericVector.hpp"
+#include "ElementSearchGrid.hpp"
 
 // C++ includes
 #include <iostream>
@@ -30,6 +32,8 @@
 #include <cmath>
 #include <cstring>
 #include <algorithm>
+#include <climits>
+#include <stdint.h>
 
 
 namespace femus
@@ -43,6 +47,8 @@ namespace femus
 
   bool Mesh::_IsUserRefinementFunctionDefined = false;
 
+  bool Mesh::_localityReordering = false;
+
   unsigned Mesh::_dimension = 2;
   unsigned Mesh::_ref_index = 4; // 8*DIM[2]+4*DIM[1]+2*DIM[0];
   unsigned Mesh::_face_index = 2; // 4*DIM[2]+2*DIM[1]+1*DIM[0];
@@ -52,6 +58,12 @@ namespace femus
   {
 
     _coarseMsh = NULL;
+    _elementSearchGrid = NULL;
+
+    _elementNearElementIsFreed = false;
+    _childElementsAreFreed = false;
+
+    _coordinatesRevision = 0;
 
     for(int i = 0; i < 5; i++) {
       _ProjCoarseToFine[i] = NULL;
@@ -86,6 +98,11 @@ namespace femus
         _ProjCoarseToFine[i] = NULL;
       }
     }
+
+    if(_elementSearchGrid) {
+      delete _elementSearchGrid;
+      _elementSearchGrid = NULL;
+    }
   }
 
 /// print Mesh info
@@ -134,33 +151,49 @@ namespace femus
 
     _level = 0;
 
-    if(name.rfind(".neu") < name.size()) {
-      GambitIO(*this).read(name, _coords, Lref, type_elem_flag);
-    }
-    else if(name.rfind(".med") < name.size()) {
-      MED_IO(*this).read(name, _coords, Lref, type_elem_flag);
+    std::vector < int > partition;
+
+    MeshCache meshCache(_meshCacheFile);
+    if(!_meshCacheFile.empty() && meshCache.Open(name, Lref)) {
+      std::cout << " Reading coarse mesh from cache: " << _meshCacheFile << std::endl;
+      meshCache.Read(*this, _coords, type_elem_flag, partition);
     }
     else {
-      std::cerr << " ERROR: Unrecognized file extension: " << name
-                << "\n   I understand the following:\n\n"
-                << "     *.neu -- Gambit Neutral File\n"
-                << std::endl;
-      exit(1);
-    }
+      // only process 0 parses the mesh file, the others receive the coarse mesh in the cache format
+      if(_iproc == 0) {
+        if(name.rfind(".neu") < name.size()) {
+          GambitIO(*this).read(name, _coords, Lref, type_elem_flag);
+        }
+        else if(name.rfind(".med") < name.size()) {
+          MED_IO(*this).read(name, _coords, Lref, type_elem_flag);
+        }
+        else {
+          std::cerr << " ERROR: Unrecognized file extension: " << name
+                    << "\n   I understand the following:\n\n"
+                    << "     *.neu -- Gambit Neutral File\n"
+                    << std::endl;
+          abort();
+        }
 
-    BiquadraticNodesNotInGambit();
+        BiquadraticNodesNotInGambit();
 
-    el->ShrinkToFit();
+        el->ShrinkToFit();
 
-    //el->SetNodeNumber(_nnodes);
+        //el->SetNodeNumber(_nnodes);
+      }
 
+      meshCache.Broadcast(*this, _coords, type_elem_flag);
 
+      partition.reserve(GetNumberOfNodes());
+      partition.resize(GetNumberOfElements());
+      MeshMetisPartitioning meshMetisPartitioning(*this);
+      meshMetisPartitioning.DoPartition(partition, false);
+
+      if(!_meshCacheFile.empty()) {
+        meshCache.Write(name, Lref, *this, _coords, type_elem_flag, partition);
+      }
+    }
 
-    std::vector < int > partition;
-    partition.reserve(GetNumberOfNodes());
-    partition.resize(GetNumberOfElements());
-    MeshMetisPartitioning meshMetisPartitioning(*this);
-    meshMetisPartitioning.DoPartition(partition, false);
     FillISvector(partition);
     partition.resize(0);
 
@@ -183,6 +216,10 @@ namespace femus
     _topology->GetSolutionName("X") = _coords[0];
     _topology->GetSolutionName("Y") = _coords[1];
     _topology->GetSolutionName("Z") = _coords[2];
+    UpdateCoordinatesRevision();
+
+    // the coordinates are now distributed in _topology, release the replicated copy
+    vector < vector < double > > ().swap(_coords);
 
 
     _topology->AddSolution("AMR", DISCONTINOUS_POLYNOMIAL, ZERO, 1, 0);
@@ -193,6 +230,7 @@ namespace femus
     AllocateAndMarkStructureNode();
 
     el->BuildElementNearElement();
+    el->DeleteElementNearVertex();
 
     el->ScatterElementQuantities();
     el->ScatterElementDof();
@@ -258,6 +296,10 @@ namespace femus
     _topology->GetSolutionName("X") = _coords[0];
     _topology->GetSolutionName("Y") = _coords[1];
     _topology->GetSolutionName("Z") = _coords[2];
+    UpdateCoordinatesRevision();
+
+    // the coordinates are now distributed in _topology, release the replicated copy
+    vector < vector < double > > ().swap(_coords);
 
     _topology->AddSolution("AMR", DISCONTINOUS_POLYNOMIAL, ZERO, 1, 0);
 
@@ -447,6 +489,10 @@ namespace femus
 //     std::cout << std::endl;
     
     el->ReorderMeshElements(mapping);
+
+    if(_localityReordering) {
+      ReorderElementsAlongHilbertCurve();
+    }
 //     for(int isdom = 0; isdom < _nprocs; isdom++) {
 //       for(unsigned iel = _elementOffset[isdom]; iel < _elementOffset[isdom + 1]; iel++) {
 //         std::cout << "("<<el->GetElementMaterial(iel) << ", "<< el->GetElementGroup(iel)<<") ";
@@ -490,8 +536,12 @@ namespace femus
 
     counter = 0;
 
+    // the nodes of the vertices, midpoints and faces/interiors owned by isdom are numbered in the consecutive blocks 3 * isdom + k
+    std::vector < unsigned > nodeBlockOffset(3 * _nprocs + 1);
+
     for(int isdom = 0; isdom < _nprocs; isdom++) {
       for(unsigned k = 0; k < 3; k++) {
+        nodeBlockOffset[3 * isdom + k] = counter;
         for(unsigned iel = _elementOffset[isdom]; iel < _elementOffset[isdom + 1]; iel++) {
           unsigned nodeStart = (k == 0) ? 0 : el->GetElementDofNumber(iel, k - 1);
           unsigned nodeEnd = el->GetElementDofNumber(iel, k);
@@ -522,6 +572,12 @@ namespace femus
       _dofOffset[2][i] = _dofOffset[2][i - 1] + _ownSize[2][i - 1];
     }
 
+    nodeBlockOffset[3 * _nprocs] = counter;
+
+    if(_localityReordering) {
+      ReorderNodesReverseCuthillMcKee(mapping, nodeBlockOffset);
+    }
+
     el->ReorderMeshNodes(mapping);
 
     if(GetLevel() == 0) {
@@ -637,6 +693,191 @@ namespace femus
 
   }
 
+  // Hilbert index of the quantized point X with bits bits per direction (J. Skilling, AIP Conf. Proc. 707, 2004)
+  static uint64_t GetHilbertIndex(unsigned X[3], const unsigned &dim, const unsigned &bits)
+  {
+    unsigned M = 1u << (bits - 1u);
+
+    // inverse undo
+    for(unsigned Q = M; Q > 1; Q >>= 1) {
+      unsigned P = Q - 1u;
+      for(unsigned i = 0; i < dim; i++) {
+        if(X[i] & Q) {
+          X[0] ^= P;
+        }
+        else {
+          unsigned t = (X[0] ^ X[i]) & P;
+          X[0] ^= t;
+          X[i] ^= t;
+        }
+      }
+    }
+
+    // Gray encode
+    for(unsigned i = 1; i < dim; i++) {
+      X[i] ^= X[i - 1];
+    }
+    unsigned t = 0;
+    for(unsigned Q = M; Q > 1; Q >>= 1) {
+      if(X[dim - 1] & Q) t ^= Q - 1u;
+    }
+    for(unsigned i = 0; i < dim; i++) {
+      X[i] ^= t;
+    }
+
+    // interleave the transposed bits
+    uint64_t index = 0;
+    for(int b = bits - 1; b >= 0; b--) {
+      for(unsigned i = 0; i < dim; i++) {
+        index = (index << 1) | ((X[i] >> b) & 1u);
+      }
+    }
+    return index;
+  }
+
+  void Mesh::ReorderElementsAlongHilbertCurve()
+  {
+
+    if(GetLevel() != 0) return;
+
+    unsigned nel = GetNumberOfElements();
+    unsigned dim = GetDimension();
+    unsigned bits = (dim == 1) ? 31 : 63 / dim;
+
+    //BEGIN element centers and their bounding box
+    std::vector < double > center(nel * dim, 0.);
+    double xMin[3] = {1.e300, 1.e300, 1.e300};
+    double xMax[3] = { -1.e300, -1.e300, -1.e300};
+
+    for(unsigned iel = 0; iel < nel; iel++) {
+      unsigned nve = el->GetElementDofNumber(iel, 0);
+      for(unsigned i = 0; i < nve; i++) {
+        unsigned inode = el->GetElementDofIndex(iel, i);
+        for(unsigned k = 0; k < dim; k++) {
+          center[iel * dim + k] += _coords[k][inode] / nve;
+        }
+      }
+      for(unsigned k = 0; k < dim; k++) {
+        xMin[k] = std::min(xMin[k], center[iel * dim + k]);
+        xMax[k] = std::max(xMax[k], center[iel * dim + k]);
+      }
+    }
+    //END element centers and their bounding box
+
+    std::vector < std::pair < uint64_t, unsigned > > index(nel);
+    double scale = static_cast < double >((1u << (bits - 1u)) - 1u) * 2. + 1.;
+    for(unsigned iel = 0; iel < nel; iel++) {
+      unsigned X[3] = {0, 0, 0};
+      for(unsigned k = 0; k < dim; k++) {
+        if(xMax[k] > xMin[k]) {
+          X[k] = static_cast < unsigned >((center[iel * dim + k] - xMin[k]) / (xMax[k] - xMin[k]) * scale);
+        }
+      }
+      index[iel] = std::make_pair(GetHilbertIndex(X, dim, bits), iel);
+    }
+    std::vector < double > ().swap(center);
+
+    // sort the runs of owned elements with the same material and group, as ordered by FillISvector
+    std::vector < unsigned > mapping(nel);
+    for(int isdom = 0; isdom < _nprocs; isdom++) {
+      unsigned i = _elementOffset[isdom];
+      while(i < _elementOffset[isdom + 1]) {
+        unsigned j = i + 1;
+        while(j < _elementOffset[isdom + 1] &&
+              el->GetElementMaterial(j) == el->GetElementMaterial(i) && el->GetElementGroup(j) == el->GetElementGroup(i)) {
+          j++;
+        }
+        std::sort(index.begin() + i, index.begin() + j);
+        for(unsigned l = i; l < j; l++) {
+          mapping[index[l].second] = l;
+        }
+        i = j;
+      }
+    }
+
+    el->ReorderMeshElements(mapping);
+  }
+
+  void Mesh::ReorderNodesReverseCuthillMcKee(std::vector < unsigned > &mapping, const std::vector < unsigned > &blockOffset)
+  {
+
+    unsigned nnodes = GetNumberOfNodes();
+    unsigned nel = GetNumberOfElements();
+
+    //BEGIN node to element incidence, in the node numbering of mapping
+    std::vector < unsigned > nodeElementOffset(nnodes + 1, 0);
+    for(unsigned iel = 0; iel < nel; iel++) {
+      for(unsigned i = 0; i < el->GetElementDofNumber(iel, 2); i++) {
+        nodeElementOffset[ mapping[el->GetElementDofIndex(iel, i)] + 1]++;
+      }
+    }
+    for(unsigned i = 0; i < nnodes; i++) {
+      nodeElementOffset[i + 1] += nodeElementOffset[i];
+    }
+    std::vector < unsigned > nodeElement(nodeElementOffset[nnodes]);
+    std::vector < unsigned > position(nodeElementOffset.begin(), nodeElementOffset.end() - 1);
+    for(unsigned iel = 0; iel < nel; iel++) {
+      for(unsigned i = 0; i < el->GetElementDofNumber(iel, 2); i++) {
+        nodeElement[ position[ mapping[el->GetElementDofIndex(iel, i)] ]++ ] = iel;
+      }
+    }
+    std::vector < unsigned > ().swap(position);
+    //END node to element incidence
+
+    std::vector < unsigned > rcm(nnodes);
+    std::vector < bool > visited(nnodes, false);
+    std::vector < unsigned > order;
+    std::vector < std::pair < unsigned, unsigned > > start;
+    std::vector < std::pair < unsigned, unsigned > > neighbor;
+
+    for(unsigned b = 0; b + 1 < blockOffset.size(); b++) {
+      unsigned begin = blockOffset[b];
+      unsigned end = blockOffset[b + 1];
+
+      // the degree is the number of elements near the node, every connected component starts from its node of minimum degree
+      start.resize(end - begin);
+      for(unsigned i = begin; i < end; i++) {
+        start[i - begin] = std::make_pair(nodeElementOffset[i + 1] - nodeElementOffset[i], i);
+      }
+      std::sort(start.begin(), start.end());
+
+      order.resize(0);
+      for(unsigned s = 0; s < start.size(); s++) {
+        if(visited[start[s].second]) continue;
+
+        visited[start[s].second] = true;
+        order.push_back(start[s].second);
+
+        for(unsigned head = order.size() - 1; head < order.size(); head++) {
+          unsigned inode = order[head];
+          neighbor.resize(0);
+          for(unsigned j = nodeElementOffset[inode]; j < nodeElementOffset[inode + 1]; j++) {
+            unsigned jel = nodeElement[j];
+            for(unsigned i = 0; i < el->GetElementDofNumber(jel, 2); i++) {
+              unsigned jnode = mapping[el->GetElementDofIndex(jel, i)];
+              if(jnode >= begin && jnode < end && !visited[jnode]) {
+                visited[jnode] = true;
+                neighbor.push_back(std::make_pair(nodeElementOffset[jnode + 1] - nodeElementOffset[jnode], jnode));
+              }
+            }
+          }
+          std::sort(neighbor.begin(), neighbor.end());
+          for(unsigned j = 0; j < neighbor.size(); j++) {
+            order.push_back(neighbor[j].second);
+          }
+        }
+      }
+
+      for(unsigned i = 0; i < order.size(); i++) {
+        rcm[order[i]] = end - 1u - i;
+      }
+    }
+
+    for(unsigned i = 0; i < nnodes; i++) {
+      mapping[i] = rcm[mapping[i]];
+    }
+  }
+
 
 // *******************************************************
   unsigned Mesh::IsdomBisectionSearch(const unsigned& dof, const short unsigned& solType) const
@@ -867,6 +1108,149 @@ namespace femus
     return _ProjCoarseToFine[solType];
   }
 
+  ElementSearchGrid* Mesh::GetElementSearchGrid()
+  {
+    if(!_elementSearchGrid) {
+      _elementSearchGrid = new ElementSearchGrid(this);
+    }
+
+    return _elementSearchGrid;
+  }
+
+  void Mesh::Compact(const bool &keepChildElements)
+  {
+    // rebuilt at the next request
+    for(int itype = 0; itype < 3; itype++) {
+      for(int jtype = 0; jtype < 3; jtype++) {
+        if(_ProjQitoQj[itype][jtype]) {
+          delete _ProjQitoQj[itype][jtype];
+          _ProjQitoQj[itype][jtype] = NULL;
+        }
+      }
+    }
+
+    if(_elementSearchGrid) {
+      delete _elementSearchGrid;
+      _elementSearchGrid = NULL;
+    }
+
+    // the smoother blocks and the element coloring are already built
+    el->FreeElementNearElement();
+    _elementNearElementIsFreed = true;
+
+    // the coarse to fine projections already built on the finer level are kept
+    if(!keepChildElements) {
+      el->FreeChildElements();
+      _childElementsAreFreed = true;
+    }
+  }
+
+  static double GetVectorMemoryUsage(const std::vector < NumericVector* > &vectors)
+  {
+    double memory = 0.;
+    for(unsigned i = 0; i < vectors.size(); i++) {
+      if(vectors[i]) memory += vectors[i]->local_size() * sizeof(double);
+    }
+    return memory;
+  }
+
+  void Mesh::GetMemoryUsage(double memory[4])
+  {
+    // element data
+    memory[0] = el->GetMemoryUsage();
+
+    // topology
+    memory[1] = GetVectorMemoryUsage(_topology->_Sol) + GetVectorMemoryUsage(_topology->_SolOld) +
+                GetVectorMemoryUsage(_topology->_Res) + GetVectorMemoryUsage(_topology->_Eps) +
+                GetVectorMemoryUsage(_topology->_Bdc);
+
+    // projections
+    memory[2] = 0.;
+    for(int itype = 0; itype < 3; itype++) {
+      for(int jtype = 0; jtype < 3; jtype++) {
+        if(_ProjQitoQj[itype][jtype]) memory[2] += _ProjQitoQj[itype][jtype]->GetMemoryUsage();
+      }
+    }
+    for(unsigned i = 0; i < 5; i++) {
+      if(_ProjCoarseToFine[i]) memory[2] += _ProjCoarseToFine[i]->GetMemoryUsage();
+    }
+
+    // dof maps, element coloring and search grid
+    memory[3] = (_elementOffset.capacity() + _elementColorOffset.capacity() + _coloredElement.capacity()) * sizeof(unsigned);
+    for(unsigned k = 0; k < 5; k++) {
+      memory[3] += (_ownSize[k].capacity() + _dofOffset[k].capacity()) * sizeof(unsigned);
+      for(unsigned isdom = 0; isdom < _ghostDofs[k].size(); isdom++) {
+        memory[3] += _ghostDofs[k][isdom].capacity() * sizeof(int);
+      }
+    }
+    for(unsigned k = 0; k < 2; k++) {
+      memory[3] += _ownedGhostMap[k].size() * (2 * sizeof(unsigned) + 4 * sizeof(void*));
+      memory[3] += _originalOwnSize[k].capacity() * sizeof(unsigned);
+    }
+    if(_elementSearchGrid) memory[3] += _elementSearchGrid->GetMemoryUsage();
+  }
+
+  const std::vector < unsigned > &Mesh::GetElementColorOffset()
+  {
+    if(_elementColorOffset.size() == 0) BuildElementColoring();
+    return _elementColorOffset;
+  }
+
+  const std::vector < unsigned > &Mesh::GetColoredElements()
+  {
+    if(_elementColorOffset.size() == 0) BuildElementColoring();
+    return _coloredElement;
+  }
+
+  void Mesh::BuildElementColoring()
+  {
+    if(_elementNearElementIsFreed) {
+      std::cout << "Error! In function \"BuildElementColoring\": the element near element lists "
+                << "have been freed by MultiLevelMesh::CompactHierarchy" << std::endl;
+      abort();
+    }
+
+    unsigned elementBegin = _elementOffset[_iproc];
+    unsigned nel = _elementOffset[_iproc + 1] - elementBegin;
+
+    // the element near element list holds all the elements sharing a vertex, then any two elements with a
+    // different color can be assembled concurrently, whatever the FE type
+    std::vector < unsigned > color(nel, UINT_MAX);
+    std::vector < unsigned > colorSize;
+    std::vector < unsigned > usedBy; // usedBy[c] = i if color c is taken by a neighbour of i
+
+    for(unsigned i = 0; i < nel; i++) {
+      unsigned iel = elementBegin + i;
+      for(unsigned j = 1; j < el->GetElementNearElementSize(iel, 1); j++) {
+        unsigned jel = el->GetElementNearElement(iel, j);
+        if(jel >= elementBegin && jel < elementBegin + nel) {
+          unsigned c = color[jel - elementBegin];
+          if(c != UINT_MAX) usedBy[c] = i;
+        }
+      }
+      unsigned c = 0;
+      while(c < colorSize.size() && usedBy[c] == i) c++;
+      if(c == colorSize.size()) {
+        colorSize.push_back(0);
+        usedBy.push_back(UINT_MAX);
+      }
+      color[i] = c;
+      colorSize[c]++;
+    }
+
+    unsigned nColors = colorSize.size();
+    _elementColorOffset.assign(nColors + 1, 0);
+    for(unsigned c = 0; c < nColors; c++) {
+      _elementColorOffset[c + 1] = _elementColorOffset[c] + colorSize[c];
+    }
+
+    _coloredElement.resize(nel);
+    std::vector < unsigned > counter(_elementColorOffset.begin(), _elementColorOffset.end() - 1);
+    for(unsigned i = 0; i < nel; i++) {
+      _coloredElement[counter[color[i]]++] = elementBegin + i;
+    }
+  }
+
   
   SparseMatrix* Mesh::GetCoarseToFineProjection(const unsigned& solType)
   {
@@ -893,6 +1277,12 @@ namespace femus
       abort();
     }
 
+    if(_coarseMsh->_childElementsAreFreed) {
+      std::cout << "Error! In function \"BuildCoarseToFineProjection\": the children of the coarse mesh elements "
+                << "have been freed by MultiLevelMesh::CompactHierarchy" << std::endl;
+      abort();
+    }
+
 //     if(!_ProjCoarseToFine[solType]) {
 
       int nf     = _dofOffset[solType][_nprocs];
@@ -39,6 +39,7 @@ using std::vector;
 class Solution;
 
 class elem;
+class ElementSearchGrid;
 
 /**
  * The mesh class
@@ -124,6 +125,17 @@ public:
       return _level;
     }
 
+    /** Revision of the topology coordinates, it has to be increased with UpdateCoordinatesRevision every time
+     * the coordinates are changed, so that the writers project them again */
+    unsigned GetCoordinatesRevision() const {
+      return _coordinatesRevision;
+    }
+
+    /** To be called after the topology coordinates have been changed */
+    void UpdateCoordinatesRevision() {
+      _coordinatesRevision++;
+    }
+
     /** Set the dimension of the problem (1D, 2D, 3D) */
     void SetDimension(const unsigned &dim) {
       Mesh::_dimension = dim;
@@ -162,7 +174,9 @@ public:
 
     /** Generate mesh functions */
 
-    /** This function generates the coarse mesh level, $l_0$, from an input mesh file */
+    /** This function generates the coarse mesh level, $l_0$, from an input mesh file.
+     *  Only process 0 parses the file and broadcasts the coarse mesh, which every process still holds:
+     *  Buildkel, FillISvector and the element scatters need the full coarse connectivity, released only after the partition */
     void ReadCoarseMesh(const std::string& name, const double Lref, std::vector<bool> &_finiteElement_flag);
 
     /** This function generates a coarse box mesh */
@@ -177,6 +191,12 @@ public:
     /** To be added */
     void FillISvector(vector < int > &epart);
 
+    /** Locality pass of FillISvector on all the following meshes: the owned elements are ordered along a Hilbert curve
+     * and the owned nodes by reverse Cuthill-McKee, see ReorderElementsAlongHilbertCurve and ReorderNodesReverseCuthillMcKee */
+    static void SetLocalityReordering(const bool &value) {
+      _localityReordering = value;
+    }
+
     /** To be added */
     void Buildkel();
     
@@ -216,6 +236,24 @@ public:
     /** Get the coarse to the fine projection matrix*/
     SparseMatrix* GetCoarseToFineProjection(const unsigned& solType);
 
+    /** Get the bin grid over the bounding boxes of the elements owned by this process, it is built at the first call */
+    ElementSearchGrid* GetElementSearchGrid();
+
+    /** Free the data of this coarse level that the solves on a built hierarchy do not use, see MultiLevelMesh::CompactHierarchy */
+    void Compact(const bool &keepChildElements);
+
+    /** Bytes allocated by this process for the element data, the topology, the projections and the dof maps and search structures */
+    void GetMemoryUsage(double memory[4]);
+
+    /** Owned elements grouped by color, elements of the same color do not share any vertex. The elements of color c are
+     * GetColoredElements()[i] for GetElementColorOffset()[c] <= i < GetElementColorOffset()[c + 1]. The coloring is built at the first call */
+    const std::vector < unsigned > &GetElementColorOffset();
+    const std::vector < unsigned > &GetColoredElements();
+
+    unsigned GetNumberOfElementColors() {
+      return GetElementColorOffset().size() - 1;
+    }
+
     /** Set the coarser mesh from which this mesh is generated */
     void SetCoarseMesh( Mesh* otherCoarseMsh ){
       _coarseMsh = otherCoarseMsh;
@@ -235,6 +273,16 @@ public:
     const unsigned GetAmrIndex()        const { return _amrIndex; };
     const unsigned GetSolidMarkIndex()  const { return _solidMarkIndex; };
 
+    /** Binary cache of the coarse mesh read by ReadCoarseMesh, see MeshCache, no cache if empty */
+    void SetMeshCacheFile(const std::string &filename) {
+      _meshCacheFile = filename;
+    }
+
+    /** Replicated node coordinates of the coarse mesh, available only while the coarse mesh is built */
+    const vector < vector < double > > &GetCoarseCoordinates() const {
+      return _coords;
+    }
+
 private:
     /** Coarser mesh from which this mesh is generated, it equals NULL if _level = 0 */
     Mesh* _coarseMsh;
@@ -245,6 +293,30 @@ private:
     /** The coarse to the fine projection matrix */
     SparseMatrix* _ProjCoarseToFine[5];
 
+    /** The point location grid over the owned elements */
+    ElementSearchGrid* _elementSearchGrid;
+
+    /** Set by Compact, the element near element lists or the children of the elements are freed */
+    bool _elementNearElementIsFreed;
+    bool _childElementsAreFreed;
+
+    /** Owned elements sorted by color and the color offsets, see GetElementColorOffset */
+    std::vector < unsigned > _elementColorOffset;
+    std::vector < unsigned > _coloredElement;
+
+    /** Order the owned elements of each material and group along a Hilbert curve through the element centers, only on the
+     * coarse level where the coordinates are available, the children of the refined levels follow their fathers */
+    void ReorderElementsAlongHilbertCurve();
+
+    /** Reverse Cuthill-McKee ordering of the nodes within each block [blockOffset[b], blockOffset[b + 1]) of the node
+     * mapping, composed with mapping; the blocks are the vertex, midpoint and face/interior nodes owned by each process */
+    void ReorderNodesReverseCuthillMcKee(std::vector < unsigned > &mapping, const std::vector < unsigned > &blockOffset);
+
+    static bool _localityReordering;
+
+    /** Greedy coloring of the owned elements on the element near element graph */
+    void BuildElementColoring();
+
     /** Build the projection matrix between Lagrange FEM at the same level mesh*/
     void BuildQitoQjProjection(const unsigned& itype, const unsigned& jtype);
 
@@ -259,6 +331,7 @@ private:
     int _nelem;                                //< number of elements
     unsigned _nnodes;                          //< number of nodes
     unsigned _level;                           //< level of mesh in the multilevel hierarchy
+    unsigned _coordinatesRevision;             //< increased every time the topology coordinates are changed
     static unsigned _dimension;                //< dimension of the problem
     static unsigned _ref_index;
     static unsigned _face_index;
@@ -270,6 +343,8 @@ private:
     vector < vector < double > > _coords;
 
     bool _meshIsHomogeneous;
+
+    std::string _meshCacheFile;
     // indices of the topology parallel vectors
     static const unsigned _xIndex = 0;
     static const unsigned _yIndex = 1;
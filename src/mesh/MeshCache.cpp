@@ -0,0 +1,355 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: MeshCache
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "MeshCache.hpp"
+#include "Mesh.hpp"
+#include "MeshMetisPartitioning.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace femus {
+
+  const uint32_t MeshCache::_version = 2;
+
+  static const char meshCacheMagic[8] = {'F', 'E', 'M', 'U', 'S', 'M', 'C', '\0'};
+  static const uint32_t meshCacheByteOrder = 0x01020304u;
+
+  MeshCache::MeshCache(const std::string &filename) {
+    _filename = filename;
+    _map = NULL;
+    _mapSize = 0;
+  }
+
+  MeshCache::~MeshCache() {
+    Close();
+  }
+
+  void MeshCache::Close() {
+    if(_map != NULL) {
+      munmap(const_cast < char * >(_map), _mapSize);
+      _map = NULL;
+      _mapSize = 0;
+    }
+  }
+
+  bool MeshCache::HashFile(const std::string &meshFile, uint64_t &size, uint64_t &hash) {
+
+    hash = 14695981039346656037ull;
+    size = 0;
+
+    int fd = open(meshFile.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0) {
+      close(fd);
+      return false;
+    }
+    size = fileStat.st_size;
+
+    if(size > 0) {
+      void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(map == MAP_FAILED) {
+        close(fd);
+        return false;
+      }
+      const unsigned char *byte = static_cast < const unsigned char * >(map);
+      for(uint64_t i = 0; i < size; i++) {
+        hash = (hash ^ byte[i]) * 1099511628211ull;
+      }
+      munmap(map, size);
+    }
+    close(fd);
+    return true;
+  }
+
+  void MeshCache::GetOffsets(const Header &header, uint64_t offset[9]) {
+    offset[0] = Align(sizeof(Header));
+    offset[1] = Align(offset[0] + 3u * header.nvt * sizeof(double));
+    offset[2] = Align(offset[1] + header.nel * sizeof(int32_t));
+    offset[3] = Align(offset[2] + header.nel * sizeof(uint16_t));
+    offset[4] = Align(offset[3] + header.nel * sizeof(uint16_t));
+    offset[5] = Align(offset[4] + header.nel * sizeof(uint16_t));
+    offset[6] = Align(offset[5] + header.nMaterials * sizeof(uint32_t));
+    offset[7] = Align(offset[6] + header.elementDofSize * sizeof(uint32_t));
+    offset[8] = offset[7] + header.elementNearFaceSize * sizeof(int32_t);
+  }
+
+  bool MeshCache::Open(const std::string &meshFile, const double &Lref) {
+
+    Close();
+
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if(fd >= 0) {
+      struct stat fileStat;
+      if(fstat(fd, &fileStat) == 0 && static_cast < uint64_t >(fileStat.st_size) >= sizeof(Header)) {
+        void *map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map != MAP_FAILED) {
+          _map = static_cast < const char * >(map);
+          _mapSize = fileStat.st_size;
+        }
+      }
+      close(fd);
+    }
+
+    // the input file is hashed by process 0 only: hashed, size and hash
+    unsigned long long meshFileKey[3] = {0, 0, 0};
+    if(_iproc == 0 && _map != NULL) {
+      uint64_t meshFileSize, meshFileHash;
+      if(HashFile(meshFile, meshFileSize, meshFileHash)) {
+        meshFileKey[0] = 1;
+        meshFileKey[1] = meshFileSize;
+        meshFileKey[2] = meshFileHash;
+      }
+    }
+    MPI_Bcast(meshFileKey, 3, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    const uint32_t partitioner = MeshMetisPartitioning::GetPartitioner();
+
+    int valid = 0;
+    if(_map != NULL && meshFileKey[0] == 1) {
+      const Header &header = *reinterpret_cast < const Header * >(_map);
+      if(memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) == 0 &&
+          header.version == _version && header.byteOrder == meshCacheByteOrder &&
+          header.fileSize == _mapSize && header.nprocs == static_cast < uint32_t >(_nprocs) && header.Lref == Lref &&
+          header.partitioner == partitioner &&
+          header.meshFileSize == meshFileKey[1] && header.meshFileHash == meshFileKey[2]) {
+        uint64_t offset[9];
+        GetOffsets(header, offset);
+        valid = (offset[8] == _mapSize) ? 1 : 0;
+      }
+    }
+
+    // all the processes have to take the same path in Mesh::ReadCoarseMesh
+    MPI_Allreduce(MPI_IN_PLACE, &valid, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+    if(!valid) Close();
+
+    return (valid == 1);
+  }
+
+  void MeshCache::Read(Mesh &mesh, std::vector < std::vector < double > > &coords, std::vector < bool > &typeElementFlag,
+                       std::vector < int > &partition) {
+
+    if(_map == NULL) {
+      std::cout << "Error in MeshCache::Read: the cache " << _filename << " is not open" << std::endl;
+      abort();
+    }
+
+    Unpack(_map, mesh, coords, typeElementFlag, partition);
+
+    Close();
+  }
+
+  void MeshCache::Unpack(const char *data, Mesh &mesh, std::vector < std::vector < double > > &coords,
+                         std::vector < bool > &typeElementFlag, std::vector < int > &partition) {
+
+    const Header &header = *reinterpret_cast < const Header * >(data);
+    uint64_t offset[9];
+    GetOffsets(header, offset);
+
+    const double *x = reinterpret_cast < const double * >(data + offset[0]);
+    const int32_t *elementPartition = reinterpret_cast < const int32_t * >(data + offset[1]);
+    const uint16_t *elementType = reinterpret_cast < const uint16_t * >(data + offset[2]);
+    const uint16_t *elementGroup = reinterpret_cast < const uint16_t * >(data + offset[3]);
+    const uint16_t *elementMaterial = reinterpret_cast < const uint16_t * >(data + offset[4]);
+    const uint32_t *materialCounter = reinterpret_cast < const uint32_t * >(data + offset[5]);
+    const uint32_t *elementDof = reinterpret_cast < const uint32_t * >(data + offset[6]);
+    const int32_t *elementNearFace = reinterpret_cast < const int32_t * >(data + offset[7]);
+
+    const unsigned nel = header.nel;
+    const unsigned nvt = header.nvt;
+
+    mesh.SetDimension(header.dimension);
+    mesh.SetNumberOfElements(nel);
+    mesh.SetNumberOfNodes(nvt);
+
+    coords.resize(3);
+    for(unsigned k = 0; k < 3; k++) {
+      coords[k].assign(x + k * nvt, x + (k + 1) * nvt);
+    }
+
+    for(unsigned i = 0; i < typeElementFlag.size() && i < 32; i++) {
+      if((header.typeElementFlag >> i) & 1u) typeElementFlag[i] = true;
+    }
+
+    partition.assign(elementPartition, elementPartition + nel);
+
+    mesh.el = new elem(nel);
+
+    uint64_t jdof = 0;
+    uint64_t jface = 0;
+    for(unsigned iel = 0; iel < nel; iel++) {
+      short unsigned ielType = elementType[iel];
+      mesh.el->SetElementType(iel, ielType);
+      mesh.el->AddToElementNumber(1, ielType);
+      mesh.el->SetElementGroup(iel, elementGroup[iel]);
+      mesh.el->SetElementMaterial(iel, elementMaterial[iel]);
+      for(unsigned i = 0; i < NVE[ielType][2]; i++) {
+        mesh.el->SetElementDofIndex(iel, i, elementDof[jdof++]);
+      }
+      for(unsigned iface = 0; iface < NFC[ielType][1]; iface++) {
+        mesh.el->SetFaceElementIndex(iel, iface, elementNearFace[jface++]);
+      }
+    }
+
+    mesh.el->SetElementGroupNumber(header.ngroup);
+    mesh.el->SetMaterialElementCounter(std::vector < unsigned > (materialCounter, materialCounter + header.nMaterials));
+    mesh.el->SetNodeNumber(nvt);
+    mesh.el->ShrinkToFit();
+  }
+
+  void MeshCache::Write(const std::string &meshFile, const double &Lref, Mesh &mesh,
+                        const std::vector < std::vector < double > > &coords,
+                        const std::vector < bool > &typeElementFlag, const std::vector < int > &partition) {
+
+    if(_iproc != 0) return;
+
+    uint64_t meshFileSize, meshFileHash;
+    if(!HashFile(meshFile, meshFileSize, meshFileHash)) {
+      std::cout << " Warning: the mesh file " << meshFile << " cannot be hashed, the mesh cache is not written" << std::endl;
+      return;
+    }
+
+    std::vector < char > buffer;
+    Pack(mesh, coords, typeElementFlag, partition, buffer);
+
+    Header &header = *reinterpret_cast < Header * >(&buffer[0]);
+    header.meshFileSize = meshFileSize;
+    header.meshFileHash = meshFileHash;
+    header.Lref = Lref;
+
+    // write a temporary file and rename it, so that concurrent runs never map a partial cache
+    std::ostringstream tmpName;
+    tmpName << _filename << ".tmp" << getpid();
+    std::ofstream fout(tmpName.str().c_str(), std::ios::binary | std::ios::trunc);
+    if(fout) {
+      fout.write(&buffer[0], buffer.size());
+      fout.close();
+    }
+    if(!fout || rename(tmpName.str().c_str(), _filename.c_str()) != 0) {
+      std::cout << " Warning: the mesh cache " << _filename << " cannot be written" << std::endl;
+      remove(tmpName.str().c_str());
+      return;
+    }
+
+    std::cout << " Mesh cache written to file: " << _filename << std::endl;
+  }
+
+  void MeshCache::Pack(Mesh &mesh, const std::vector < std::vector < double > > &coords,
+                       const std::vector < bool > &typeElementFlag, const std::vector < int > &partition,
+                       std::vector < char > &buffer) const {
+
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+    header.version = _version;
+    header.byteOrder = meshCacheByteOrder;
+    header.nprocs = _nprocs;
+    header.partitioner = MeshMetisPartitioning::GetPartitioner();
+    header.dimension = mesh.GetDimension();
+    header.nel = mesh.GetNumberOfElements();
+    header.nvt = mesh.GetNumberOfNodes();
+    header.ngroup = mesh.el->GetElementGroupNumber();
+    for(unsigned i = 0; i < typeElementFlag.size() && i < 32; i++) {
+      if(typeElementFlag[i]) header.typeElementFlag |= (1u << i);
+    }
+    std::vector < unsigned > materialElementCounter = mesh.el->GetMaterialElementCounter();
+    header.nMaterials = materialElementCounter.size();
+
+    const unsigned nel = header.nel;
+    const unsigned nvt = header.nvt;
+
+    std::vector < int32_t > elementPartition(nel);
+    std::vector < uint16_t > elementType(nel), elementGroup(nel), elementMaterial(nel);
+    std::vector < uint32_t > elementDof;
+    std::vector < int32_t > elementNearFace;
+    elementDof.reserve(nel * NVE[0][2]);
+    elementNearFace.reserve(nel * NFC[0][1]);
+    for(unsigned iel = 0; iel < nel; iel++) {
+      short unsigned ielType = mesh.el->GetElementType(iel);
+      elementPartition[iel] = (partition.empty()) ? 0 : partition[iel];
+      elementType[iel] = ielType;
+      elementGroup[iel] = mesh.el->GetElementGroup(iel);
+      elementMaterial[iel] = mesh.el->GetElementMaterial(iel);
+      for(unsigned i = 0; i < NVE[ielType][2]; i++) {
+        elementDof.push_back(mesh.el->GetElementDofIndex(iel, i));
+      }
+      for(unsigned iface = 0; iface < NFC[ielType][1]; iface++) {
+        elementNearFace.push_back(mesh.el->GetFaceElementIndex(iel, iface));
+      }
+    }
+    header.elementDofSize = elementDof.size();
+    header.elementNearFaceSize = elementNearFace.size();
+
+    uint64_t offset[9];
+    GetOffsets(header, offset);
+    header.fileSize = offset[8];
+
+    buffer.assign(offset[8], 0);
+    memcpy(&buffer[0], &header, sizeof(Header));
+    for(unsigned k = 0; k < 3; k++) {
+      if(nvt > 0) memcpy(&buffer[offset[0] + k * nvt * sizeof(double)], &coords[k][0], nvt * sizeof(double));
+    }
+    if(nel > 0) {
+      memcpy(&buffer[offset[1]], &elementPartition[0], nel * sizeof(int32_t));
+      memcpy(&buffer[offset[2]], &elementType[0], nel * sizeof(uint16_t));
+      memcpy(&buffer[offset[3]], &elementGroup[0], nel * sizeof(uint16_t));
+      memcpy(&buffer[offset[4]], &elementMaterial[0], nel * sizeof(uint16_t));
+    }
+    for(unsigned i = 0; i < header.nMaterials; i++) {
+      uint32_t value = materialElementCounter[i];
+      memcpy(&buffer[offset[5] + i * sizeof(uint32_t)], &value, sizeof(uint32_t));
+    }
+    if(!elementDof.empty()) memcpy(&buffer[offset[6]], &elementDof[0], elementDof.size() * sizeof(uint32_t));
+    if(!elementNearFace.empty()) memcpy(&buffer[offset[7]], &elementNearFace[0], elementNearFace.size() * sizeof(int32_t));
+  }
+
+  void MeshCache::Broadcast(Mesh &mesh, std::vector < std::vector < double > > &coords,
+                            std::vector < bool > &typeElementFlag) {
+
+    std::vector < char > buffer;
+    unsigned long long size = 0;
+    if(_iproc == 0) {
+      Pack(mesh, coords, typeElementFlag, std::vector < int > (), buffer);
+      size = buffer.size();
+    }
+    MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    // the buffer is sent in blocks, since its size can exceed the int count of MPI
+    buffer.resize(size);
+    const unsigned long long blockSize = 1ull << 30;
+    for(unsigned long long begin = 0; begin < size; begin += blockSize) {
+      int count = static_cast < int >((size - begin < blockSize) ? size - begin : blockSize);
+      MPI_Bcast(&buffer[begin], count, MPI_CHAR, 0, MPI_COMM_WORLD);
+    }
+
+    if(_iproc != 0) {
+      std::vector < int > partition;
+      Unpack(&buffer[0], mesh, coords, typeElementFlag, partition);
+    }
+  }
+
+} //end namespace femus
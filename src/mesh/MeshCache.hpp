@@ -0,0 +1,117 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: MeshCache
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_mesh_MeshCache_hpp__
+#define __femus_mesh_MeshCache_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ParallelObject.hpp"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace femus {
+
+  class Mesh;
+
+  /**
+   * Binary cache of the coarse mesh, to skip the parsing of the input file, the construction of the biquadratic nodes
+   * and the METIS partition on the following runs. The file stores the node coordinates, the element types, groups,
+   * materials, dofs and near faces, and the element partition, as they are before FillISvector.
+   * A header keys the cache to the size and the hash of the input mesh file, to Lref, to the number of processes and to
+   * the partitioner (see MeshMetisPartitioning::SetGeometricPartitioning); only process 0 hashes the input file.
+   * The cache is read with mmap by all the processes, and it is rewritten by process 0 if any key does not match.
+   * The refined levels are not stored, since they are built locally from the coarse mesh.
+   * The same format is used by Broadcast to send the coarse mesh parsed by process 0 to the other processes.
+   */
+  class MeshCache : public ParallelObject {
+    public:
+
+      MeshCache(const std::string &filename);
+
+      ~MeshCache();
+
+      /** Map the cache file and check its keys, it returns true on all the processes or on none */
+      bool Open(const std::string &meshFile, const double &Lref);
+
+      /** Fill the coarse mesh, its coordinates, the element type flags and the element partition from the open cache */
+      void Read(Mesh &mesh, std::vector < std::vector < double > > &coords, std::vector < bool > &typeElementFlag,
+                std::vector < int > &partition);
+
+      /** Write the cache of the coarse mesh built from meshFile, only process 0 writes */
+      void Write(const std::string &meshFile, const double &Lref, Mesh &mesh, const std::vector < std::vector < double > > &coords,
+                 const std::vector < bool > &typeElementFlag, const std::vector < int > &partition);
+
+      /** Send the coarse mesh read by process 0 to all the other processes, in the cache format.
+       *  It does not need a cache file */
+      void Broadcast(Mesh &mesh, std::vector < std::vector < double > > &coords, std::vector < bool > &typeElementFlag);
+
+    private:
+
+      /** Unmap the cache file */
+      void Close();
+
+      /** The coarse mesh in the cache format, without the keys of the input file; partition can be empty */
+      void Pack(Mesh &mesh, const std::vector < std::vector < double > > &coords, const std::vector < bool > &typeElementFlag,
+                const std::vector < int > &partition, std::vector < char > &buffer) const;
+
+      /** Fill the coarse mesh, its coordinates, the element type flags and the element partition from data in the cache format */
+      static void Unpack(const char *data, Mesh &mesh, std::vector < std::vector < double > > &coords,
+                         std::vector < bool > &typeElementFlag, std::vector < int > &partition);
+
+      /** Size and FNV-1a hash of the content of meshFile, false if it cannot be read */
+      static bool HashFile(const std::string &meshFile, uint64_t &size, uint64_t &hash);
+
+      /** 8-byte alignment of the sections */
+      static uint64_t Align(const uint64_t &offset) {
+        return (offset + 7u) & ~static_cast < uint64_t >(7u);
+      }
+
+      struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t fileSize;
+        uint64_t meshFileSize;
+        uint64_t meshFileHash;
+        double Lref;
+        uint32_t nprocs;
+        uint32_t dimension;
+        uint32_t nel;
+        uint32_t nvt;
+        uint32_t ngroup;
+        uint32_t typeElementFlag;
+        uint32_t nMaterials;
+        uint32_t partitioner;     // 0 Metis, 1 geometric, 2 ParMETIS
+        uint64_t elementDofSize;
+        uint64_t elementNearFaceSize;
+      };
+
+      /** Offsets of the sections coordinates, partition, element types, groups, materials, material counter, dofs and
+       * near faces, offset[8] is the file size */
+      static void GetOffsets(const Header &header, uint64_t offset[9]);
+
+      static const uint32_t _version;
+
+      std::string _filename;
+      const char *_map;
+      uint64_t _mapSize;
+  };
+
+} //end namespace femus
+
+#endif
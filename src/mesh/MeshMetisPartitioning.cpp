@@ -20,12 +20,20 @@
 #include "Mesh.hpp"
 #include "FemusConfig.hpp"
 
+#include "petscsys.h"
+
 #ifdef HAVE_METIS
 #include "metis.h"
 #endif
 
+#if defined(HAVE_METIS) && defined(PETSC_HAVE_PARMETIS)
+#include "parmetis.h"
+#define FEMUS_HAVE_PARMETIS
+#endif
+
 //C++ include
 #include <iostream>
+#include <algorithm>
 
 
 namespace femus
@@ -35,6 +43,19 @@ namespace femus
   using std::endl;
 
 
+  bool MeshMetisPartitioning::_geometricPartitioning = false;
+
+  unsigned MeshMetisPartitioning::GetPartitioner()
+  {
+#ifdef FEMUS_HAVE_PARMETIS
+    return (_geometricPartitioning) ? 1 : 2;
+#elif defined(HAVE_METIS)
+    return (_geometricPartitioning) ? 1 : 0;
+#else
+    return 1;
+#endif
+  }
+
   MeshMetisPartitioning::MeshMetisPartitioning(Mesh& mesh) : MeshPartitioning(mesh)
   {
 
@@ -70,10 +91,20 @@ namespace femus
     else {
 
 #ifndef HAVE_METIS
-      std::cerr << "Fatal error: Metis library was not found. Metis partioning algorithm cannot be called!" << std::endl;
-      exit(1);
+      _geometricPartitioning = true;
 #endif
 
+      if(_geometricPartitioning) {
+        DoGeometricPartition(epart);
+        return;
+      }
+
+#ifdef FEMUS_HAVE_PARMETIS
+      DoParallelPartition(epart, AMR);
+      return;
+#endif
+
+#ifdef HAVE_METIS
       bool standard = true;
 
       if(standard) {
@@ -144,12 +175,153 @@ namespace femus
       else{
       
       }
+#endif
     }
     
     
     return;
   }
 
+  void MeshMetisPartitioning::DoGeometricPartition(std::vector <int>& epart)
+  {
+    unsigned nelem = _mesh.GetNumberOfElements();
+    const std::vector < std::vector < double > > &coords = _mesh.GetCoarseCoordinates();
+
+    if(coords.size() < 3 || coords[0].size() < _mesh.GetNumberOfNodes()) {
+      // refined elements are numbered close to their parents, contiguous blocks keep them together
+      for(int isdom = 0; isdom < _nprocs; isdom++) {
+        unsigned begin = (static_cast < unsigned long > (nelem) * isdom) / _nprocs;
+        unsigned end = (static_cast < unsigned long > (nelem) * (isdom + 1)) / _nprocs;
+        for(unsigned iel = begin; iel < end; iel++) {
+          epart[iel] = isdom;
+        }
+      }
+      return;
+    }
+
+    std::vector < std::vector < double > > centroid(3, std::vector < double > (nelem, 0.));
+    for(unsigned iel = 0; iel < nelem; iel++) {
+      unsigned nve = _mesh.el->GetElementDofNumber(iel, 0);
+      for(unsigned i = 0; i < nve; i++) {
+        unsigned inode = _mesh.el->GetElementDofIndex(iel, i);
+        for(unsigned k = 0; k < 3; k++) {
+          centroid[k][iel] += coords[k][inode];
+        }
+      }
+      for(unsigned k = 0; k < 3; k++) {
+        centroid[k][iel] /= nve;
+      }
+    }
+
+    std::vector < unsigned > element(nelem);
+    for(unsigned iel = 0; iel < nelem; iel++) {
+      element[iel] = iel;
+    }
+
+    RecursiveBisection(element, 0, nelem, 0, _nprocs, centroid, epart);
+  }
+
+  void MeshMetisPartitioning::RecursiveBisection(std::vector < unsigned >& element, const unsigned& begin, const unsigned& end,
+                                                 const int& firstPart, const int& nParts,
+                                                 const std::vector < std::vector < double > >& centroid, std::vector <int>& epart)
+  {
+    if(nParts == 1) {
+      for(unsigned i = begin; i < end; i++) {
+        epart[element[i]] = firstPart;
+      }
+      return;
+    }
+
+    // an empty range has no bounding box and no element to assign
+    if(begin == end) return;
+
+    // cut orthogonal to the longest side of the bounding box
+    unsigned direction = 0;
+    double length = -1.;
+    for(unsigned k = 0; k < 3; k++) {
+      double xmin = centroid[k][element[begin]];
+      double xmax = xmin;
+      for(unsigned i = begin + 1; i < end; i++) {
+        double x = centroid[k][element[i]];
+        if(x < xmin) xmin = x;
+        else if(x > xmax) xmax = x;
+      }
+      if(xmax - xmin > length) {
+        length = xmax - xmin;
+        direction = k;
+      }
+    }
+
+    // the first half gets nParts1 parts and a proportional number of elements
+    int nParts1 = nParts / 2;
+    unsigned middle = begin + static_cast < unsigned > ((static_cast < unsigned long > (end - begin) * nParts1) / nParts);
+
+    const std::vector < double > &x = centroid[direction];
+    std::nth_element(element.begin() + begin, element.begin() + middle, element.begin() + end,
+                     [&x](const unsigned & i, const unsigned & j) {
+                       return x[i] < x[j] || (x[i] == x[j] && i < j);
+                     });
+
+    RecursiveBisection(element, begin, middle, firstPart, nParts1, centroid, epart);
+    RecursiveBisection(element, middle, end, firstPart + nParts1, nParts - nParts1, centroid, epart);
+  }
+
+  void MeshMetisPartitioning::DoParallelPartition(std::vector <int>& epart, const bool& AMR)
+  {
+#ifdef FEMUS_HAVE_PARMETIS
+    unsigned nelem = _mesh.GetNumberOfElements();
+
+    // contiguous blocks of elements, with at least one element each since nelem > _nprocs
+    std::vector < idx_t > elmdist(_nprocs + 1);
+    for(int jproc = 0; jproc <= _nprocs; jproc++) {
+      elmdist[jproc] = (static_cast < unsigned long > (nelem) * jproc) / _nprocs;
+    }
+    const unsigned elementBegin = elmdist[_iproc];
+    const unsigned elementEnd = elmdist[_iproc + 1];
+
+    std::vector < idx_t > eptr(elementEnd - elementBegin + 1);
+    std::vector < idx_t > eind;
+    eptr[0] = 0;
+    for(unsigned iel = elementBegin; iel < elementEnd; iel++) {
+      unsigned ndofs = _mesh.el->GetElementDofNumber(iel, 2);
+      for(unsigned inode = 0; inode < ndofs; inode++) {
+        eind.push_back(_mesh.el->GetElementDofIndex(iel, inode));
+      }
+      eptr[iel - elementBegin + 1] = eind.size();
+    }
+
+    idx_t wgtflag = 0;
+    idx_t numflag = 0;
+    idx_t ncon = 1;
+    idx_t ncommon = (AMR || _mesh.GetDimension() == 1) ? 1 : _mesh.GetDimension() + 1;
+    idx_t nparts = _nprocs;
+    std::vector < real_t > tpwgts(nparts, 1. / nparts);
+    real_t ubvec = 1.05;
+    idx_t options[3] = {0, 0, 0};
+    idx_t edgecut;
+    std::vector < idx_t > part(elementEnd - elementBegin);
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    int err = ParMETIS_V3_PartMeshKway(&elmdist[0], &eptr[0], &eind[0], NULL, &wgtflag, &numflag, &ncon, &ncommon, &nparts,
+                                       &tpwgts[0], &ubvec, options, &edgecut, &part[0], &comm);
+    if(err != METIS_OK) {
+      std::cout << "Error in MeshMetisPartitioning::DoParallelPartition: ParMETIS failed" << std::endl;
+      abort();
+    }
+
+    std::vector < int > localPart(part.begin(), part.end());
+    std::vector < int > count(_nprocs), offset(_nprocs);
+    for(int jproc = 0; jproc < _nprocs; jproc++) {
+      offset[jproc] = elmdist[jproc];
+      count[jproc] = elmdist[jproc + 1] - elmdist[jproc];
+    }
+    MPI_Allgatherv(&localPart[0], localPart.size(), MPI_INT, &epart[0], &count[0], &offset[0], MPI_INT, MPI_COMM_WORLD);
+#else
+    std::cout << "Error in MeshMetisPartitioning::DoParallelPartition: PETSc has been configured without ParMETIS" << std::endl;
+    abort();
+#endif
+  }
+
   void MeshMetisPartitioning::DoPartition(std::vector <int>& epart, const Mesh& meshc)
   {
     epart.resize(_mesh.GetNumberOfElements());
@@ -51,8 +51,30 @@ public:
      *  for uniformed refined meshes */
     void DoPartition( std::vector < int > &epart, const Mesh &meshc );
 
+    /** Use the built-in geometric partitioning instead of ParMETIS or Metis for coarse and AMR meshes.
+     *  It is always used when the code is compiled without Metis */
+    static void SetGeometricPartitioning( const bool &value ) {
+      _geometricPartitioning = value;
+    }
+
+    /** Partitioner of coarse and AMR meshes: 0 Metis, 1 geometric, 2 ParMETIS when PETSc provides it */
+    static unsigned GetPartitioner();
+
 private:
 
+    /** Recursive coordinate bisection of the element centroids, with balanced element numbers.
+     *  Meshes without coarse coordinates (AMR) are split in contiguous blocks of elements */
+    void DoGeometricPartition( std::vector < int > &epart );
+
+    /** ParMETIS partition of the dual graph: every process gives the connectivity of one contiguous block of elements,
+     *  then the partition is gathered on all the processes */
+    void DoParallelPartition( std::vector < int > &epart, const bool &AMR );
+
+    void RecursiveBisection( std::vector < unsigned > &element, const unsigned &begin, const unsigned &end,
+                             const int &firstPart, const int &nParts, const std::vector < std::vector < double > > &centroid,
+                             std::vector < int > &epart );
+
+    static bool _geometricPartitioning;
 
 };
 
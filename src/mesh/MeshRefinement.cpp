@@ -221,57 +221,57 @@ namespace femus {
 
     std::vector < unsigned > materialElementCounter(3,0);
     
-    for(unsigned isdom = 0; isdom < _nprocs; isdom++) {
-      elc->LocalizeElementDof(isdom);
-      elc->LocalizeElementNearFace(isdom);
-      elc->LocalizeElementQuantities(isdom);
-      for(unsigned iel = mshc->_elementOffset[isdom]; iel < mshc->_elementOffset[isdom + 1]; iel++) {
-        if(static_cast < unsigned short >(coarseLocalizedAmrVector[iel] + 0.25) == 1) {
-          unsigned elt = elc->GetElementType(iel);
-          // project element type
-          for(unsigned j = 0; j < _mesh.GetRefIndex(); j++) {
-            _mesh.el->SetElementType(jel + j, elc->GetElementType(iel));
-            _mesh.el->SetElementGroup(jel + j, elc->GetElementGroup(iel));
-            
+    // every process builds the whole fine connectivity, so all the coarse partitions are localized at once
+    elc->LocalizeElementDof();
+    elc->LocalizeElementNearFace();
+    elc->LocalizeElementQuantities();
+    for(unsigned iel = 0; iel < mshc->_elementOffset[_nprocs]; iel++) {
+      if(static_cast < unsigned short >(coarseLocalizedAmrVector[iel] + 0.25) == 1) {
+        unsigned elt = elc->GetElementType(iel);
+        // project element type
+        for(unsigned j = 0; j < _mesh.GetRefIndex(); j++) {
+          _mesh.el->SetElementType(jel + j, elc->GetElementType(iel));
+          _mesh.el->SetElementGroup(jel + j, elc->GetElementGroup(iel));
+          
 	    unsigned gr_mat = elc->GetElementMaterial(iel);
 	    _mesh.el->SetElementMaterial(jel + j, gr_mat);
 	    if( gr_mat == 2) materialElementCounter[0] += 1;
 	    else if(gr_mat == 3 ) materialElementCounter[1] += 1;
 	    else materialElementCounter[2] += 1;
 	        
-            _mesh.el->SetElementLevel(jel + j, elc->GetElementLevel(iel) + 1);
-            if(iel >= elementOffsetCoarse && iel < elementOffsetCoarseP1) {
-              elc->SetChildElement(iel, j, jel + j);
-            }
+          _mesh.el->SetElementLevel(jel + j, elc->GetElementLevel(iel) + 1);
+          if(iel >= elementOffsetCoarse && iel < elementOffsetCoarseP1) {
+            elc->SetChildElement(iel, j, jel + j);
           }
+        }
 
-          // project vertex indeces
-          for(unsigned j = 0; j < _mesh.GetRefIndex(); j++)
-            for(unsigned inode = 0; inode < elc->GetNVE(elt, 0); inode++) {
-              unsigned jDof =  otherFiniteElement[elt][0]->GetBasis()->GetFine2CoarseVertexMapping(j, inode);
-              _mesh.el->SetElementDofIndex(jel + j, inode,  elc->GetElementDofIndex(iel, jDof));
-            }
-
-          // project face indeces
-          for(unsigned iface = 0; iface <  elc->GetNFC(elt, 1); iface++) {
-            int value = elc->GetFaceElementIndex(iel, iface);
-
-            if(value < -1)
-              for(unsigned jface = 0; jface < _mesh.GetFaceIndex(); jface++)
-                _mesh.el->SetFaceElementIndex(jel + coarse2FineFaceMapping[elt][iface][jface][0], coarse2FineFaceMapping[elt][iface][jface][1], value);
+        // project vertex indeces
+        for(unsigned j = 0; j < _mesh.GetRefIndex(); j++)
+          for(unsigned inode = 0; inode < elc->GetNVE(elt, 0); inode++) {
+            unsigned jDof =  otherFiniteElement[elt][0]->GetBasis()->GetFine2CoarseVertexMapping(j, inode);
+            _mesh.el->SetElementDofIndex(jel + j, inode,  elc->GetElementDofIndex(iel, jDof));
           }
 
-          // update element numbers
-          jel += _mesh.GetRefIndex();
-          _mesh.el->AddToElementNumber(_mesh.GetRefIndex(), elt);
+        // project face indeces
+        for(unsigned iface = 0; iface <  elc->GetNFC(elt, 1); iface++) {
+          int value = elc->GetFaceElementIndex(iel, iface);
+
+          if(value < -1)
+            for(unsigned jface = 0; jface < _mesh.GetFaceIndex(); jface++)
+              _mesh.el->SetFaceElementIndex(jel + coarse2FineFaceMapping[elt][iface][jface][0], coarse2FineFaceMapping[elt][iface][jface][1], value);
         }
-        else {
-          _mesh.SetIfHomogeneous(false);
-          AMR = true;
-          unsigned elt = elc->GetElementType(iel);
-          _mesh.el->SetElementType(jel, elc->GetElementType(iel));
-          _mesh.el->SetElementGroup(jel , elc->GetElementGroup(iel));
-          _mesh.el->SetElementMaterial(jel, elc->GetElementMaterial(iel));
+
+        // update element numbers
+        jel += _mesh.GetRefIndex();
+        _mesh.el->AddToElementNumber(_mesh.GetRefIndex(), elt);
+      }
+      else {
+        _mesh.SetIfHomogeneous(false);
+        AMR = true;
+        unsigned elt = elc->GetElementType(iel);
+        _mesh.el->SetElementType(jel, elc->GetElementType(iel));
+        _mesh.el->SetElementGroup(jel , elc->GetElementGroup(iel));
+        _mesh.el->SetElementMaterial(jel, elc->GetElementMaterial(iel));
 	  
 	  unsigned gr_mat = elc->GetElementMaterial(iel);
 	  _mesh.el->SetElementMaterial(jel, gr_mat);
@@ -279,33 +279,32 @@ namespace femus {
 	  else if(gr_mat == 3 ) materialElementCounter[1] += 1;
 	  else materialElementCounter[2] += 1;
 	  
-          _mesh.el->SetElementLevel(jel, elc->GetElementLevel(iel));
-          if(iel >= elementOffsetCoarse && iel < elementOffsetCoarseP1) {
-            elc->SetChildElement(iel, 0, jel);
-          }
+        _mesh.el->SetElementLevel(jel, elc->GetElementLevel(iel));
+        if(iel >= elementOffsetCoarse && iel < elementOffsetCoarseP1) {
+          elc->SetChildElement(iel, 0, jel);
+        }
 
-          // project nodes indeces
-          for(unsigned inode = 0; inode < elc->GetNVE(elt, 2); inode++)
-            _mesh.el->SetElementDofIndex(jel, inode, elc->GetElementDofIndex(iel, inode));
+        // project nodes indeces
+        for(unsigned inode = 0; inode < elc->GetNVE(elt, 2); inode++)
+          _mesh.el->SetElementDofIndex(jel, inode, elc->GetElementDofIndex(iel, inode));
 
-          // project face indeces
-          for(unsigned iface = 0; iface <  elc->GetNFC(elt, 1); iface++) {
-            int value = elc->GetFaceElementIndex(iel, iface);
+        // project face indeces
+        for(unsigned iface = 0; iface <  elc->GetNFC(elt, 1); iface++) {
+          int value = elc->GetFaceElementIndex(iel, iface);
 
-            if(value < -1) {
-              _mesh.el->SetFaceElementIndex(jel, iface, value);
-            }
+          if(value < -1) {
+            _mesh.el->SetFaceElementIndex(jel, iface, value);
           }
-
-          // update element numbers
-          jel++;
-          _mesh.el->AddToElementNumber(1, elt);
         }
+
+        // update element numbers
+        jel++;
+        _mesh.el->AddToElementNumber(1, elt);
       }
-      elc->FreeLocalizedElementDof();
-      elc->FreeLocalizedElementNearFace();
-      elc->FreeLocalizedElementQuantities();
     }
+    elc->FreeLocalizedElementDof();
+    elc->FreeLocalizedElementNearFace();
+    elc->FreeLocalizedElementQuantities();
     
     _mesh.el->SetMaterialElementCounter(materialElementCounter);
     
@@ -436,6 +435,7 @@ namespace femus {
     _mesh._topology->_Sol[0]->close();
     _mesh._topology->_Sol[1]->close();
     _mesh._topology->_Sol[2]->close();
+    _mesh.UpdateCoordinatesRevision();
 
     _mesh.el->BuildElementNearElement();
     _mesh.el->DeleteElementNearVertex();
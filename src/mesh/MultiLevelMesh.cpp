@@ -28,6 +28,7 @@
 
 //C++ include
 #include <iostream>
+#include <iomanip>
 
 
 namespace femus {
@@ -188,6 +189,7 @@ void MultiLevelMesh::ReadCoarseMesh(const char mesh_file[], const char GaussOrde
     //coarse mesh
     _level0[0] = new Mesh();
     std::cout << " Reading corse mesh from file: " << mesh_file << std::endl;
+    _level0[0]->SetMeshCacheFile(_meshCacheFile);
     _level0[0]->ReadCoarseMesh(mesh_file, Lref,_finiteElementGeometryFlag);
 
     BuildElemType(GaussOrder);
@@ -313,6 +315,56 @@ void MultiLevelMesh::EraseCoarseLevels(unsigned levels_to_be_erased) {
 
 //---------------------------------------------------------------------------------------------
 
+void MultiLevelMesh::CompactHierarchy(const bool &keepChildElements) {
+    Mesh *finestMesh = _level[_gridn - 1u];
+    for(unsigned i = 0; i < _level0.size(); i++) {
+      if(_level0[i] != finestMesh) {
+        _level0[i]->Compact(keepChildElements);
+      }
+    }
+}
+
+//---------------------------------------------------------------------------------------------
+
+void MultiLevelMesh::PrintMemoryInfo() {
+    const char *name[4] = {"elements", "topology", "projections", "dof maps"};
+    double total[4] = {0., 0., 0., 0.};
+
+    int iproc;
+    MPI_Comm_rank(MPI_COMM_WORLD, &iproc);
+
+    if(iproc == 0) {
+      std::cout << " Mesh memory (MB, summed on the processes):" << std::endl;
+      std::cout << " level";
+      for(unsigned j = 0; j < 4; j++) std::cout << std::setw(13) << name[j];
+      std::cout << std::endl;
+    }
+
+    for(int i = 0; i < _gridn; i++) {
+      double memory[4];
+      _level[i]->GetMemoryUsage(memory);
+      MPI_Allreduce(MPI_IN_PLACE, memory, 4, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      if(iproc == 0) {
+        std::cout << std::setw(6) << i;
+        for(unsigned j = 0; j < 4; j++) {
+          std::cout << std::setw(13) << std::fixed << std::setprecision(2) << memory[j] / 1048576.;
+          total[j] += memory[j];
+        }
+        std::cout << std::endl;
+      }
+    }
+
+    if(iproc == 0) {
+      std::cout << " total";
+      for(unsigned j = 0; j < 4; j++) std::cout << std::setw(13) << std::fixed << std::setprecision(2) << total[j] / 1048576.;
+      std::cout << std::endl;
+      std::cout.unsetf(std::ios_base::floatfield);
+      std::cout << std::setprecision(6);
+    }
+}
+
+//---------------------------------------------------------------------------------------------
+
 void MultiLevelMesh::PrintInfo() {
     std::cout << " Number of uniform mesh refinement: " << _gridn << std::endl;
     for(int i=0; i<_gridn; i++) {
@@ -23,6 +23,7 @@ PURPOSE.  See the above copyright notice for more information.
 #include "WriterEnum.hpp"
 #include "Writer.hpp"
 #include <vector>
+#include <string>
 namespace femus {
 
 
@@ -55,6 +56,14 @@ public:
     /** Read the coarse-mesh from an input file (call the right reader from the extension) */
     void ReadCoarseMesh(const char mesh_file[], const char GaussOrder[], const double Lref);
 
+    /** Binary cache of the coarse mesh read from the input file, it is used by the following ReadCoarseMesh if the input
+     * file, Lref, the number of processes and the partitioner match, and it is rewritten otherwise, see MeshCache.
+     * The constructor that reads the mesh file does not use a cache, since it reads the file before this can be called:
+     * use the default constructor, SetMeshCacheFile, ReadCoarseMesh and RefineMesh instead */
+    void SetMeshCacheFile(const char cache_file[]) {
+      _meshCacheFile = cache_file;
+    }
+
     /** Built-in cube-structured mesh generator */
     void GenerateCoarseBoxMesh( const unsigned int nx,
                                const unsigned int ny,
@@ -91,6 +100,16 @@ public:
     /** Print the mesh info for each level */
     void PrintInfo();
 
+    /** Free the data of the coarse levels that the solves on the built hierarchy do not use: the projections between
+     * the FE types, the element search grids and the element near element lists, and the children of the elements if
+     * keepChildElements is false, then the coarse to fine projections not built yet can no longer be built.
+     * The finest level is not changed, so that it can still be refined (AMR). Call it after the first solve of every system,
+     * when the multigrid operators, the smoother blocks and the element colorings of the coarse levels are built */
+    void CompactHierarchy(const bool &keepChildElements = false);
+
+    /** Print the memory of the element data, the topology, the projections and the dof maps of each level */
+    void PrintMemoryInfo();
+
     // data
     const elem_type *_finiteElement[6][5];
     
@@ -124,6 +143,9 @@ private:
     std::vector <Mesh*> _level;
 
     std::vector <bool> _finiteElementGeometryFlag;
+
+    /** Coarse mesh cache file, empty if not used */
+    std::string _meshCacheFile;
     
     /** MultilevelMesh  writer */
     Writer* _writer;
@@ -252,6 +252,11 @@ namespace femus {
     return _size;
   }
 
+  template <class Type> std::size_t MyMatrix<Type>::memory() {
+    return (_mat.capacity() + _mat2.capacity()) * sizeof(Type) + _offset.capacity() * sizeof(unsigned) +
+           _rowOffset.memory() + _rowSize.memory() + _matSize.memory();
+  }
+
   template <class Type> unsigned MyMatrix<Type>::size(const unsigned &i) {
     return (_matIsAllocated) ? _rowSize[i] : 0;
   }
@@ -374,6 +379,44 @@ namespace femus {
     _lproc = lproc;
   }
 
+  // ******************
+  // all the partitions are gathered at once, the matrix is indexed as in serial until clearBroadcast() is called
+  template <class Type> void MyMatrix<Type>::localize() {
+
+    if(_serial) {
+      std::cout << "Error in MyMatrix.localize(), matrix is in " << status() << " status" << std::endl;
+      abort();
+    }
+
+    _matSize.localize();
+    _rowSize.localize();
+    _rowOffset.localize();
+
+    std::vector < int > recvCount(_nprocs);
+    std::vector < int > displacement(_nprocs + 1);
+    displacement[0] = 0;
+    for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+      recvCount[jproc] = _matSize[jproc];
+      displacement[jproc + 1] = displacement[jproc] + recvCount[jproc];
+      // the row offsets are relative to the partition of jproc
+      for(unsigned i = _offset[jproc]; i < _offset[jproc + 1]; i++) {
+        _rowOffset[i] += displacement[jproc];
+      }
+    }
+
+    _mat.swap(_mat2);
+    _mat.resize(displacement[_nprocs]);
+
+    MPI_Allgatherv((_mat2.size() > 0) ? &_mat2[0] : NULL, _matSize[_iproc], _MY_MPI_DATATYPE,
+                   (_mat.size() > 0) ? &_mat[0] : NULL, &recvCount[0], &displacement[0], _MY_MPI_DATATYPE, MPI_COMM_WORLD);
+
+    _begin = 0;
+    _end = _offset[_nprocs];
+    _size = _end - _begin;
+
+    _lproc = _nprocs;
+  }
+
   // ******************
   template <class Type> void MyMatrix<Type>::clearBroadcast() {
 
@@ -68,6 +68,9 @@ namespace femus {
 
       // ******************
       unsigned size();
+
+      // ****************** allocated bytes
+      std::size_t memory();
       
       unsigned size(const unsigned &i);
 
@@ -99,6 +102,9 @@ namespace femus {
       // ******************
       void broadcast(const unsigned &lproc);
 
+      // ******************
+      void localize();
+
       // ******************
       void clearBroadcast();
 
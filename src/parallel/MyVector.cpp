@@ -120,6 +120,11 @@ namespace femus {
     return _size;
   }
 
+  // ******************
+  template <class Type> std::size_t MyVector<Type>::memory() {
+    return (_vec.capacity() + _vec2.capacity()) * sizeof(Type) + _offset.capacity() * sizeof(unsigned);
+  }
+
   // ******************
   template <class Type> unsigned MyVector<Type>::begin() {
     return _begin;
@@ -173,17 +178,9 @@ namespace femus {
 
     _offset.resize(_nprocs+1);
     _offset[0]=0;
-    
-    for(unsigned jproc = 0; jproc<_nprocs; jproc++ ){
-      if(jproc != _iproc){
-	MPI_Send(&_size, 1, MPI_UNSIGNED, jproc, 1, MPI_COMM_WORLD);
-	MPI_Recv(&_offset[jproc+1], 1, MPI_UNSIGNED, jproc, 1, MPI_COMM_WORLD, NULL);
-      }
-      else{
-	_offset[_iproc+1]=_size;
-      }
-    }
-    
+
+    MPI_Allgather(&_size, 1, MPI_UNSIGNED, &_offset[1], 1, MPI_UNSIGNED, MPI_COMM_WORLD);
+
     for(unsigned i=0;i<_nprocs;i++){
       _offset[i+1] += _offset[i];
     }
@@ -241,6 +238,33 @@ namespace femus {
     _lproc = lproc;
   }
 
+  // ******************
+  // all the partitions are gathered at once, the vector is indexed as in serial until clearBroadcast() is called
+  template <class Type> void MyVector<Type>::localize() {
+
+    if(_serial) {
+      std::cout << "Error in MyVector.localize(), vector is in " << status() << " status" << std::endl;
+      abort();
+    }
+
+    std::vector < int > recvCount(_nprocs);
+    std::vector < int > displacement(_nprocs);
+    for(unsigned jproc = 0; jproc < _nprocs; jproc++) {
+      recvCount[jproc] = _offset[jproc + 1] - _offset[jproc];
+      displacement[jproc] = _offset[jproc];
+    }
+
+    _vec.swap(_vec2);
+    _vec.resize(_offset[_nprocs]);
+
+    MPI_Allgatherv((_vec2.size() > 0) ? &_vec2[0] : NULL, _vec2.size(), _MY_MPI_DATATYPE,
+                   (_vec.size() > 0) ? &_vec[0] : NULL, &recvCount[0], &displacement[0], _MY_MPI_DATATYPE, MPI_COMM_WORLD);
+
+    _begin = 0;
+    _end = _offset[_nprocs];
+    _lproc = _nprocs;
+  }
+
   // ******************
   template <class Type> void MyVector<Type>::clearBroadcast() {
 
@@ -61,6 +61,9 @@ namespace femus {
       // ******************
       unsigned size();
 
+      // ****************** allocated bytes
+      std::size_t memory();
+
       // ******************
       unsigned begin();
 
@@ -85,6 +88,9 @@ namespace femus {
       // ******************
       void broadcast(const unsigned &lproc);
 
+      // ******************
+      void localize();
+
       // ******************
       void clearBroadcast();
 
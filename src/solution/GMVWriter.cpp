@@ -26,6 +26,8 @@
 #include <algorithm>
 #include <cstring>
 #include "Files.hpp"
+#include "WriterQueue.hpp"
+#include "Profiler.hpp"
 
 
 namespace femus {
@@ -44,6 +46,8 @@ namespace femus {
 
   void GMVWriter::Write( const std::string output_path, const char order[], const std::vector<std::string>& vars, const unsigned time_step ) {
 
+    ProfilerTimer timer("Output");
+
     // ********** linear -> index==0 *** quadratic -> index==1 **********
     unsigned index = ( strcmp( order, "linear" ) ) ? 1 : 0;
 
@@ -56,20 +60,14 @@ namespace femus {
     std::ostringstream filename;
     filename << output_path << "/" << filename_prefix << ".level" << _gridn << "." << time_step << "." << order << ".gmv";
 
-    std::ofstream fout;
+    // the file is formatted in memory and written by Submit, right away or by the output thread
+    std::ostringstream fout( std::ios::out | std::ios::binary );
 
     if( _iproc != 0 ) {
-      fout.rdbuf();   //redirect to dev_null
+      fout.setstate( std::ios::badbit );   //only the root process prints
     }
     else {
-      fout.open( filename.str().c_str() );
-      if( fout.is_open() ) {
-        std::cout << std::endl << " The output is printed to file " << filename.str() << " in GMV format" << std::endl;
-      }
-      else {
-        std::cout << std::endl << " The output file " << filename.str() << " cannot be opened.\n";
-        abort();
-      }
+      std::cout << std::endl << " The output is printed to file " << filename.str() << " in GMV format" << std::endl;
     }
 
     Mesh* mesh = _ml_mesh->GetLevel( _gridn - 1 );
@@ -296,7 +294,9 @@ namespace femus {
 
     sprintf( buffer, "%s", "endgmv" );
     fout.write( ( char* ) buffer, sizeof( char ) * 8 );
-    fout.close();
+    if( _iproc == 0 ) {
+      Submit( new WriterFileTask( filename.str(), fout.str() ) );
+    }
     //END GMV FILE PRINT
 
     delete numVector;
@@ -23,6 +23,7 @@ PURPOSE.  See the above copyright notice for more information.
 #include "FemusConfig.hpp"
 #include "FemusDefault.hpp"
 #include "ParsedFunction.hpp"
+#include "SolutionCheckpoint.hpp"
 
 
 
@@ -702,6 +703,19 @@ namespace femus
   
 
 
+  void MultiLevelSolution::SaveCheckpoint(const char* filename, const double &time)
+  {
+    SolutionCheckpoint checkpoint(this);
+    checkpoint.Save(filename, time);
+  }
+
+  double MultiLevelSolution::LoadCheckpoint(const char* filename)
+  {
+    SolutionCheckpoint checkpoint(this);
+    return checkpoint.Load(filename);
+  }
+
+
   void MultiLevelSolution::RefineSolution(const unsigned &gridf)
   {
 
@@ -241,6 +241,11 @@ public:
     void SaveSolution(const char* filename, const unsigned &iteration);
     void LoadSolution(const char* filename);
     void LoadSolution(const unsigned &level, const char* filename);
+
+    /** Save all the levels of all the solutions, and their old solutions, in the HDF5 checkpoint filename */
+    void SaveCheckpoint(const char* filename, const double &time = 0.);
+    /** Load the HDF5 checkpoint filename, also on a different number of processes; it returns the checkpoint time */
+    double LoadCheckpoint(const char* filename);
     
      // *******************************************************
 
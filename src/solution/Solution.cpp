@@ -382,7 +382,8 @@ _removeNullSpace[old_size + s] = false;
    * Update _Sol
    **/
 
-  void Solution::UpdateSol(const vector <unsigned> &_SolPdeIndex,  NumericVector* _EPS, const vector <vector <unsigned> > &KKoffset) {
+  void Solution::UpdateSol(const vector <unsigned> &_SolPdeIndex,  NumericVector* _EPS, const vector <vector <unsigned> > &KKoffset,
+                           const unsigned &blockSize) {
 
     PetscScalar zero = 0.;
 
@@ -397,7 +398,7 @@ _removeNullSpace[old_size + s] = false;
       vector <int> index(_msh->_ownSize[soltype][processor_id()]);
 
       for(int i = 0; i < _msh->_ownSize[soltype][processor_id()]; i++) {
-        index[i] = loc_offset_EPS + i;
+        index[i] = (blockSize == 1) ? loc_offset_EPS + i : KKoffset[0][processor_id()] + i * blockSize + k;
       }
 
       vector <double> valueEPS(_msh->_ownSize[soltype][processor_id()]);
@@ -434,7 +435,8 @@ _removeNullSpace[old_size + s] = false;
    * Update _Res
    **/
 //--------------------------------------------------------------------------------
-  void Solution::UpdateRes(const vector <unsigned> &_SolPdeIndex, NumericVector* _RES, const vector <vector <unsigned> > &KKoffset) {
+  void Solution::UpdateRes(const vector <unsigned> &_SolPdeIndex, NumericVector* _RES, const vector <vector <unsigned> > &KKoffset,
+                           const unsigned &blockSize) {
 
     PetscScalar zero = 0.;
 
@@ -449,7 +451,7 @@ _removeNullSpace[old_size + s] = false;
       vector <int> index(_msh->_ownSize[soltype][processor_id()]);
 
       for(int i = 0; i < _msh->_ownSize[soltype][processor_id()]; i++) {
-        index[i] = loc_offset_RES + i;
+        index[i] = (blockSize == 1) ? loc_offset_RES + i : KKoffset[0][processor_id()] + i * blockSize + k;
       }
 
       vector <double> valueRES(_msh->_ownSize[soltype][processor_id()]);
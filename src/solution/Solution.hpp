@@ -76,9 +76,13 @@ namespace femus {
 //       /** Sum to Solution vector the Epsilon vector. It is used inside the multigrid cycle */
 //       void UpdateSolAndRes(const vector <unsigned> &_SolPdeIndex,  NumericVector* EPS, NumericVector* RES, const vector <vector <unsigned> > &KKoffset);
 
-      void UpdateSol(const vector <unsigned> &_SolPdeIndex,  NumericVector* EPS, const vector <vector <unsigned> > &KKoffset);
+      /** blockSize is LinearEquation::GetBlockSize(), > 1 for the node-interleaved system dofs,
+       * the system dofs are the same as LinearEquation::GetKKDof */
+      void UpdateSol(const vector <unsigned> &_SolPdeIndex,  NumericVector* EPS, const vector <vector <unsigned> > &KKoffset,
+                     const unsigned &blockSize);
       /** */
-      void UpdateRes(const vector <unsigned> &_SolPdeIndex, NumericVector* _RES, const vector <vector <unsigned> > &KKoffset);
+      void UpdateRes(const vector <unsigned> &_SolPdeIndex, NumericVector* _RES, const vector <vector <unsigned> > &KKoffset,
+                     const unsigned &blockSize);
 
       /** Update the solution */
       void CopySolutionToOldSolution();
@@ -0,0 +1,640 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: SolutionCheckpoint
+ Authors: Eugenio Aulisa, Giorgio Bornia
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "SolutionCheckpoint.hpp"
+#include "MultiLevelSolution.hpp"
+#include "NumericVector.hpp"
+#include "SparseMatrix.hpp"
+#include "FemusConfig.hpp"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <cfloat>
+#include <map>
+
+#ifdef HAVE_HDF5
+#include "hdf5.h"
+#endif
+
+namespace femus {
+
+#ifdef HAVE_HDF5
+
+  // file access property list, MPI-IO if HDF5 is parallel
+  static hid_t CreateFileAccessList() {
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+#ifdef H5_HAVE_PARALLEL
+    H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
+#endif
+    return fapl;
+  }
+
+  // data transfer property list, collective if HDF5 is parallel
+  static hid_t CreateTransferList() {
+    hid_t dxpl = H5Pcreate(H5P_DATASET_XFER);
+#ifdef H5_HAVE_PARALLEL
+    H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
+#endif
+    return dxpl;
+  }
+
+  static bool DatasetExists(hid_t file, const std::string &name) {
+    // H5Lexists requires all the intermediate groups to exist
+    for(size_t pos = name.find('/', 1); pos != std::string::npos; pos = name.find('/', pos + 1)) {
+      if(H5Lexists(file, name.substr(0, pos).c_str(), H5P_DEFAULT) <= 0) return false;
+    }
+    return H5Lexists(file, name.c_str(), H5P_DEFAULT) > 0;
+  }
+
+  static hsize_t GetNumberOfRows(hid_t file, const std::string &name) {
+    hid_t dataset = H5Dopen(file, name.c_str(), H5P_DEFAULT);
+    hid_t dataspace = H5Dget_space(dataset);
+    hsize_t dims[2] = {0, 0};
+    H5Sget_simple_extent_dims(dataspace, dims, NULL);
+    H5Sclose(dataspace);
+    H5Dclose(dataset);
+    return dims[0];
+  }
+
+  // write the rows [rowOffset, rowOffset + localRows) of a [globalRows][columns] dataset, created if create is true
+  static void WriteRows(hid_t file, const std::string &name, hid_t type, const hsize_t &globalRows, const hsize_t &columns,
+                        const hsize_t &rowOffset, const hsize_t &localRows, const void *data, const bool &create) {
+
+    hsize_t dims[2] = {globalRows, columns};
+    hid_t dataset;
+    if(create) {
+      hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+      H5Pset_create_intermediate_group(lcpl, 1);
+      hid_t dataspace = H5Screate_simple(2, dims, NULL);
+      dataset = H5Dcreate(file, name.c_str(), type, dataspace, lcpl, H5P_DEFAULT, H5P_DEFAULT);
+      H5Sclose(dataspace);
+      H5Pclose(lcpl);
+    }
+    else {
+      dataset = H5Dopen(file, name.c_str(), H5P_DEFAULT);
+    }
+
+    hid_t filespace = H5Dget_space(dataset);
+    hsize_t start[2] = {rowOffset, 0};
+    hsize_t count[2] = {localRows, columns};
+    hsize_t memDims[2] = {(localRows > 0) ? localRows : 1, columns};
+    hid_t memspace = H5Screate_simple(2, memDims, NULL);
+    if(localRows > 0) {
+      H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+    }
+    else {
+      H5Sselect_none(filespace);
+      H5Sselect_none(memspace);
+    }
+
+    hid_t dxpl = CreateTransferList();
+    H5Dwrite(dataset, type, memspace, filespace, dxpl, data);
+    H5Pclose(dxpl);
+
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    H5Dclose(dataset);
+  }
+
+  // read the rows [rowOffset, rowOffset + localRows) of a [rows][columns] dataset
+  static void ReadRows(hid_t file, const std::string &name, hid_t type, const hsize_t &columns,
+                       const hsize_t &rowOffset, const hsize_t &localRows, void *data) {
+
+    if(!DatasetExists(file, name)) {
+      std::cout << "Error in SolutionCheckpoint::Load: the dataset " << name << " is not in the checkpoint" << std::endl;
+      abort();
+    }
+
+    hid_t dataset = H5Dopen(file, name.c_str(), H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset);
+    hsize_t start[2] = {rowOffset, 0};
+    hsize_t count[2] = {localRows, columns};
+    hsize_t memDims[2] = {(localRows > 0) ? localRows : 1, columns};
+    hid_t memspace = H5Screate_simple(2, memDims, NULL);
+    if(localRows > 0) {
+      H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+    }
+    else {
+      H5Sselect_none(filespace);
+      H5Sselect_none(memspace);
+    }
+
+    hid_t dxpl = CreateTransferList();
+    H5Dread(dataset, type, memspace, filespace, dxpl, data);
+    H5Pclose(dxpl);
+
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    H5Dclose(dataset);
+  }
+
+#endif
+
+  static std::string DatasetName(const unsigned &level, const std::string &group, const char name[]) {
+    std::ostringstream datasetName;
+    datasetName << "/level" << level << "/" << group << "/" << name;
+    return datasetName.str();
+  }
+
+  static std::string TypeGroup(const unsigned &solType) {
+    std::ostringstream group;
+    group << "type" << solType;
+    return group.str();
+  }
+
+  // FNV-1a hash of the bytes of the owned keys, it identifies the owned dofs and their numbering
+  static unsigned long long KeyChecksum(const std::vector < double > &keys) {
+    unsigned long long checksum = 14695981039346656037ULL;
+    const unsigned char *byte = reinterpret_cast < const unsigned char* >(keys.data());
+    for(size_t i = 0; i < keys.size() * sizeof(double); i++) {
+      checksum ^= byte[i];
+      checksum *= 1099511628211ULL;
+    }
+    return checksum;
+  }
+
+
+  SolutionCheckpoint::SolutionCheckpoint(MultiLevelSolution *mlSol) {
+    _mlSol = mlSol;
+  }
+
+  void SolutionCheckpoint::GetDofKeys(Mesh *msh, const unsigned &solType, std::vector < double > &keys) {
+
+    unsigned dim = msh->GetDimension();
+    unsigned dofOffset = msh->_dofOffset[solType][_iproc];
+    unsigned ownSize = msh->_ownSize[solType][_iproc];
+
+    keys.assign(4 * ownSize, 0.);
+
+    std::vector < std::vector < double > > xv;
+    for(unsigned iel = msh->_elementOffset[_iproc]; iel < msh->_elementOffset[_iproc + 1]; iel++) {
+      msh->GetElementNodeCoordinates(xv, iel, 2);
+
+      if(solType < 3) { // Lagrange dofs: node coordinates
+        unsigned nDofs = msh->GetElementDofNumber(iel, solType);
+        for(unsigned j = 0; j < nDofs; j++) {
+          unsigned jdof = msh->GetSolutionDof(j, iel, solType);
+          if(jdof >= dofOffset && jdof < dofOffset + ownSize) {
+            for(unsigned d = 0; d < dim; d++) {
+              keys[4 * (jdof - dofOffset) + d] = xv[d][j];
+            }
+          }
+        }
+      }
+      else { // discontinuous dofs: element center and local index
+        unsigned nVertices = msh->GetElementDofNumber(iel, 0);
+        std::vector < double > xc(3, 0.);
+        for(unsigned d = 0; d < dim; d++) {
+          for(unsigned j = 0; j < nVertices; j++) {
+            xc[d] += xv[d][j];
+          }
+          xc[d] /= nVertices;
+        }
+        unsigned nDofs = msh->GetElementDofNumber(iel, solType);
+        for(unsigned j = 0; j < nDofs; j++) {
+          unsigned jdof = msh->GetSolutionDof(j, iel, solType);
+          for(unsigned d = 0; d < 3; d++) {
+            keys[4 * (jdof - dofOffset) + d] = xc[d];
+          }
+          keys[4 * (jdof - dofOffset) + 3] = j;
+        }
+      }
+    }
+  }
+
+  void SolutionCheckpoint::GetVectors(const unsigned &level, const unsigned &solType, std::vector < unsigned > &solIndex,
+                                      std::vector < bool > &old) {
+    solIndex.resize(0);
+    old.resize(0);
+    Solution *solution = _mlSol->GetSolutionLevel(level);
+    for(unsigned i = 0; i < _mlSol->GetSolutionSize(); i++) {
+      if(_mlSol->GetSolutionType(i) == static_cast < int >(solType)) {
+        solIndex.push_back(i);
+        old.push_back(false);
+        if(solution->_SolOld[i] != NULL) {
+          solIndex.push_back(i);
+          old.push_back(true);
+        }
+      }
+    }
+  }
+
+  void SolutionCheckpoint::Save(const std::string &filename, const double &time) {
+
+#ifdef HAVE_HDF5
+
+    unsigned nLevels = _mlSol->_mlMesh->GetNumberOfLevels();
+
+    std::vector < std::vector < std::vector < double > > > keys(nLevels, std::vector < std::vector < double > > (5));
+    for(unsigned level = 0; level < nLevels; level++) {
+      for(unsigned solType = 0; solType < 5; solType++) {
+        std::vector < unsigned > solIndex;
+        std::vector < bool > old;
+        GetVectors(level, solType, solIndex, old);
+        if(solIndex.size() > 0) {
+          GetDofKeys(_mlSol->_mlMesh->GetLevel(level), solType, keys[level][solType]);
+        }
+      }
+    }
+
+    // with serial HDF5 the processes write their rows in turn
+#ifdef H5_HAVE_PARALLEL
+    const int nTurns = 1;
+#else
+    const int nTurns = _nprocs;
+#endif
+
+    for(int turn = 0; turn < nTurns; turn++) {
+      if(nTurns == 1 || turn == _iproc) {
+        bool create = (nTurns == 1 || turn == 0);
+
+        hid_t fapl = CreateFileAccessList();
+        hid_t file = (create) ? H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl) :
+                     H5Fopen(filename.c_str(), H5F_ACC_RDWR, fapl);
+        H5Pclose(fapl);
+        if(file < 0) {
+          std::cout << "Error in SolutionCheckpoint::Save: the file " << filename << " cannot be opened" << std::endl;
+          abort();
+        }
+
+        hsize_t rootRows = (_iproc == 0) ? 1 : 0;
+        unsigned nprocs = _nprocs;
+        WriteRows(file, "/time", H5T_NATIVE_DOUBLE, 1, 1, 0, rootRows, &time, create);
+        WriteRows(file, "/nprocs", H5T_NATIVE_UINT, 1, 1, 0, rootRows, &nprocs, create);
+        WriteRows(file, "/levels", H5T_NATIVE_UINT, 1, 1, 0, rootRows, &nLevels, create);
+
+        for(unsigned level = 0; level < nLevels; level++) {
+          Mesh *msh = _mlSol->_mlMesh->GetLevel(level);
+          Solution *solution = _mlSol->GetSolutionLevel(level);
+
+          for(unsigned solType = 0; solType < 5; solType++) {
+            std::vector < unsigned > solIndex;
+            std::vector < bool > old;
+            GetVectors(level, solType, solIndex, old);
+            if(solIndex.size() == 0) continue;
+
+            std::string typeGroup = TypeGroup(solType);
+            unsigned nDofs = msh->_dofOffset[solType][_nprocs];
+            unsigned dofOffset = msh->_dofOffset[solType][_iproc];
+            unsigned ownSize = msh->_ownSize[solType][_iproc];
+
+            WriteRows(file, DatasetName(level, typeGroup, "dofOffset"), H5T_NATIVE_UINT, _nprocs + 1, 1, 0,
+                      rootRows * (_nprocs + 1), &msh->_dofOffset[solType][0], create);
+            WriteRows(file, DatasetName(level, typeGroup, "key"), H5T_NATIVE_DOUBLE, nDofs, 4, dofOffset,
+                      ownSize, keys[level][solType].data(), create);
+            unsigned long long checksum = KeyChecksum(keys[level][solType]);
+            WriteRows(file, DatasetName(level, typeGroup, "keyChecksum"), H5T_NATIVE_ULLONG, _nprocs, 1, _iproc,
+                      1, &checksum, create);
+
+            std::vector < double > values(ownSize);
+            for(unsigned k = 0; k < solIndex.size(); k++) {
+              NumericVector *vec = (old[k]) ? solution->_SolOld[solIndex[k]] : solution->_Sol[solIndex[k]];
+              for(unsigned i = 0; i < ownSize; i++) {
+                values[i] = (*vec)(dofOffset + i);
+              }
+              WriteRows(file, DatasetName(level, _mlSol->GetSolutionName(solIndex[k]), (old[k]) ? "SolOld" : "Sol"),
+                        H5T_NATIVE_DOUBLE, nDofs, 1, dofOffset, ownSize, values.data(), create);
+            }
+          }
+        }
+
+        H5Fclose(file);
+      }
+      if(nTurns > 1) MPI_Barrier(PETSC_COMM_WORLD);
+    }
+
+#else
+    std::cout << "Error in SolutionCheckpoint::Save: femus is built without HDF5" << std::endl;
+    abort();
+#endif
+  }
+
+  double SolutionCheckpoint::Load(const std::string &filename) {
+
+    double time = 0.;
+
+#ifdef HAVE_HDF5
+
+    hid_t fapl = CreateFileAccessList();
+    hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, fapl);
+    H5Pclose(fapl);
+    if(file < 0) {
+      std::cout << "Error in SolutionCheckpoint::Load: the file " << filename << " cannot be opened" << std::endl;
+      abort();
+    }
+
+    unsigned fileNprocs;
+    unsigned fileLevels;
+    ReadRows(file, "/time", H5T_NATIVE_DOUBLE, 1, 0, 1, &time);
+    ReadRows(file, "/nprocs", H5T_NATIVE_UINT, 1, 0, 1, &fileNprocs);
+    ReadRows(file, "/levels", H5T_NATIVE_UINT, 1, 0, 1, &fileLevels);
+
+    unsigned nLevels = _mlSol->_mlMesh->GetNumberOfLevels();
+    unsigned loadLevels = (fileLevels < nLevels) ? fileLevels : nLevels;
+
+    bool keyScaleIsBuilt = false;
+    double h = 1.;
+    std::vector < double > xMin(3, 0.);
+
+    for(unsigned level = 0; level < loadLevels; level++) {
+      Mesh *msh = _mlSol->_mlMesh->GetLevel(level);
+      Solution *solution = _mlSol->GetSolutionLevel(level);
+
+      for(unsigned solType = 0; solType < 5; solType++) {
+        std::vector < unsigned > solIndex;
+        std::vector < bool > old;
+        GetVectors(level, solType, solIndex, old);
+        if(solIndex.size() == 0) continue;
+
+        // SolOld is loaded only if it is in the checkpoint
+        std::vector < NumericVector* > vec;
+        std::vector < std::string > name;
+        for(unsigned k = 0; k < solIndex.size(); k++) {
+          std::string datasetName = DatasetName(level, _mlSol->GetSolutionName(solIndex[k]), (old[k]) ? "SolOld" : "Sol");
+          if(!old[k] || DatasetExists(file, datasetName)) {
+            vec.push_back((old[k]) ? solution->_SolOld[solIndex[k]] : solution->_Sol[solIndex[k]]);
+            name.push_back(datasetName);
+          }
+        }
+        unsigned nValues = vec.size();
+
+        std::string typeGroup = TypeGroup(solType);
+        std::vector < unsigned > fileDofOffset(fileNprocs + 1);
+        ReadRows(file, DatasetName(level, typeGroup, "dofOffset"), H5T_NATIVE_UINT, 1, 0, fileNprocs + 1, fileDofOffset.data());
+
+        unsigned dofOffset = msh->_dofOffset[solType][_iproc];
+        unsigned ownSize = msh->_ownSize[solType][_iproc];
+
+        std::vector < double > keys;
+        GetDofKeys(msh, solType, keys);
+
+        // the rows are read directly only if every process owns the same dofs with the same numbering as in the checkpoint,
+        // checked with the dof partition and the checksum of the owned keys
+        bool samePartition = (fileNprocs == static_cast < unsigned >(_nprocs));
+        for(unsigned jproc = 0; jproc <= fileNprocs && samePartition; jproc++) {
+          if(fileDofOffset[jproc] != msh->_dofOffset[solType][jproc]) samePartition = false;
+        }
+        std::string checksumName = DatasetName(level, typeGroup, "keyChecksum");
+        if(samePartition && DatasetExists(file, checksumName)) {
+          unsigned long long fileChecksum;
+          ReadRows(file, checksumName, H5T_NATIVE_ULLONG, 1, _iproc, 1, &fileChecksum);
+          int sameKeys = (fileChecksum == KeyChecksum(keys)) ? 1 : 0;
+          int allSameKeys;
+          MPI_Allreduce(&sameKeys, &allSameKeys, 1, MPI_INT, MPI_MIN, PETSC_COMM_WORLD);
+          samePartition = (allSameKeys == 1);
+        }
+        else {
+          samePartition = false;
+        }
+
+        std::vector < double > values(ownSize * nValues);
+
+        if(samePartition) {
+          std::vector < double > buffer(ownSize);
+          for(unsigned k = 0; k < nValues; k++) {
+            ReadRows(file, name[k], H5T_NATIVE_DOUBLE, 1, dofOffset, ownSize, buffer.data());
+            for(unsigned i = 0; i < ownSize; i++) {
+              values[i * nValues + k] = buffer[i];
+            }
+          }
+        }
+        else {
+          // every process reads an equal share of the rows, that are then sent to the owners of the matching dofs
+          if(!keyScaleIsBuilt) {
+            GetKeyScale(h, xMin);
+            keyScaleIsBuilt = true;
+          }
+
+          unsigned long long fileDofs = fileDofOffset[fileNprocs];
+          hsize_t rowBegin = (fileDofs * _iproc) / _nprocs;
+          hsize_t rowEnd = (fileDofs * (_iproc + 1)) / _nprocs;
+          hsize_t nRows = rowEnd - rowBegin;
+
+          std::vector < double > fileKeys(4 * nRows);
+          ReadRows(file, DatasetName(level, typeGroup, "key"), H5T_NATIVE_DOUBLE, 4, rowBegin, nRows, fileKeys.data());
+
+          std::vector < double > fileValues(nRows * nValues);
+          std::vector < double > buffer(nRows);
+          for(unsigned k = 0; k < nValues; k++) {
+            ReadRows(file, name[k], H5T_NATIVE_DOUBLE, 1, rowBegin, nRows, buffer.data());
+            for(unsigned i = 0; i < nRows; i++) {
+              fileValues[i * nValues + k] = buffer[i];
+            }
+          }
+
+          // a key that falls on a quantization cell boundary is matched in a second pass with the cells shifted by half a cell
+          std::vector < bool > matched(ownSize, false);
+          for(unsigned pass = 0; pass < 2; pass++) {
+            unsigned unmatched = MatchKeys(fileKeys, fileValues, keys, values, matched, nValues, h, xMin, 0.5 * pass);
+            unsigned globalUnmatched;
+            MPI_Allreduce(&unmatched, &globalUnmatched, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+            if(globalUnmatched == 0) break;
+            if(pass == 1) {
+              std::cout << "Error in SolutionCheckpoint::Load: " << globalUnmatched << " dofs of type " << solType << " on level "
+                        << level << " are not in the checkpoint, the mesh is different" << std::endl;
+              abort();
+            }
+          }
+        }
+
+        for(unsigned k = 0; k < nValues; k++) {
+          for(unsigned i = 0; i < ownSize; i++) {
+            vec[k]->set(dofOffset + i, values[i * nValues + k]);
+          }
+          vec[k]->close();
+        }
+      }
+    }
+
+    H5Fclose(file);
+
+    // the levels that are not in the checkpoint are projected from the coarser ones
+    for(unsigned level = loadLevels; level < nLevels; level++) {
+      _mlSol->RefineSolution(level);
+    }
+
+#else
+    std::cout << "Error in SolutionCheckpoint::Load: femus is built without HDF5" << std::endl;
+    abort();
+#endif
+
+    return time;
+  }
+
+  void SolutionCheckpoint::GetKeyScale(double &h, std::vector < double > &xMin) {
+
+    unsigned nLevels = _mlSol->_mlMesh->GetNumberOfLevels();
+
+    double hMin = DBL_MAX;
+    xMin.assign(3, DBL_MAX);
+
+    std::vector < std::vector < double > > xv;
+    for(unsigned level = 0; level < nLevels; level++) {
+      Mesh *msh = _mlSol->_mlMesh->GetLevel(level);
+      unsigned dim = msh->GetDimension();
+      for(unsigned iel = msh->_elementOffset[_iproc]; iel < msh->_elementOffset[_iproc + 1]; iel++) {
+        msh->GetElementNodeCoordinates(xv, iel, 2);
+        unsigned nNodes = xv[0].size();
+        for(unsigned i = 0; i < nNodes; i++) {
+          for(unsigned d = 0; d < dim; d++) {
+            if(xv[d][i] < xMin[d]) xMin[d] = xv[d][i];
+          }
+          for(unsigned j = i + 1; j < nNodes; j++) {
+            double distance2 = 0.;
+            for(unsigned d = 0; d < dim; d++) {
+              distance2 += (xv[d][i] - xv[d][j]) * (xv[d][i] - xv[d][j]);
+            }
+            if(distance2 > 0. && distance2 < hMin) hMin = distance2;
+          }
+        }
+      }
+      for(unsigned d = dim; d < 3; d++) xMin[d] = 0.;
+    }
+    hMin = sqrt(hMin);
+
+    MPI_Allreduce(MPI_IN_PLACE, &hMin, 1, MPI_DOUBLE, MPI_MIN, PETSC_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &xMin[0], 3, MPI_DOUBLE, MPI_MIN, PETSC_COMM_WORLD);
+
+    // distinct dofs are at least hMin / 2 apart, while round-off is many orders of magnitude smaller than 1.e-3 hMin
+    h = 1.e-3 * hMin;
+  }
+
+  unsigned SolutionCheckpoint::MatchKeys(const std::vector < double > &fileKeys, const std::vector < double > &fileValues,
+                                         const std::vector < double > &keys, std::vector < double > &values,
+                                         std::vector < bool > &matched, const unsigned &nValues, const double &h,
+                                         const std::vector < double > &xMin, const double &shift) {
+
+    unsigned nRows = fileKeys.size() / 4;
+    unsigned nOwned = keys.size() / 4;
+
+    // the quantized key is stored as doubles, exact since the cell indices are much smaller than 2^53
+    std::vector < double > q(4);
+    unsigned rowSize = 4 + nValues;
+    unsigned requestSize = 5;
+    unsigned replySize = 2 + nValues;
+
+    std::vector < std::vector < double > > sendRows(_nprocs);
+    std::vector < std::vector < double > > sendRequests(_nprocs);
+
+    for(unsigned pass = 0; pass < 2; pass++) {
+      unsigned n = (pass == 0) ? nRows : nOwned;
+      const std::vector < double > &k = (pass == 0) ? fileKeys : keys;
+      for(unsigned i = 0; i < n; i++) {
+        if(pass == 1 && matched[i]) continue;
+        unsigned long long hash = 14695981039346656037ULL;
+        for(unsigned d = 0; d < 4; d++) {
+          q[d] = (d < 3) ? floor((k[4 * i + d] - xMin[d]) / h + shift) : k[4 * i + d];
+          hash = (hash ^ static_cast < unsigned long long >(static_cast < long long >(q[d]))) * 1099511628211ULL;
+        }
+        unsigned jproc = hash % _nprocs;
+        if(pass == 0) {
+          sendRows[jproc].insert(sendRows[jproc].end(), q.begin(), q.end());
+          sendRows[jproc].insert(sendRows[jproc].end(), fileValues.begin() + i * nValues, fileValues.begin() + (i + 1) * nValues);
+        }
+        else {
+          sendRequests[jproc].insert(sendRequests[jproc].end(), q.begin(), q.end());
+          sendRequests[jproc].push_back(i);
+        }
+      }
+    }
+
+    std::vector < int > sendCount(_nprocs), sendOffset(_nprocs), recvCount(_nprocs), recvOffset(_nprocs);
+    std::vector < double > sendData;
+    std::vector < double > recvRows;
+    std::vector < double > recvRequests;
+    std::vector < double > recvReplies;
+
+    std::vector < std::vector < double > > *sendBuffer[3] = {&sendRows, &sendRequests, &sendRows};
+    std::vector < double > *recvData[3] = {&recvRows, &recvRequests, &recvReplies};
+    std::vector < int > requestCount(_nprocs), requestOffset(_nprocs);
+
+    for(unsigned stage = 0; stage < 3; stage++) {
+
+      if(stage == 2) { // reply to the requests: local index, found flag and values
+        std::map < std::vector < double >, unsigned > rowMap;
+        for(unsigned i = 0; i < recvRows.size(); i += rowSize) {
+          rowMap[std::vector < double > (recvRows.begin() + i, recvRows.begin() + i + 4)] = i + 4;
+        }
+        for(int jproc = 0; jproc < _nprocs; jproc++) {
+          sendRows[jproc].resize(0);
+          for(int i = requestOffset[jproc]; i < requestOffset[jproc] + requestCount[jproc]; i += requestSize) {
+            std::map < std::vector < double >, unsigned >::iterator it =
+              rowMap.find(std::vector < double > (recvRequests.begin() + i, recvRequests.begin() + i + 4));
+            sendRows[jproc].push_back(recvRequests[i + 4]);
+            if(it != rowMap.end()) {
+              sendRows[jproc].push_back(1.);
+              sendRows[jproc].insert(sendRows[jproc].end(), recvRows.begin() + it->second, recvRows.begin() + it->second + nValues);
+            }
+            else {
+              sendRows[jproc].push_back(0.);
+              sendRows[jproc].insert(sendRows[jproc].end(), nValues, 0.);
+            }
+          }
+        }
+      }
+
+      unsigned sendSize = 0;
+      for(int jproc = 0; jproc < _nprocs; jproc++) {
+        sendCount[jproc] = (*sendBuffer[stage])[jproc].size();
+        sendOffset[jproc] = sendSize;
+        sendSize += sendCount[jproc];
+      }
+
+      MPI_Alltoall(&sendCount[0], 1, MPI_INT, &recvCount[0], 1, MPI_INT, PETSC_COMM_WORLD);
+
+      unsigned recvSize = 0;
+      for(int jproc = 0; jproc < _nprocs; jproc++) {
+        recvOffset[jproc] = recvSize;
+        recvSize += recvCount[jproc];
+      }
+
+      sendData.resize(sendSize);
+      for(int jproc = 0; jproc < _nprocs; jproc++) {
+        std::copy((*sendBuffer[stage])[jproc].begin(), (*sendBuffer[stage])[jproc].end(), sendData.begin() + sendOffset[jproc]);
+        std::vector < double > ().swap((*sendBuffer[stage])[jproc]);
+      }
+      recvData[stage]->resize(recvSize);
+
+      MPI_Alltoallv(sendData.data(), &sendCount[0], &sendOffset[0], MPI_DOUBLE,
+                    recvData[stage]->data(), &recvCount[0], &recvOffset[0], MPI_DOUBLE, PETSC_COMM_WORLD);
+
+      if(stage == 1) {
+        requestCount = recvCount;
+        requestOffset = recvOffset;
+      }
+    }
+
+    for(unsigned i = 0; i < recvReplies.size(); i += replySize) {
+      if(recvReplies[i + 1] == 1.) {
+        unsigned idof = static_cast < unsigned >(recvReplies[i]);
+        for(unsigned k = 0; k < nValues; k++) {
+          values[idof * nValues + k] = recvReplies[i + 2 + k];
+        }
+        matched[idof] = true;
+      }
+    }
+
+    unsigned unmatched = 0;
+    for(unsigned i = 0; i < nOwned; i++) {
+      if(!matched[i]) unmatched++;
+    }
+    return unmatched;
+  }
+
+} //end namespace femus
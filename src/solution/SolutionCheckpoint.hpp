@@ -0,0 +1,75 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: SolutionCheckpoint
+ Authors: Eugenio Aulisa, Giorgio Bornia
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_solution_SolutionCheckpoint_hpp__
+#define __femus_solution_SolutionCheckpoint_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "ParallelObject.hpp"
+#include <vector>
+#include <string>
+
+namespace femus {
+
+  class MultiLevelSolution;
+  class Mesh;
+
+  /**
+   * Checkpoint of all the levels of a MultiLevelSolution in a single HDF5 file.
+   * For every level and every FE type the file stores the dof partition and a partition-independent key of each dof
+   * (node coordinates for Lagrange dofs, element center and local index for discontinuous dofs); for every level and
+   * solution it stores the Sol and, if allocated, the SolOld vectors. With parallel HDF5 the file is written collectively,
+   * otherwise the processes write their rows in turn.
+   * It also stores a checksum of the owned keys of each process. A checkpoint is read directly if the dof partition and the
+   * checksums are the same, otherwise the rows are redistributed by matching the keys, so that a run can be restarted
+   * on a different number of processes or with a different partition or numbering of the dofs.
+   */
+  class SolutionCheckpoint : public ParallelObject {
+    public:
+
+      SolutionCheckpoint(MultiLevelSolution *mlSol);
+
+      ~SolutionCheckpoint() {};
+
+      void Save(const std::string &filename, const double &time);
+
+      /** Load all the levels, it returns the checkpoint time */
+      double Load(const std::string &filename);
+
+    private:
+
+      /** Owned dofs of solType and their keys [dof][4], ordered as the dofs */
+      void GetDofKeys(Mesh *msh, const unsigned &solType, std::vector < double > &keys);
+
+      /** Vectors of the level with FE type solType, with their dataset names */
+      void GetVectors(const unsigned &level, const unsigned &solType, std::vector < unsigned > &solIndex,
+                      std::vector < bool > &old);
+
+      /** Minimum node distance and bounding box lower corner of all the meshes, used to quantize the keys */
+      void GetKeyScale(double &h, std::vector < double > &xMin);
+
+      /** Exchange the file rows and the owned dofs by key and fill the owned values, it returns the number of unmatched dofs */
+      unsigned MatchKeys(const std::vector < double > &fileKeys, const std::vector < double > &fileValues,
+                         const std::vector < double > &keys, std::vector < double > &values, std::vector < bool > &matched,
+                         const unsigned &nValues, const double &h, const std::vector < double > &xMin, const double &shift);
+
+      MultiLevelSolution *_mlSol;
+  };
+
+} //end namespace femus
+
+#endif
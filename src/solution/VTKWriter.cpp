@@ -27,7 +27,15 @@
 #include <cstdio>
 #include <iomanip>
 #include <algorithm>
+#include <climits>
 #include "Files.hpp"
+#include "FemusConfig.hpp"
+#include "WriterQueue.hpp"
+#include "Profiler.hpp"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 namespace femus {
 
@@ -37,13 +45,37 @@ namespace femus {
 
   VTKWriter::VTKWriter( MultiLevelSolution* ml_sol ): Writer( ml_sol ) {
     _debugOutput = false;
+    _appendedOutput = false;
+    _compressedOutput = false;
   }
 
   VTKWriter::VTKWriter( MultiLevelMesh* ml_mesh ): Writer( ml_mesh ) {
     _debugOutput = false;
+    _appendedOutput = false;
+    _compressedOutput = false;
+  }
+
+  VTKWriter::~VTKWriter(){
+    ClearCache();
   }
 
-  VTKWriter::~VTKWriter(){}
+  void VTKWriter::SetCompressedOutput( bool value ) {
+#ifdef HAVE_ZLIB
+    _compressedOutput = value;
+#else
+    if( value ) {
+      std::cout << "Warning femus is built without zlib, the VTK output is not compressed" << std::endl;
+    }
+    _compressedOutput = false;
+#endif
+  }
+
+  void VTKWriter::ClearCache() {
+    for( std::map < unsigned, LevelCache >::iterator it = _levelCache.begin(); it != _levelCache.end(); ++it ) {
+      delete it->second.mysol;
+    }
+    _levelCache.clear();
+  }
   
 
    void VTKWriter::Write(const std::string output_path, const char order[], const std::vector < std::string >& vars, const unsigned time_step ) {
@@ -75,12 +107,15 @@ namespace femus {
   
   void VTKWriter::Write(const unsigned my_level, const std::string filename_prefix, const std::string output_path, const char order[], const std::vector < std::string >& vars, const unsigned time_step ) {
       
+    ProfilerTimer timer("Output");
+
     std::ostringstream level_name_stream;    
     level_name_stream << ".level" << my_level;
     std::string level_name(level_name_stream.str());   
        
     // *********** open vtu files *************
-    std::ofstream fout;
+    // the vtu file is staged in a VTKPieceTask, that encodes and writes it right away or in the output thread
+    std::ostringstream fout;
 
     std::string dirnamePVTK = "VTKParallelFiles/";
     Files files;
@@ -96,33 +131,26 @@ namespace femus {
     std::ostringstream filename;
     filename << output_path << "/" << dirnamePVTK << filename_prefix << level_name << "." << _iproc << "." << time_step << "." << order << ".vtu";
 
-    fout.open( filename.str().c_str() );
-    if( !fout.is_open() ) {
-      std::cout << std::endl << " The output file " << filename.str() << " cannot be opened.\n";
-      abort();
-    }
+    VTKPieceTask* piece = new VTKPieceTask( filename.str(), _appendedOutput, _compressedOutput );
 
     // *********** write vtu header ************
     fout << "<?xml version=\"1.0\"?>" << std::endl;
-    fout << "<VTKFile type = \"UnstructuredGrid\" version=\"0.1\" byte_order=\"LittleEndian\">" << std::endl;
+    fout << "<VTKFile type = \"UnstructuredGrid\" version=\"0.1\" byte_order=\"LittleEndian\"";
+    if( _compressedOutput ) fout << " compressor=\"vtkZLibDataCompressor\"";
+    fout << ">" << std::endl;
     fout << "  <UnstructuredGrid>" << std::endl;
 
     // *********** open pvtu file *************
-    std::ofstream Pfout;
+    std::ostringstream Pfout;
+    std::ostringstream Pfilename;
+    Pfilename << output_path << "/" << filename_prefix << level_name << "." << time_step << "." << order << ".pvtu";
     if( _iproc != 0 ) {
-      Pfout.rdbuf();   //redirect to dev_null
+      Pfout.setstate( std::ios::badbit );   //only the root process prints the pvtu file
     }
     else {
-      std::ostringstream Pfilename;
-      Pfilename << output_path << "/" << filename_prefix << level_name << "." << time_step << "." << order << ".pvtu";
-      Pfout.open( Pfilename.str().c_str() );
-      if( Pfout.is_open() ) {
-        std::cout << std::endl << " The output is printed to file " << Pfilename.str() << " in parallel VTK-XML (64-based) format" << std::endl;
-      }
-      else {
-        std::cout << std::endl << " The output file " << Pfilename.str() << " cannot be opened.\n";
-        abort();
-      }
+      std::cout << std::endl << " The output is printed to file " << Pfilename.str() << " in parallel VTK-XML ("
+                << ( ( _appendedOutput ) ? "appended raw" : "64-based" ) << ( ( _compressedOutput ) ? ", zlib compressed" : "" )
+                << ") format" << std::endl;
     }
 
     // *********** write pvtu header ***********
@@ -137,128 +165,61 @@ namespace femus {
     // ****************************************
 
     Mesh* mesh = _ml_mesh->GetLevel( my_level - 1 );
-    Solution* solution = _ml_sol->GetSolutionLevel( my_level - 1 );
+    Solution* solution = ( _ml_sol != NULL ) ? _ml_sol->GetSolutionLevel( my_level - 1 ) : NULL;
 
-    //count the own node dofs on all levels
-    unsigned nvt = mesh->_ownSize[index][_iproc];
+    // ghost map, connectivity and the other mesh quantities are computed only the first time this level is printed
+    LevelCache &cache = GetLevelCache( my_level, index, mesh );
 
-    // count the ghost node dofs and the own element dofs element on all levels
-    unsigned ghostMapCounter = 0;
-    map < unsigned, unsigned > ghostMap;
-    unsigned counter = 0;
     unsigned elemetOffset = mesh->_elementOffset[_iproc];
     unsigned elemetOffsetp1 = mesh->_elementOffset[_iproc + 1];
-    unsigned nel = elemetOffsetp1 - elemetOffset;
-    unsigned dofOffset = mesh->_dofOffset[index][_iproc];
-    for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
-      short unsigned ielt = mesh->GetElementType( iel );
-      for( unsigned j = 0; j < mesh->GetElementDofNumber( iel, index ); j++ ) {
-        counter++;
-        unsigned jdof = mesh->GetSolutionDof( j, iel, index );
-        if( jdof < dofOffset ) { // check if jdof is a ghost node
-          if( ghostMap.find( jdof ) == ghostMap.end() ) {
-            ghostMap[jdof] = ghostMapCounter;
-            ghostMapCounter++;
-          }
-        }
-      }
-    }
-
-    unsigned nvtOwned = nvt;
-    nvt += ghostMap.size(); // total node dofs (own + ghost)
+    unsigned nel = cache.nel;
+    unsigned nvtOwned = cache.nvtOwned;
+    unsigned nvt = nvtOwned + cache.ghostDofs.size(); // total node dofs (own + ghost)
 
-    const unsigned dim_array_coord [] = { nvt * 3 * sizeof( float ) };
-    const unsigned dim_array_conn[]   = { counter * sizeof( int ) };
-    const unsigned dim_array_off []   = { nel * sizeof( int ) };
-    const unsigned dim_array_type []  = { nel * sizeof( short unsigned ) };
-    const unsigned dim_array_reg []   = { nel * sizeof( short unsigned ) };
-    const unsigned dim_array_elvar [] = { nel * sizeof( float ) };
-    const unsigned dim_array_ndvar [] = { nvt * sizeof( float ) };
+    NumericVector* mysol = cache.mysol;
 
     // initialize common buffer_void memory
-    unsigned buffer_size = ( dim_array_coord[0] > dim_array_conn[0] ) ? dim_array_coord[0] : dim_array_conn[0];
-    void* buffer_void = new char [buffer_size];
-    char* buffer_char = static_cast <char*>( buffer_void );
-
-    size_t cch;
-    cch = b64::b64_encode( &buffer_char[0], buffer_size , NULL, 0 );
-    vector <char> enc;
-    enc.resize( cch );
-    char* pt_char;
+    unsigned buffer_size = ( 3 * nvt > nel ) ? 3 * nvt : nel;
+    std::vector < float > buffer( buffer_size + 1 );
+    void* buffer_void = &buffer[0];
 
     fout  << "    <Piece NumberOfPoints= \"" << nvt << "\" NumberOfCells= \"" << nel << "\" >" << std::endl;
 
     //-----------------------------------------------------------------------------------------------
     // print coordinates *********************************************Solu*******************************************
     fout  << "      <Points>" << std::endl;
-    fout  << "        <DataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"binary\">" << std::endl;
-
     Pfout << "    <PPoints>" << std::endl;
-    Pfout << "      <PDataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"binary\"/>" << std::endl;
-
-    NumericVector* mysol;
-    mysol = NumericVector::build().release();
-
-    if( n_processors() == 1 ) { // IF SERIAL
-      mysol->init( mesh->_dofOffset[index][_nprocs],
-                   mesh->_dofOffset[index][_nprocs], false, SERIAL );
-    }
-    else { // IF PARALLEL
-      mysol->init( mesh->_dofOffset[index][_nprocs],
-                   mesh->_ownSize[index][_iproc],
-                   mesh->_ghostDofs[index][_iproc], false, GHOSTED );
-    }
 
     // point pointer to common mamory area buffer of void type;
     float* var_coord = static_cast<float*>( buffer_void );
 
-    for( int i = 0; i < 3; i++ ) {
-      if( !_surface ) {
-        mysol->matrix_mult( *mesh->_topology->_Sol[i],
-                            *mesh->GetQitoQjProjection( index, 2 ) );
-        if( _graph && i == 2 ) {
-          unsigned indGraph = _ml_sol->GetIndex( _graphVariable.c_str() );
-          mysol->matrix_mult( *solution->_Sol[indGraph],
-                              *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indGraph ) ) );
+    if( !_surface ) {
+      // the topology coordinates are projected again only if they have been changed
+      if( mesh->GetCoordinatesRevision() != cache.coordinatesRevision ) {
+        cache.coordinates.resize( 3 * nvt );
+        for( int i = 0; i < 3; i++ ) {
+          mysol->matrix_mult( *mesh->_topology->_Sol[i],
+                              *mesh->GetQitoQjProjection( index, 2 ) );
+          GetNodeValues( cache, &cache.coordinates[0], 3, i, false );
         }
+        cache.coordinatesRevision = mesh->GetCoordinatesRevision();
       }
-      else {
-        unsigned indSurfVar = _ml_sol->GetIndex( _surfaceVariables[i].c_str() );
-        mysol->matrix_mult( *solution->_Sol[indSurfVar],
-                            *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indSurfVar ) ) );
-      }
-      for( unsigned ii = 0; ii < nvtOwned; ii++ ) {
-        var_coord[ ii * 3 + i] = ( *mysol )( ii +  dofOffset );
+      for( unsigned ii = 0; ii < 3 * nvt; ii++ ) {
+        var_coord[ii] = cache.coordinates[ii];
       }
-      if( _ml_sol != NULL && _moving_mesh  && _ml_mesh->GetLevel( 0 )->GetDimension() > i )  { // if moving mesh
-        unsigned indDXDYDZ = _ml_sol->GetIndex( _moving_vars[i].c_str() );
-        mysol->matrix_mult( *solution->_Sol[indDXDYDZ],
-                            *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indDXDYDZ ) ) );
-        for( unsigned ii = 0; ii < nvtOwned; ii++ ) {
-          var_coord[ii * 3 + i] += ( *mysol )( ii +  dofOffset );
-        }
+      if( _graph ) {
+        unsigned indGraph = _ml_sol->GetIndex( _graphVariable.c_str() );
+        mysol->matrix_mult( *solution->_Sol[indGraph],
+                            *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indGraph ) ) );
+        GetNodeValues( cache, var_coord, 3, 2, false );
       }
     }
-    unsigned offset_ig = 3 * nvtOwned;
-
-    //print ghost nodes
-    for( int i = 0; i < 3; i++ ) {
-      if( !_surface ) {
-        mysol->matrix_mult( *mesh-> _topology->_Sol[i],
-                            *mesh-> GetQitoQjProjection( index, 2 ) );
-        if( _graph && i == 2 ) {
-          unsigned indGraphVar = _ml_sol->GetIndex( _graphVariable.c_str() );
-          mysol->matrix_mult( *solution->_Sol[indGraphVar],
-                              *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indGraphVar ) ) );
-        }
-      }
-      else {
+    else {
+      for( int i = 0; i < 3; i++ ) {
         unsigned indSurfVar = _ml_sol->GetIndex( _surfaceVariables[i].c_str() );
         mysol->matrix_mult( *solution->_Sol[indSurfVar],
                             *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indSurfVar ) ) );
-      }
-      for( std::map <unsigned, unsigned>::iterator it = ghostMap.begin(); it != ghostMap.end(); ++it ) {
-        var_coord[ offset_ig + 3 * it->second + i ] = ( *mysol )( it->first );
+        GetNodeValues( cache, var_coord, 3, i, false );
       }
     }
 
@@ -267,25 +228,12 @@ namespace femus {
         unsigned indDXDYDZ = _ml_sol->GetIndex( _moving_vars[i].c_str() );
         mysol->matrix_mult( *solution->_Sol[indDXDYDZ],
                             *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( indDXDYDZ ) ) );
-        for( std::map <unsigned, unsigned>::iterator it = ghostMap.begin(); it != ghostMap.end(); ++it ) {
-          var_coord[ offset_ig + 3 * it->second + i ] += ( *mysol )( it->first );
-        }
+        GetNodeValues( cache, var_coord, 3, i, true );
       }
     }
 
-    cch = b64::b64_encode( &dim_array_coord[0], sizeof( dim_array_coord ), NULL, 0 );
-    b64::b64_encode( &dim_array_coord[0], sizeof( dim_array_coord ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    //print coordinates array
-    cch = b64::b64_encode( &var_coord[0], dim_array_coord[0] , NULL, 0 );
-    b64::b64_encode( &var_coord[0], dim_array_coord[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    fout << std::endl;
+    PrintDataArray( fout, Pfout, piece, "Float32", "", 3, var_coord, nvt * 3 * sizeof( float ) );
 
-    fout  << "        </DataArray>" << std::endl;
     fout  << "      </Points>" << std::endl;
     Pfout << "    </PPoints>" << std::endl;
     //-----------------------------------------------------------------------------------------------
@@ -294,103 +242,12 @@ namespace femus {
     // Printing of element connectivity - offset - format type  *
     fout  << "      <Cells>" << std::endl;
     Pfout << "    <PCells>" << std::endl;
-    //-----------------------------------------------------------------------------------------------
-    //print connectivity
-    fout  << "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"Int32\" Name=\"connectivity\" format=\"binary\"/>" << std::endl;
-
-    // point pointer to common mamory area buffer of void type;
-    int* var_conn = static_cast <int*>( buffer_void );
-    icount = 0;
-    for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
-      for( unsigned j = 0; j < mesh->GetElementDofNumber( iel, index ); j++ ) {
-        unsigned loc_vtk_conn = (mesh->GetElementType( iel ) == 0)? FemusToVTKorToXDMFConn[j] : j;
-        unsigned jdof = mesh->GetSolutionDof( loc_vtk_conn, iel, index );
-        var_conn[icount] = ( jdof >= dofOffset ) ? jdof - dofOffset : nvtOwned + ghostMap[jdof];
-        icount++;
-      }
-    }
-
-    //print connectivity dimension
-    cch = b64::b64_encode( &dim_array_conn[0], sizeof( dim_array_conn ), NULL, 0 );
-    b64::b64_encode( &dim_array_conn[0], sizeof( dim_array_conn ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    //print connectivity array
-    cch = b64::b64_encode( &var_conn[0], dim_array_conn[0] , NULL, 0 );
-    b64::b64_encode( &var_conn[0], dim_array_conn[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    fout << std::endl;
-    fout << "        </DataArray>" << std::endl;
-    //------------------------------------------------------------------------------------------------
-
-    //-------------------------------------------------------------------------------------------------
-    //printing offset
-    fout  << "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"Int32\" Name=\"offsets\" format=\"binary\"/>" << std::endl;
-
-    // point pointer to common memory area buffer of void type;
-    int* var_off = static_cast <int*>( buffer_void );
-    icount = 0;
-    int offset_el = 0;
-    // print offset array
-    for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
-      offset_el += mesh->GetElementDofNumber( iel, index );
-      var_off[icount] = offset_el;
-      icount++;
-    }
-
-    //print offset dimension
-    cch = b64::b64_encode( &dim_array_off[0], sizeof( dim_array_off ), NULL, 0 );
-    b64::b64_encode( &dim_array_off[0], sizeof( dim_array_off ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    //print offset array
-    cch = b64::b64_encode( &var_off[0], dim_array_off[0] , NULL, 0 );
-    b64::b64_encode( &var_off[0], dim_array_off[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    fout  << std::endl;
-
-    fout  << "        </DataArray>" << std::endl;
-
-    //--------------------------------------------------------------------------------------------------
-
-    //--------------------------------------------------------------------------------------------------
 
+    PrintDataArray( fout, Pfout, piece, "Int32", "connectivity", 1, cache.connectivity.data(), cache.connectivity.size() * sizeof( int ) );
+    PrintDataArray( fout, Pfout, piece, "Int32", "offsets", 1, cache.offsets.data(), nel * sizeof( int ) );
     //Element format type : 23:Serendipity(8-nodes)  28:Quad9-Biquadratic
-    fout  << "        <DataArray type=\"UInt16\" Name=\"types\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"UInt16\" Name=\"types\" format=\"binary\"/>" << std::endl;
+    PrintDataArray( fout, Pfout, piece, "UInt16", "types", 1, cache.types.data(), nel * sizeof( unsigned short ) );
 
-    // point pointer to common mamory area buffer of void type;
-    unsigned short* var_type = static_cast <unsigned short*>( buffer_void );
-    icount = 0;
-    for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
-      short unsigned ielt = mesh->GetElementType( iel );
-      var_type[icount] = femusToVtkCellType[index][ielt];
-      icount++;
-    }
-
-    //print element format dimension
-    cch = b64::b64_encode( &dim_array_type[0], sizeof( dim_array_type ), NULL, 0 );
-    b64::b64_encode( &dim_array_type[0], sizeof( dim_array_type ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    //print element format array
-    cch = b64::b64_encode( &var_type[0], dim_array_type[0] , NULL, 0 );
-    b64::b64_encode( &var_type[0], dim_array_type[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    fout  << std::endl;
-    fout  << "        </DataArray>" << std::endl;
-    //----------------------------------------------------------------------------------------------------
-//
     fout  << "      </Cells>" << std::endl;
     Pfout << "    </PCells>" << std::endl;
     //--------------------------------------------------------------------------------------------------
@@ -399,149 +256,50 @@ namespace femus {
     fout  << "      <CellData Scalars=\"scalars\">" << std::endl;
     Pfout << "    <PCellData Scalars=\"scalars\">" << std::endl;
 
-    unsigned short* var_reg = static_cast <unsigned short*>( buffer_void );
-
     // Print Metis Partitioning
-    fout  << "        <DataArray type=\"UInt16\" Name=\"Metis partition\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"UInt16\" Name=\"Metis partition\" format=\"binary\"/>" << std::endl;
-
     // point pointer to common mamory area buffer of void type;
     unsigned short* var_proc = static_cast <unsigned short*>( buffer_void );
-
-    icount = 0;
-    for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
-      var_proc[icount] = _iproc;
-      icount++;
+    for( unsigned iel = 0; iel < nel; iel++ ) {
+      var_proc[iel] = _iproc;
     }
-
-    //print regions dimension
-    cch = b64::b64_encode( &dim_array_reg[0], sizeof( dim_array_reg ), NULL, 0 );
-    b64::b64_encode( &dim_array_reg[0], sizeof( dim_array_reg ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-
-    //print regions array
-    cch = b64::b64_encode( &var_proc[0], dim_array_reg[0] , NULL, 0 );
-    b64::b64_encode( &var_proc[0], dim_array_reg[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-    fout  << std::endl;
-    fout  << "        </DataArray>" << std::endl;
-
+    PrintDataArray( fout, Pfout, piece, "UInt16", "Metis partition", 1, var_proc, nel * sizeof( unsigned short ) );
 
     //BEGIN SARA&GIACOMO
-
+    float* var_el = static_cast< float*>( buffer_void );
 
     //-------------------------------------------MATERIAL---------------------------------------------------------
-
-    //NumericVector& material =  mesh->_topology->GetSolutionName( "Material" );
-
-    fout  << "        <DataArray type=\"Float32\" Name=\"" << "Material" << "\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"Float32\" Name=\"" << "Material" << "\" format=\"binary\"/>" << std::endl;
-    // point pointer to common memory area buffer of void type;
-    float* var_el = static_cast< float*>( buffer_void );
     icount = 0;
     for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
       var_el[icount] = mesh->GetElementMaterial(iel); 
       icount++;
     }
-
-    //print solution on element dimension
-    cch = b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), NULL, 0 );
-    b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    //print solution on element array
-    cch = b64::b64_encode( &var_el[0], dim_array_elvar[0] , NULL, 0 );
-    b64::b64_encode( &var_el[0], dim_array_elvar[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    fout << std::endl;
-    fout << "        </DataArray>" << std::endl;
+    PrintDataArray( fout, Pfout, piece, "Float32", "Material", 1, var_el, nel * sizeof( float ) );
 
     //------------------------------------------------------GROUP-----------------------------------------------------------
-
-    //NumericVector& group =  mesh->_topology->GetSolutionName( "Group" );
-
-    fout  << "        <DataArray type=\"Float32\" Name=\"" << "Group" << "\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"Float32\" Name=\"" << "Group" << "\" format=\"binary\"/>" << std::endl;
-    // point pointer to common memory area buffer of void type;
-    var_el = static_cast< float*>( buffer_void );
     icount = 0;
     for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
       var_el[icount] = mesh->GetElementGroup(iel);
       icount++;
     }
-    //print solution on element dimension
-    cch = b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), NULL, 0 );
-    b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    //print solution on element array
-    cch = b64::b64_encode( &var_el[0], dim_array_elvar[0] , NULL, 0 );
-    b64::b64_encode( &var_el[0], dim_array_elvar[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    fout << std::endl;
-    fout << "        </DataArray>" << std::endl;
+    PrintDataArray( fout, Pfout, piece, "Float32", "Group", 1, var_el, nel * sizeof( float ) );
 
     //-------------------------------------------------------TYPE--------------------------------------------------
-   // NumericVector& type =  mesh->_topology->GetSolutionName( "Type" );
-
-    fout  << "        <DataArray type=\"Float32\" Name=\"" << "TYPE" << "\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"Float32\" Name=\"" << "TYPE" << "\" format=\"binary\"/>" << std::endl;
-    // point pointer to common memory area buffer of void type;
-    var_el = static_cast< float*>( buffer_void );
     icount = 0;
     for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
       var_el[icount] = mesh->GetElementType(iel);
       icount++;
     }
-    //print solution on element dimension
-    cch = b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), NULL, 0 );
-    b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    //print solution on element array
-    cch = b64::b64_encode( &var_el[0], dim_array_elvar[0] , NULL, 0 );
-    b64::b64_encode( &var_el[0], dim_array_elvar[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    fout << std::endl;
-    fout << "        </DataArray>" << std::endl;
+    PrintDataArray( fout, Pfout, piece, "Float32", "TYPE", 1, var_el, nel * sizeof( float ) );
 
-    
-    //-------------------------------------------------------TYPE--------------------------------------------------
-    fout  << "      <DataArray type=\"Float32\" Name=\"" << "Level" << "\" format=\"binary\">" << std::endl;
-    Pfout << "      <PDataArray type=\"Float32\" Name=\"" << "Level" << "\" format=\"binary\"/>" << std::endl;
-    // point pointer to common memory area buffer of void type;
-    var_el = static_cast< float*>( buffer_void );
+    //-------------------------------------------------------LEVEL--------------------------------------------------
     icount = 0;
     for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
       var_el[icount] = mesh->el->GetElementLevel(iel);
       icount++;
     }
-    //print solution on element dimension
-    cch = b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), NULL, 0 );
-    b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    //print solution on element array
-    cch = b64::b64_encode( &var_el[0], dim_array_elvar[0] , NULL, 0 );
-    b64::b64_encode( &var_el[0], dim_array_elvar[0], &enc[0], cch );
-    pt_char = &enc[0];
-    for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-    fout << std::endl;
-    fout << "        </DataArray>" << std::endl;
-    
-    
-    //END SARA&GIACOMO
+    PrintDataArray( fout, Pfout, piece, "Float32", "Level", 1, var_el, nel * sizeof( float ) );
 
-    if( _ml_sol == NULL ) {
-      delete [] var_proc;
-    }
+    //END SARA&GIACOMO
 
     bool print_all = 0;
     for( unsigned ivar = 0; ivar < vars.size(); ivar++ ) {
@@ -563,10 +321,6 @@ namespace femus {
             else if( name == 2 ) printName = "Res" + solName;
             else printName = "Eps" + solName;
 
-            fout  << "        <DataArray type=\"Float32\" Name=\"" << printName << "\" format=\"binary\">" << std::endl;
-            Pfout << "      <PDataArray type=\"Float32\" Name=\"" << printName << "\" format=\"binary\"/>" << std::endl;
-            // point pointer to common memory area buffer of void type;
-            float* var_el = static_cast< float*>( buffer_void );
             icount = 0;
             for( int iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
               unsigned iel_Metis = mesh->GetSolutionDof( 0, iel, _ml_sol->GetSolutionType( i ) );
@@ -580,20 +334,7 @@ namespace femus {
                 var_el[icount] = ( *solution->_Eps[i] )( iel_Metis );
               icount++;
             }
-
-            //print solution on element dimension
-            cch = b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), NULL, 0 );
-            b64::b64_encode( &dim_array_elvar[0], sizeof( dim_array_elvar ), &enc[0], cch );
-            pt_char = &enc[0];
-            for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-            //print solution on element array
-            cch = b64::b64_encode( &var_el[0], dim_array_elvar[0] , NULL, 0 );
-            b64::b64_encode( &var_el[0], dim_array_elvar[0], &enc[0], cch );
-            pt_char = &enc[0];
-            for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-            fout << std::endl;
-            fout << "        </DataArray>" << std::endl;
+            PrintDataArray( fout, Pfout, piece, "Float32", printName, 1, var_el, nel * sizeof( float ) );
           }
         }
       } //end _ml_sol != NULL
@@ -626,18 +367,6 @@ namespace femus {
             else if( name == 2 ) printName = "Res" + solName;
             else printName = "Eps" + solName;
 
-            fout  << "        <DataArray type=\"Float32\" Name=\"" << printName << "\" format=\"binary\">" << std::endl;
-            Pfout << "      <PDataArray type=\"Float32\" Name=\"" << printName << "\" format=\"binary\"/>" << std::endl;
-
-            //print solutions on nodes dimension
-            cch = b64::b64_encode( &dim_array_ndvar[0], sizeof( dim_array_ndvar ), NULL, 0 );
-            b64::b64_encode( &dim_array_ndvar[0], sizeof( dim_array_ndvar ), &enc[0], cch );
-            pt_char = &enc[0];
-            for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-
-            unsigned offset_iprc = mesh->_dofOffset[index][_iproc];
-            unsigned nvt_ig = mesh->_ownSize[index][_iproc];
-
             if( name == 0 )
               mysol->matrix_mult( *solution->_Sol[solIndex],
                                   *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( solIndex ) ) );
@@ -651,50 +380,258 @@ namespace femus {
               mysol->matrix_mult( *solution->_Eps[solIndex],
                                   *mesh->GetQitoQjProjection( index, _ml_sol->GetSolutionType( solIndex ) ) );
 
-            for( unsigned ii = 0; ii < nvt_ig; ii++ ) {
-              var_nd[ ii ] = ( *mysol )( ii + offset_iprc );
-            }
-            unsigned offset_ig = nvtOwned;
-
-            for( std::map <unsigned, unsigned>::iterator it = ghostMap.begin(); it != ghostMap.end(); ++it ) {
-              var_nd[ offset_ig + it->second ] = ( *mysol )( it->first );
-            }
-
-            cch = b64::b64_encode( &var_nd[0], dim_array_ndvar [0], NULL, 0 );
-            b64::b64_encode( &var_nd[0], dim_array_ndvar [0], &enc[0], cch );
-            pt_char = &enc[0];
-            for( unsigned i = 0; i < cch; i++, pt_char++ ) fout << *pt_char;
-            fout << std::endl;
+            GetNodeValues( cache, var_nd, 1, 0, false );
 
-            fout  << "        </DataArray>" << std::endl;
+            PrintDataArray( fout, Pfout, piece, "Float32", printName, 1, var_nd, nvt * sizeof( float ) );
           }
         } //endif
       } // end for sol
       fout  << "      </PointData>" << std::endl;
       Pfout << "    </PPointData>" << std::endl;
-      delete [] var_nd;
     }  //end _ml_sol != NULL
 
     //------------------------------------------------------------------------------------------------
 
     fout << "    </Piece>" << std::endl;
     fout << "  </UnstructuredGrid>" << std::endl;
-    fout << "</VTKFile>" << std::endl;
-    fout.close();
+    piece->SetTail( fout.str() );
+    Submit( piece );
 
     Pfout << "  </PUnstructuredGrid>" << std::endl;
     Pfout << "</VTKFile>" << std::endl;
-    Pfout.close();
-
-
-    //-----------------------------------------------------------------------------------------------------
-    //free memory
-    delete mysol;
+    if( _iproc == 0 ) {
+      Submit( new WriterFileTask( Pfilename.str(), Pfout.str() ) );
+    }
 
     //--------------------------------------------------------------------------------------------------------
     return;
   }
 
+
+  VTKWriter::LevelCache& VTKWriter::GetLevelCache( const unsigned &level, const unsigned &index, Mesh* mesh ) {
+
+    unsigned elemetOffset = mesh->_elementOffset[_iproc];
+    unsigned elemetOffsetp1 = mesh->_elementOffset[_iproc + 1];
+    unsigned nel = elemetOffsetp1 - elemetOffset;
+    unsigned dofOffset = mesh->_dofOffset[index][_iproc];
+    unsigned nvtOwned = mesh->_ownSize[index][_iproc];
+
+    unsigned key = 3 * level + index;
+    std::map < unsigned, LevelCache >::iterator it = _levelCache.find( key );
+    if( it != _levelCache.end() ) {
+      LevelCache &cache = it->second;
+      if( cache.mesh == mesh && cache.nel == nel && cache.dofOffset == dofOffset && cache.nvtOwned == nvtOwned ) {
+        return cache;
+      }
+      delete cache.mysol;
+      _levelCache.erase( it );
+    }
+
+    LevelCache &cache = _levelCache[key];
+    cache.mesh = mesh;
+    cache.nel = nel;
+    cache.dofOffset = dofOffset;
+    cache.nvtOwned = nvtOwned;
+
+    // count the ghost node dofs
+    std::map < unsigned, unsigned > ghostMap;
+    unsigned counter = 0;
+    for( unsigned iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
+      for( unsigned j = 0; j < mesh->GetElementDofNumber( iel, index ); j++ ) {
+        counter++;
+        unsigned jdof = mesh->GetSolutionDof( j, iel, index );
+        if( jdof < dofOffset ) { // check if jdof is a ghost node
+          if( ghostMap.find( jdof ) == ghostMap.end() ) {
+            unsigned ghostMapCounter = ghostMap.size();
+            ghostMap[jdof] = ghostMapCounter;
+          }
+        }
+      }
+    }
+    cache.ghostDofs.resize( ghostMap.size() );
+    for( std::map <unsigned, unsigned>::iterator it = ghostMap.begin(); it != ghostMap.end(); ++it ) {
+      cache.ghostDofs[it->second] = it->first;
+    }
+
+    //connectivity
+    cache.connectivity.resize( counter );
+    unsigned icount = 0;
+    for( unsigned iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
+      for( unsigned j = 0; j < mesh->GetElementDofNumber( iel, index ); j++ ) {
+        unsigned loc_vtk_conn = ( mesh->GetElementType( iel ) == 0 ) ? FemusToVTKorToXDMFConn[j] : j;
+        unsigned jdof = mesh->GetSolutionDof( loc_vtk_conn, iel, index );
+        cache.connectivity[icount] = ( jdof >= dofOffset ) ? jdof - dofOffset : nvtOwned + ghostMap[jdof];
+        icount++;
+      }
+    }
+
+    //offsets and types
+    cache.offsets.resize( nel );
+    cache.types.resize( nel );
+    int offset_el = 0;
+    for( unsigned iel = elemetOffset; iel < elemetOffsetp1; iel++ ) {
+      offset_el += mesh->GetElementDofNumber( iel, index );
+      cache.offsets[iel - elemetOffset] = offset_el;
+      cache.types[iel - elemetOffset] = femusToVtkCellType[index][mesh->GetElementType( iel )];
+    }
+
+    cache.coordinates.clear();
+    cache.coordinatesRevision = UINT_MAX;
+
+    cache.mysol = NumericVector::build().release();
+    if( n_processors() == 1 ) { // IF SERIAL
+      cache.mysol->init( mesh->_dofOffset[index][_nprocs],
+                         mesh->_dofOffset[index][_nprocs], false, SERIAL );
+    }
+    else { // IF PARALLEL
+      cache.mysol->init( mesh->_dofOffset[index][_nprocs],
+                         mesh->_ownSize[index][_iproc],
+                         mesh->_ghostDofs[index][_iproc], false, GHOSTED );
+    }
+
+    return cache;
+  }
+
+
+  void VTKWriter::GetNodeValues( const LevelCache &cache, float* var, const unsigned &stride, const unsigned &component, const bool &add ) const {
+    const NumericVector &mysol = *cache.mysol;
+    for( unsigned ii = 0; ii < cache.nvtOwned; ii++ ) {
+      float value = mysol( ii + cache.dofOffset );
+      var[ii * stride + component] = ( add ) ? var[ii * stride + component] + value : value;
+    }
+    float* var_ig = var + cache.nvtOwned * stride;
+    for( unsigned k = 0; k < cache.ghostDofs.size(); k++ ) {
+      float value = mysol( cache.ghostDofs[k] );
+      var_ig[k * stride + component] = ( add ) ? var_ig[k * stride + component] + value : value;
+    }
+  }
+
+
+  void VTKWriter::PrintDataArray( std::ostringstream &fout, std::ostringstream &Pfout, VTKPieceTask* piece, const char type[], const std::string &name,
+                                  const unsigned &numberOfComponents, const void* data, const unsigned &size ) {
+
+    std::ostringstream attributes;
+    attributes << "type=\"" << type << "\"";
+    if( name.size() > 0 ) attributes << " Name=\"" << name << "\"";
+    if( numberOfComponents > 1 ) attributes << " NumberOfComponents=\"" << numberOfComponents << "\"";
+
+    Pfout << "      <PDataArray " << attributes.str() << " format=\"" << ( ( _appendedOutput ) ? "appended" : "binary" ) << "\"/>" << std::endl;
+
+    piece->AddDataArray( fout.str(), attributes.str(), data, size );
+    fout.str( "" );
+  }
+
+
+  VTKPieceTask::VTKPieceTask( const std::string &filename, const bool &appended, const bool &compressed ) {
+    _filename = filename;
+    _appended = appended;
+    _compressed = compressed;
+  }
+
+  void VTKPieceTask::AddDataArray( const std::string &text, const std::string &attributes, const void* data, const unsigned &size ) {
+    _text.push_back( text );
+    _attributes.push_back( attributes );
+    const char* pt_char = static_cast <const char*>( data );
+    _data.push_back( std::vector < char > ( pt_char, pt_char + size ) );
+  }
+
+  void VTKPieceTask::EncodeDataArray( const unsigned &k, std::vector < unsigned > &header, std::vector < char > &compressedData,
+                                      const char* &payload, unsigned &payloadSize ) const {
+
+    // the header is the UInt32 byte count of the data, or the zlib block table (number of blocks, block size,
+    // size of the last partial block, compressed size of each block) followed by the compressed blocks
+    unsigned size = _data[k].size();
+    payload = ( size > 0 ) ? &_data[k][0] : NULL;
+    payloadSize = size;
+
+#ifdef HAVE_ZLIB
+    if( _compressed ) {
+      const unsigned blockSize = 1u << 16;
+      unsigned nBlocks = ( size + blockSize - 1 ) / blockSize;
+      header.assign( 3 + nBlocks, 0 );
+      header[0] = nBlocks;
+      header[1] = blockSize;
+      header[2] = size % blockSize;
+
+      compressedData.resize( nBlocks * compressBound( blockSize ) + 1 );
+      payloadSize = 0;
+      for( unsigned b = 0; b < nBlocks; b++ ) {
+        uLong blockBytes = ( b == nBlocks - 1 && header[2] != 0 ) ? header[2] : blockSize;
+        uLongf compressedBytes = compressBound( blockBytes );
+        compress2( reinterpret_cast <Bytef*>( &compressedData[payloadSize] ), &compressedBytes,
+                   reinterpret_cast <const Bytef*>( payload + b * blockSize ), blockBytes, Z_BEST_SPEED );
+        header[3 + b] = compressedBytes;
+        payloadSize += compressedBytes;
+      }
+      payload = &compressedData[0];
+      return;
+    }
+#else
+    ( void ) compressedData; // the buffer of the compressed blocks is used only with zlib
+#endif
+    header.assign( 1, size );
+  }
+
+  void VTKPieceTask::Execute() {
+
+    std::ofstream fout;
+    fout.open( _filename.c_str(), std::ios::out | std::ios::binary );
+    if( !fout.is_open() ) {
+      std::cout << std::endl << " The output file " << _filename << " cannot be opened.\n";
+      abort();
+    }
+
+    std::vector < char > appendedData;
+    std::vector < unsigned > header;
+    std::vector < char > compressedData;
+    std::vector < char > enc;
+
+    for( unsigned k = 0; k < _data.size(); k++ ) {
+      const char* payload;
+      unsigned payloadSize;
+      EncodeDataArray( k, header, compressedData, payload, payloadSize );
+
+      const char* pt_header = reinterpret_cast <const char*>( &header[0] );
+      unsigned headerSize = header.size() * sizeof( unsigned );
+
+      fout << _text[k];
+      if( _appended ) {
+        fout << "        <DataArray " << _attributes[k] << " format=\"appended\" offset=\"" << appendedData.size() << "\"/>" << std::endl;
+        appendedData.insert( appendedData.end(), pt_header, pt_header + headerSize );
+        if( payloadSize > 0 ) appendedData.insert( appendedData.end(), payload, payload + payloadSize );
+      }
+      else {
+        fout << "        <DataArray " << _attributes[k] << " format=\"binary\">" << std::endl;
+
+        // header and data are base64 encoded separately
+        size_t cch = b64::b64_encode( pt_header, headerSize, NULL, 0 );
+        enc.resize( cch + 1 );
+        b64::b64_encode( pt_header, headerSize, &enc[0], cch );
+        fout.write( &enc[0], cch );
+
+        cch = b64::b64_encode( payload, payloadSize, NULL, 0 );
+        enc.resize( cch + 1 );
+        b64::b64_encode( payload, payloadSize, &enc[0], cch );
+        fout.write( &enc[0], cch );
+        fout << std::endl;
+
+        fout << "        </DataArray>" << std::endl;
+      }
+      std::vector < char > ().swap( _data[k] );
+    }
+
+    fout << _tail;
+    if( _appended ) {
+      fout << "  <AppendedData encoding=\"raw\">" << std::endl;
+      fout << "   _";
+      if( appendedData.size() > 0 ) fout.write( &appendedData[0], appendedData.size() );
+      fout << std::endl;
+      fout << "  </AppendedData>" << std::endl;
+    }
+    fout << "</VTKFile>" << std::endl;
+    fout.close();
+  }
+
 } //end namespace femus
 
 
@@ -20,6 +20,9 @@
 // includes :
 //----------------------------------------------------------------------------
 #include "Writer.hpp"
+#include "WriterQueue.hpp"
+#include <map>
+#include <sstream>
 
 
 namespace femus {
@@ -30,6 +33,38 @@ namespace femus {
 // Forward declarations
 //------------------------------------------------------------------------------
 class MultiLevelProblem;
+class Mesh;
+class NumericVector;
+
+/** A staged vtu file: the xml text and a copy of the data arrays, that are encoded (base64 or appended raw, optionally zlib compressed)
+ * and written in Execute */
+class VTKPieceTask : public WriterTask {
+
+public:
+
+    VTKPieceTask( const std::string &filename, const bool &appended, const bool &compressed );
+
+    /** text is the xml that precedes the DataArray */
+    void AddDataArray( const std::string &text, const std::string &attributes, const void* data, const unsigned &size );
+
+    /** xml that follows the last DataArray, up to the closing of UnstructuredGrid */
+    void SetTail( const std::string &text ){ _tail = text;}
+
+    void Execute();
+
+  private:
+
+    void EncodeDataArray( const unsigned &k, std::vector < unsigned > &header, std::vector < char > &compressedData,
+                          const char* &payload, unsigned &payloadSize ) const;
+
+    std::string _filename;
+    bool _appended;
+    bool _compressed;
+    std::vector < std::string > _text;
+    std::vector < std::string > _attributes;
+    std::vector < std::vector < char > > _data;
+    std::string _tail;
+};
 
 
 class VTKWriter : public Writer {
@@ -60,9 +95,46 @@ public:
     /** Set if to print or not to prind the debugging variables */
     void SetDebugOutput( bool value ){ _debugOutput = value;}
 
+    /** Write the data arrays as raw binary in the AppendedData section of the vtu files instead of inline base64 */
+    void SetAppendedOutput( bool value ){ _appendedOutput = value;}
+
+    /** Compress the data arrays with zlib, it is ignored if femus is built without zlib */
+    void SetCompressedOutput( bool value );
+
+    /** Drop the cached ghost maps, connectivities and coordinates, call it if the mesh coordinates are changed by hand */
+    void ClearCache();
+
   private:
 
+    /** Level quantities that do not change between time steps while the mesh is unchanged */
+    struct LevelCache {
+      Mesh* mesh;
+      unsigned nel;
+      unsigned nvtOwned;
+      unsigned dofOffset;
+      std::vector < unsigned > ghostDofs; // global dof of the ghost node nvtOwned + i
+      std::vector < int > connectivity;
+      std::vector < int > offsets;
+      std::vector < unsigned short > types;
+      std::vector < float > coordinates; // [nvt][3], topology coordinates only
+      unsigned coordinatesRevision; // Mesh::GetCoordinatesRevision of the projected coordinates
+      NumericVector* mysol;
+    };
+
+    LevelCache& GetLevelCache( const unsigned &level, const unsigned &index, Mesh* mesh );
+
+    /** Copy the owned and ghost values of the projected solution in var[node * stride + component] */
+    void GetNodeValues( const LevelCache &cache, float* var, const unsigned &stride, const unsigned &component, const bool &add ) const;
+
+    /** Print the PDataArray tag and stage a copy of the data in piece, fout holds the vtu text that precedes the DataArray */
+    void PrintDataArray( std::ostringstream &fout, std::ostringstream &Pfout, VTKPieceTask* piece, const char type[], const std::string &name,
+                         const unsigned &numberOfComponents, const void* data, const unsigned &size );
+
     bool _debugOutput;
+    bool _appendedOutput;
+    bool _compressedOutput;
+
+    std::map < unsigned, LevelCache > _levelCache; // key: 3 * level + order index
 
     /** femus to vtk cell type map */
     static short unsigned int femusToVtkCellType[3][6];
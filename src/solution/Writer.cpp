@@ -28,6 +28,7 @@
 #include "VTKWriter.hpp"
 #include "GMVWriter.hpp"
 #include "XDMFWriter.hpp"
+#include "WriterQueue.hpp"
 
 
 
@@ -43,6 +44,7 @@ namespace femus {
     _moving_mesh = 0;
     _graph = false;
     _surface = false;
+    _queue = NULL;
   }
 
   Writer::Writer( MultiLevelMesh* ml_mesh ):
@@ -52,9 +54,12 @@ namespace femus {
     _moving_mesh = 0;
     _graph = false;
     _surface = false;
+    _queue = NULL;
   }
 
-  Writer::~Writer() { }
+  Writer::~Writer() {
+    if(_queue != NULL) delete _queue;
+  }
 
 
   std::unique_ptr<Writer> Writer::build(const WriterEnum format, MultiLevelSolution * ml_sol)  {
@@ -97,6 +102,28 @@ namespace femus {
 
   }
 
+  void Writer::SetAsynchronousOutput(const bool &value, const unsigned &maxQueueSize){
+    if(_queue != NULL) {
+      delete _queue;
+      _queue = NULL;
+    }
+    if(value) _queue = new WriterQueue(maxQueueSize);
+  }
+
+  void Writer::Flush(){
+    if(_queue != NULL) _queue->Flush();
+  }
+
+  void Writer::Submit(WriterTask* task){
+    if(_queue != NULL) {
+      _queue->Push(task);
+    }
+    else {
+      task->Execute();
+      delete task;
+    }
+  }
+
   void Writer::SetMovingMesh(std::vector<std::string>& movvars_in){
     _moving_mesh = 1;
     _moving_vars = movvars_in;
@@ -36,6 +36,8 @@ namespace femus {
   class MultiLevelSolution;
   class SparseMatrix;
   class Vector;
+  class WriterTask;
+  class WriterQueue;
 
 
   class Writer : public ParallelObject {
@@ -82,8 +84,21 @@ namespace femus {
     void SetSurfaceVariables( std::vector < std::string > &surfaceVariable );
     void UnsetSurfaceVariables(){ _surface = false;};
 
+    /** Stage the output files in memory and write them from a background thread, Write returns as soon as the data is staged.
+     * At most maxQueueSize files wait in the queue. Writers that cannot stage their output keep writing synchronously */
+    void SetAsynchronousOutput( const bool &value, const unsigned &maxQueueSize = 4 );
+
+    /** Wait until all the staged output files are written, it is also called by the destructor */
+    void Flush();
+
   protected:
 
+    /** Execute the task now, or queue it in asynchronous mode; the writer takes ownership of the task */
+    void Submit( WriterTask* task );
+
+    /** the background output queue, NULL in synchronous mode */
+    WriterQueue* _queue;
+
     /** a flag to move the output mesh */
     int _moving_mesh;
 
@@ -0,0 +1,98 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: WriterQueue
+ Authors: Eugenio Aulisa, Simone Bnà, Giorgio Bornia
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "WriterQueue.hpp"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+namespace femus {
+
+  void WriterFileTask::Execute() {
+    std::ofstream fout;
+    fout.open(_filename.c_str(), std::ios::out | std::ios::binary);
+    if(!fout.is_open()) {
+      std::cout << std::endl << " The output file " << _filename << " cannot be opened.\n";
+      abort();
+    }
+    fout.write(_data.c_str(), _data.size());
+    fout.close();
+  }
+
+  WriterQueue::WriterQueue(const unsigned &maxSize) {
+    _maxSize = (maxSize > 0) ? maxSize : 1;
+    _busy = false;
+    _stop = false;
+    _thread = std::thread(&WriterQueue::Run, this);
+  }
+
+  WriterQueue::~WriterQueue() {
+    Flush();
+    {
+      std::lock_guard < std::mutex > lock(_mutex);
+      _stop = true;
+    }
+    _taskCondition.notify_one();
+    _thread.join();
+  }
+
+  void WriterQueue::Push(WriterTask* task) {
+    {
+      std::unique_lock < std::mutex > lock(_mutex);
+      while(_tasks.size() >= _maxSize) {
+        _doneCondition.wait(lock);
+      }
+      _tasks.push_back(task);
+    }
+    _taskCondition.notify_one();
+  }
+
+  void WriterQueue::Flush() {
+    std::unique_lock < std::mutex > lock(_mutex);
+    while(!_tasks.empty() || _busy) {
+      _doneCondition.wait(lock);
+    }
+  }
+
+  void WriterQueue::Run() {
+    while(true) {
+      WriterTask* task;
+      {
+        std::unique_lock < std::mutex > lock(_mutex);
+        while(_tasks.empty() && !_stop) {
+          _taskCondition.wait(lock);
+        }
+        if(_tasks.empty()) return;
+        task = _tasks.front();
+        _tasks.pop_front();
+        _busy = true;
+      }
+      _doneCondition.notify_all();
+
+      task->Execute();
+      delete task;
+
+      {
+        std::lock_guard < std::mutex > lock(_mutex);
+        _busy = false;
+      }
+      _doneCondition.notify_all();
+    }
+  }
+
+} //end namespace femus
@@ -0,0 +1,89 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: WriterQueue
+ Authors: Eugenio Aulisa, Simone Bnà, Giorgio Bornia
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_solution_WriterQueue_hpp__
+#define __femus_solution_WriterQueue_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace femus {
+
+  /**
+   * A staged output file. It owns a copy of all the data it needs, so that it can be executed
+   * after the solution has changed and from a thread that does not make any MPI or PETSc call.
+   */
+  class WriterTask {
+    public:
+      virtual ~WriterTask() {};
+
+      /** format and write the file */
+      virtual void Execute() = 0;
+  };
+
+  /** A file whose content is already formatted */
+  class WriterFileTask : public WriterTask {
+    public:
+      WriterFileTask(const std::string &filename, const std::string &data): _filename(filename), _data(data) {};
+
+      void Execute();
+
+    private:
+      std::string _filename;
+      std::string _data;
+  };
+
+  /**
+   * Bounded queue of output files written by a background thread.
+   * Push blocks while the queue is full, so at most maxSize staged files are kept in memory.
+   */
+  class WriterQueue {
+    public:
+
+      WriterQueue(const unsigned &maxSize);
+
+      /** Flush the queue and stop the thread */
+      ~WriterQueue();
+
+      /** Queue the task, the queue takes ownership */
+      void Push(WriterTask* task);
+
+      /** Wait until all the queued tasks have been executed */
+      void Flush();
+
+    private:
+
+      void Run();
+
+      std::deque < WriterTask* > _tasks;
+      unsigned _maxSize;
+      bool _busy;
+      bool _stop;
+
+      std::mutex _mutex;
+      std::condition_variable _taskCondition;
+      std::condition_variable _doneCondition;
+      std::thread _thread;
+  };
+
+} //end namespace femus
+
+#endif
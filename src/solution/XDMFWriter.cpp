@@ -27,6 +27,7 @@
 #include <cstring>
 #include <sstream>
 #include <iomanip>
+#include "Profiler.hpp"
 
 #ifdef HAVE_HDF5
 #include "hdf5.h"
@@ -67,6 +68,8 @@ namespace femus {
 
 #ifdef HAVE_HDF5
 
+    ProfilerTimer timer("Output");
+
     bool print_all = 0;
     for( unsigned ivar = 0; ivar < vars.size(); ivar++ ) {
       print_all += !( vars[ivar].compare( "All" ) ) + !( vars[ivar].compare( "all" ) ) + !( vars[ivar].compare( "ALL" ) );
@@ -17,7 +17,9 @@
 // includes :
 //----------------------------------------------------------------------------
 #include <iostream>
+#include <cstring>
 #include "FemusInit.hpp"
+#include "Profiler.hpp"
 
 namespace femus {
 
@@ -52,12 +54,28 @@ FemusInit::FemusInit(
 
    std::cout << " FemusInit(): PETSC_COMM_WORLD initialized" << std::endl << std::endl;
 
+   // -femus_profile <report.json|report.csv> [-femus_profile_log_stages]
+   bool usePetscLogStages = false;
+   for(int j = 1; j < argc; j++) {
+     if(!strcmp(argv[j], "-femus_profile_log_stages")) usePetscLogStages = true;
+   }
+   for(int j = 1; j < argc; j++) {
+     if(!strcmp(argv[j], "-femus_profile") && j + 1 < argc) {
+       Profiler::Enable(usePetscLogStages);
+       Profiler::SetReportFile(argv[j + 1]);
+     }
+   }
+
     return;
 }
 
 
 FemusInit::~FemusInit() {
 
+    if(Profiler::IsEnabled() && !Profiler::GetReportFile().empty()) {
+      Profiler::WriteReport(Profiler::GetReportFile());
+    }
+
 #ifdef HAVE_PETSC
     PetscFinalize();
     std::cout << std::endl << " ~FemusInit(): PETSC_COMM_WORLD ends" << std::endl;
@@ -0,0 +1,226 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: Profiler
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include "Profiler.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+namespace femus {
+
+  bool Profiler::_enabled = false;
+  bool Profiler::_usePetscLogStages = false;
+  std::string Profiler::_reportFile;
+  std::vector < Profiler::Region > Profiler::_region;
+  std::vector < unsigned > Profiler::_root;
+  std::vector < unsigned > Profiler::_stack;
+
+  void Profiler::Enable(const bool &usePetscLogStages) {
+    _enabled = true;
+    _usePetscLogStages = usePetscLogStages;
+  }
+
+  void Profiler::Start(const char name[]) {
+
+    if(!_enabled) return;
+
+    int parent = (_stack.empty()) ? -1 : static_cast < int >(_stack.back());
+    std::vector < unsigned > &sibling = (parent < 0) ? _root : _region[parent].child;
+
+    unsigned i = 0;
+    while(i < sibling.size() && _region[sibling[i]].name != name) i++;
+
+    unsigned index;
+    if(i < sibling.size()) {
+      index = sibling[i];
+    }
+    else {
+      index = _region.size();
+      Region region;
+      region.name = name;
+      region.path = (parent < 0) ? region.name : _region[parent].path + "/" + region.name;
+      region.parent = parent;
+      region.depth = (parent < 0) ? 0 : _region[parent].depth + 1;
+      region.calls = 0;
+      region.time = 0.;
+      region.start = 0.;
+      region.stage = PetscLogStage();
+      if(_usePetscLogStages) {
+        PetscLogStageRegister(region.path.c_str(), &region.stage);
+      }
+      _region.push_back(region);
+      // the reference sibling may be invalid after push_back
+      if(parent < 0) _root.push_back(index);
+      else _region[parent].child.push_back(index);
+    }
+
+    _stack.push_back(index);
+    if(_usePetscLogStages) {
+      PetscLogStagePush(_region[index].stage);
+    }
+    _region[index].start = GetWallTime();
+  }
+
+  void Profiler::Stop() {
+
+    if(!_enabled || _stack.empty()) return;
+
+    Region &region = _region[_stack.back()];
+    region.time += GetWallTime() - region.start;
+    region.calls++;
+    if(_usePetscLogStages) {
+      PetscLogStagePop();
+    }
+    _stack.pop_back();
+  }
+
+  void Profiler::Reset() {
+    while(_usePetscLogStages && !_stack.empty()) {
+      PetscLogStagePop();
+      _stack.pop_back();
+    }
+    _region.resize(0);
+    _root.resize(0);
+    _stack.resize(0);
+  }
+
+  bool Profiler::GatherTimes(std::vector < unsigned > &order, std::vector < double > &minTime, std::vector < double > &maxTime,
+                             std::vector < double > &avgTime, std::vector < double > &selfTime) {
+
+    unsigned nRegions = _region.size();
+
+    // depth-first order
+    order.resize(0);
+    std::vector < unsigned > stack(_root.rbegin(), _root.rend());
+    while(!stack.empty()) {
+      unsigned i = stack.back();
+      stack.pop_back();
+      order.push_back(i);
+      for(unsigned j = _region[i].child.size(); j > 0; j--) {
+        stack.push_back(_region[i].child[j - 1]);
+      }
+    }
+
+    std::vector < double > time(nRegions), self(nRegions);
+    for(unsigned i = 0; i < nRegions; i++) {
+      time[i] = _region[order[i]].time;
+      self[i] = time[i];
+      for(unsigned j = 0; j < _region[order[i]].child.size(); j++) {
+        self[i] -= _region[_region[order[i]].child[j]].time;
+      }
+    }
+
+    int nprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    unsigned sizeRange[2] = {nRegions, ~nRegions};
+    MPI_Allreduce(MPI_IN_PLACE, sizeRange, 2, MPI_UNSIGNED, MPI_MIN, MPI_COMM_WORLD);
+    bool sameRegions = (sizeRange[0] == nRegions && ~sizeRange[1] == nRegions);
+
+    minTime = time;
+    maxTime = time;
+    avgTime = time;
+    selfTime = self;
+    if(sameRegions && nRegions > 0) {
+      MPI_Allreduce(MPI_IN_PLACE, &minTime[0], nRegions, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+      MPI_Allreduce(MPI_IN_PLACE, &maxTime[0], nRegions, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+      MPI_Allreduce(MPI_IN_PLACE, &avgTime[0], nRegions, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      MPI_Allreduce(MPI_IN_PLACE, &selfTime[0], nRegions, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      for(unsigned i = 0; i < nRegions; i++) {
+        avgTime[i] /= nprocs;
+        selfTime[i] /= nprocs;
+      }
+    }
+    return sameRegions;
+  }
+
+  void Profiler::WriteReport(const std::string &filename) {
+
+    std::vector < unsigned > order;
+    std::vector < double > minTime, maxTime, avgTime, selfTime;
+    bool sameRegions = GatherTimes(order, minTime, maxTime, avgTime, selfTime);
+
+    int iproc, nprocs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &iproc);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    if(iproc != 0) return;
+
+    std::ofstream fout(filename.c_str());
+    if(!fout) {
+      std::cout << " Warning: the profiler report " << filename << " cannot be written" << std::endl;
+      return;
+    }
+    fout << std::setprecision(9);
+
+    bool csv = (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0);
+
+    if(csv) {
+      fout << "path,depth,calls,min,max,avg,self_avg,imbalance" << std::endl;
+      for(unsigned i = 0; i < order.size(); i++) {
+        const Region &region = _region[order[i]];
+        fout << "\"" << region.path << "\"," << region.depth << "," << region.calls << "," << minTime[i] << ","
+             << maxTime[i] << "," << avgTime[i] << "," << selfTime[i] << ","
+             << ((avgTime[i] > 0.) ? maxTime[i] / avgTime[i] : 1.) << std::endl;
+      }
+    }
+    else {
+      fout << "{" << std::endl;
+      fout << "  \"processes\": " << nprocs << "," << std::endl;
+      fout << "  \"sameRegionsOnAllProcesses\": " << (sameRegions ? "true" : "false") << "," << std::endl;
+      fout << "  \"regions\": [" << std::endl;
+      for(unsigned i = 0; i < order.size(); i++) {
+        const Region &region = _region[order[i]];
+        fout << "    {\"path\": \"" << region.path << "\", \"name\": \"" << region.name << "\", \"depth\": " << region.depth
+             << ", \"calls\": " << region.calls << ", \"min\": " << minTime[i] << ", \"max\": " << maxTime[i]
+             << ", \"avg\": " << avgTime[i] << ", \"self_avg\": " << selfTime[i]
+             << ", \"imbalance\": " << ((avgTime[i] > 0.) ? maxTime[i] / avgTime[i] : 1.) << "}"
+             << ((i + 1 < order.size()) ? "," : "") << std::endl;
+      }
+      fout << "  ]" << std::endl;
+      fout << "}" << std::endl;
+    }
+    fout.close();
+
+    std::cout << " Profiler report written to file: " << filename << std::endl;
+  }
+
+  void Profiler::PrintReport() {
+
+    std::vector < unsigned > order;
+    std::vector < double > minTime, maxTime, avgTime, selfTime;
+    bool sameRegions = GatherTimes(order, minTime, maxTime, avgTime, selfTime);
+
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+
+    std::cout << std::endl << " Wall-clock profile (s" << (sameRegions ? ", over the processes" : ", local") << "):" << std::endl;
+    std::cout << std::left << std::setw(48) << " region" << std::right << std::setw(8) << "calls" << std::setw(12) << "min"
+              << std::setw(12) << "max" << std::setw(12) << "avg" << std::setw(12) << "self avg" << std::endl;
+    for(unsigned i = 0; i < order.size(); i++) {
+      const Region &region = _region[order[i]];
+      std::string name = " " + std::string(2 * region.depth, ' ') + region.name;
+      std::cout << std::left << std::setw(48) << name << std::right << std::setw(8) << region.calls << std::fixed
+                << std::setprecision(4) << std::setw(12) << minTime[i] << std::setw(12) << maxTime[i]
+                << std::setw(12) << avgTime[i] << std::setw(12) << selfTime[i] << std::endl;
+    }
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+  }
+
+} //end namespace femus
@@ -0,0 +1,116 @@
+/*=========================================================================
+
+ Program: FEMUS
+ Module: Profiler
+ Authors: Eugenio Aulisa
+
+ Copyright (c) FEMTTU
+ All rights reserved.
+
+ This software is distributed WITHOUT ANY WARRANTY; without even
+ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __femus_utils_Profiler_hpp__
+#define __femus_utils_Profiler_hpp__
+
+//----------------------------------------------------------------------------
+// includes :
+//----------------------------------------------------------------------------
+#include <vector>
+#include <string>
+#include <mpi.h>
+#include <petsclog.h>
+
+namespace femus {
+
+  /**
+   * Registry of nested wall-clock timers. A region is opened by Start(name) and closed by Stop(), or by the scope of a
+   * ProfilerTimer, and it is identified by its name and by the regions open when it starts, so that the same name in
+   * different phases gives different entries. The time of a region includes the time of its children.
+   * The collection is off until Enable is called; then every region can also push a PETSc log stage with the same path,
+   * so that -log_view splits the PETSc events in the same way.
+   * The regions are timed on the main thread only. All the processes should open the same regions, since the report gives
+   * the minimum, maximum and average time over the processes.
+   */
+  class Profiler {
+    public:
+
+      static void Enable(const bool &usePetscLogStages = false);
+
+      static bool IsEnabled() {
+        return _enabled;
+      }
+
+      /** Wall-clock time in seconds */
+      static double GetWallTime() {
+        return MPI_Wtime();
+      }
+
+      static void Start(const char name[]);
+
+      static void Stop();
+
+      /** Clear all the regions, the open regions are discarded */
+      static void Reset();
+
+      /** Report of all the regions, as a CSV file if filename ends with .csv and as a JSON file otherwise, collective */
+      static void WriteReport(const std::string &filename);
+
+      /** Report of all the regions on std::cout, collective */
+      static void PrintReport();
+
+      /** File of the report written by ~FemusInit at the end of the run, no report if empty */
+      static void SetReportFile(const std::string &filename) {
+        _reportFile = filename;
+      }
+
+      static const std::string &GetReportFile() {
+        return _reportFile;
+      }
+
+    private:
+
+      struct Region {
+        std::string name;
+        std::string path;
+        int parent;
+        unsigned depth;
+        unsigned long calls;
+        double time;
+        double start;
+        PetscLogStage stage;
+        std::vector < unsigned > child;
+      };
+
+      /** Regions in depth-first order and their minimum, maximum and average time and average time without the children
+       * over the processes, it returns false if the processes have different regions, then only the local times are given */
+      static bool GatherTimes(std::vector < unsigned > &order, std::vector < double > &minTime, std::vector < double > &maxTime,
+                              std::vector < double > &avgTime, std::vector < double > &selfTime);
+
+      static bool _enabled;
+      static bool _usePetscLogStages;
+      static std::string _reportFile;
+      static std::vector < Region > _region;
+      static std::vector < unsigned > _root;
+      static std::vector < unsigned > _stack;
+  };
+
+  /** Region of the Profiler open in the scope of this object */
+  class ProfilerTimer {
+    public:
+
+      ProfilerTimer(const char name[]) {
+        Profiler::Start(name);
+      }
+
+      ~ProfilerTimer() {
+        Profiler::Stop();
+      }
+  };
+
+} //end namespace femus
+
+#endif
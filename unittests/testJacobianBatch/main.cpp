@@ -0,0 +1,101 @@
+#include "FemusInit.hpp"
+#include "MultiLevelMesh.hpp"
+#include "Mesh.hpp"
+#include "NumericVector.hpp"
+#include "ElemType.hpp"
+#include <cmath>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+using namespace femus;
+
+/*
+  Check of elem_type::JacobianBatch against elem_type::Jacobian.
+  On the first elements of a 2D QUAD9 and a 3D HEX27 box mesh, with the nodes moved so that the maps are not affine,
+  the weights and the physical gradients of all the Gauss points are compared for the linear, serendipity and
+  quadratic Lagrange elements. The test fails if the relative difference is above the tolerance.
+*/
+
+double CheckMesh(Mesh *msh, const unsigned &dim) {
+
+  const unsigned xType = 2;
+  const unsigned nElements = 4;
+
+  std::vector < std::vector < double > > x(dim);
+  std::vector < double > phi, phi_x;
+  std::vector < double > weightBatch, gradPhiBatch;
+  elem_type::BatchWorkspace batchWork;
+  double weight;
+
+  double error = 0.;
+
+  unsigned iproc = msh->processor_id();
+  for(unsigned iel = msh->_elementOffset[iproc]; iel < msh->_elementOffset[iproc + 1] &&
+      iel < msh->_elementOffset[iproc] + nElements; iel++) {
+
+    short unsigned ielGeom = msh->GetElementType(iel);
+    unsigned nDofsX = msh->GetElementDofNumber(iel, xType);
+
+    for(unsigned k = 0; k < dim; k++) {
+      x[k].resize(nDofsX);
+    }
+    for(unsigned i = 0; i < nDofsX; i++) {
+      unsigned xDof  = msh->GetSolutionDof(i, iel, xType);
+      for(unsigned k = 0; k < dim; k++) {
+        x[k][i] = (*msh->_topology->_Sol[k])(xDof);
+      }
+      // smooth distortion, shared by the neighbouring elements
+      for(unsigned k = 0; k < dim; k++) {
+        x[k][i] += 0.03 * sin(3. * x[(k + 1) % dim][i] + 1. + k);
+      }
+    }
+
+    for(unsigned solType = 0; solType < 3; solType++) {
+
+      const elem_type *fe = msh->_finiteElement[ielGeom][solType];
+      unsigned nDofs = msh->GetElementDofNumber(iel, solType);
+      unsigned ncPadded = fe->GetPaddedDofNumber();
+      unsigned nGauss = fe->GetGaussPointNumber();
+
+      fe->JacobianBatch(x, weightBatch, gradPhiBatch, batchWork);
+
+      for(unsigned ig = 0; ig < nGauss; ig++) {
+        fe->Jacobian(x, ig, weight, phi, phi_x);
+
+        error = std::max(error, fabs(weightBatch[ig] - weight) / fabs(weight));
+
+        double gradNorm = 0.;
+        double gradError = 0.;
+        for(unsigned i = 0; i < nDofs; i++) {
+          for(unsigned d = 0; d < dim; d++) {
+            double gradPhi = gradPhiBatch[(ig * dim + d) * ncPadded + i];
+            gradNorm = std::max(gradNorm, fabs(phi_x[i * dim + d]));
+            gradError = std::max(gradError, fabs(gradPhi - phi_x[i * dim + d]));
+          }
+        }
+        error = std::max(error, gradError / gradNorm);
+      }
+    }
+  }
+
+  return error;
+}
+
+int main(int argc, char** args) {
+
+  FemusInit mpinit(argc, args, MPI_COMM_WORLD);
+
+  MultiLevelMesh mlMsh2d;
+  mlMsh2d.GenerateCoarseBoxMesh(4, 4, 0, -0.5, 0.5, -0.5, 0.5, 0., 0., QUAD9, "seventh");
+  double error2d = CheckMesh(mlMsh2d.GetLevel(0), 2);
+
+  MultiLevelMesh mlMsh3d;
+  mlMsh3d.GenerateCoarseBoxMesh(2, 2, 2, -0.5, 0.5, -0.5, 0.5, -0.5, 0.5, HEX27, "seventh");
+  double error3d = CheckMesh(mlMsh3d.GetLevel(0), 3);
+
+  const double tolerance = 1.0e-12;
+  cout << "JacobianBatch check: relative error 2D = " << error2d << ", 3D = " << error3d << ", tolerance = " << tolerance << endl;
+
+  return (error2d < tolerance && error3d < tolerance) ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include "FemusInit.hpp"
+#include "MultiLevelProblem.hpp"
+#include "NumericVector.hpp"
+#include "SparseMatrix.hpp"
+#include "NonLinearImplicitSystem.hpp"
+#include "AssemblyKernels.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+using namespace femus;
+
+/*
+  Finite difference check of the Newton Jacobian of the Navier-Stokes assembly kernel.
+  On the finest level of a 2D box mesh, with a smooth non-zero velocity and pressure, the product of the assembled
+  Jacobian with a direction w is compared with the central difference of the residual:
+               J w ~ - ( Res(u + eps w) - Res(u - eps w) ) / ( 2 eps ),
+  since the kernels assemble Res = - F(u) and J = dF/du. The test fails if the relative error is above the tolerance.
+  The optional argument is the number of assembly threads.
+*/
+
+double InitialValueU(const std::vector < double >& x) {
+  return sin(3. * x[0]) * cos(2. * x[1]);
+}
+
+double InitialValueV(const std::vector < double >& x) {
+  return 1. + x[0] * x[1] + cos(x[0] + 2. * x[1]);
+}
+
+double InitialValueP(const std::vector < double >& x) {
+  return x[0] - 2. * x[1] * x[1];
+}
+
+bool SetBoundaryCondition(const std::vector < double >& x, const char name[], double& value, const int facename, const double time) {
+  value = 0.;
+  return false;
+}
+
+void AssembleNS(MultiLevelProblem& ml_prob) {
+  std::vector < std::string > velocityNames;
+  velocityNames.push_back("U");
+  velocityNames.push_back("V");
+
+  double nu = 0.1;
+  AssembleNavierStokes(ml_prob, "NS", velocityNames, "P", nu, NEWTON);
+}
+
+int main(int argc, char** args) {
+
+  unsigned nThreads = (argc >= 2) ? atoi(args[1]) : 1;
+
+  FemusInit mpinit(argc, args, MPI_COMM_WORLD);
+
+  MultiLevelMesh mlMsh;
+  mlMsh.GenerateCoarseBoxMesh(4, 4, 0, -0.5, 0.5, -0.5, 0.5, 0., 0., QUAD9, "seventh");
+  unsigned numberOfUniformLevels = 2;
+  mlMsh.RefineMesh(numberOfUniformLevels, numberOfUniformLevels, NULL);
+
+  MultiLevelSolution mlSol(&mlMsh);
+  mlSol.AddSolution("U", LAGRANGE, SECOND);
+  mlSol.AddSolution("V", LAGRANGE, SECOND);
+  mlSol.AddSolution("P", LAGRANGE, FIRST);
+  mlSol.Initialize("U", InitialValueU);
+  mlSol.Initialize("V", InitialValueV);
+  mlSol.Initialize("P", InitialValueP);
+  mlSol.AttachSetBoundaryConditionFunction(SetBoundaryCondition);
+  mlSol.GenerateBdc("All");
+
+  MultiLevelProblem mlProb(&mlSol);
+
+  NonLinearImplicitSystem& system = mlProb.add_system < NonLinearImplicitSystem > ("NS");
+  system.AddSolutionToSystemPDE("U");
+  system.AddSolutionToSystemPDE("V");
+  system.AddSolutionToSystemPDE("P");
+  system.SetAssembleFunction(AssembleNS);
+  system.SetNumberOfAssemblyThreads(nThreads);
+  system.init();
+
+  unsigned level = mlMsh.GetNumberOfLevels() - 1;
+  system.SetLevelToAssemble(level);
+  LinearEquationSolver* pdeSys = system._LinSolver[level];
+  Solution* sol = mlSol.GetSolutionLevel(level);
+
+  // direction w
+  std::unique_ptr < NumericVector > w = pdeSys->_EPS->clone();
+  for(int i = w->first_local_index(); i < w->last_local_index(); i++) {
+    w->set(i, sin(1. + i));
+  }
+  w->close();
+
+  // J w at u
+  AssembleNS(mlProb);
+  std::unique_ptr < NumericVector > Jw = w->clone();
+  Jw->matrix_mult(*w, *pdeSys->_KK);
+
+  // residuals at u + eps w and u - eps w
+  const double eps = 1.0e-6;
+
+  *pdeSys->_EPS = *w;
+  pdeSys->_EPS->scale(eps);
+  sol->UpdateSol(system.GetSolPdeIndex(), pdeSys->_EPS, pdeSys->KKoffset, pdeSys->GetBlockSize());
+  AssembleNS(mlProb);
+  std::unique_ptr < NumericVector > difference = pdeSys->_RES->clone();
+
+  pdeSys->_EPS->scale(-2.);
+  sol->UpdateSol(system.GetSolPdeIndex(), pdeSys->_EPS, pdeSys->KKoffset, pdeSys->GetBlockSize());
+  AssembleNS(mlProb);
+  difference->add(-1., *pdeSys->_RES);
+  difference->scale(-0.5 / eps);
+
+  Jw->add(-1., *difference);
+  double error = Jw->linfty_norm() / difference->linfty_norm();
+
+  const double tolerance = 1.0e-6;
+  cout << "Jacobian check: relative error = " << error << ", tolerance = " << tolerance << endl;
+
+  return (error < tolerance) ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include "FemusInit.hpp"
+#include "MultiLevelProblem.hpp"
+#include "MultiLevelMesh.hpp"
+#include "LinearImplicitSystem.hpp"
+#include "NumericVector.hpp"
+#include "ElemType.hpp"
+#include "MarkerSet.hpp"
+#include "ParticleGridTransfer.hpp"
+#include <cmath>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+using namespace femus;
+
+/*
+  Check of ParticleGridTransfer::ParticlesToGrid against the per-particle scatter of the MPM assembly.
+  Three markers are put in every owned element of a 2D QUAD9 box mesh, in the reverse element order. The mass is
+  scattered to the solution M and the momentum to the residual of a system with DX and DY, both with the transfer and
+  marker by marker with elem_type::Jacobian and add_vector_blocked. The test fails if the relative difference is above
+  the tolerance.
+*/
+
+bool SetBoundaryCondition(const std::vector < double >& x, const char name[], double& value, const int facename, const double time) {
+  value = 0.;
+  return false;
+}
+
+double RelativeError(NumericVector &reference, NumericVector &value) {
+  double norm = reference.linfty_norm();
+  reference -= value;
+  return reference.linfty_norm() / norm;
+}
+
+int main(int argc, char** args) {
+
+  FemusInit mpinit(argc, args, MPI_COMM_WORLD);
+
+  MultiLevelMesh mlMsh;
+  mlMsh.GenerateCoarseBoxMesh(4, 4, 0, -0.5, 0.5, -0.5, 0.5, 0., 0., QUAD9, "seventh");
+  const unsigned dim = mlMsh.GetDimension();
+
+  MultiLevelSolution mlSol(&mlMsh);
+  mlSol.AddSolution("DX", LAGRANGE, SECOND);
+  mlSol.AddSolution("DY", LAGRANGE, SECOND);
+  mlSol.AddSolution("M", LAGRANGE, SECOND);
+  mlSol.Initialize("All");
+  mlSol.AttachSetBoundaryConditionFunction(SetBoundaryCondition);
+  mlSol.GenerateBdc("All");
+
+  MultiLevelProblem ml_prob(&mlSol);
+  LinearImplicitSystem& system = ml_prob.add_system < LinearImplicitSystem > ("P2G");
+  system.AddSolutionToSystemPDE("DX");
+  system.AddSolutionToSystemPDE("DY");
+  system.init();
+
+  Mesh* msh = mlMsh.GetLevel(0);
+  Solution* sol = mlSol.GetSolutionLevel(0);
+  LinearEquationSolver* pde = system._LinSolver[0];
+  const unsigned solType = mlSol.GetSolutionType("DX");
+  const unsigned iproc = msh->processor_id();
+
+  std::vector < unsigned > indexSol(dim), indexPde(dim);
+  indexSol[0] = mlSol.GetIndex("DX");
+  indexSol[1] = mlSol.GetIndex("DY");
+  indexPde[0] = system.GetSolPdeIndex("DX");
+  indexPde[1] = system.GetSolPdeIndex("DY");
+  unsigned indexSolM = mlSol.GetIndex("M");
+
+  //BEGIN markers
+  const double xiMarker[3][2] = {{-0.5, -0.3}, {0.2, 0.7}, {0.6, -0.8}};
+  const unsigned elementBegin = msh->_elementOffset[iproc];
+  const unsigned elementEnd = msh->_elementOffset[iproc + 1];
+  const unsigned nMarkers = 3 * (elementEnd - elementBegin);
+
+  std::vector < unsigned > element(nMarkers);
+  std::vector < std::vector < double > > xi(nMarkers, std::vector < double > (dim));
+  std::vector < std::vector < double > > velocity(dim, std::vector < double > (nMarkers));
+  std::vector < double > mass(nMarkers);
+
+  MarkerSet markerSet(dim, true);
+  markerSet.Resize(nMarkers);
+  for(unsigned p = 0; p < nMarkers; p++) {
+    element[p] = elementEnd - 1 - p / 3;
+    markerSet.SetMarkerElement(p, element[p]);
+    for(unsigned k = 0; k < dim; k++) {
+      xi[p][k] = xiMarker[p % 3][k];
+      markerSet.GetLocalCoordinates(k)[p] = xi[p][k];
+      velocity[k][p] = sin(1. + p + 2. * k);
+      markerSet.GetMPMQuantity(dim + k)[p] = velocity[k][p];
+    }
+    mass[p] = 1. + 0.1 * (p % 7);
+    markerSet.GetMPMQuantity(3 * dim)[p] = mass[p];
+  }
+  //END
+
+  //BEGIN particles to grid transfer
+  ParticleGridTransfer transfer(msh, solType);
+  transfer.Setup(markerSet);
+
+  std::vector < const double* > particleOne(1), particleVelocity(dim);
+  std::vector < double > one(nMarkers, 1.);
+  particleOne[0] = (nMarkers > 0) ? &one[0] : NULL;
+  for(unsigned k = 0; k < dim; k++) {
+    particleVelocity[k] = markerSet.GetMPMQuantity(dim + k);
+  }
+  std::vector < NumericVector* > gridMass(1, sol->_Sol[indexSolM]);
+
+  gridMass[0]->zero();
+  transfer.ParticlesToGrid(particleOne, markerSet.GetMPMQuantity(3 * dim), gridMass);
+  gridMass[0]->close();
+
+  pde->_RES->zero();
+  transfer.ParticlesToGrid(particleVelocity, markerSet.GetMPMQuantity(3 * dim), *pde, indexSol, indexPde, pde->_RES);
+  pde->_RES->close();
+  //END
+
+  //BEGIN per-particle scatter
+  std::unique_ptr < NumericVector > referenceMass = gridMass[0]->clone();
+  std::unique_ptr < NumericVector > referenceMomentum = pde->_RES->clone();
+  referenceMass->zero();
+  referenceMomentum->zero();
+
+  std::vector < std::vector < double > > x(dim);
+  std::vector < double > phi, gradphi;
+  std::vector < double > Rhs;
+  std::vector < int > dofs;
+  double weight;
+  for(unsigned p = 0; p < nMarkers; p++) {
+    unsigned iel = element[p];
+    short unsigned ielGeom = msh->GetElementType(iel);
+    unsigned nDofs = msh->GetElementDofNumber(iel, solType);
+    for(unsigned k = 0; k < dim; k++) {
+      x[k].resize(nDofs);
+      for(unsigned i = 0; i < nDofs; i++) {
+        x[k][i] = (*msh->_topology->_Sol[k])(msh->GetSolutionDof(i, iel, 2));
+      }
+    }
+    msh->_finiteElement[ielGeom][solType]->Jacobian(x, xi[p], weight, phi, gradphi);
+
+    Rhs.resize(nDofs);
+    dofs.resize(nDofs);
+    for(unsigned i = 0; i < nDofs; i++) {
+      Rhs[i] = mass[p] * phi[i];
+      dofs[i] = msh->GetSolutionDof(i, iel, solType);
+    }
+    referenceMass->add_vector_blocked(Rhs, dofs);
+
+    for(unsigned k = 0; k < dim; k++) {
+      for(unsigned i = 0; i < nDofs; i++) {
+        Rhs[i] = mass[p] * phi[i] * velocity[k][p];
+        dofs[i] = pde->GetSystemDof(indexSol[k], indexPde[k], i, iel);
+      }
+      referenceMomentum->add_vector_blocked(Rhs, dofs);
+    }
+  }
+  referenceMass->close();
+  referenceMomentum->close();
+  //END
+
+  double errorMass = RelativeError(*referenceMass, *gridMass[0]);
+  double errorMomentum = RelativeError(*referenceMomentum, *pde->_RES);
+
+  const double tolerance = 1.0e-12;
+  cout << "ParticlesToGrid check: relative error mass = " << errorMass << ", momentum = " << errorMomentum
+       << ", tolerance = " << tolerance << endl;
+
+  return (errorMass < tolerance && errorMomentum < tolerance) ? 0 : 1;
+}